@@ -0,0 +1,163 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _BOOTSEQUENCE_H_
+#define _BOOTSEQUENCE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "hal.h"
+#include "taskmanager.h"
+
+namespace StegoPhone {
+    enum class BootStepResult : uint8_t {
+        Pending,    // call again on the next pass
+        Done,
+        Failed
+    };
+
+    enum class BootStepState : uint8_t {
+        Waiting,    // for the steps it depends on
+        Running,    // started, not done yet
+        Done,
+        Failed,
+        Skipped     // a step it depends on failed
+    };
+
+    const char *bootStepStateName(BootStepState state);
+
+    // first is true on the step's first call, when it starts whatever it waits on
+    typedef BootStepResult (*BootStepFunction)(void *context, bool first);
+
+    // one row of a boot table: after is a mask of the rows (by index) that must be done first
+    struct BootStep {
+        const char *name;
+        uint16_t after;
+        BootStepFunction run;
+    };
+
+    constexpr uint16_t bootAfter(uint8_t step) {
+        return (uint16_t) (1u << step);
+    }
+
+    // for a static_assert next to the table: every row depends only on rows above it, so there is no
+    // cycle and the table order is one valid serial boot
+    template<size_t Count>
+    constexpr bool bootStepsOrdered(const BootStep (&steps)[Count]) {
+        for (size_t i = 0; i < Count; i++) {
+            if (steps[i].after >> i) return false;
+        }
+        return true;
+    }
+
+    // Runs a table of boot steps as their dependencies allow. Each poll() calls every step whose
+    // dependencies are done and that has not finished, so steps that wait on hardware (a module
+    // booting, a card answering) overlap instead of queueing behind each other; a step that fails
+    // skips everything depending on it, the rest still runs. Each step's start, end and the time spent
+    // inside its calls are kept for the boot timeline ("boot" on the console).
+    //
+    // Threads: poll() from one task; the rest from any.
+    class BootSequence {
+    public:
+        static const uint8_t MaxSteps = 16;
+
+        BootSequence(const BootStep *steps, uint8_t count, void *context);
+
+        // one pass over the table; returns true once every step has finished one way or another
+        bool poll();
+
+        bool finished() const;
+
+        // a step failed or was skipped
+        bool failed() const;
+
+        // the first step that failed, or count() when none has
+        uint8_t firstFailure() const;
+
+        uint8_t count() const;
+
+        const char *name(uint8_t step) const;
+
+        BootStepState state(uint8_t step) const;
+
+        bool done(uint8_t step) const;
+
+        // relative to the first poll()
+        uint32_t startMicros(uint8_t step) const;
+
+        uint32_t endMicros(uint8_t step) const;
+
+        // time inside the step's calls, as opposed to waiting between them
+        uint32_t busyMicros(uint8_t step) const;
+
+        // first poll() to the last step finishing (or now, while running)
+        uint32_t elapsedMicros() const;
+
+        // the sum of every step's start to end: what the same steps take one after another
+        uint32_t serialMicros() const;
+
+        uint32_t passes() const;
+
+        // console "boot"; context is the sequence
+        static void consoleCommand(void *context, HAL::SerialPort &out, const char *args);
+
+    protected:
+        struct Record {
+            BootStepState state;
+            uint32_t start;
+            uint32_t end;
+            uint32_t busy;
+        };
+
+        const BootStep *_steps;
+        uint8_t _count;
+        void *_context;
+        Record _records[MaxSteps];
+        volatile bool _finished;
+        bool _started;
+        uint32_t _startMicros;
+        uint32_t _endMicros;
+        uint32_t _passes;
+    };
+
+    // A blocking init (a library's begin() that waits on its hardware) run once on a task of its own, so
+    // it holds up neither the task polling the boot nor the steps beside it: its step start()s it on the
+    // first call and returns result() from then on. With no scheduler running, or no task to spare, it
+    // runs inside start() instead, as a plain step would. The task is stopped once result() has seen it
+    // finish.
+    //
+    // Threads: start()/result() from the task polling the boot.
+    class BootJob {
+    public:
+        static const uint16_t TaskStackWords = 768;
+
+        // true when the init worked
+        typedef bool (*Function)(void *context);
+
+        BootJob();
+
+        ~BootJob();
+
+        void start(const char *name, uint8_t priority, Function function, void *context);
+
+        // Pending while it runs, then Done or Failed
+        BootStepResult result();
+
+        bool taskRunning() const;
+
+    protected:
+        static void taskStep(void *context, uint32_t notifications);
+
+        ManagedTask *_task;
+        Function _function;
+        void *_context;
+        volatile BootStepResult _result;
+    };
+}
+
+#endif //_BOOTSEQUENCE_H_
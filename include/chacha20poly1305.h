@@ -0,0 +1,94 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _CHACHA20POLY1305_H_
+#define _CHACHA20POLY1305_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ChaCha20, Poly1305 and their AEAD construction as RFC 8439 defines them. Everything works in place
+// on the caller's buffer with a fixed amount of stack (one 64 byte keystream block, one 16 byte
+// Poly1305 block) and no allocation. 32 bit arithmetic throughout (Poly1305 in five 26 bit limbs), so
+// the Cortex-M7 runs it without 64 by 64 multiplies; nothing branches or indexes on secret data.
+namespace StegoPhone {
+    namespace Crypto {
+        static const uint8_t KeyBytes = 32;
+        static const uint8_t NonceBytes = 12;
+        static const uint8_t TagBytes = 16;
+
+        // CHACHA20
+        //================================================================================================
+        // keystream from a block counter on; apply() XORs it over data, in pieces of any size
+        class ChaCha20 {
+        public:
+            static const uint8_t BlockBytes = 64;
+
+            ChaCha20(const uint8_t *key, const uint8_t *nonce, uint32_t counter);
+
+            ~ChaCha20();
+
+            void apply(uint8_t *data, size_t length);
+
+            // the next whole keystream block, skipping what is left of the current one
+            void block(uint8_t *out);
+
+        protected:
+            uint32_t _state[16];
+            uint8_t _keystream[BlockBytes];
+            uint8_t _used; // keystream bytes already applied
+        };
+
+        // HChaCha20 (draft-irtf-cfrg-xchacha): 32 key bytes and a 16 byte nonce to a 32 byte subkey, the rounds
+        // without the final addition. Here it turns a Diffie-Hellman output into a uniform session key.
+        void hchacha20(const uint8_t *key, const uint8_t *nonce, uint8_t *out);
+
+        // POLY1305
+        //================================================================================================
+        // one time authenticator: a key is used for one message only
+        class Poly1305 {
+        public:
+            explicit Poly1305(const uint8_t *key);
+
+            ~Poly1305();
+
+            void update(const uint8_t *data, size_t length);
+
+            // zeros up to the next 16 byte boundary, as the AEAD pads each part
+            void pad();
+
+            void finish(uint8_t *tag);
+
+        protected:
+            void blocks(const uint8_t *data, size_t length, uint32_t hibit);
+
+            uint32_t _r[5];
+            uint32_t _h[5];
+            uint32_t _pad[4];
+            uint8_t _buffer[16];
+            uint8_t _buffered;
+        };
+
+        // AEAD
+        //================================================================================================
+        // data encrypted in place; the tag covers aad and the ciphertext
+        void seal(const uint8_t *key, const uint8_t *nonce, const uint8_t *aad, size_t aadLength,
+                  uint8_t *data, size_t length, uint8_t *tag);
+
+        // the tag is checked before anything is decrypted: false leaves data as it came
+        bool open(const uint8_t *key, const uint8_t *nonce, const uint8_t *aad, size_t aadLength,
+                  uint8_t *data, size_t length, const uint8_t *tag);
+
+        // comparison whose time does not depend on where the buffers differ
+        bool equal(const uint8_t *a, const uint8_t *b, size_t length);
+
+        // zeroing the compiler may not drop as a dead store
+        void wipe(void *data, size_t length);
+    }
+}
+
+#endif //_CHACHA20POLY1305_H_
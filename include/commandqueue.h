@@ -0,0 +1,140 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _COMMANDQUEUE_H_
+#define _COMMANDQUEUE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hal.h"
+#include "linebuffer.h"
+#include "patternmatcher.h"
+#include "trace.h"
+
+namespace StegoPhone {
+    enum class CommandResult {
+        Matched,
+        Timeout,
+        Overflow
+    };
+
+    // data points into the queue's buffer (null terminated) and is only valid during the callback
+    struct CommandResponse {
+        CommandResult result;
+        int terminator; // index into the terminator set, or PatternMatcher::NoMatch
+        const char *data;
+        size_t length;
+    };
+
+    typedef void (*CommandCallback)(void *context, const CommandResponse &response);
+
+    // Non-blocking request/response engine for line oriented serial devices. Commands are queued
+    // with their own terminator set and timeout; loop() feeds received bytes through a response state
+    // machine, completes the command in flight and writes the next one immediately, so a burst of
+    // commands runs back to back without sleeping. Nothing is allocated after construction.
+    //
+    // After a timeout or overflow the rest of that response may still be on its way, so input is
+    // dropped up to the next '\n' (or until the line has been quiet for ResyncQuietMs) before the next
+    // command goes out; a late reply cannot complete the command after it.
+    class CommandQueue {
+    public:
+        static const uint8_t Depth = 8;
+        static const size_t MaxCommandLength = 64; // room for an AT+CIPSTART with a host name
+        static const size_t ResponseCapacity = 512;
+        static const uint32_t ResyncQuietMs = 50;
+
+        // bytes received while no command is in flight go to unsolicited (if given); all traffic is
+        // traced on traceChannel when tracing is compiled in
+        CommandQueue(HAL::SerialPort &serialPort, const char *lineEnding, LineBuffer *unsolicited = 0,
+                     TraceChannel traceChannel = TraceChannel::Unknown);
+
+        // command may be null to only wait for a terminator (e.g. a boot banner). terminators must
+        // outlive the command. returns false if the queue is full or the command is too long.
+        bool submit(const char *command, const PatternMatcher &terminators, uint32_t timeoutMs,
+                    CommandCallback callback, void *context);
+
+        // drain the serial port, then expire()
+        void loop();
+
+        // for owners that read the port themselves and pass on only the bytes that belong to responses
+        void receive(uint8_t c);
+
+        // time out the command in flight
+        void expire();
+
+        bool idle() const;
+
+        // the command in flight, or null when idle or only waiting for a terminator
+        const char *current() const;
+
+        uint8_t pending() const;
+
+        // drop everything queued and in flight without calling back
+        void clear();
+
+        // STATS
+        //================================================================================================
+        uint32_t completed() const;
+
+        uint32_t timeouts() const;
+
+        // bytes dropped resynchronising after a timeout or overflow
+        uint32_t discarded() const;
+
+        // submit to completion, last and worst
+        uint32_t lastLatencyMicros() const;
+
+        uint32_t maxLatencyMicros() const;
+
+    protected:
+        struct Entry {
+            char command[MaxCommandLength];
+            bool hasCommand;
+            const PatternMatcher *terminators;
+            uint32_t timeoutMs;
+            CommandCallback callback;
+            void *context;
+            uint32_t submittedMicros;
+        };
+
+        void start();
+
+        void complete(CommandResult result, int terminator);
+
+        void resync(uint8_t c);
+
+        HAL::SerialPort &_serialPort;
+        const char *_lineEnding;
+        LineBuffer *_unsolicited;
+        TraceChannel _traceChannel;
+
+        Entry _entries[Depth];
+        uint8_t _head;
+        uint8_t _count;
+
+        // response state machine
+        enum class State {
+            Idle,
+            AwaitingResponse,
+            Resyncing       // dropping what is left of a failed response
+        };
+        State _state;
+        uint32_t _sentMillis;
+        uint32_t _resyncMillis; // resync started or last byte dropped
+        PatternScanner _scanner;
+        char _response[ResponseCapacity + 1];
+        size_t _responseLength;
+
+        uint32_t _completed;
+        uint32_t _timeouts;
+        uint32_t _discarded;
+        uint32_t _lastLatencyMicros;
+        uint32_t _maxLatencyMicros;
+    };
+}
+
+#endif //_COMMANDQUEUE_H_
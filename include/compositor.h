@@ -0,0 +1,131 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _COMPOSITOR_H_
+#define _COMPOSITOR_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hal.h"
+#include "rtos.h"
+#include "taskmanager.h"
+
+namespace StegoPhone {
+    // Batches frame commits for a HAL::Display. Draws go to the display's buffer as before; request()
+    // marks the frame as wanted and commit(), once per UI tick, sends what changed since the last
+    // commit, no more often than the frame interval.
+    //
+    // Changes are found by comparing the buffer against a shadow of what the panel shows, 8x8 tile by
+    // tile, so any drawing (including clears) is picked up. Changed tiles are copied into the shadow
+    // and each tile row goes out through the transport as one span from its first to last changed
+    // tile.
+    //
+    // With the flush task running the shadow is the back buffer: commit() only diffs and copies, and
+    // the task sends the spans while the UI draws the next frame into the display buffer. A commit
+    // that finds the task still sending stays requested; the task wakes the committer when it is done.
+    class Compositor {
+    public:
+        static const uint32_t DefaultFrameIntervalMicros = 33333; // 30 fps
+        static const uint8_t TileBytes = 8; // buffer bytes per tile (one byte per 8 pixel column)
+        static const uint16_t FlushTaskStackWords = 256;
+
+        Compositor(HAL::Display &display, HAL::DisplayTransport &transport,
+                   uint32_t frameIntervalMicros = DefaultFrameIntervalMicros);
+
+        void request();
+
+        // send changes if a frame was requested and the interval has passed; true if a frame went out
+        // (or was handed to the flush task)
+        bool commit();
+
+        // send changes now, ignoring the frame interval
+        bool flush();
+
+        // resend everything on the next frame
+        void invalidate();
+
+        void setFrameInterval(uint32_t frameIntervalMicros);
+
+        // when the committing task should next call commit() for a held request: the rest of the frame
+        // interval (at least 1 ms), or RTOS::WaitForever with none held or the flush task still sending
+        uint32_t msUntilDue() const;
+
+        // notified when the flush task finishes a frame with a request held
+        void setCommitter(ManagedTask *task);
+
+        // FLUSH TASK
+        //================================================================================================
+        // run sends on their own task; until then (and after stop) commits send on the caller
+        bool startFlushTask(uint8_t priority);
+
+        void stopFlushTask();
+
+        bool flushTaskRunning();
+
+        // a frame is handed over and not yet fully sent
+        bool flushing() const;
+
+        // STATS
+        //================================================================================================
+        uint32_t frames() const;
+
+        // requested commits held back by the frame interval
+        uint32_t deferred() const;
+
+        // requested commits held back because the previous frame was still being sent
+        uint32_t busy() const;
+
+        uint32_t bytesSent() const;
+
+        // panel bytes and send time of the last frame
+        uint32_t lastFrameBytes() const;
+
+        uint32_t lastFrameMicros() const;
+
+        uint32_t maxFrameMicros() const;
+
+        // time the committing task spent on the last frame (diff, copy and, without the task, send)
+        uint32_t lastCommitMicros() const;
+
+        uint32_t maxCommitMicros() const;
+
+        // console "display"
+        static void consoleCommand(void *context, HAL::SerialPort &out, const char *args);
+
+    protected:
+        void send();
+
+        static void flushStep(void *context, uint32_t notifications);
+
+        HAL::Display &_display;
+        HAL::DisplayTransport &_transport;
+        // what the panel shows once the spans are sent
+        uint8_t _shadow[HAL::Display::BufferSize];
+        // changed span per tile row, 0 tiles if unchanged
+        uint8_t _spanFirst[HAL::Display::TileHeight];
+        uint8_t _spanTiles[HAL::Display::TileHeight];
+        uint32_t _frameIntervalMicros;
+        uint32_t _lastFrameStart;
+        volatile bool _requested;
+        bool _invalid;
+        volatile bool _flushing;
+        ManagedTask *_flushTask;
+        ManagedTask *volatile _committer;
+
+        uint32_t _frames;
+        uint32_t _deferred;
+        uint32_t _busy;
+        uint32_t _bytesSent;
+        uint32_t _lastFrameBytes;
+        uint32_t _lastFrameMicros;
+        uint32_t _maxFrameMicros;
+        uint32_t _lastCommitMicros;
+        uint32_t _maxCommitMicros;
+    };
+}
+
+#endif //_COMPOSITOR_H_
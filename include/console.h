@@ -0,0 +1,59 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _CONSOLE_H_
+#define _CONSOLE_H_
+
+#include <stdint.h>
+#include "hal.h"
+#include "linebuffer.h"
+
+namespace StegoPhone {
+    // args is the rest of the line after the command name, null terminated, never null
+    typedef void (*ConsoleHandler)(void *context, HAL::SerialPort &out, const char *args);
+
+    // Line oriented debug console on ConsoleSerial: "<command> [args]". Subsystems register their
+    // diagnostics here instead of printing from their hot paths.
+    class Console {
+    public:
+        static const uint8_t MaxCommands = 24;
+        static const size_t MaxLineLength = 64;
+
+        static Console *getInstance();
+
+        // name and help must outlive the console; false if the table is full
+        bool addCommand(const char *name, const char *help, ConsoleHandler handler, void *context = 0);
+
+        void loop();
+
+        // run a line as if it had been typed
+        bool execute(const char *line);
+
+    protected:
+        struct Command {
+            const char *name;
+            const char *help;
+            ConsoleHandler handler;
+            void *context;
+        };
+
+        static Console *_instance;
+
+        Console();
+
+        void receiveLine(LineView line);
+
+        static void help(void *context, HAL::SerialPort &out, const char *args);
+
+        HAL::SerialPort &_serialPort;
+        LineBuffer *_lineBuffer;
+        Command _commands[MaxCommands];
+        uint8_t _commandCount;
+    };
+}
+
+#endif //_CONSOLE_H_
@@ -0,0 +1,210 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _DSP_H_
+#define _DSP_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Sample block kernels for the call audio path, in Q15 (int16_t), Q31 (int32_t) and float.
+//
+// Fixed point results are defined by the integer arithmetic spelled out on each kernel, rounding and
+// saturation included, and are bit for bit the same on every build. On the Cortex-M7 (__ARM_FEATURE_DSP)
+// the Q15 kernels run two samples per instruction with SMLALD (dual 16x16 multiply, 64 bit accumulate:
+// SMLAD's 32 bit accumulator overflows after two full scale products) and QADD16, and saturate with
+// SSAT; on the host the same loops run with those instructions written out in C.
+namespace StegoPhone {
+    namespace DSP {
+        inline int16_t saturate16(int32_t value) {
+            return (int16_t) (value > 32767 ? 32767 : (value < -32768 ? -32768 : value));
+        }
+
+        inline int32_t saturate32(int64_t value) {
+            return (int32_t) (value > INT32_MAX ? INT32_MAX : (value < INT32_MIN ? INT32_MIN : value));
+        }
+
+        // DOT PRODUCTS
+        //================================================================================================
+        // sum of a[i] * b[i], exact (Q30 for Q15 inputs)
+        int64_t dotQ15(const int16_t *a, const int16_t *b, size_t count);
+
+        // sum of (a[i] * b[i]) >> 14, Q48: sixteen guard bits, as CMSIS-DSP's arm_dot_prod_q31
+        int64_t dotQ31(const int32_t *a, const int32_t *b, size_t count);
+
+        float dotF32(const float *a, const float *b, size_t count);
+
+        // GAIN AND MIXING
+        //================================================================================================
+        // samples = saturate16((samples * gain + round) >> (15 - shift)): gain is Q15 scaled up by 2^shift
+        void gainQ15(int16_t *samples, size_t count, int16_t gain, uint8_t shift = 0);
+
+        // samples = saturate32((samples * gain + round) >> (31 - shift))
+        void gainQ31(int32_t *samples, size_t count, int32_t gain, uint8_t shift = 0);
+
+        void gainF32(float *samples, size_t count, float gain);
+
+        // samples = saturate16(samples + other)
+        void addQ15(int16_t *samples, const int16_t *other, size_t count);
+
+        void addQ31(int32_t *samples, const int32_t *other, size_t count);
+
+        void addF32(float *samples, const float *other, size_t count);
+
+        // LEVEL
+        //================================================================================================
+        // largest magnitude; 32768 for a full scale negative Q15 sample
+        uint32_t peakQ15(const int16_t *samples, size_t count);
+
+        uint32_t peakQ31(const int32_t *samples, size_t count);
+
+        float peakF32(const float *samples, size_t count);
+
+        // sum of samples[i]^2, exact
+        uint64_t energyQ15(const int16_t *samples, size_t count);
+
+        // floor(sqrt(energy / count)); 0 for an empty block
+        uint32_t rmsQ15(const int16_t *samples, size_t count);
+
+        // floor(sqrt(mean of (samples[i]^2 >> 31) << 31)), in Q31
+        uint32_t rmsQ31(const int32_t *samples, size_t count);
+
+        float rmsF32(const float *samples, size_t count);
+
+        // floor(sqrt(value))
+        uint32_t isqrt64(uint64_t value);
+
+        // FIR
+        //================================================================================================
+        // Direct form FIR over a mirrored delay line (each sample stored twice, Taps apart, as LineBuffer
+        // does for bytes), so the last Taps inputs are always contiguous and every output is one dot
+        // product against the time reversed coefficients. Any block size; no allocation.
+        //
+        // Q15: out = saturate16((dotQ15 + 2^14) >> 15). Q31: out = saturate32((sum of in * h + 2^30) >> 31)
+        // with an exact 64 bit sum, which holds while the coefficients' magnitudes add up to less than 2.
+        template<typename T, uint16_t Taps>
+        class Fir {
+        public:
+            // coefficients h[0..Taps), h[0] applying to the newest sample; copied
+            explicit Fir(const T *coefficients) {
+                for (uint16_t i = 0; i < Taps; i++)
+                    this->_reversed[i] = coefficients[Taps - 1 - i];
+                this->reset();
+            }
+
+            void reset() {
+                memset(this->_history, 0, sizeof(this->_history));
+                this->_position = 0;
+            }
+
+            // in and out may be the same buffer
+            void process(const T *in, T *out, size_t count) {
+                for (size_t i = 0; i < count; i++) {
+                    const T sample = in[i];
+                    this->_history[this->_position] = sample;
+                    this->_history[this->_position + Taps] = sample;
+                    if (++this->_position == Taps) this->_position = 0;
+                    out[i] = output(&this->_history[this->_position], this->_reversed);
+                }
+            }
+
+        protected:
+            static int16_t output(const int16_t *window, const int16_t *reversed) {
+                return saturate16((int32_t) ((dotQ15(window, reversed, Taps) + (1 << 14)) >> 15));
+            }
+
+            static int32_t output(const int32_t *window, const int32_t *reversed) {
+                int64_t sum = 0;
+                for (uint16_t i = 0; i < Taps; i++)
+                    sum += (int64_t) window[i] * reversed[i];
+                return saturate32((sum + ((int64_t) 1 << 30)) >> 31);
+            }
+
+            static float output(const float *window, const float *reversed) {
+                return dotF32(window, reversed, Taps);
+            }
+
+            T _reversed[Taps];
+            T _history[2 * Taps];
+            uint16_t _position; // oldest sample in the window
+        };
+
+        template<uint16_t Taps>
+        using FirQ15 = Fir<int16_t, Taps>;
+
+        template<uint16_t Taps>
+        using FirQ31 = Fir<int32_t, Taps>;
+
+        template<uint16_t Taps>
+        using FirF32 = Fir<float, Taps>;
+
+        // BIQUAD
+        //================================================================================================
+        // One second order section, direct form I:
+        //     y = b0 x[n] + b1 x[n-1] + b2 x[n-2] - a1 y[n-1] - a2 y[n-2]
+        // Fixed point coefficients carry one integer bit (Q14 / Q30) so |a1| up to 2 fits; a cascade is
+        // an array of sections run one after the other.
+        //
+        // Q15: y = saturate16((exact sum + 2^13) >> 14). Q31: y = saturate32((exact 64 bit sum + 2^29) >> 30).
+        class BiquadQ15 {
+        public:
+            // b0, b1, b2, a1, a2 in Q14; |a1|, |a2| below 2
+            explicit BiquadQ15(const int16_t *coefficients);
+
+            void reset();
+
+            void process(const int16_t *in, int16_t *out, size_t count);
+
+        protected:
+            int16_t _b[3];
+            int16_t _a[2]; // negated
+            int16_t _x[2];
+            int16_t _y[2];
+        };
+
+        class BiquadQ31 {
+        public:
+            // b0, b1, b2, a1, a2 in Q30
+            explicit BiquadQ31(const int32_t *coefficients);
+
+            void reset();
+
+            void process(const int32_t *in, int32_t *out, size_t count);
+
+        protected:
+            int32_t _b[3];
+            int32_t _a[2]; // negated
+            int32_t _x[2];
+            int32_t _y[2];
+        };
+
+        // transposed direct form II, the better behaved form in float
+        class BiquadF32 {
+        public:
+            explicit BiquadF32(const float *coefficients);
+
+            void reset();
+
+            void process(const float *in, float *out, size_t count);
+
+        protected:
+            float _b[3];
+            float _a[2];
+            float _z[2];
+        };
+
+        // CONVERSION
+        //================================================================================================
+        void q15ToF32(const int16_t *in, float *out, size_t count);
+
+        // out = saturate16(round(in * 32768))
+        void f32ToQ15(const float *in, int16_t *out, size_t count);
+    }
+}
+
+#endif //_DSP_H_
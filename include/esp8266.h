@@ -0,0 +1,226 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _ESP8266_H_
+#define _ESP8266_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <Callback.h>
+#include "hal.h"
+#include "commandqueue.h"
+#include "esp8266command.h"
+#include "taskmanager.h"
+
+namespace StegoPhone {
+    enum class ESP8266Status {
+        Offline,
+        Present,
+        Error
+    };
+
+    enum class ESP8266Urc : uint8_t {
+        Ready,            // module (re)booted
+        WifiConnected,
+        WifiGotIP,
+        WifiDisconnected,
+        LinkConnected,
+        LinkClosed
+    };
+
+    struct ESP8266Event {
+        ESP8266Urc urc;
+        int8_t link; // -1 when the code carries none
+    };
+
+    // An +IPD payload, or a ring's worth of one. Points into the driver's receive ring and is only valid
+    // for the duration of the dataReceived callback; nothing is copied on the way to it.
+    struct IpdView {
+        uint8_t link;
+        const uint8_t *data;
+        size_t length;
+        bool partial; // more of the same +IPD follows
+    };
+
+    // Non-blocking driver for the ESP-12E on ESP8266Serial. Reads the port itself and splits the byte
+    // stream as it arrives: +IPD payloads go straight into a mirrored ring and out as views, URC lines
+    // are decoded and signalled, everything else goes to the CommandQueue, so a payload or a URC in the
+    // middle of a command's response neither completes nor corrupts it.
+    class ESP8266 {
+    public:
+        static const size_t PayloadCapacity = 2048; // the largest +IPD the AT firmware sends
+        static const size_t MaxSendLength = 2048;   // AT+CIPSEND limit
+        static const uint8_t MaxLinks = 5;
+        static const size_t VersionCapacity = 48;
+
+        // task poll period while a command, a send, a payload or a link is open / otherwise
+        static const uint32_t BusyPollMs = 2;
+        static const uint32_t IdlePollMs = 20;
+        static const uint16_t TaskStackWords = 512;
+
+        static ESP8266 *getInstance();
+
+        // queue the bring up: echo off, firmware version, multiple connections. Does not wait.
+        void setup();
+
+        // setup() from another task: the next loop() queues it, on the ESP8266's own task once that runs
+        void requestSetup();
+
+        // requested and not queued yet
+        bool setupRequested();
+
+        // polled mode: read the port, complete commands; leave alone once the task runs
+        void loop();
+
+        // feed bytes from another source
+        void push(const uint8_t *data, size_t length);
+
+        void push(uint8_t c);
+
+        bool startTask(uint8_t priority);
+
+        void stopTask();
+
+        bool taskRunning();
+
+        // COMMANDS
+        //================================================================================================
+        // queue a command; the callback runs from loop() once a terminator arrives or on timeout
+        bool submit(const char *cmd, const PatternMatcher &terminators, CommandCallback callback, void *context,
+                    uint32_t timeoutMs = ESP8266Command::DefaultTimeoutMs);
+
+        // AT+CIPSTART=<link>,"TCP","<host>",<port>; the link opens with its CONNECT
+        bool connect(uint8_t link, const char *host, uint16_t port, CommandCallback callback, void *context);
+
+        bool close(uint8_t link, CommandCallback callback, void *context);
+
+        // AT+CIPSEND; the payload is written when the modem prompts for it, so data must stay valid until
+        // the callback. false if the queue is full or length is 0 or over MaxSendLength.
+        bool send(uint8_t link, const uint8_t *data, size_t length, CommandCallback callback, void *context);
+
+        CommandQueue *commands();
+
+        ESP8266Status status();
+
+        // "AT version:..." from AT+GMR, empty until answered
+        const char *version();
+
+        bool wifiConnected();
+
+        bool linkOpen(uint8_t link);
+
+        Signal<IpdView> dataReceived;
+
+        Signal<ESP8266Event> eventReceived;
+
+        // STATS
+        //================================================================================================
+        uint32_t urcs();
+
+        uint32_t ipdSegments();
+
+        uint64_t ipdBytes();
+
+        // +IPD headers that did not parse
+        uint32_t ipdErrors();
+
+        uint32_t sends();
+
+        uint32_t sendFailures();
+
+        uint64_t bytesSent();
+
+        // console "esp8266"
+        static void consoleCommand(void *context, HAL::SerialPort &out, const char *args);
+
+    protected:
+        static ESP8266 *_instance;
+
+        ESP8266();
+
+        static void taskStep(void *context, uint32_t notifications);
+
+        static void versionReceived(void *context, const CommandResponse &response);
+
+        static void multiplexReceived(void *context, const CommandResponse &response);
+
+        static void sendComplete(void *context, const CommandResponse &response);
+
+        bool busy();
+
+        void lineByte(uint8_t c);
+
+        void releasePrefix();
+
+        void headerByte(uint8_t c);
+
+        void payloadByte(uint8_t c);
+
+        void emitPayload(bool partial);
+
+        void prompt();
+
+        void lineComplete();
+
+        void urc(ESP8266Urc urc, int8_t link);
+
+        HAL::SerialPort &_serialPort;
+        CommandQueue *_commands;
+        ManagedTask *_task;
+        volatile bool _setupRequested;
+        ESP8266Status _status;
+        char _version[VersionCapacity];
+        bool _multiplexed; // +IPD and CONNECT/CLOSED carry a link id
+        bool _wifiConnected;
+        uint8_t _linksOpen; // bit per link
+
+        // receive state machine; a line is held back only while it still looks like "+IPD,"
+        enum class RxState {
+            Line,
+            Header,
+            Payload
+        };
+        static const size_t LineCapacity = 32; // URCs are short, longer lines are not one
+        static const size_t HeaderCapacity = 32; // "<link>,<length>" and, with AT+CIPDINFO=1, the remote address
+        RxState _rxState;
+        uint8_t _prefixLength; // bytes of "+IPD," matched at the start of this line
+        char _line[LineCapacity];
+        size_t _lineLength;
+        uint8_t _headerLength;
+        uint32_t _headerFields[2];
+        uint8_t _headerField;
+
+        // mirrored payload ring (every byte stored twice, PayloadCapacity apart), as in LineBuffer
+        uint8_t *_ring;
+        uint32_t _ringHead;     // free running write position
+        uint32_t _payloadStart; // free running position of the first byte not yet handed out
+        uint32_t _payloadRemaining;
+        uint8_t _payloadLink;
+
+        // sends waiting for their prompt / result, in submission order
+        struct PendingSend {
+            const uint8_t *data;
+            size_t length;
+            bool written;
+            CommandCallback callback;
+            void *context;
+        };
+        PendingSend _sends[CommandQueue::Depth];
+        uint8_t _sendHead;
+        uint8_t _sendCount;
+
+        uint32_t _urcs;
+        uint32_t _ipdSegments;
+        uint64_t _ipdBytes;
+        uint32_t _ipdErrors;
+        uint32_t _sendsCompleted;
+        uint32_t _sendFailures;
+        uint64_t _bytesSent;
+    };
+}
+
+#endif //_ESP8266_H_
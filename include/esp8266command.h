@@ -0,0 +1,61 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _ESP8266COMMAND_H_
+#define _ESP8266COMMAND_H_
+
+#include <stdint.h>
+#include "patternmatcher.h"
+
+namespace StegoPhone {
+    namespace ESP8266Command {
+        // AT command set (ESP8266 AT instruction set 1.x), sent with a "\r\n" line ending
+        constexpr const char *Attention = "AT";
+        constexpr const char *EchoOff = "ATE0";
+        constexpr const char *Version = "AT+GMR";
+        constexpr const char *MultipleConnections = "AT+CIPMUX=1";
+        constexpr const char *Send = "AT+CIPSEND=";
+        constexpr const char *Start = "AT+CIPSTART=";
+        constexpr const char *Close = "AT+CIPCLOSE=";
+
+        // response terminators
+        constexpr const char *Ok = "OK\r\n";
+        constexpr const char *Error = "ERROR\r\n";
+        constexpr const char *Fail = "FAIL\r\n";
+        constexpr const char *SendOk = "SEND OK\r\n";
+        constexpr const char *SendFail = "SEND FAIL\r\n";
+
+        // unsolicited result codes; a link id and ',' may come first in multiple connection mode
+        constexpr const char *Ready = "ready";
+        constexpr const char *WifiConnected = "WIFI CONNECTED";
+        constexpr const char *WifiGotIP = "WIFI GOT IP";
+        constexpr const char *WifiDisconnect = "WIFI DISCONNECT";
+        constexpr const char *Connect = "CONNECT";
+        constexpr const char *Closed = "CLOSED";
+        // "+IPD,<link>,<length>:" then length bytes of payload, no line ending
+        constexpr const char *IpdPrefix = "+IPD,";
+        // written after "AT+CIPSEND=" once the modem wants the payload
+        constexpr char SendPrompt = '>';
+
+        constexpr const char *LineEnding = "\r\n";
+
+        constexpr uint32_t DefaultTimeoutMs = 1000;
+        constexpr uint32_t ConnectTimeoutMs = 10000;
+        // plus the payload's time on the wire
+        constexpr uint32_t SendTimeoutMs = 5000;
+
+        // prebuilt terminator sets for CommandQueue
+
+        // Ok (0), Error (1) or Fail (2)
+        const PatternMatcher &okOrError();
+
+        // SendOk (0), SendFail (1) or Error (2); the "OK" before the prompt does not complete a send
+        const PatternMatcher &sendResult();
+    }
+}
+
+#endif //_ESP8266COMMAND_H_
@@ -0,0 +1,115 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _FRAMECIPHER_H_
+#define _FRAMECIPHER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "hal.h"
+#include "modemframe.h"
+#include "chacha20poly1305.h"
+#include "framefec.h"
+
+namespace StegoPhone {
+    // ChaCha20-Poly1305 over ModemFrames, in the frame's own buffer. A sealed data frame is
+    //
+    //     sequence (4, little endian) | ciphertext | tag (16)
+    //
+    // and the app writes its plaintext straight to payload(frame), so nothing is copied on either
+    // side: seal() encrypts around it and open() decrypts it where it lies. The frame type is
+    // authenticated as associated data.
+    //
+    // Both ends share one key. The nonce is a direction word (which end sent it) and the 32 bit frame
+    // sequence, so the two directions never reuse a nonce; the sequence counts up from 0 per key and
+    // seal() refuses once it would wrap. Received sequences go through a sliding window of
+    // ReplayWindow frames: repeats and anything older than the window are dropped, reordering within
+    // it is not.
+    //
+    // Threads: seal() on the task that fills transmit frames, open() on the one that takes received
+    // frames; setKey()/clear() while neither runs.
+    class FrameCipher {
+    public:
+        static const uint8_t HeaderBytes = 4;
+        static const uint8_t Overhead = HeaderBytes + Crypto::TagBytes;
+        // what fits once sealed and then FEC coded with the default code
+        static const uint16_t MaxPayload = ModemFrame::Capacity - FrameFec::DefaultOverhead - Overhead;
+        static const uint8_t ReplayWindow = 64;
+
+        FrameCipher();
+
+        ~FrameCipher();
+
+        // a new session: copies the key, sequence and replay window back to the start. The two ends
+        // must pass opposite initiator flags.
+        void setKey(const uint8_t *key, bool initiator);
+
+        // wipe the key; seal() and open() fail until the next setKey()
+        void clear();
+
+        bool keyed() const;
+
+        // where the plaintext goes in a frame to be sealed, and where open() leaves it
+        static uint8_t *payload(ModemFrame *frame);
+
+        // payloadLength bytes at payload(frame) encrypted in place; header and tag added and
+        // frame->length set. False (frame untouched) without a key, past MaxPayload or when the
+        // sequence is used up.
+        bool seal(ModemFrame *frame, uint16_t payloadLength);
+
+        // check and decrypt in place; frame->length becomes the payload's. False (and counted) for a
+        // short frame, a bad tag, a replay or one too old for the window.
+        bool open(ModemFrame *frame);
+
+        // STATS
+        //================================================================================================
+        uint32_t sealed() const;
+
+        uint32_t opened() const;
+
+        uint32_t badTags() const;
+
+        // repeats and frames older than the window
+        uint32_t replays() const;
+
+        uint64_t bytesSealed() const;
+
+        uint64_t bytesOpened() const;
+
+        void resetStats();
+
+        // console "aead [reset]"; context is the cipher
+        static void consoleCommand(void *context, HAL::SerialPort &out, const char *args);
+
+    protected:
+        static const uint32_t InitiatorSends = 1;
+        static const uint32_t ResponderSends = 2;
+
+        void nonce(uint8_t *out, uint32_t direction, uint32_t sequence) const;
+
+        uint8_t _key[Crypto::KeyBytes];
+        bool _keyed;
+        uint32_t _txDirection;
+        uint32_t _rxDirection;
+        uint64_t _txNext;   // next sequence to seal; 2^32 once they are used up
+        uint64_t _rxNext;   // one past the highest sequence opened
+        uint64_t _rxWindow; // bit i: sequence _rxNext - 1 - i opened
+
+        uint32_t _sealed;
+        uint32_t _opened;
+        uint32_t _badTags;
+        uint32_t _replays;
+        uint64_t _bytesSealed;
+        uint64_t _bytesOpened;
+    };
+
+    static_assert(FrameCipher::MaxPayload + FrameCipher::Overhead + FrameFec::DefaultOverhead <= ModemFrame::Capacity,
+                  "a sealed frame always fits the default FEC code");
+}
+
+#endif //_FRAMECIPHER_H_
@@ -0,0 +1,93 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _FRAMEFEC_H_
+#define _FRAMEFEC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "hal.h"
+#include "modemframe.h"
+#include "reedsolomon.h"
+
+namespace StegoPhone {
+    // Reed-Solomon over ModemFrames, in the frame's own buffer. The payload is split byte by byte over
+    // depth() codewords (byte i goes to codeword i % depth), and each codeword's parity() check bytes
+    // follow the payload, interleaved the same way:
+    //
+    //     payload (length) | parity (depth * parity, codeword i % depth at byte i)
+    //
+    // so a burst of up to depth * parity / 2 bytes lands at most parity / 2 errors in each codeword
+    // and is corrected. Each codeword is a shortened RS(n, n - parity) read in place with a stride.
+    //
+    // Sealed frames go through it last on the way out and first on the way in (FrameCipher's tag then
+    // only ever sees what FEC could not fix). FrameCipher::MaxPayload leaves room for DefaultOverhead,
+    // so every sealed frame fits with the default code; configuring more overhead shortens what fits.
+    //
+    // Threads: encode() on the task that sends frames, decode() on the one that takes them;
+    // configure() while neither runs.
+    class FrameFec {
+    public:
+        static const uint8_t MaxDepth = 8;
+        static const uint8_t DefaultParity = 16;
+        static const uint8_t DefaultDepth = 2;
+        static const uint16_t DefaultOverhead = DefaultParity * DefaultDepth;
+
+        FrameFec();
+
+        // false (and unchanged) outside 1..ReedSolomon::MaxParity or 1..MaxDepth
+        bool configure(uint8_t parity, uint8_t depth);
+
+        uint8_t parity() const;
+
+        uint8_t depth() const;
+
+        // bytes added to each frame
+        uint16_t overhead() const;
+
+        uint16_t maxPayload() const;
+
+        // check bytes appended to frame->length bytes of payload and frame->length grown; false (frame
+        // untouched) past maxPayload()
+        bool encode(ModemFrame *frame);
+
+        // corrected in place and frame->length back to the payload's; false (and counted) when a
+        // codeword has more errors than it can correct, or the frame is shorter than the overhead
+        bool decode(ModemFrame *frame);
+
+        // STATS
+        //================================================================================================
+        uint32_t encoded() const;
+
+        uint32_t decoded() const;
+
+        // frames that needed correcting, and the bytes corrected in them
+        uint32_t correctedFrames() const;
+
+        uint32_t correctedBytes() const;
+
+        uint32_t failures() const;
+
+        void resetStats();
+
+        // console "fec [reset]"; context is the FEC layer
+        static void consoleCommand(void *context, HAL::SerialPort &out, const char *args);
+
+    protected:
+        Fec::ReedSolomon _code;
+        uint8_t _depth;
+
+        uint32_t _encoded;
+        uint32_t _decoded;
+        uint32_t _correctedFrames;
+        uint32_t _correctedBytes;
+        uint32_t _failures;
+    };
+}
+
+#endif //_FRAMEFEC_H_
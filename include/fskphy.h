@@ -0,0 +1,125 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _FSKPHY_H_
+#define _FSKPHY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "modemphy.h"
+
+namespace StegoPhone {
+    // Built-in voice band phy: continuous phase binary FSK, 1200 baud at 9600 samples/s with mark
+    // (1) at 1200 Hz and space (0) at 2400 Hz, both well inside a 300-3400 Hz phone channel. The tones
+    // are a whole baud apart, so one symbol long correlators tell them apart without a carrier lock;
+    // a DPLL on the mark/space decision recovers the symbol clock.
+    //
+    // On the air, bits LSB first:
+    //     preamble 0x55 x PreambleBytes, sync 0x2D 0xD4, type, length, payload, CRC-16/CCITT lo hi, 0x55
+    // The CRC covers type, length and payload. Sync is only taken after a preamble byte, so noise
+    // alone fakes one about every 2^24 bits.
+    class FskPhy : public ModemPhy {
+    public:
+        static const uint32_t SampleRate = 9600;
+        static const uint32_t BaudRate = 1200;
+        static const uint8_t SamplesPerSymbol = SampleRate / BaudRate;
+        static const uint32_t MarkHz = 1200;
+        static const uint32_t SpaceHz = 2400;
+        static const int16_t Amplitude = 16384; // -6 dBFS
+        static const uint8_t PreambleBytes = 8;
+        static const uint8_t PreambleByte = 0x55;
+        static const uint8_t SyncFirst = 0x2D;
+        static const uint8_t SyncSecond = 0xD4;
+        static const uint8_t TailBytes = 1;
+        // bytes on the air around the payload
+        static const uint8_t OverheadBytes = PreambleBytes + 2 + 2 + 2 + TailBytes;
+
+        FskPhy();
+
+        const char *name() const override;
+
+        uint32_t sampleRate() const override;
+
+        uint32_t bitRate() const override;
+
+        bool beginFrame(const ModemFrame *frame) override;
+
+        bool transmitting() const override;
+
+        void modulate(int16_t *samples, size_t count) override;
+
+        void demodulate(const int16_t *samples, size_t count, ModemFrameSink &sink) override;
+
+        void reset(ModemFrameSink &sink) override;
+
+        // STATS
+        //================================================================================================
+        uint32_t syncs() const;
+
+        // frames whose CRC did not match
+        uint32_t crcErrors() const;
+
+    protected:
+        static const uint32_t SyncPattern =
+                ((uint32_t) SyncSecond << 16) | ((uint32_t) SyncFirst << 8) | PreambleByte;
+        static const int32_t PllStep = 65536 / SamplesPerSymbol;
+
+        enum class RxState : uint8_t {
+            Hunt,
+            Type,
+            Length,
+            Payload,
+            CrcLow,
+            CrcHigh
+        };
+
+        static uint16_t crcUpdate(uint16_t crc, uint8_t byte);
+
+        // byte index on the air of the frame being sent
+        uint8_t txByteAt(uint16_t index) const;
+
+        void bitReceived(bool bit, ModemFrameSink &sink);
+
+        void byteReceived(uint8_t byte, ModemFrameSink &sink);
+
+        // TRANSMIT
+        const ModemFrame *_txFrame;
+        uint16_t _txIndex;
+        uint16_t _txTotal;
+        uint16_t _txCrc;
+        uint8_t _txByte;
+        uint8_t _txBit;
+        uint8_t _txSample;
+        uint32_t _txPhase;
+        uint32_t _txIncrement;
+
+        // RECEIVE: mark/space correlators over the last symbol, then the symbol clock
+        float _histI[2][SamplesPerSymbol];
+        float _histQ[2][SamplesPerSymbol];
+        uint8_t _histIndex;
+        uint32_t _loPhase;
+        int32_t _pll;
+        bool _lastMark;
+
+        RxState _rxState;
+        uint32_t _shift;
+        uint8_t _rxByte;
+        uint8_t _rxBits;
+        ModemFrame *_rxFrame; // 0 while skipping a frame the sink had no room for
+        ModemFrameType _rxType;
+        uint16_t _rxLength;
+        uint16_t _rxIndex;
+        uint16_t _rxCrc;
+        uint8_t _rxCrcLow;
+
+        uint32_t _syncs;
+        uint32_t _crcErrors;
+    };
+}
+
+#endif //_FSKPHY_H_
@@ -0,0 +1,232 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _HAL_H_
+#define _HAL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Thin hardware abstraction layer. The teensy40 env implements it in src/hal_teensy.cpp on top of
+// the Arduino core, U8g2, SdFat and USBHost_t36; the native env implements it in src/sim/ with
+// simulated devices so the firmware logic can run (and be timed) on a Linux host.
+
+#ifndef DEC
+#define DEC 10
+#endif
+#ifndef HEX
+#define HEX 16
+#endif
+
+// USBHost_t36 special key codes, as delivered to the keyboard press callback
+#ifndef KEYD_UP
+#define KEYD_UP        0xDA
+#define KEYD_DOWN      0xD9
+#define KEYD_LEFT      0xD8
+#define KEYD_RIGHT     0xD7
+#define KEYD_INSERT    0xD1
+#define KEYD_DELETE    0xD4
+#define KEYD_PAGE_UP   0xD3
+#define KEYD_PAGE_DOWN 0xD6
+#define KEYD_HOME      0xD2
+#define KEYD_END       0xD5
+#define KEYD_F1        0xC2
+#define KEYD_F2        0xC3
+#define KEYD_F3        0xC4
+#define KEYD_F4        0xC5
+#define KEYD_F5        0xC6
+#define KEYD_F6        0xC7
+#define KEYD_F7        0xC8
+#define KEYD_F8        0xC9
+#define KEYD_F9        0xCA
+#define KEYD_F10       0xCB
+#define KEYD_F11       0xCC
+#define KEYD_F12       0xCD
+#endif
+
+namespace StegoPhone {
+    namespace HAL {
+        // TIME
+        //================================================================================================
+        uint32_t millis();
+
+        uint32_t micros();
+
+        void delay(uint32_t ms);
+
+        // RANDOM
+        //================================================================================================
+        // for key material. target: the hardware TRNG. native: a fixed-seed generator, so runs repeat.
+        void randomBytes(uint8_t *out, size_t length);
+
+        // GPIO
+        //================================================================================================
+        enum class PinMode {
+            Input,
+            InputPullup,
+            Output
+        };
+
+        enum class Edge {
+            Rising,
+            Falling,
+            Change
+        };
+
+        typedef void (*InterruptHandler)();
+
+        void pinMode(uint8_t pin, PinMode mode);
+
+        void digitalWrite(uint8_t pin, bool value);
+
+        bool digitalRead(uint8_t pin);
+
+        void attachInterrupt(uint8_t pin, InterruptHandler handler, Edge edge);
+
+        void detachInterrupt(uint8_t pin);
+
+        // SERIAL
+        //================================================================================================
+        class SerialPort {
+        public:
+            virtual void begin(uint32_t baud) = 0;
+
+            virtual int available() = 0;
+
+            virtual int read() = 0;
+
+            virtual size_t write(uint8_t c) = 0;
+
+            virtual size_t write(const uint8_t *data, size_t length);
+
+            virtual void flush();
+
+            size_t write(const char *str);
+
+            size_t print(const char *str);
+
+            size_t print(char c);
+
+            size_t print(int n, int base = DEC);
+
+            size_t print(unsigned int n, int base = DEC);
+
+            size_t print(long n, int base = DEC);
+
+            size_t print(unsigned long n, int base = DEC);
+
+            size_t println();
+
+            size_t println(const char *str);
+
+            size_t println(char c);
+
+            size_t println(int n, int base = DEC);
+
+            size_t println(unsigned int n, int base = DEC);
+
+            size_t println(long n, int base = DEC);
+
+            size_t println(unsigned long n, int base = DEC);
+
+        protected:
+            size_t printNumber(unsigned long n, int base);
+        };
+
+        SerialPort &consoleSerial();
+
+        SerialPort &esp8266Serial();
+
+        SerialPort &rn52Serial();
+
+        // DISPLAY
+        //================================================================================================
+        enum class Font {
+            Small, // u8g2_font_amstrad_cpc_extended_8f
+            Large  // u8g2_font_profont22_tf
+        };
+
+        // 256x64 SSD1322 with a full frame buffer in U8g2 tile layout: 8 tile rows of 256 bytes,
+        // each byte a vertical strip of 8 pixels (LSB on top).
+        class Display {
+        public:
+            static const uint16_t Width = 256;
+            static const uint16_t Height = 64;
+            static const uint8_t TileWidth = Width / 8;
+            static const uint8_t TileHeight = Height / 8;
+            static const size_t BufferSize = Width * TileHeight;
+            // SSD1322 is 4 bits per pixel on the wire
+            static const size_t PanelBytes = (size_t) Width * Height / 2;
+            static const size_t PanelBytesPerTile = 8 * 8 / 2;
+
+            virtual void begin() = 0;
+
+            virtual void setFont(Font font) = 0;
+
+            virtual void clear() = 0;
+
+            virtual void clearBuffer() = 0;
+
+            virtual void drawStr(int16_t x, int16_t y, const char *str) = 0;
+
+            virtual void sendBuffer() = 0;
+
+            virtual uint8_t *getBufferPtr() = 0;
+        };
+
+        Display &display();
+
+        // Moves finished pixels to the panel, independent of the Display that drew them. Frames come
+        // from any buffer in Display tile layout, so a copy can be sent while the next one is drawn.
+        // target: bit-banged on the OLED pins, or hardware SPI with DMA when built with
+        // STEGOS_DISPLAY_DMA=1 (CLK/SDA moved to SCK/MOSI, pins 13/11). native: in memory.
+        class DisplayTransport {
+        public:
+            // send tiles [tileX, tileX + tileWidth) of tile row tileY from buffer. Returns once sent;
+            // the calling task may be blocked while a DMA transfer runs.
+            virtual void sendTiles(const uint8_t *buffer, uint8_t tileX, uint8_t tileY, uint8_t tileWidth) = 0;
+        };
+
+        DisplayTransport &displayTransport();
+
+        // STORAGE
+        //================================================================================================
+        bool storageBegin();
+
+        // I2C
+        //================================================================================================
+        void i2cBegin();
+
+        // USB HOST
+        //================================================================================================
+        struct KeyboardHandlers {
+            void (*press)(int unicode);
+            void (*extrasPress)(uint32_t top, uint16_t key);
+            void (*rawPress)(uint8_t keycode);
+            void (*rawRelease)(uint8_t keycode);
+        };
+
+        struct MouseReport {
+            uint8_t buttons;
+            int mouseX;
+            int mouseY;
+            int wheel;
+            int wheelH;
+        };
+
+        void usbBegin();
+
+        void usbTask();
+
+        void attachKeyboard(const KeyboardHandlers &handlers);
+
+        // returns false if no report is pending; a returned report is consumed
+        bool readMouse(MouseReport &report);
+    }
+}
+
+#endif //_HAL_H_
@@ -0,0 +1,120 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _INPUTQUEUE_H_
+#define _INPUTQUEUE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "hal.h"
+#include "spscring.h"
+
+// events the USB side can get ahead of the UI by; a power of two
+#ifndef STEGOS_INPUT_CAPACITY
+#define STEGOS_INPUT_CAPACITY 32
+#endif
+
+namespace StegoPhone {
+    enum class InputEventType : uint8_t {
+        Key,      // code: unicode / KEYD_*
+        Consumer, // page: HID usage page, code: usage
+        Mouse     // buttons, dx, dy, wheel, wheelH
+    };
+
+    struct InputEvent {
+        uint32_t micros; // when it was queued
+        InputEventType type;
+        uint8_t buttons;
+        uint16_t code;
+        uint16_t page;
+        int16_t dx;
+        int16_t dy;
+        int8_t wheel;
+        int8_t wheelH;
+    };
+
+    // Bounded single producer, single consumer ring (an SpscRing) between the USB host callbacks and the UI.
+    // The producer (the task running usb.Task(), where KeyboardController calls back) only stamps and
+    // stores events; the consumer handles them later on its own task.
+    //
+    // Key and consumer events are dropped, and counted, when the ring is full. Mouse reports are
+    // summed into one pending event, pushed by flushMouse() or when the buttons change, so a stalled
+    // consumer costs pointer resolution but loses no movement.
+    class InputQueue {
+    public:
+        static const uint32_t Capacity = STEGOS_INPUT_CAPACITY;
+
+        InputQueue();
+
+        // PRODUCER
+        //================================================================================================
+        bool pushKey(int unicode);
+
+        bool pushConsumer(uint32_t top, uint16_t usage);
+
+        void pushMouse(const HAL::MouseReport &report);
+
+        // push the summed mouse movement, if any; it stays pending if the ring is full
+        bool flushMouse();
+
+        // CONSUMER
+        //================================================================================================
+        bool pop(InputEvent &event);
+
+        // record queue-to-handled latency once the consumer is done with event
+        void handled(const InputEvent &event);
+
+        uint32_t depth() const;
+
+        // STATS
+        //================================================================================================
+        uint32_t queued() const;
+
+        uint32_t dropped() const;
+
+        uint32_t mouseReports() const;
+
+        uint32_t mouseEvents() const;
+
+        uint32_t handledCount() const;
+
+        uint32_t lastLatencyMicros() const;
+
+        uint32_t maxLatencyMicros() const;
+
+        uint32_t averageLatencyMicros() const;
+
+        // console "input"
+        static void consoleCommand(void *context, HAL::SerialPort &out, const char *args);
+
+    protected:
+        bool push(InputEvent &event);
+
+        static int16_t saturate16(int32_t value);
+
+        static int8_t saturate8(int32_t value);
+
+        SpscRing<InputEvent, Capacity> _events;
+
+        // producer side
+        InputEvent _mouse;
+        bool _mousePending;
+        uint32_t _queued;
+        uint32_t _dropped;
+        uint32_t _mouseReports;
+        uint32_t _mouseEvents;
+
+        // consumer side
+        uint32_t _handled;
+        uint32_t _lastLatencyMicros;
+        uint32_t _maxLatencyMicros;
+        uint64_t _totalLatencyMicros;
+    };
+}
+
+#endif //_INPUTQUEUE_H_
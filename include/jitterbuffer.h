@@ -0,0 +1,148 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _JITTERBUFFER_H_
+#define _JITTERBUFFER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "hal.h"
+#include "modemframe.h"
+
+namespace StegoPhone {
+    enum class PlayoutResult : uint8_t {
+        Waiting,  // filling up to the target delay; play silence
+        Frame,    // the next frame, in order
+        Lost,     // the next frame never came and its turn has passed: conceal it
+        Stretched // the next frame is not here yet: conceal, and the delay grows by a frame
+    };
+
+    // Adaptive playout buffer for voice (and data) frames off the call modem, one every frameMicros at
+    // the sender. Received frames are copied into Depth slots from a FramePool, indexed by sequence,
+    // and pop() is called once a frame period by the playout side, which gets them back in order.
+    //
+    // Inter-arrival jitter is estimated as RFC 3550 does, J += (|D| - J) / 16 with D the change in
+    // transit time between arrivals, and sets the target delay: 1 + JitterMultiple * J frames, rounded
+    // up (InitialFrames until the estimate has SettleArrivals behind it). A missing frame is given up
+    // (Lost) once the target's worth of frames is buffered from it on, and arriving afterwards counts
+    // as late; short of that it is waited for (Stretched). When the buffer has stayed above target for
+    // a ShrinkWindow of pops, one frame is dropped to pull the delay back in. Lost and Stretched are
+    // meant for VoiceDecoder::conceal().
+    //
+    // Times are passed in, so the buffer runs the same from HAL::micros() or a synthetic trace.
+    //
+    // Threads: push() and pop() on one task.
+    class JitterBuffer {
+    public:
+        static const uint8_t Depth = 16;          // slots; a frame more than Depth - 2 ahead resyncs
+        static const uint8_t InitialFrames = 2;   // target delay before the jitter estimate settles
+        static const uint8_t SettleArrivals = 16;
+        static const uint8_t JitterMultiple = 3;
+        static const uint8_t ShrinkWindow = 8;    // pops
+        static const uint32_t DefaultFrameMicros = 20000;
+
+        JitterBuffer();
+
+        // sender frame period; starts over
+        void setFrameMicros(uint32_t micros);
+
+        uint32_t frameMicros() const;
+
+        // empty, back to waiting for the target delay; the jitter estimate is kept
+        void reset();
+
+        // a received frame, copied; false when it is late or a duplicate (both counted) or too long
+        bool push(uint32_t sequence, const uint8_t *data, uint16_t length, uint32_t nowMicros);
+
+        // the next turn's worth of playout; frame is set for PlayoutResult::Frame (0 otherwise) and
+        // stays valid until the next pop()
+        PlayoutResult pop(uint32_t nowMicros, const ModemFrame *&frame);
+
+        bool playing() const;
+
+        // frames from the next to play up to the newest received, gaps included
+        uint8_t depth() const;
+
+        uint8_t targetFrames() const;
+
+        uint32_t jitterMicros() const;
+
+        // STATS
+        //================================================================================================
+        uint32_t pushed() const;
+
+        uint32_t played() const;
+
+        uint32_t lost() const;
+
+        uint32_t stretched() const;
+
+        // frames dropped to bring the delay back down
+        uint32_t shrunk() const;
+
+        // arrived after their turn
+        uint32_t lateDrops() const;
+
+        uint32_t duplicates() const;
+
+        // jumps too far ahead to buffer, which start it over
+        uint32_t resyncs() const;
+
+        // arrival to playout of played frames
+        uint32_t lastLatencyMicros() const;
+
+        uint32_t meanLatencyMicros() const;
+
+        uint32_t maxLatencyMicros() const;
+
+        void resetStats();
+
+        // console "jitter [reset]"; context is the buffer
+        static void consoleCommand(void *context, HAL::SerialPort &out, const char *args);
+
+    protected:
+        struct Slot {
+            ModemFrame *frame;
+            uint32_t sequence;
+            uint32_t arrivalMicros;
+        };
+
+        void updateTarget();
+
+        void flush();
+
+        FramePool<Depth> _pool;
+        Slot _slots[Depth];      // by sequence % Depth
+        ModemFrame *_held;       // returned by the last pop()
+        uint32_t _frameMicros;
+        bool _playing;
+        bool _any;               // something pushed since the last flush
+        uint32_t _next;          // sequence to play next
+        uint32_t _newest;        // one past the highest sequence buffered
+        uint8_t _arrivals;       // counted up to SettleArrivals
+        uint32_t _lastTransit;
+        uint32_t _jitter;        // RFC 3550 estimate, micros << 4
+        uint8_t _target;
+        uint8_t _windowPops;
+        uint8_t _windowLow;      // least depth over the shrink window
+
+        uint32_t _pushed;
+        uint32_t _played;
+        uint32_t _lost;
+        uint32_t _stretched;
+        uint32_t _shrunk;
+        uint32_t _lateDrops;
+        uint32_t _duplicates;
+        uint32_t _resyncs;
+        uint32_t _lastLatency;
+        uint32_t _maxLatency;
+        uint64_t _latencySum;
+    };
+}
+
+#endif //_JITTERBUFFER_H_
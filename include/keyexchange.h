@@ -0,0 +1,137 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _KEYEXCHANGE_H_
+#define _KEYEXCHANGE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "hal.h"
+#include "x25519.h"
+#include "framecipher.h"
+#include "taskmanager.h"
+
+namespace StegoPhone {
+    enum class KeyExchangeState : uint8_t {
+        Idle,
+        ComputingPublic, // our public key, from the ephemeral secret
+        WaitingPeer,     // ours is ready to send; the peer's has not come
+        ComputingShared,
+        Established,     // session key handed to the FrameCipher
+        Failed           // the peer sent a small order point
+    };
+
+    // Ephemeral X25519 agreement for the EncryptionHandshaking state. Both scalar multiplications run a
+    // slice of SliceSteps ladder steps at a time (setSliceSteps()), each slice timed, with the CPU handed
+    // back between slices: on its own task it sleeps SliceGapMs after every slice, so no other task, of
+    // any priority, waits on it for longer than one slice. Polled, each slice() call is one slice.
+    //
+    // The session key is HChaCha20 of the shared secret; the secret, the shared point and the ladder
+    // are wiped once it is set on the cipher.
+    //
+    // Threads: begin()/peerKey()/publicKey()/abort() on the handshake's task, slices on the key task.
+    class KeyExchange {
+    public:
+        static const uint16_t DefaultSliceSteps = 16;
+        static const uint16_t TaskStackWords = 768;
+        // the key task's sleep between slices
+        static const uint32_t SliceGapMs = 1;
+
+        explicit KeyExchange(FrameCipher &cipher);
+
+        ~KeyExchange();
+
+        // start over with 32 random bytes of ephemeral secret (copied); the initiator flag goes to the
+        // cipher. Taken up by the next slice.
+        void begin(const uint8_t *secret, bool initiator);
+
+        // as above, with the roles left to the two public keys: the end whose key is larger initiates,
+        // so two peers that start at the same time still agree who is who
+        void begin(const uint8_t *secret);
+
+        // the peer's public key (copied); the shared secret follows ours
+        void peerKey(const uint8_t *peerPublic);
+
+        // back to idle at the next slice, everything wiped
+        void abort();
+
+        KeyExchangeState state() const;
+
+        // our public key once state() has got to WaitingPeer
+        bool publicKey(uint8_t *out) const;
+
+        // at most this many ladder steps per slice
+        void setSliceSteps(uint16_t steps);
+
+        uint16_t sliceSteps() const;
+
+        // one slice; true while there is more to do before the peer's key is needed or the session is set
+        bool slice();
+
+        // an event task woken by begin()/peerKey()/abort()
+        bool startTask(uint8_t priority);
+
+        void stopTask();
+
+        bool taskRunning() const;
+
+        // STATS
+        //================================================================================================
+        uint32_t slices() const;
+
+        uint32_t lastSliceMicros() const;
+
+        // the longest anything else waited on a slice
+        uint32_t maxSliceMicros() const;
+
+        // summed slice time for the last public key and the last shared secret
+        uint32_t publicMicros() const;
+
+        uint32_t sharedMicros() const;
+
+        uint32_t established() const;
+
+        uint32_t failed() const;
+
+        void resetStats();
+
+        // console "keyx [reset]"; context is the key exchange
+        static void consoleCommand(void *context, HAL::SerialPort &out, const char *args);
+
+    protected:
+        static void taskStep(void *context, uint32_t notifications);
+
+        void wake();
+
+        void finish();
+
+        FrameCipher &_cipher;
+        ManagedTask *_task;
+        Crypto::X25519 _job;
+        volatile KeyExchangeState _state;
+        volatile bool _beginRequested;
+        volatile bool _abortRequested;
+        volatile bool _peerReady;
+        bool _initiator;
+        bool _initiatorFromKeys;
+        uint16_t _sliceSteps;
+        uint8_t _secret[Crypto::X25519::Bytes];
+        uint8_t _public[Crypto::X25519::Bytes];
+        uint8_t _peer[Crypto::X25519::Bytes];
+
+        uint32_t _slices;
+        uint32_t _lastSliceMicros;
+        uint32_t _maxSliceMicros;
+        uint32_t _publicMicros;
+        uint32_t _sharedMicros;
+        uint32_t _established;
+        uint32_t _failed;
+    };
+}
+
+#endif //_KEYEXCHANGE_H_
@@ -0,0 +1,43 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _KEYNAMES_H_
+#define _KEYNAMES_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace StegoPhone {
+    // Names for USB keyboard input. All names sit in one packed string pool in flash; the tables hold
+    // 16 bit offsets into it. Control codes are indexed directly, KEYD_* keys and consumer usages by
+    // binary search over tables sorted at compile time. Nothing is built or allocated per lookup.
+    class KeyNames {
+    public:
+        // usage page reported as top by the HID extras (consumer control) callback
+        static const uint32_t ConsumerPage = 0xC0000;
+
+        // KEYD_* navigation and function keys, then control codes 0-32; 0 for anything printable
+        static const char *keyboard(int unicode);
+
+        // KEYD_* only
+        static const char *special(int unicode);
+
+        // 0-31 as their ASCII mnemonics, 32 as "Space"
+        static const char *control(int unicode);
+
+        // consumer page usage, 0 if unnamed
+        static const char *consumer(uint16_t usage);
+
+        // names across all tables
+        static size_t count();
+
+        // tables plus string pool
+        static size_t flashBytes();
+    };
+}
+
+#endif //_KEYNAMES_H_
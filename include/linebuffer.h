@@ -8,27 +8,68 @@
 #ifndef _LINEBUFFER_H_
 #define _LINEBUFFER_H_
 
-#include <Arduino.h>
+#include <stdint.h>
+#include <stddef.h>
 #include <Callback.h>
+#include "hal.h"
 
 namespace StegoPhone {
+    // A received line, without its "\n" / "\r\n" terminator. Points into the LineBuffer ring and is
+    // only valid for the duration of the lineReceived callback; it is not null terminated.
+    struct LineView {
+        const char *data;
+        size_t length;
+        bool partial; // longer than the ring, emitted in pieces (LineOverflow::EmitPartial)
+    };
+
+    enum class LineOverflow {
+        DiscardLine, // drop the line, resynchronise at the next '\n'
+        EmitPartial  // emit every full ring's worth as a partial line
+    };
+
+    // Fixed capacity line splitter. Storage is allocated once, at construction; the ring is mirrored
+    // (every byte is stored twice, Capacity apart) so any line that fits is contiguous in memory and
+    // can be handed out without copying. Each byte is scanned exactly once.
     class LineBuffer {
     public:
-        LineBuffer();
+        // capacity is rounded up to a power of two
+        LineBuffer(HAL::SerialPort &serialPort, size_t capacity = 1024,
+                   LineOverflow overflow = LineOverflow::DiscardLine);
 
         ~LineBuffer();
 
         void setup();
 
+        // drain the serial port
         void loop();
 
-        Signal<char *> lineReceived;
+        // feed bytes from another source
+        void push(const uint8_t *data, size_t length);
+
+        void push(uint8_t c);
+
+        size_t capacity() const;
+
+        uint32_t linesReceived() const;
+
+        uint32_t overflows() const;
+
+        Signal<LineView> lineReceived;
 
     private:
-        char *_serialBuffer;
-        int _serialBufferSize;
-        int _serialBufferDataLength;
+        void emit(uint32_t end, bool partial);
+
+        HAL::SerialPort &_serialPort;
+        char *_ring;
+        uint32_t _capacity;
+        uint32_t _mask;
+        uint32_t _head;      // free running write position
+        uint32_t _lineStart; // free running position of the first byte of the pending line
+        LineOverflow _overflow;
+        bool _discarding;
+        uint32_t _linesReceived;
+        uint32_t _overflows;
     };
 }
 
-#endif //_LINEBUFFER_H_
\ No newline at end of file
+#endif //_LINEBUFFER_H_
@@ -0,0 +1,170 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _LOG_H_
+#define _LOG_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <type_traits>
+#include "hal.h"
+
+// records below this level are compiled out: 0 debug, 1 info, 2 warning, 3 error, 4 nothing
+#ifndef STEGOS_LOG_LEVEL
+#define STEGOS_LOG_LEVEL 1
+#endif
+
+// records queued, power of two
+#ifndef STEGOS_LOG_CAPACITY
+#define STEGOS_LOG_CAPACITY 64
+#endif
+
+namespace StegoPhone {
+    enum class LogLevel : uint8_t {
+        Debug,
+        Info,
+        Warning,
+        Error
+    };
+
+    // text copied into the record, for arguments that will not outlive the call; one per record,
+    // checked at compile time
+    struct LogText {
+        const char *data;
+        size_t length;
+    };
+
+    // how many of a log call's arguments are LogText; a record has room for one
+    template<typename... Args>
+    struct LogTextCount {
+        static const int value = 0;
+    };
+
+    template<typename First, typename... Rest>
+    struct LogTextCount<First, Rest...> {
+        static const int value = (std::is_same<typename std::decay<First>::type, LogText>::value ? 1 : 0) +
+                                 LogTextCount<Rest...>::value;
+    };
+
+    struct LogRecord {
+        static const uint8_t MaxArgs = 6;
+        static const uint8_t TextCapacity = 32;
+
+        uint32_t micros;
+        LogLevel level;
+        uint8_t argCount;
+        uint8_t textArgs; // bit i: argument i is text[]
+        const char *format;
+        intptr_t args[MaxArgs];
+        char text[TextCapacity];
+    };
+
+    // Asynchronous logging. write() stores the format pointer and raw arguments in a bounded lock-free
+    // MPMC queue (Vyukov) and returns; it never blocks or allocates and is safe from ISRs. A single
+    // low-priority task calls drain() to format records onto the console. When the queue is full the
+    // record is dropped and counted.
+    //
+    // Formats support %d %i %u %x %X %c %s %% with an optional '-', '0' and width. The format and any
+    // %s pointer must be static (string literals); pass Log::text(...) for anything else.
+    class Log {
+    public:
+        static const uint32_t Capacity = STEGOS_LOG_CAPACITY;
+
+        template<typename... Args>
+        static bool write(LogLevel level, const char *format, Args... args) {
+            static_assert(sizeof...(Args) <= LogRecord::MaxArgs, "too many log arguments");
+            static_assert(LogTextCount<Args...>::value <= 1, "one Log::text argument per log record");
+            Cell *cell = reserve();
+            if (!cell) {
+                _dropped[(uint8_t) level].fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            LogRecord &record = cell->record;
+            record.micros = HAL::micros();
+            record.level = level;
+            record.argCount = 0;
+            record.textArgs = 0;
+            record.format = format;
+            int expand[] = {0, (pack(record, args), 0)...};
+            (void) expand;
+            publish(cell);
+            return true;
+        }
+
+        static LogText text(const char *data, size_t length);
+
+        static LogText text(const char *str);
+
+        // format up to maxRecords queued records onto out; returns the number written
+        static uint32_t drain(HAL::SerialPort &out, uint32_t maxRecords = 0xFFFFFFFF);
+
+        // pop one record without formatting it
+        static bool next(LogRecord &record);
+
+        // format a record into buf, without the newline; returns the length
+        static size_t format(const LogRecord &record, char *buf, size_t size);
+
+        // STATS
+        //================================================================================================
+        static uint32_t queued();
+
+        static uint32_t dropped();
+
+        static uint32_t dropped(LogLevel level);
+
+        static uint32_t drained();
+
+        // time spent formatting and writing drained records
+        static uint32_t drainMicros();
+
+        // console "log"
+        static void consoleCommand(void *context, HAL::SerialPort &out, const char *args);
+
+    protected:
+        struct Cell {
+            std::atomic<uint32_t> sequence; // stored relative to the cell index, so zero is "free for lap 0"
+            uint32_t position;
+            LogRecord record;
+        };
+
+        static Cell *reserve();
+
+        static void publish(Cell *cell);
+
+        template<typename T>
+        static inline typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type
+        pack(LogRecord &record, T value) {
+            record.args[record.argCount++] = (intptr_t) value;
+        }
+
+        static inline void pack(LogRecord &record, const char *value) {
+            record.args[record.argCount++] = (intptr_t) value;
+        }
+
+        static void pack(LogRecord &record, LogText value);
+
+        static Cell _cells[Capacity];
+        static std::atomic<uint32_t> _enqueuePos;
+        static std::atomic<uint32_t> _dequeuePos;
+        static std::atomic<uint32_t> _dropped[4];
+        static uint32_t _drained;
+        static uint32_t _drainMicros;
+    };
+}
+
+#define STEGOS_LOG(level, ...) \
+    do { \
+        if ((int) (level) >= STEGOS_LOG_LEVEL) ::StegoPhone::Log::write(level, __VA_ARGS__); \
+    } while (0)
+
+#define STEGOS_LOG_DEBUG(...) STEGOS_LOG(::StegoPhone::LogLevel::Debug, __VA_ARGS__)
+#define STEGOS_LOG_INFO(...) STEGOS_LOG(::StegoPhone::LogLevel::Info, __VA_ARGS__)
+#define STEGOS_LOG_WARNING(...) STEGOS_LOG(::StegoPhone::LogLevel::Warning, __VA_ARGS__)
+#define STEGOS_LOG_ERROR(...) STEGOS_LOG(::StegoPhone::LogLevel::Error, __VA_ARGS__)
+
+#endif //_LOG_H_
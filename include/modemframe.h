@@ -0,0 +1,69 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _MODEMFRAME_H_
+#define _MODEMFRAME_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "spscring.h"
+
+namespace StegoPhone {
+    enum class ModemFrameType : uint8_t {
+        Announce = 1, // link layer: looking for a peer
+        Hello = 2,    // link layer: peer heard, handshaking
+        Data = 3,
+        KeyShare = 4  // a public key for the session's key agreement, ahead of any data
+    };
+
+    // one frame over the air; the length byte on the wire caps it at Capacity
+    struct ModemFrame {
+        static const uint16_t Capacity = 255;
+
+        ModemFrameType type;
+        uint16_t length;
+        uint8_t data[Capacity];
+    };
+
+    // Count frames allocated up front. One task acquires and exactly one other task releases (the app
+    // fills transmit frames the modem task gives back; the modem task fills received frames the app gives
+    // back), so the free list is an SpscRing running the other way. The acquiring side must not release
+    // into it too: frames it drops itself go on a list of its own (ModemStage's receive recycle list).
+    template<uint32_t Count>
+    class FramePool {
+    public:
+        FramePool() {
+            for (uint32_t i = 0; i < Count; i++)
+                this->_free.push(&this->_frames[i]);
+        }
+
+        // 0 when every frame is out
+        ModemFrame *acquire() {
+            ModemFrame *frame;
+            return this->_free.pop(frame) ? frame : 0;
+        }
+
+        void release(ModemFrame *frame) {
+            this->_free.push(frame);
+        }
+
+        uint32_t available() const {
+            return this->_free.size();
+        }
+
+        bool owns(const ModemFrame *frame) const {
+            return frame >= &this->_frames[0] && frame < &this->_frames[Count];
+        }
+
+    protected:
+        ModemFrame _frames[Count];
+        SpscRing<ModemFrame *, Count> _free;
+    };
+}
+
+#endif //_MODEMFRAME_H_
@@ -0,0 +1,54 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _MODEMPHY_H_
+#define _MODEMPHY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "modemframe.h"
+
+namespace StegoPhone {
+    // where a demodulator puts what it decodes
+    class ModemFrameSink {
+    public:
+        // a frame to decode into once a start of frame is seen; 0 skips this one
+        virtual ModemFrame *frameStart() = 0;
+
+        // the frame from frameStart(), complete; valid is false when the check failed
+        virtual void frameDecoded(ModemFrame *frame, bool valid) = 0;
+    };
+
+    // One modulation scheme, driven a block of samples at a time by ModemStage. Both directions are
+    // incremental: modulate() continues the frame in progress (silence when there is none) and
+    // demodulate() carries its symbol timing and partial frame across calls, so any block size works.
+    // Samples are signed 16 bit at sampleRate().
+    class ModemPhy {
+    public:
+        virtual const char *name() const = 0;
+
+        virtual uint32_t sampleRate() const = 0;
+
+        // raw bits per second on the air, before framing
+        virtual uint32_t bitRate() const = 0;
+
+        // start sending frame; it must stay untouched until transmitting() is false. false if busy.
+        virtual bool beginFrame(const ModemFrame *frame) = 0;
+
+        virtual bool transmitting() const = 0;
+
+        virtual void modulate(int16_t *samples, size_t count) = 0;
+
+        virtual void demodulate(const int16_t *samples, size_t count, ModemFrameSink &sink) = 0;
+
+        // drop both directions mid frame; a frame being decoded goes back through frameDecoded()
+        virtual void reset(ModemFrameSink &sink) = 0;
+    };
+}
+
+#endif //_MODEMPHY_H_
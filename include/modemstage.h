@@ -0,0 +1,198 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _MODEMSTAGE_H_
+#define _MODEMSTAGE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "hal.h"
+#include "modemphy.h"
+#include "spscring.h"
+#include "taskmanager.h"
+
+namespace StegoPhone {
+    enum class ModemLinkState : uint8_t {
+        Idle,        // not started: received audio is dropped, silence goes out
+        Announcing,  // Announce every AnnounceIntervalMs until a peer answers
+        Handshaking, // peer heard, Hello until it hears us too
+        Connected
+    };
+
+    // Streaming modem over call audio. The audio side (codec driver, or the simulated channel) pushes
+    // each received block of BlockSamples and pulls one to play in its place; process() runs the phy over
+    // every queued block, demodulating what came in and modulating what goes out, and times each block
+    // against the audio deadline (one block of audio).
+    //
+    // Frames come from two FramePools allocated with the stage, so nothing touches the heap per frame:
+    // the app acquire()s a transmit frame, fills it and send()s it, and it returns to the pool once on
+    // the air; received frames are receive()d and given back with release(). Announce/Hello frames
+    // stay inside the stage and drive the link state.
+    //
+    // Threads: pushAudio()/pullAudio() on the audio side, process() and the link on the modem task,
+    // acquire()/send()/receive()/release() on one app task. Every queue between them is an SpscRing.
+    class ModemStage : public ModemFrameSink {
+    public:
+        static const size_t BlockSamples = 192;  // 20ms at 9600 samples/s
+        static const uint8_t BlockDepth = 8;     // blocks queued each way
+        static const uint8_t TxLeadBlocks = 2;   // transmit blocks kept ready ahead of the audio side
+        static const uint8_t FrameDepth = 8;     // frames per pool
+        static const uint32_t AnnounceIntervalMs = 500;
+        static const uint32_t HandshakeTimeoutMs = 3000; // back to announcing without a Hello
+        static const uint16_t TaskStackWords = 512;
+
+        struct AudioBlock {
+            int16_t samples[BlockSamples];
+        };
+
+        ModemStage(ModemPhy &phy);
+
+        ModemPhy &phy();
+
+        // one block of audio, the time process() has for each
+        uint32_t deadlineMicros() const;
+
+        // LINK
+        //================================================================================================
+        // start announcing; from any task, taken up by the next process()
+        void start();
+
+        // back to idle at the next process(); queued and half sent frames go back to their pools
+        void stop();
+
+        ModemLinkState linkState() const;
+
+        // AUDIO SIDE
+        //================================================================================================
+        // one received block; false (and counted) when the modem task is BlockDepth blocks behind
+        bool pushAudio(const int16_t *samples);
+
+        // the next block to play; silence and false (counted) when none is ready
+        bool pullAudio(int16_t *samples);
+
+        // MODEM TASK
+        //================================================================================================
+        // everything pushed so far; returns the number of blocks processed
+        uint32_t process();
+
+        // an event task woken by pushAudio()
+        bool startTask(uint8_t priority);
+
+        void stopTask();
+
+        bool taskRunning() const;
+
+        // FRAMES
+        //================================================================================================
+        // a transmit frame to fill, 0 while all of them are queued or on the air
+        ModemFrame *acquire();
+
+        // queue a frame from acquire(); it is sent after those before it
+        void send(ModemFrame *frame);
+
+        // the next received Data or KeyShare frame, 0 if none
+        ModemFrame *receive();
+
+        // hand a received frame back
+        void release(ModemFrame *frame);
+
+        // STATS
+        //================================================================================================
+        uint32_t blocks() const;
+
+        // blocks whose processing took longer than the deadline
+        uint32_t lateBlocks() const;
+
+        uint32_t lastBlockMicros() const;
+
+        uint32_t maxBlockMicros() const;
+
+        uint64_t busyMicros() const;
+
+        uint32_t audioOverruns() const;
+
+        uint32_t audioUnderruns() const;
+
+        uint32_t framesSent() const;
+
+        uint32_t framesReceived() const;
+
+        // frames that failed their check
+        uint32_t frameErrors() const;
+
+        // frames skipped because every receive frame was still with the app
+        uint32_t framesDropped() const;
+
+        // receive frames free, in the pool and on the modem task's recycle list; a snapshot
+        uint32_t receiveFramesFree() const;
+
+        void resetStats();
+
+        // console "modem [reset]"; context is the stage
+        static void consoleCommand(void *context, HAL::SerialPort &out, const char *args);
+
+    protected:
+        ModemFrame *frameStart() override;
+
+        void frameDecoded(ModemFrame *frame, bool valid) override;
+
+        static void taskStep(void *context, uint32_t notifications);
+
+        uint32_t blocksFor(uint32_t ms) const;
+
+        void enterState(ModemLinkState state);
+
+        void linkReceived(const ModemFrame *frame);
+
+        // per block: link timers, and the next frame onto the phy once it is free
+        void transmitTick();
+
+        void queueLink(ModemFrameType type, bool heard);
+
+        // a receive frame the modem task drops itself (link, bad or abandoned): the app releases into
+        // _rxPool, so the modem task keeps its own on _rxRecycled and takes from there first
+        void recycle(ModemFrame *frame);
+
+        ModemPhy &_phy;
+        ManagedTask *_task;
+        volatile ModemLinkState _linkState;
+        volatile bool _startRequested;
+        volatile bool _stopRequested;
+        uint32_t _stateBlocks; // blocks since the link state changed
+        uint32_t _linkBlocks;  // blocks since the last link frame went out
+
+        SpscRing<AudioBlock, BlockDepth> _rxAudio;
+        SpscRing<AudioBlock, BlockDepth> _txAudio;
+
+        FramePool<FrameDepth> _txPool;
+        FramePool<FrameDepth> _rxPool;
+        SpscRing<ModemFrame *, FrameDepth> _txQueue;
+        SpscRing<ModemFrame *, FrameDepth> _rxQueue;
+        ModemFrame *_rxRecycled[FrameDepth]; // modem task only
+        volatile uint32_t _rxRecycledCount;
+        ModemFrame *_sending;    // pool frame on the phy
+        ModemFrame _linkFrame;   // Announce/Hello, never from a pool
+        bool _linkPending;       // filled in once the phy is free
+        ModemFrameType _linkType;
+        bool _linkHeard;         // Hello: the peer's Hello was heard too
+
+        uint32_t _blocks;
+        uint32_t _lateBlocks;
+        uint32_t _lastBlockMicros;
+        uint32_t _maxBlockMicros;
+        uint64_t _busyMicros;
+        uint32_t _audioOverruns;
+        uint32_t _audioUnderruns;
+        uint32_t _framesSent;
+        uint32_t _framesReceived;
+        uint32_t _frameErrors;
+        uint32_t _framesDropped;
+    };
+}
+
+#endif //_MODEMSTAGE_H_
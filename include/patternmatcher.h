@@ -0,0 +1,103 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _PATTERNMATCHER_H_
+#define _PATTERNMATCHER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <initializer_list>
+
+namespace StegoPhone {
+    // Streaming multi-pattern matcher (Aho-Corasick compiled to a DFA over byte classes). The table
+    // is built once; scanning is one class lookup and one table lookup per byte, whatever the
+    // number or length of patterns, and needs no history of the stream.
+    //
+    // A match is reported on the byte that completes a pattern. If several patterns end on the same
+    // byte the longest wins; if one pattern is a prefix of another ("ERR" / "ERROR") the shorter
+    // completes first, so keep such pairs in separate sets.
+    //
+    // The table is fixed size (a little over 800 bytes); build long lived matchers once.
+    class PatternMatcher {
+    public:
+        static const uint8_t MaxPatterns = 8;
+        static const uint8_t MaxStates = 32;
+        static const uint8_t MaxClasses = 16;
+        static const int NoMatch = -1;
+
+        PatternMatcher(const char *pattern);
+
+        PatternMatcher(std::initializer_list<const char *> patterns);
+
+        PatternMatcher(const char *const *patterns, uint8_t count);
+
+        // false if the patterns exceeded the fixed limits; such a matcher never matches
+        bool valid() const;
+
+        uint8_t patterns() const;
+
+        const char *pattern(int index) const;
+
+        size_t patternLength(int index) const;
+
+        // DFA interface, for callers that keep their own cursor
+        inline uint8_t next(uint8_t state, uint8_t c) const {
+            return this->_delta[state][this->_classOf[c]];
+        }
+
+        inline int match(uint8_t state) const {
+            return this->_output[state];
+        }
+
+    protected:
+        void build(const char *const *patterns, uint8_t count);
+
+        bool _valid;
+        uint8_t _patternCount;
+        uint8_t _stateCount;
+        const char *_patterns[MaxPatterns];
+        uint8_t _patternLength[MaxPatterns];
+        uint8_t _classOf[256];
+        uint8_t _delta[MaxStates][MaxClasses];
+        int8_t _output[MaxStates];
+    };
+
+    // a cursor over a PatternMatcher
+    class PatternScanner {
+    public:
+        PatternScanner() : _matcher(0), _state(0) {
+        }
+
+        PatternScanner(const PatternMatcher &matcher) : _matcher(&matcher), _state(0) {
+        }
+
+        // returns the index of the pattern completed by this byte, or PatternMatcher::NoMatch
+        inline int feed(uint8_t c) {
+            this->_state = this->_matcher->next(this->_state, c);
+            return this->_matcher->match(this->_state);
+        }
+
+        inline void reset() {
+            this->_state = 0;
+        }
+
+        inline void reset(const PatternMatcher &matcher) {
+            this->_matcher = &matcher;
+            this->_state = 0;
+        }
+
+        inline const PatternMatcher &matcher() const {
+            return *this->_matcher;
+        }
+
+    protected:
+        const PatternMatcher *_matcher;
+        uint8_t _state;
+    };
+}
+
+#endif //_PATTERNMATCHER_H_
@@ -0,0 +1,143 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hal.h"
+
+// Hot path profiling. Build with -DSTEGOS_PROFILE=1 to record; otherwise STEGOS_PROFILE_SCOPE expands
+// to nothing and no histograms are compiled in.
+#ifndef STEGOS_PROFILE
+#define STEGOS_PROFILE 0
+#endif
+
+#if STEGOS_PROFILE && !defined(__IMXRT1062__)
+#include <chrono>
+#endif
+
+namespace StegoPhone {
+    enum class ProbeId : uint8_t {
+        Loop,        // StegoPhone::loop(), one UI pass
+        Draw,        // StegoPhone::drawDisplay()
+        Commit,      // StegoPhone::commitDisplay()
+        DisplaySend, // Compositor::send(), dirty spans to the panel
+        UsbPoll,     // StegoPhone::pollUSB(), usb.Task() and mouse reports
+        UsbCallback, // keyboard callbacks, inside usb.Task()
+        InputEvent,  // one queued input event handled
+        RN52,        // RN52::service(), responses and status
+        ESP8266,     // ESP8266::loop(), URCs, +IPD and responses
+        Count
+    };
+
+    struct ProbeStats {
+        uint32_t count;
+        uint32_t min; // ticks
+        uint32_t p50;
+        uint32_t p99;
+        uint32_t max;
+    };
+
+    // Fixed size histograms of scope durations, one per probe. Ticks are Cortex-M7 cycles (DWT CYCCNT,
+    // enabled by the Teensy core at boot) on target and nanoseconds of std::chrono::steady_clock on
+    // the host. Buckets are log scale with four steps per power of two, so a percentile is at most a
+    // quarter above the true value; min and max are exact.
+    //
+    // Recording is a handful of plain stores, not atomics: a probe belongs to one task (or ISR) at a
+    // time, which is how the firmware places them.
+    class Profile {
+    public:
+        static const uint8_t Buckets = 124; // 0..3, then four per power of two up to 2^32
+
+        static bool enabled();
+
+        static inline uint32_t ticks() {
+#if defined(__IMXRT1062__)
+            return *(volatile uint32_t *) 0xE0001004; // DWT->CYCCNT
+#elif STEGOS_PROFILE
+            return (uint32_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+            return 0;
+#endif
+        }
+
+        static uint32_t ticksPerMicrosecond();
+
+        static inline uint8_t bucket(uint32_t ticks) {
+            if (ticks < 4) return (uint8_t) ticks;
+            const uint8_t msb = (uint8_t) (31 - __builtin_clz(ticks));
+            return (uint8_t) (((msb - 1) << 2) | ((ticks >> (msb - 2)) & 3));
+        }
+
+        // largest tick count that falls in bucket
+        static uint32_t bucketLimit(uint8_t bucket);
+
+#if STEGOS_PROFILE
+        static inline void record(ProbeId id, uint32_t ticks) {
+            Histogram &histogram = _histograms[(uint8_t) id];
+            histogram.buckets[bucket(ticks)]++;
+            if (histogram.count == 0 || ticks < histogram.min) histogram.min = ticks;
+            if (ticks > histogram.max) histogram.max = ticks;
+            histogram.count++;
+        }
+#endif
+
+        // false when the probe has no samples (or profiling is compiled out)
+        static bool stats(ProbeId id, ProbeStats &stats);
+
+        static void reset();
+
+        static const char *name(ProbeId id);
+
+        // console "prof [reset]"
+        static void consoleCommand(void *context, HAL::SerialPort &out, const char *args);
+
+#if STEGOS_PROFILE
+    protected:
+        struct Histogram {
+            uint32_t count;
+            uint32_t min;
+            uint32_t max;
+            uint32_t buckets[Buckets];
+        };
+
+        static Histogram _histograms[(uint8_t) ProbeId::Count];
+#endif
+    };
+
+#if STEGOS_PROFILE
+    // times its own lifetime into the probe's histogram
+    class ProfileScope {
+    public:
+        inline ProfileScope(ProbeId id) : _id(id), _start(Profile::ticks()) {
+        }
+
+        inline ~ProfileScope() {
+            Profile::record(this->_id, Profile::ticks() - this->_start);
+        }
+
+    protected:
+        ProbeId _id;
+        uint32_t _start;
+    };
+#endif
+}
+
+#define STEGOS_PROFILE_CONCAT2(a, b) a##b
+#define STEGOS_PROFILE_CONCAT(a, b) STEGOS_PROFILE_CONCAT2(a, b)
+
+#if STEGOS_PROFILE
+#define STEGOS_PROFILE_SCOPE(id) \
+    ::StegoPhone::ProfileScope STEGOS_PROFILE_CONCAT(stegosProfileScope, __LINE__)(::StegoPhone::ProbeId::id)
+#else
+#define STEGOS_PROFILE_SCOPE(id) ((void) 0)
+#endif
+
+#endif //_PROFILE_H_
@@ -0,0 +1,64 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _REEDSOLOMON_H_
+#define _REEDSOLOMON_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Reed-Solomon codes over GF(256) (x^8 + x^4 + x^3 + x^2 + 1, generator 2), systematic, generator
+// roots 2^0 .. 2^(parity - 1), shortened to any length up to 255. Multiplication goes through log and
+// antilog tables the compiler builds. A codeword is read and corrected where it lies, every stride-th
+// byte of a buffer, so codewords interleaved byte by byte in one frame need no copying.
+namespace StegoPhone {
+    namespace Fec {
+        // log/antilog tables; exp is doubled so exp[log a + log b] needs no reduction
+        struct GaloisTables {
+            uint8_t exp[512];
+            uint8_t log[256]; // log[0] unused
+        };
+
+        extern const GaloisTables Galois;
+
+        inline uint8_t multiply(uint8_t a, uint8_t b) {
+            return (a && b) ? Galois.exp[Galois.log[a] + Galois.log[b]] : 0;
+        }
+
+        // a / b for b non zero
+        inline uint8_t divide(uint8_t a, uint8_t b) {
+            return a ? Galois.exp[Galois.log[a] + 255 - Galois.log[b]] : 0;
+        }
+
+        class ReedSolomon {
+        public:
+            static const uint8_t MaxParity = 32;
+            static const uint16_t MaxLength = 255;
+
+            // parity symbols per codeword, 1..MaxParity; up to parity / 2 symbol errors are corrected
+            explicit ReedSolomon(uint8_t parity = MaxParity);
+
+            bool setParity(uint8_t parity);
+
+            uint8_t parity() const;
+
+            // count symbols at data[0], data[stride], ...: the first count - parity() the message, the
+            // last parity() filled in. count from parity() to MaxLength.
+            void encode(uint8_t *data, uint16_t count, uint16_t stride = 1) const;
+
+            // corrects the codeword in place: the number of symbols corrected, or -1 (data untouched)
+            // when there are more errors than the code can correct and it could tell
+            int16_t decode(uint8_t *data, uint16_t count, uint16_t stride = 1) const;
+
+        protected:
+            uint8_t _parity;
+            uint8_t _generator[MaxParity + 1]; // g(x), highest power first, g[0] = 1
+        };
+    }
+}
+
+#endif //_REEDSOLOMON_H_
@@ -0,0 +1,166 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _RESAMPLER_H_
+#define _RESAMPLER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "dsp.h"
+
+namespace StegoPhone {
+    namespace DSP {
+        // compile time filter design: just enough math in constexpr to fill a table without libm
+        namespace Design {
+            constexpr double Pi = 3.14159265358979323846;
+
+            constexpr double sine(double x) {
+                while (x > Pi)
+                    x -= 2 * Pi;
+                while (x < -Pi)
+                    x += 2 * Pi;
+                double term = x;
+                double sum = x;
+                for (int i = 1; i < 16; i++) {
+                    term *= -x * x / ((2 * i) * (2 * i + 1));
+                    sum += term;
+                }
+                return sum;
+            }
+
+            constexpr double squareRoot(double x) {
+                if (x <= 0) return 0;
+                double root = x < 1 ? 1 : x;
+                for (int i = 0; i < 64; i++)
+                    root = (root + x / root) / 2;
+                return root;
+            }
+
+            // modified Bessel function of the first kind, order zero
+            constexpr double besselI0(double x) {
+                double term = 1;
+                double sum = 1;
+                for (int k = 1; k < 32; k++) {
+                    term *= (x / (2 * k)) * (x / (2 * k));
+                    sum += term;
+                }
+                return sum;
+            }
+
+            constexpr int16_t toQ15(double value) {
+                const double scaled = value * 32768 + (value >= 0 ? 0.5 : -0.5);
+                return (int16_t) (scaled > 32767 ? 32767 : (scaled < -32768 ? -32768 : scaled));
+            }
+        }
+
+        // Q15 coefficients of a polyphase filter bank, one row per phase, each row time reversed so it
+        // lines up with a FIR style mirrored delay line (oldest sample first)
+        template<uint16_t Phases, uint16_t Taps>
+        struct PolyphaseTable {
+            int16_t coefficients[Phases][Taps];
+        };
+
+        // Kaiser windowed sinc prototype of Up * Taps taps at the upsampled rate, cut off just below the
+        // lower of the two Nyquist rates and scaled by Up so every phase has unity gain at DC
+        template<uint16_t Up, uint16_t Down, uint16_t Taps>
+        constexpr PolyphaseTable<Up, Taps> designPolyphase(double beta, double passFraction) {
+            PolyphaseTable<Up, Taps> table = {};
+            const uint16_t length = Up * Taps;
+            const double cutoff = passFraction * 0.5 / (Up > Down ? Up : Down); // cycles per upsampled sample
+            const double centre = (length - 1) / 2.0;
+            const double windowScale = 1 / Design::besselI0(beta);
+            double prototype[Up * Taps] = {};
+            double sum = 0;
+            for (uint16_t i = 0; i < length; i++) {
+                const double t = i - centre;
+                const double sinc = t == 0 ? 2 * cutoff : Design::sine(2 * Design::Pi * cutoff * t) / (Design::Pi * t);
+                const double r = t / centre;
+                prototype[i] = sinc * Design::besselI0(beta * Design::squareRoot(1 - r * r)) * windowScale;
+                sum += prototype[i];
+            }
+            for (uint16_t phase = 0; phase < Up; phase++) {
+                for (uint16_t j = 0; j < Taps; j++)
+                    table.coefficients[phase][j] = Design::toQ15(prototype[phase + (Taps - 1 - j) * Up] * Up / sum);
+            }
+            return table;
+        }
+
+        // Streaming rational resampler by Up / Down on Q15 blocks. Each input sample goes into a mirrored
+        // delay line of Taps (as Fir does); each output is one dotQ15 of that window against the phase
+        // row for its position, so there is no zero stuffing and no work on discarded samples. The phase
+        // carries across process() calls: cutting a stream into blocks of any size gives the same output.
+        //
+        //     out = saturate16((dotQ15(window, row) + 2^14) >> 15)
+        //
+        // The table is a constexpr static: built by the compiler, in flash on the Teensy.
+        template<uint16_t Up, uint16_t Down, uint16_t Taps = 24>
+        class Resampler {
+        public:
+            static const uint16_t Phases = Up;
+
+            // input samples of delay through the filter
+            static constexpr double DelayInputSamples = (Up * Taps - 1) / 2.0 / Up;
+
+            static constexpr PolyphaseTable<Up, Taps> Table = designPolyphase<Up, Down, Taps>(7.0, 0.9);
+
+            Resampler() {
+                this->reset();
+            }
+
+            void reset() {
+                memset(this->_history, 0, sizeof(this->_history));
+                this->_position = 0;
+                this->_phase = 0;
+            }
+
+            // most outputs count inputs can produce
+            static constexpr size_t maxOutput(size_t count) {
+                return (count * Up + Down - 1) / Down + 1;
+            }
+
+            // returns the number of samples written to out, which must hold maxOutput(count)
+            size_t process(const int16_t *in, size_t count, int16_t *out) {
+                size_t produced = 0;
+                uint32_t phase = this->_phase;
+                for (size_t i = 0; i < count; i++) {
+                    this->_history[this->_position] = in[i];
+                    this->_history[this->_position + Taps] = in[i];
+                    if (++this->_position == Taps) this->_position = 0;
+                    const int16_t *window = &this->_history[this->_position];
+                    for (; phase < Up; phase += Down) {
+                        const int64_t sum = dotQ15(window, Table.coefficients[phase], Taps);
+                        out[produced++] = saturate16((int32_t) ((sum + (1 << 14)) >> 15));
+                    }
+                    phase -= Up;
+                }
+                this->_phase = phase;
+                return produced;
+            }
+
+        protected:
+            int16_t _history[2 * Taps];
+            uint16_t _position; // oldest sample in the window
+            uint32_t _phase;    // next output's phase, Up or more when it waits for another input
+        };
+
+        template<uint16_t Up, uint16_t Down, uint16_t Taps>
+        constexpr PolyphaseTable<Up, Taps> Resampler<Up, Down, Taps>::Table;
+
+        template<uint16_t Up, uint16_t Down, uint16_t Taps>
+        constexpr double Resampler<Up, Down, Taps>::DelayInputSamples;
+
+        // Bluetooth HFP voice (CVSD 8 kHz, mSBC 16 kHz) to and from the modem's 9600/s
+        typedef Resampler<6, 5> Sco8kToModem;
+        typedef Resampler<5, 6> ModemToSco8k;
+        typedef Resampler<3, 5> Sco16kToModem;
+        typedef Resampler<5, 3> ModemToSco16k;
+    }
+}
+
+#endif //_RESAMPLER_H_
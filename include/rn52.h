@@ -8,8 +8,14 @@
 #ifndef _RN52_H_
 #define _RN52_H_
 
-#include <Arduino.h>
+#include <stdint.h>
+#include "hal.h"
 #include "linebuffer.h"
+#include "commandqueue.h"
+#include "rn52command.h"
+#include "trace.h"
+#include "rtos.h"
+#include "taskmanager.h"
 
 namespace StegoPhone {
     enum class RN52Status {
@@ -20,14 +26,39 @@ namespace StegoPhone {
 
     class RN52 {
     public:
+        // event task: poll period while a command is in flight / while idle
+        static const uint32_t BusyPollMs = 1;
+        static const uint32_t IdlePollMs = 20;
+        static const uint16_t EventTaskStackWords = 512;
+
         static RN52 *getInstance();
 
 
         bool setup();
 
+        // polled mode: service commands and pending events; leave alone once the event task runs
         void loop();
 
-        void receiveLine(char *line);
+        // EVENT TASK
+        //================================================================================================
+        // the interrupt wakes a dedicated task that owns the RN52 (commands, status, unsolicited lines)
+        bool startEventTask(uint8_t priority);
+
+        void stopEventTask();
+
+        bool eventTaskRunning();
+
+        uint32_t interruptCount();
+
+        // interrupt to updateStatus(), last and worst
+        uint32_t interruptLatencyMicros();
+
+        uint32_t maxInterruptLatencyMicros();
+
+        // console "rn52"
+        static void consoleCommand(void *context, HAL::SerialPort &out, const char *args);
+
+        void receiveLine(LineView line);
 
         RN52Status status();
 
@@ -35,14 +66,29 @@ namespace StegoPhone {
 
         void rn52Command(const char *cmd);
 
-        bool rn52Exec(const char *cmd, char *buf, const int bufferSize, const char *match, const int interDelay = 100, const int timeout = 500);
+        // queue a command; the callback runs from loop() once the terminator arrives or on timeout
+        bool submit(const char *cmd, const PatternMatcher &terminators, CommandCallback callback, void *context,
+                    uint32_t timeoutMs = RN52Command::DefaultTimeoutMs);
+
+        // queue a "Q"; the result lands in statusWord()
+        void requestStatus();
 
-        unsigned short rn52Status(char *hexArray);
+        uint16_t statusWord();
+
+        uint32_t statusUpdates();
+
+        CommandQueue *commands();
 
         bool ExceptionOccurred();
 
+        // blocks until the RN52 has booted into command mode, up to RN52Command::BootTimeoutMs
         bool Enable();
 
+        // the same without blocking, for other tasks: setup() and power up happen on whatever services the
+        // RN52, its event task or loop(); status() is Present once the banner has arrived, Error after
+        // RN52Command::BootTimeoutMs without it
+        void requestPowerUp();
+
         bool Disable();
 
         bool Enabled();
@@ -66,17 +112,44 @@ namespace StegoPhone {
 
         RN52();
 
+        static void statusReceived(void *context, const CommandResponse &response);
+
+        static void eventStep(void *context, uint32_t notifications);
+
+        void service(bool event);
+
+        bool powerUp();
+
+        // Offline until the banner arrives or RN52Command::BootTimeoutMs passes, then as enabled() left it
+        RN52Status checkPowerUp();
+
+        // the banner arrived (matched) or did not: interrupt and settings dump, or powered down again
+        bool enabled(bool matched);
+
         bool exceptionOccurred = false;
         LineBuffer *_lineBuffer;
-        RN52Status _status;
+        CommandQueue *_commands;
+        uint16_t _statusWord;
+        uint32_t _statusUpdates;
+        volatile RN52Status _status; // read by other tasks
         bool _enabled;
         bool _cmd;
+        volatile bool _powerUpRequested;
+        bool _poweringUp;
+        volatile bool _bannerSeen;  // "CMD" as a line while powering up
+        uint32_t _powerUpMillis;
 
         // ISR/MODIFIED
         //================================================================================================
         static void intRN52Update();
 
-        volatile bool interruptOccurred; // updated by ISR if RN52 has an event
+        volatile bool interruptOccurred; // updated by ISR if RN52 has an event (polled mode)
+        volatile bool _interruptPending; // set by ISR, cleared by updateStatus()
+        volatile uint32_t _interruptMicros;
+        volatile uint32_t _interruptCount;
+        ManagedTask *volatile _eventTask;
+        uint32_t _interruptLatencyMicros;
+        uint32_t _maxInterruptLatencyMicros;
     };
 }
 
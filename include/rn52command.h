@@ -8,4 +8,39 @@
 #ifndef _RN52COMMAND_H_
 #define _RN52COMMAND_H_
 
-#endif //_RN52COMMAND_H_
\ No newline at end of file
+#include <stdint.h>
+#include "patternmatcher.h"
+
+namespace StegoPhone {
+    namespace RN52Command {
+        // ASCII command set (RN52 user guide), sent with a "\n" line ending
+        constexpr const char *DumpSettings = "D";
+        constexpr const char *QueryStatus = "Q";
+        constexpr const char *Version = "V";
+
+        // response terminators
+        constexpr const char *CmdBanner = "CMD\r\n";
+        constexpr const char *DumpEnd = "END\r\n";
+        constexpr const char *LineEnd = "\r\n";
+        constexpr const char *Ack = "AOK\r\n";
+        constexpr const char *Error = "ERR\r\n";
+        constexpr const char *Unknown = "?\r\n";
+
+        constexpr const char *LineEnding = "\n";
+
+        constexpr uint32_t DefaultTimeoutMs = 500;
+        constexpr uint32_t BootTimeoutMs = 5000;
+
+        // prebuilt terminator sets for CommandQueue
+        const PatternMatcher &cmdBanner();
+
+        const PatternMatcher &dumpEnd();
+
+        const PatternMatcher &lineEnd();
+
+        // Ack (0), Error (1) or Unknown (2)
+        const PatternMatcher &ackOrError();
+    }
+}
+
+#endif //_RN52COMMAND_H_
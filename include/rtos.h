@@ -0,0 +1,75 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _RTOS_H_
+#define _RTOS_H_
+
+#include <stdint.h>
+
+// The slice of FreeRTOS the firmware uses. The teensy40 env maps it onto FreeRTOS-Teensy4 in
+// src/rtos_teensy.cpp. The native env emulates it in src/sim/sim_rtos.cpp: every task is a thread,
+// but only one holds the CPU at a time and switches happen only when it blocks or yields
+// (highest priority ready task first), and when every task is blocked the simulated clock skips
+// ahead to the next timeout.
+
+namespace StegoPhone {
+    namespace RTOS {
+        typedef void (*TaskFunction)(void *arg);
+        typedef void *TaskHandle;
+
+        static const uint32_t WaitForever = 0xFFFFFFFF;
+        static const uint32_t StackUnknown = 0xFFFFFFFF;
+
+        // TASKS
+        //================================================================================================
+        // stackWords as for xTaskCreate; higher priority runs first
+        bool createTask(TaskFunction function, const char *name, uint16_t stackWords, void *arg, uint8_t priority,
+                        TaskHandle *handle = 0);
+
+        void deleteTask(TaskHandle task);
+
+        // target: never returns. native: the calling thread becomes a priority 1 task and returns
+        void startScheduler();
+
+        bool schedulerStarted();
+
+        TaskHandle currentTask();
+
+        void delay(uint32_t ms);
+
+        // RTOS ticks since the scheduler started (xTaskGetTickCount); 1ms each on the host
+        uint32_t tickCount();
+
+        // sleep until periodMs after lastWake, a tickCount(), and move lastWake on to it (vTaskDelayUntil).
+        // false, without sleeping, if that time had already passed
+        bool delayUntil(uint32_t &lastWake, uint32_t periodMs);
+
+        void yield();
+
+        // fewest stack words ever left free (uxTaskGetStackHighWaterMark); StackUnknown on the host,
+        // where tasks run on host sized thread stacks
+        uint32_t stackUnusedWords(TaskHandle task);
+
+        // a few instructions no other task or ISR may come between (taskENTER_CRITICAL); they do not nest
+        // across tasks and must not block
+        void enterCritical();
+
+        void exitCritical();
+
+        // NOTIFICATIONS
+        //================================================================================================
+        // counting direct-to-task notification (xTaskNotifyGive / ulTaskNotifyTake)
+        void notify(TaskHandle task);
+
+        void notifyFromISR(TaskHandle task);
+
+        // block until notified or timeoutMs passes; returns the count taken (0 on timeout) and clears it
+        uint32_t waitNotify(uint32_t timeoutMs = WaitForever);
+    }
+}
+
+#endif //_RTOS_H_
@@ -0,0 +1,81 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _SPSCRING_H_
+#define _SPSCRING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+namespace StegoPhone {
+    // Bounded single producer, single consumer ring of Capacity (a power of two) slots: InputQueue's
+    // events, the modem's audio blocks and frame lists. Small values go through push()/pop(); large ones
+    // are filled and read in place through writeSlot()/commitWrite() and readSlot()/commitRead().
+    template<typename T, uint32_t Capacity>
+    class SpscRing {
+        static_assert((Capacity & (Capacity - 1)) == 0, "ring capacity must be a power of two");
+
+    public:
+        SpscRing() : _head(0), _tail(0) {
+        }
+
+        // PRODUCER
+        //================================================================================================
+        // the slot to fill next, or 0 when full
+        T *writeSlot() {
+            const uint32_t head = this->_head.load(std::memory_order_relaxed);
+            if (head - this->_tail.load(std::memory_order_acquire) >= Capacity) return 0;
+            return &this->_slots[head & (Capacity - 1)];
+        }
+
+        void commitWrite() {
+            this->_head.store(this->_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        bool push(const T &value) {
+            T *slot = this->writeSlot();
+            if (!slot) return false;
+            *slot = value;
+            this->commitWrite();
+            return true;
+        }
+
+        // CONSUMER
+        //================================================================================================
+        // the oldest slot, or 0 when empty
+        T *readSlot() {
+            const uint32_t tail = this->_tail.load(std::memory_order_relaxed);
+            if (tail == this->_head.load(std::memory_order_acquire)) return 0;
+            return &this->_slots[tail & (Capacity - 1)];
+        }
+
+        void commitRead() {
+            this->_tail.store(this->_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        bool pop(T &value) {
+            T *slot = this->readSlot();
+            if (!slot) return false;
+            value = *slot;
+            this->commitRead();
+            return true;
+        }
+
+        // either side; a snapshot
+        uint32_t size() const {
+            return this->_head.load(std::memory_order_acquire) - this->_tail.load(std::memory_order_acquire);
+        }
+
+    protected:
+        T _slots[Capacity];
+        std::atomic<uint32_t> _head; // free running, producer
+        std::atomic<uint32_t> _tail; // free running, consumer
+    };
+}
+
+#endif //_SPSCRING_H_
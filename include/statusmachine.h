@@ -0,0 +1,208 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _STATUSMACHINE_H_
+#define _STATUSMACHINE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "hal.h"
+
+namespace StegoPhone {
+    enum class StegoStatus : uint8_t {
+        Offline,
+        InitializationStart,
+        InitializationFailure,
+        DisplayInitialized,
+        InputInitialized,
+        PhoneBTInitialized,
+        HeadsetBTInitialized,
+        Ready,
+        CallIncoming,
+        IncomingRinging,
+        CallConnected,
+        QuietModemAnnouncing,
+        QuietModemHandshaking,
+        QuietModemConnected,
+        CallPINSending,
+        CallPINSynchronized,
+        ModemInitializing,
+        ModemHandshaking,
+        EncryptionHandshaking,
+        EncryptedDataEstablished,
+        EncryptedVoice
+    };
+
+    static const uint8_t StatusCount = (uint8_t) StegoStatus::EncryptedVoice + 1;
+
+    // what moves the status along: boot steps from setup(), the rest seen by loop() as the RN52 call
+    // state, the modem link and the key agreement change
+    enum class StegoEvent : uint8_t {
+        Boot,
+        DisplayUp,
+        PhoneBTUp,
+        InputUp,
+        BootDone,
+        BootFailed,
+        CallRinging,          // RN52: incoming call
+        CallActive,           // RN52: a call has audio
+        CallEnded,            // RN52: no call
+        ModemAnnouncing,
+        ModemPeerHeard,
+        ModemConnected,
+        ModemStopped,
+        KeyAgreementStarted,
+        KeyAgreed,
+        KeyAgreementFailed,
+        KeyAgreementStopped,
+        Timeout               // the state's timeout ran out
+    };
+
+    static const uint8_t EventCount = (uint8_t) StegoEvent::Timeout + 1;
+
+    const char *statusName(StegoStatus status);
+
+    const char *eventName(StegoEvent event);
+
+    // runs between leaving one state and entering the next; it must not dispatch
+    typedef void (*StatusAction)(void *context);
+
+    // one row of a transition table: (from, event) -> (action, to, timeout). A timeout arms when the
+    // row enters its state; 0 for none.
+    struct StatusTransition {
+        StegoStatus from;
+        StegoEvent event;
+        StegoStatus to;
+        uint32_t timeoutMs;
+        StatusAction action;
+    };
+
+    // (state, event) -> row index, NoTransition where the table has no row
+    struct StatusDispatch {
+        static const uint8_t NoTransition = 0xff;
+
+        uint8_t row[StatusCount][EventCount];
+    };
+
+    // the dispatch index of a constexpr table, built by the compiler
+    template<size_t Count>
+    constexpr StatusDispatch buildDispatch(const StatusTransition (&rows)[Count]) {
+        static_assert(Count < StatusDispatch::NoTransition, "transition table too long for its index");
+        StatusDispatch dispatch = {};
+        for (uint8_t s = 0; s < StatusCount; s++) {
+            for (uint8_t e = 0; e < EventCount; e++)
+                dispatch.row[s][e] = StatusDispatch::NoTransition;
+        }
+        for (size_t i = 0; i < Count; i++)
+            dispatch.row[(uint8_t) rows[i].from][(uint8_t) rows[i].event] = (uint8_t) i;
+        return dispatch;
+    }
+
+    // for a static_assert next to the table: no (state, event) pair twice
+    template<size_t Count>
+    constexpr bool transitionsUnique(const StatusTransition (&rows)[Count]) {
+        for (size_t i = 0; i < Count; i++) {
+            for (size_t j = i + 1; j < Count; j++) {
+                if (rows[i].from == rows[j].from && rows[i].event == rows[j].event) return false;
+            }
+        }
+        return true;
+    }
+
+    // StegoStatus driven by a compile time transition table: dispatch() is one lookup in the
+    // StatusDispatch index, poll() fires Timeout once the current state's timeout runs out, and every
+    // transition goes into a ring of the last TraceDepth, stamped in microseconds. Events with no row
+    // for the current state are counted and otherwise ignored.
+    //
+    // The time from entering one state of a call to entering another is kept per SetupPhase (last
+    // and worst), so call set up can be read phase by phase.
+    //
+    // Threads: one task (the UI task) dispatches and polls.
+    class StatusMachine {
+    public:
+        static const uint8_t TraceDepth = 16;
+
+        enum class SetupPhase : uint8_t {
+            Answer,     // ringing to connected
+            Modem,      // connected to the quiet modem link up
+            Keys,       // link up to encrypted data
+            Total,      // connected to encrypted data
+            Count
+        };
+
+        struct TraceEntry {
+            uint32_t micros;
+            StegoStatus from;
+            StegoEvent event;
+            StegoStatus to;
+        };
+
+        struct PhaseStats {
+            uint32_t count;
+            uint32_t lastMicros;
+            uint32_t maxMicros;
+        };
+
+        StatusMachine(const StatusTransition *rows, const StatusDispatch &dispatch, void *context,
+                      StegoStatus initial = StegoStatus::Offline);
+
+        StegoStatus status() const;
+
+        // false (and counted as ignored) when the table has no row for the event in this state
+        bool dispatch(StegoEvent event, uint32_t nowMicros);
+
+        // Timeout once the state's timeout has run out; true when one fired
+        bool poll(uint32_t nowMicros);
+
+        // time in the current state
+        uint32_t stateMicros(uint32_t nowMicros) const;
+
+        // STATS
+        //================================================================================================
+        uint32_t transitions() const;
+
+        uint32_t ignored() const;
+
+        uint32_t timeouts() const;
+
+        // back from the latest transition (0); false past what the ring holds
+        bool recent(uint8_t back, TraceEntry &entry) const;
+
+        const PhaseStats &phase(SetupPhase phase) const;
+
+        static const char *phaseName(SetupPhase phase);
+
+        void resetStats();
+
+        // console "state [reset]"; context is the machine
+        static void consoleCommand(void *context, HAL::SerialPort &out, const char *args);
+
+    protected:
+        void enter(const StatusTransition &row, uint32_t nowMicros);
+
+        const StatusTransition *_rows;
+        const StatusDispatch &_dispatch;
+        void *_context;
+        StegoStatus _status;
+        uint32_t _enteredMicros;
+        bool _timing;
+        uint32_t _deadlineMicros;
+
+        // this call's entries into each state, for the set up phases
+        uint32_t _callEntered;  // bit per StegoStatus
+        uint32_t _callMicros[StatusCount];
+
+        uint32_t _transitions;
+        uint32_t _ignored;
+        uint32_t _timeouts;
+        TraceEntry _trace[TraceDepth];
+        PhaseStats _phases[(uint8_t) SetupPhase::Count];
+    };
+}
+
+#endif //_STATUSMACHINE_H_
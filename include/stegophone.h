@@ -8,93 +8,156 @@
 #ifndef _STEGOPHONE_H_
 #define _STEGOPHONE_H_
 
-#define U8G2_16BIT 1
-
-#include <Arduino.h>
+#include <stdint.h>
 #include <vector>
-#include <map>
-#include <string>
-
-#include <U8g2lib.h>
-#include <SPI.h>
-#include <Wire.h>
-#include <TimeLib.h>
-
-#include "SdFat.h"
-#include "sdios.h"
-#include "FreeStack.h"
-#include "ExFatlib\ExFatLib.h"
-#include "USBHost_t36.h"
-
-#define SD_CONFIG SdioConfig(DMA_SDIO)
 
+#include "hal.h"
 #include "rn52.h"
+#include "esp8266.h"
+#include "compositor.h"
+#include "inputqueue.h"
+#include "rtos.h"
+#include "taskmanager.h"
+#include "modemstage.h"
+#include "framecipher.h"
+#include "keyexchange.h"
+#include "jitterbuffer.h"
+#include "framefec.h"
+#include "statusmachine.h"
+#include "timerwheel.h"
+#include "bootsequence.h"
 
-namespace StegoPhone {
-    enum class StegoStatus {
-        Offline,
-        InitializationStart,
-        InitializationFailure,
-        DisplayInitialized,
-        InputInitialized,
-        PhoneBTInitialized,
-        HeadsetBTInitialized,
-        Ready,
-        CallIncoming,
-        IncomingRinging,
-        CallConnected,
-        QuietModemAnnouncing,
-        QuietModemHandshaking,
-        QuietModemConnected,
-        CallPINSending,
-        CallPINSynchronized,
-        ModemInitializing,
-        ModemHandshaking,
-        EncryptionHandshaking,
-        EncryptedDataEstablished,
-        EncryptedVoice
-    };
+// 1: the OLED is on hardware SPI (SCK 13, MOSI 11) and frames go out by DMA; the user LED, also on 13, is
+// not driven. 0: the original wiring on OLED_CLK_Pin/OLED_SDA_Pin, bit-banged.
+#ifndef STEGOS_DISPLAY_DMA
+#define STEGOS_DISPLAY_DMA 0
+#endif
 
+namespace StegoPhone {
     class StegoPhone {
     public:
         // PIN DEFINITIONS
         //================================================================================================
-        static const byte rn52ENPin = 2;          // active high
-        static const byte rn52CMDPin = 3;         // active low
-        static const byte rn52SPISel = 4;         //
-        static const byte rn52InterruptPin = 30;  // input no pull, active low 100ms
-        static const byte userLEDPin = 13;        //
-        static const byte OLED_CLK_Pin = 16;      //
-        static const byte OLED_SDA_Pin = 17;      //
-        static const byte OLED_CS_Pin = 10;       //
-        static const byte OLED_DC_Pin = 9;        //
-        static const byte OLED_RESET_Pin = 33;    //
+        static const uint8_t rn52ENPin = 2;          // active high
+        static const uint8_t rn52CMDPin = 3;         // active low
+        static const uint8_t rn52SPISel = 4;         //
+        static const uint8_t rn52InterruptPin = 30;  // input no pull, active low 100ms
+        static const uint8_t userLEDPin = 13;        // SCK with STEGOS_DISPLAY_DMA: left to the display
+        static const uint8_t OLED_CLK_Pin = 16;      //
+        static const uint8_t OLED_SDA_Pin = 17;      //
+        static const uint8_t OLED_CS_Pin = 10;       //
+        static const uint8_t OLED_DC_Pin = 9;        //
+        static const uint8_t OLED_RESET_Pin = 33;    //
 
         static const int ConsoleSerialRate = 9600;
         static const int ESP8266SerialRate = 115200;
         static const int RN52SerialRate = 115200;
 
-        static usb_serial_class ConsoleSerial;
-        static HardwareSerial ESP8266Serial;
-        static HardwareSerial RN52Serial;
+        static HAL::SerialPort &ConsoleSerial;
+        static HAL::SerialPort &ESP8266Serial;
+        static HAL::SerialPort &RN52Serial;
 
+        // STATUS
         //================================================================================================
-        static bool recFind(HardwareSerial serialPort, String target, uint32_t timeout);
+        static const uint32_t RingTimeoutMs = 60000;          // ringing with no word from the RN52
+        static const uint32_t PeerTimeoutMs = 30000;          // announcing to a far end that never answers
+        static const uint32_t KeyAgreementTimeoutMs = 10000;
+        static const uint32_t KeyShareIntervalMs = 1000;      // our public key again, until the peer's comes
+
+        // a fresh ephemeral secret for the key exchange, on the modem connecting; our public key goes to
+        // the peer in a KeyShare frame once it is computed
+        void startKeyAgreement();
 
         StegoStatus status();
 
+        // the status and its transition table; "state" on the console
+        StatusMachine *statusMachine();
+
+        // from setup() until the boot has finished or failed; loop() leaves the display to it
+        bool booting();
+
         static StegoPhone *getInstance();
 
+        // starts the boot sequence on a timer; setup() returns at once and the steps run from the wheel
         void setup();
 
+        // one UI pass: input events, RN52 status, console, frame commit. Polls USB itself unless the
+        // USB task runs.
         void loop();
 
+        // BOOT
+        //================================================================================================
+        static const uint32_t BootPollMs = 1;
+        // the display, SD card and USB host inits block, each on a task of its own below the timers
+        static const uint8_t BootJobPriority = 1;
+
+        // the boot steps, their dependencies and timeline; "boot" on the console
+        BootSequence *bootSequence();
+
+        // the steps of the boot table; context is the StegoPhone
+        static BootStepResult bootPorts(void *context, bool first);
+
+        static BootStepResult bootDisplay(void *context, bool first);
+
+        static BootStepResult bootRN52(void *context, bool first);
+
+        static BootStepResult bootESP8266(void *context, bool first);
+
+        static BootStepResult bootStorage(void *context, bool first);
+
+        static BootStepResult bootUSB(void *context, bool first);
+
+        static BootStepResult bootLogo(void *context, bool first);
+
+        // TASKS
+        //================================================================================================
+        static const uint32_t USBPollMs = 2;
+        static const uint32_t UIIdleMs = 500; // UI pass with no input to wake it
+        static const uint16_t UITaskStackWords = 512;
+        static const uint16_t USBTaskStackWords = 256;
+
+        // USB polling task (producer) and the UI task (consumer) it wakes when input is queued
+        bool startTasks(uint8_t uiPriority, uint8_t usbPriority);
+
+        void stopTasks();
+
+        // one USB pass: callbacks and mouse reports into the input queue
+        void pollUSB();
+
+        // handle everything queued so far; returns the number of events handled
+        uint32_t handleInput();
+
+        InputQueue *input();
+
+        // one shot and periodic timers; "timers" on the console
+        TimerWheel *timers();
+
+        // call audio modem; "modem" on the console
+        ModemStage *modem();
+
+        // sealing and opening of data frames once a session key is agreed; "aead" on the console
+        FrameCipher *cipher();
+
+        // ephemeral X25519 agreement that keys the cipher; "keyx" on the console
+        KeyExchange *keyExchange();
+
+        // playout of received voice frames; "jitter" on the console
+        JitterBuffer *jitterBuffer();
+
+        // forward error correction of data frames; "fec" on the console
+        FrameFec *fec();
+
         bool displayLogo();
 
-        void drawDisplay(u8g2_int_t x, u8g2_int_t y, const uint64_t data, bool send, bool clear);
-        void drawDisplay(u8g2_int_t x, u8g2_int_t y, const char data, bool send, bool clear);
-        void drawDisplay(u8g2_int_t x, u8g2_int_t y, const char* data, bool send, bool clear);
-        void drawDisplay(u8g2_int_t x, u8g2_int_t y, const std::vector<char*> data, bool send, bool clear);
+        void drawDisplay(int16_t x, int16_t y, const uint64_t data, bool send, bool clear);
+        void drawDisplay(int16_t x, int16_t y, const char data, bool send, bool clear);
+        void drawDisplay(int16_t x, int16_t y, const char* data, bool send, bool clear);
+        void drawDisplay(int16_t x, int16_t y, const std::vector<char*> data, bool send, bool clear);
+
+        // send what changed since the last frame, at most once per frame interval unless forced
+        bool commitDisplay(bool force = false);
+
+        Compositor *compositor();
 
         // Built-In LED
         //================================================================================================
@@ -102,6 +165,7 @@ namespace StegoPhone {
 
         void toggleUserLED();
 
+        // toggle every interval ms from a timer from now on; returns at once
         void blinkForever(int interval = 1000);
 
     protected:
@@ -113,19 +177,76 @@ namespace StegoPhone {
 
         // HARDWARE HANDLES
         //================================================================================================
-        static U8G2_SSD1322_NHD_256X64_F_4W_SW_SPI display;
+        static HAL::Display &display;
+
+        // BOOT
+        //================================================================================================
+        // one boot sequence pass, then the status events it has reached
+        static void bootStep(void *context);
+
+        void observeBoot();
 
-        static SdExFat sd;
-        static USBHost usb;
-        static KeyboardController keyboard;
-        static MouseController mouse;
+        // the blocking halves of the display, SD and USB steps, run as BootJobs
+        static bool initDisplay(void *context);
+
+        static bool initStorage(void *context);
+
+        static bool initUSB(void *context);
+
+        static void blinkStep(void *context);
 
         // Internal
         //================================================================================================
         StegoPhone();
 
-        StegoStatus _status;
+        StatusMachine *_status;
         static StegoPhone *_instance;
+        uint32_t _rn52StatusUpdates; // last RN52 status drawn
+        Compositor *_compositor;
+        InputQueue *_input;
+        ModemPhy *_modemPhy;
+        ModemStage *_modem;
+        FrameCipher *_cipher;
+        KeyExchange *_keyExchange;
+        JitterBuffer *_jitter;
+        FrameFec *_fec;
+        TimerWheel *_timers;
+        BootSequence *_boot;
+        Timer _bootTimer;
+        BootJob _displayJob;
+        BootJob _storageJob;
+        BootJob _usbJob;
+        Timer _blinkTimer;
+        ManagedTask *_uiTask;
+        ManagedTask *_usbTask;
+
+        // last event seen from each source; loop() dispatches only the changes
+        StegoEvent _callEvent;
+        StegoEvent _linkEvent;
+        StegoEvent _keyEvent;
+
+        // our KeyShare frames: whether one is owed, and when the last went out
+        bool _keyShareDue;
+        uint32_t _keyShareMillis;
+
+        // the RN52 call state, modem link and key agreement as they are now, as events
+        void observeCall(uint16_t statusWord);
+
+        void observeLink();
+
+        void observeKeys();
+
+        // KeyShare frames both ways between the modem and the key exchange
+        void shareKeys();
+
+        void observe(StegoEvent &last, StegoEvent now);
+
+        static void uiStep(void *context, uint32_t notifications);
+        static void usbStep(void *context, uint32_t notifications);
+
+        void handleKey(int unicode);
+        void handleConsumer(uint32_t top, uint16_t usage);
+        void handleMouse(const InputEvent &event);
 
         static void OnUSBKeyboardPress(int unicode);
         static void OnUSBKeyboardHIDExtrasPress(uint32_t top, uint16_t key);
@@ -0,0 +1,117 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _TASKMANAGER_H_
+#define _TASKMANAGER_H_
+
+#include <stdint.h>
+#include "hal.h"
+#include "rtos.h"
+
+namespace StegoPhone {
+    enum class TaskTrigger : uint8_t {
+        Periodic, // a step every periodMs, counted from the start of the previous step
+        Event     // a step per notify(), or after periodMs without one (RTOS::WaitForever: never)
+    };
+
+    // one pass of a task's work; notifications is the count taken before it (0 for periodic tasks)
+    typedef void (*TaskStep)(void *context, uint32_t notifications);
+
+    // what a subsystem declares for its task; name must outlive it
+    struct TaskSpec {
+        const char *name;
+        uint8_t priority;
+        uint16_t stackWords;
+        TaskTrigger trigger;
+        uint32_t periodMs;
+        TaskStep step;
+        void *context;
+    };
+
+    struct TaskStats {
+        uint32_t steps;
+        uint32_t lastStepMicros;
+        uint32_t maxStepMicros;
+        uint32_t overruns;      // periodic steps longer than the period
+        uint64_t busyMicros;    // summed step time
+        uint32_t stackUnusedWords;
+    };
+
+    // A task run by the TaskManager: steps first when created, then as its trigger says.
+    class ManagedTask {
+    public:
+        const TaskSpec &spec() const;
+
+        RTOS::TaskHandle handle() const;
+
+        void notify();
+
+        void notifyFromISR();
+
+        // change the period / event timeout; takes effect after the current step
+        void setPeriod(uint32_t periodMs);
+
+        TaskStats stats() const;
+
+    protected:
+        friend class TaskManager;
+
+        TaskSpec _spec;
+        RTOS::TaskHandle _handle;
+        volatile uint32_t _periodMs;
+        bool _used;
+
+        uint32_t _steps;
+        uint32_t _lastStepMicros;
+        uint32_t _maxStepMicros;
+        uint32_t _overruns;
+        uint64_t _busyMicros;
+    };
+
+    // Owns every long running task. Subsystems hand it a TaskSpec instead of writing their own wait
+    // loops, and it keeps per task step counts, time per step and stack headroom for the console.
+    //
+    // Step time is measured around the step with HAL::micros(), so it includes time spent preempted
+    // by higher priority tasks; CPU share is summed step time over time since the stats were reset.
+    class TaskManager {
+    public:
+        // the firmware's nine, and the three boot jobs while they run
+        static const uint8_t MaxTasks = 12;
+
+        static TaskManager *getInstance();
+
+        // 0 if the table is full or the task could not be created
+        ManagedTask *start(const TaskSpec &spec);
+
+        // delete the task; the caller makes sure it is not half way through something that matters
+        void stop(ManagedTask *task);
+
+        uint8_t count() const;
+
+        ManagedTask *find(const char *name);
+
+        // CPU share since then, in tenths of a percent
+        uint32_t cpuPermille(const ManagedTask *task) const;
+
+        void resetStats();
+
+        // console "tasks [reset]"
+        static void consoleCommand(void *context, HAL::SerialPort &out, const char *args);
+
+    protected:
+        static TaskManager *_instance;
+
+        TaskManager();
+
+        static void run(void *arg);
+
+        ManagedTask _tasks[MaxTasks];
+        uint32_t _statsSince;
+    };
+}
+
+#endif //_TASKMANAGER_H_
@@ -0,0 +1,147 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _TIMERWHEEL_H_
+#define _TIMERWHEEL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "hal.h"
+#include "taskmanager.h"
+
+namespace StegoPhone {
+    typedef void (*TimerCallback)(void *context);
+
+    // a one shot or periodic timer; the caller owns it and it lives as long as it is armed
+    class Timer {
+    public:
+        explicit Timer(TimerCallback callback = 0, void *context = 0);
+
+        void setCallback(TimerCallback callback, void *context);
+
+        bool armed() const;
+
+    protected:
+        friend class TimerWheel;
+
+        TimerCallback _callback;
+        void *_context;
+        Timer *_next;
+        Timer **_link;          // whatever points at this one, 0 while unarmed
+        uint64_t _expiry;       // tick
+        uint32_t _periodMs;     // 0: one shot
+    };
+
+    // Hierarchical timer wheel, 1ms ticks: Levels wheels of Slots slots, each slot of a level spanning a
+    // whole turn of the one below. A timer goes into the slot its expiry falls in at the finest level
+    // that reaches that far, so arm() and cancel() are a list insert and unlink; as the finest wheel
+    // comes round, the next slot up is cascaded down into it. Past the top (about 4.6 hours) a timer
+    // waits in the top level's last slot and is placed again as it comes round.
+    //
+    // advance() runs every callback due by then, in expiry order tick by tick, each outside the wheel's
+    // critical section, so a callback may arm or cancel any timer, itself included. How late each
+    // fired against its expiry is kept for the console.
+    //
+    // Threads: arm()/cancel() from any task; advance() from one, normally the wheel's own task, which
+    // sleeps until the next timer is due and is woken when an earlier one is armed.
+    class TimerWheel {
+    public:
+        static const uint8_t Levels = 4;
+        static const uint8_t SlotBits = 6;
+        static const uint16_t Slots = 1 << SlotBits;
+        static const uint16_t TaskStackWords = 768;  // boot steps bring up the RN52 and draw the logo
+        // the task's longest sleep with nothing armed, well inside half a micros() wrap (35 minutes)
+        static const uint32_t IdleWakeMs = 60000;
+
+        explicit TimerWheel(uint32_t nowMicros);
+
+        // due delayMs after nowMicros (the clock advance() is given), then every periodMs if that is not
+        // 0; arming an armed timer moves it. The wheel's clock catches up to nowMicros, so a timer armed
+        // after a long sleep is not counted from the last advance().
+        void arm(Timer *timer, uint32_t delayMs, uint32_t periodMs, uint32_t nowMicros);
+
+        // false when it was not armed
+        bool cancel(Timer *timer);
+
+        // run everything due by nowMicros; returns the number of callbacks run
+        uint32_t advance(uint32_t nowMicros);
+
+        // ms from the last advance() to the next tick that may have work (a due timer or a cascade),
+        // RTOS::WaitForever with nothing armed
+        uint32_t msUntilNext() const;
+
+        uint32_t armedCount() const;
+
+        // SERVICE TASK
+        //================================================================================================
+        // an event task that advances the wheel and sleeps until msUntilNext()
+        bool startTask(uint8_t priority);
+
+        void stopTask();
+
+        bool taskRunning() const;
+
+        // STATS
+        //================================================================================================
+        uint32_t fired() const;
+
+        // expiry to callback, over everything fired
+        uint32_t lastLateMicros() const;
+
+        uint32_t meanLateMicros() const;
+
+        uint32_t maxLateMicros() const;
+
+        // callbacks that ran LateMicros or more after their expiry
+        static const uint32_t LateMicros = 2000;
+
+        uint32_t late() const;
+
+        // ticks advanced and timers moved down a level
+        uint32_t ticks() const;
+
+        uint32_t cascaded() const;
+
+        void resetStats();
+
+        // console "timers [reset]"; context is the wheel
+        static void consoleCommand(void *context, HAL::SerialPort &out, const char *args);
+
+    protected:
+        static void taskStep(void *context, uint32_t notifications);
+
+        // into its slot; the caller holds the critical section
+        void place(Timer *timer);
+
+        void link(Timer *timer, Timer **slot);
+
+        void unlink(Timer *timer);
+
+        void cascade(uint8_t level);
+
+        // the clock forward to nowMicros, never back; the caller holds the critical section
+        void catchUp(uint32_t nowMicros);
+
+        ManagedTask *volatile _task;
+        Timer *_slots[Levels][Slots];
+        uint64_t _tick;         // last tick advanced through
+        uint64_t _micros;       // time since construction, as far as advance() and arm() have seen
+        uint32_t _lastMicros;   // the clock at the last advance() or arm()
+        uint32_t _armed;
+
+        uint32_t _fired;
+        uint32_t _lastLateMicros;
+        uint64_t _totalLateMicros;
+        uint32_t _maxLateMicros;
+        uint32_t _late;
+        uint32_t _ticks;
+        uint32_t _cascaded;
+    };
+}
+
+#endif //_TIMERWHEEL_H_
@@ -0,0 +1,123 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hal.h"
+
+// Deferred binary trace of serial traffic. Build with -DSTEGOS_TRACE=1 to record; otherwise the
+// STEGOS_TRACE_* macros expand to nothing and the ring is not compiled in.
+#ifndef STEGOS_TRACE
+#define STEGOS_TRACE 0
+#endif
+
+// records kept, power of two (8 bytes each)
+#ifndef STEGOS_TRACE_CAPACITY
+#define STEGOS_TRACE_CAPACITY 2048
+#endif
+
+#if STEGOS_TRACE
+#include <atomic>
+#endif
+
+namespace StegoPhone {
+    enum class TraceChannel : uint8_t {
+        Unknown,
+        RN52,
+        ESP8266
+    };
+
+    enum class TraceDirection : uint8_t {
+        Rx,
+        Tx
+    };
+
+    struct TraceRecord {
+        uint32_t micros;
+        TraceChannel channel;
+        TraceDirection direction;
+        uint8_t value;
+    };
+
+    // Lock-free multi-producer ring of timestamped bytes. Recording is a fetch_add and three stores,
+    // safe from tasks and ISRs alike; when the ring is full the oldest records are overwritten.
+    // Formatting happens later, in dump(), from a single consumer.
+    class Trace {
+    public:
+        static const uint32_t Capacity = STEGOS_TRACE_CAPACITY;
+
+        static bool enabled();
+
+#if STEGOS_TRACE
+        static inline void record(TraceChannel channel, TraceDirection direction, uint8_t value) {
+            const uint32_t index = _head.fetch_add(1, std::memory_order_relaxed);
+            Slot &slot = _slots[index & (Capacity - 1)];
+            slot.word.store(Busy, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.micros.store(HAL::micros(), std::memory_order_relaxed);
+            slot.word.store(pack(index, channel, direction, value), std::memory_order_release);
+        }
+
+        static void record(TraceChannel channel, TraceDirection direction, const uint8_t *data, size_t length);
+#endif
+
+        // copy out the oldest undumped record; false when there is none
+        static bool next(TraceRecord &record);
+
+        // format undumped records to out, oldest first, grouped into hex/ascii lines per channel;
+        // returns the number of records printed
+        static uint32_t dump(HAL::SerialPort &out, uint32_t maxRecords = 0xFFFFFFFF);
+
+        // forget undumped records
+        static void clear();
+
+        static uint32_t recorded();
+
+        // overwritten before they were dumped
+        static uint32_t lost();
+
+        static const char *channelName(TraceChannel channel);
+
+        // console "trace [clear|stats]"
+        static void consoleCommand(void *context, HAL::SerialPort &out, const char *args);
+
+#if STEGOS_TRACE
+    protected:
+        static const uint32_t Busy = 0xFFFFFFFF;
+
+        // word: index (low 16 bits) << 16 | channel << 9 | direction << 8 | value
+        struct Slot {
+            std::atomic<uint32_t> word;
+            std::atomic<uint32_t> micros;
+        };
+
+        static inline uint32_t pack(uint32_t index, TraceChannel channel, TraceDirection direction, uint8_t value) {
+            return (index << 16) | ((uint32_t) channel << 9) | ((uint32_t) direction << 8) | value;
+        }
+
+        static Slot _slots[Capacity];
+        static std::atomic<uint32_t> _head;
+        static uint32_t _cursor;
+        static uint32_t _lost;
+#endif
+    };
+}
+
+#if STEGOS_TRACE
+#define STEGOS_TRACE_BYTE(channel, direction, value) \
+    ::StegoPhone::Trace::record(channel, direction, (uint8_t) (value))
+#define STEGOS_TRACE_BYTES(channel, direction, data, length) \
+    ::StegoPhone::Trace::record(channel, direction, (const uint8_t *) (data), length)
+#else
+#define STEGOS_TRACE_BYTE(channel, direction, value) ((void) 0)
+#define STEGOS_TRACE_BYTES(channel, direction, data, length) ((void) 0)
+#endif
+
+#endif //_TRACE_H_
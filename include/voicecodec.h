@@ -0,0 +1,129 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _VOICECODEC_H_
+#define _VOICECODEC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace StegoPhone {
+    enum class VoiceMode : uint8_t {
+        Bits3200, // 20ms frames of 64 bits: finer spectrum, a gain per 10ms
+        Bits2400, // 20ms frames of 48 bits
+        Bits1200  // 40ms frames of 48 bits
+    };
+
+    struct VoiceModeInfo {
+        uint16_t bitRate;
+        uint16_t frameSamples; // at VoiceSampleRate
+        uint8_t frameBytes;
+        uint8_t frameMs;
+    };
+
+    static const uint32_t VoiceSampleRate = 8000;
+
+    const VoiceModeInfo &voiceModeInfo(VoiceMode mode);
+
+    // the parameters a frame carries, as the decoder sees them
+    struct VoiceParams {
+        static const uint8_t Order = 10;
+
+        uint8_t lag;            // pitch period in samples, 0 for an unvoiced frame
+        uint16_t rms[2];        // pre-emphasised speech level, per half frame (the same twice below 3200)
+        int16_t lar[Order];     // log area ratios, Q14
+    };
+
+    // LPC vocoder in the line of LPC-10, at 1200-3200 bit/s for voice over the call modem (EncryptedVoice).
+    // Per frame the encoder sends a 10th order spectral envelope as quantised log area ratios, a pitch
+    // period or unvoiced, and the level; the decoder drives a lattice synthesis filter with a pulse
+    // train or noise, interpolating the parameters every 5ms so frame edges do not click.
+    //
+    // 8 kHz mono in Q15, which is what the SCO link carries (resampler.h for the modem's rate). Fixed
+    // point throughout, bit for bit the same on the Teensy and the host; fixed frames, all state in the
+    // objects, nothing allocated.
+    class VoiceEncoder {
+    public:
+        static const uint16_t MaxFrameSamples = 320;
+        static const uint8_t MaxFrameBytes = 8;
+        static const uint8_t MinLag = 20;   // 400 Hz
+        static const uint8_t MaxLag = 146;  // 55 Hz
+        static const uint8_t WindowLead = 80; // samples of the previous frame in the LPC window
+
+        explicit VoiceEncoder(VoiceMode mode = VoiceMode::Bits2400);
+
+        // a new stream in this mode
+        void setMode(VoiceMode mode);
+
+        VoiceMode mode() const;
+
+        void reset();
+
+        // frameSamples in, frameBytes out
+        void encode(const int16_t *samples, uint8_t *bits);
+
+        // what the last frame was quantised to
+        const VoiceParams &lastParams() const;
+
+        // normalised pitch correlation of the last frame, Q15
+        int16_t lastVoicing() const;
+
+    protected:
+        void analyse(uint16_t frameSamples);
+
+        uint8_t searchPitch(uint16_t frameSamples);
+
+        VoiceMode _mode;
+        VoiceParams _params;
+        int16_t _voicing;
+        int16_t _previousInput;
+        int32_t _lowpass;
+        int16_t _speech[WindowLead + MaxFrameSamples]; // pre-emphasised
+        int16_t _pitch[MaxLag + MaxFrameSamples];      // low passed, for the pitch search
+        int16_t _windowed[WindowLead + MaxFrameSamples];
+        int16_t _reflection[VoiceParams::Order];       // Q15
+    };
+
+    class VoiceDecoder {
+    public:
+        static const uint8_t SubframeSamples = 40;
+        static const uint8_t ConcealFrames = 4; // lost frames faded over before silence
+
+        explicit VoiceDecoder(VoiceMode mode = VoiceMode::Bits2400);
+
+        void setMode(VoiceMode mode);
+
+        VoiceMode mode() const;
+
+        void reset();
+
+        // frameBytes in, frameSamples out
+        void decode(const uint8_t *bits, int16_t *samples);
+
+        // a frame in place of one that never came: the last parameters again at half the level each
+        // time, silence after ConcealFrames
+        void conceal(int16_t *samples);
+
+        const VoiceParams &lastParams() const;
+
+    protected:
+        // from the last frame's parameters to these, a subframe at a time
+        void synthesise(const VoiceParams &next, int16_t *samples);
+
+        int32_t excitation(uint8_t lag, uint32_t gain);
+
+        VoiceMode _mode;
+        VoiceParams _params;
+        uint8_t _lost;
+        int32_t _lattice[VoiceParams::Order];
+        uint16_t _pulseCountdown;
+        uint32_t _noise;
+        int16_t _deemphasis;
+    };
+}
+
+#endif //_VOICECODEC_H_
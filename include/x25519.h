@@ -0,0 +1,78 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _X25519_H_
+#define _X25519_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace StegoPhone {
+    namespace Crypto {
+        // X25519 (RFC 7748) as a job that can stop between steps. A scalar multiplication is
+        //
+        //     LadderSteps Montgomery ladder steps, one per scalar bit (10 multiplies/squares each)
+        //     InvertSteps steps of the inversion by Fermat (a square, most with a multiply)
+        //     one step for the last multiply and the encoding
+        //
+        // and step() runs as many as it is given, so the caller can hand the CPU back between slices
+        // and never hold it for a whole multiplication. Field elements are sixteen 16 bit limbs in
+        // int32_t, products summed in int64_t: every multiply is a 32x32->64 SMULL/SMLAL on the M7.
+        // The ladder swaps by mask and runs every step whatever the scalar; nothing branches or indexes
+        // on secret data.
+        class X25519 {
+        public:
+            static const uint8_t Bytes = 32;
+            static const uint16_t LadderSteps = 255;
+            static const uint16_t InvertSteps = 254;
+            static const uint16_t TotalSteps = LadderSteps + InvertSteps + 1;
+
+            // u = 9
+            static const uint8_t BasePoint[Bytes];
+
+            X25519();
+
+            ~X25519();
+
+            // a new multiplication of point by scalar (clamped here), both copied
+            void begin(const uint8_t *scalar, const uint8_t *point);
+
+            // up to steps more; true once the result is ready
+            bool step(uint16_t steps);
+
+            bool done() const;
+
+            uint16_t stepsLeft() const;
+
+            // the result's u coordinate; false when it is all zero (a small order point, RFC 7748 6.1)
+            bool result(uint8_t *out) const;
+
+            // wipe the scalar, the ladder and the result
+            void clear();
+
+            // the whole multiplication in one call
+            static bool compute(uint8_t *out, const uint8_t *scalar, const uint8_t *point);
+
+        protected:
+            typedef int32_t Field[16];
+
+            void ladderStep();
+
+            uint8_t _scalar[Bytes];
+            Field _x1;
+            Field _x2; // (x2 : z2) and (x3 : z3), swapped by the scalar's bits
+            Field _z2;
+            Field _x3;
+            Field _z3;
+            Field _inverse;
+            uint8_t _out[Bytes];
+            uint16_t _stepsDone;
+        };
+    }
+}
+
+#endif //_X25519_H_
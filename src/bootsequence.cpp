@@ -0,0 +1,253 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include <stdio.h>
+#include <string.h>
+#include "bootsequence.h"
+#include "rtos.h"
+
+namespace StegoPhone {
+    namespace {
+        const char *const StateNames[] = {"waiting", "running", "done", "FAILED", "skipped"};
+
+        const uint8_t TimelineColumns = 32;
+
+        // microseconds as ms with a tenth
+        void formatMs(char *buf, size_t size, uint32_t micros) {
+            snprintf(buf, size, "%lu.%lu", (unsigned long) (micros / 1000), (unsigned long) ((micros / 100) % 10));
+        }
+    }
+
+    const char *bootStepStateName(BootStepState state) {
+        return StateNames[(uint8_t) state];
+    }
+
+    BootSequence::BootSequence(const BootStep *steps, uint8_t count, void *context) {
+        this->_steps = steps;
+        this->_count = count > MaxSteps ? MaxSteps : count;
+        this->_context = context;
+        memset(this->_records, 0, sizeof(this->_records));
+        for (uint8_t i = 0; i < MaxSteps; i++)
+            this->_records[i].state = BootStepState::Waiting;
+        this->_finished = (this->_count == 0);
+        this->_started = false;
+        this->_startMicros = 0;
+        this->_endMicros = 0;
+        this->_passes = 0;
+    }
+
+    bool BootSequence::poll() {
+        if (this->_finished) return true;
+        const uint32_t now = HAL::micros();
+        if (!this->_started) {
+            this->_started = true;
+            this->_startMicros = now;
+        }
+        this->_passes++;
+
+        uint16_t done = 0, dead = 0;
+        for (uint8_t i = 0; i < this->_count; i++) {
+            const BootStepState state = this->_records[i].state;
+            if (state == BootStepState::Done) done |= bootAfter(i);
+            else if (state == BootStepState::Failed || state == BootStepState::Skipped) dead |= bootAfter(i);
+        }
+
+        // in table order, so a step whose dependencies finish in this pass starts in it too
+        for (uint8_t i = 0; i < this->_count; i++) {
+            const BootStep &step = this->_steps[i];
+            Record &record = this->_records[i];
+            if (record.state == BootStepState::Done || record.state == BootStepState::Failed ||
+                record.state == BootStepState::Skipped)
+                continue;
+            if (step.after & dead) {
+                record.state = BootStepState::Skipped;
+                record.start = record.end = HAL::micros() - this->_startMicros;
+                dead |= bootAfter(i);
+                continue;
+            }
+            if ((step.after & done) != step.after) continue;
+
+            const bool first = (record.state == BootStepState::Waiting);
+            const uint32_t callStart = HAL::micros();
+            if (first) {
+                record.state = BootStepState::Running;
+                record.start = callStart - this->_startMicros;
+            }
+            const BootStepResult result = step.run(this->_context, first);
+            const uint32_t callEnd = HAL::micros();
+            record.busy += callEnd - callStart;
+            if (result == BootStepResult::Pending) continue;
+
+            record.end = callEnd - this->_startMicros;
+            if (record.end > this->_endMicros) this->_endMicros = record.end;
+            if (result == BootStepResult::Done) {
+                record.state = BootStepState::Done;
+                done |= bootAfter(i);
+            } else {
+                record.state = BootStepState::Failed;
+                dead |= bootAfter(i);
+            }
+        }
+        bool finished = true;
+        for (uint8_t i = 0; i < this->_count && finished; i++)
+            finished = (this->_records[i].state != BootStepState::Running &&
+                        this->_records[i].state != BootStepState::Waiting);
+        this->_finished = finished;
+        return finished;
+    }
+
+    bool BootSequence::finished() const {
+        return this->_finished;
+    }
+
+    bool BootSequence::failed() const {
+        for (uint8_t i = 0; i < this->_count; i++) {
+            if (this->_records[i].state == BootStepState::Failed || this->_records[i].state == BootStepState::Skipped)
+                return true;
+        }
+        return false;
+    }
+
+    uint8_t BootSequence::firstFailure() const {
+        uint8_t first = this->_count;
+        for (uint8_t i = 0; i < this->_count; i++) {
+            if (this->_records[i].state != BootStepState::Failed) continue;
+            if (first == this->_count || this->_records[i].end < this->_records[first].end) first = i;
+        }
+        return first;
+    }
+
+    uint8_t BootSequence::count() const {
+        return this->_count;
+    }
+
+    const char *BootSequence::name(uint8_t step) const {
+        return step < this->_count ? this->_steps[step].name : "";
+    }
+
+    BootStepState BootSequence::state(uint8_t step) const {
+        return step < this->_count ? this->_records[step].state : BootStepState::Skipped;
+    }
+
+    bool BootSequence::done(uint8_t step) const {
+        return this->state(step) == BootStepState::Done;
+    }
+
+    uint32_t BootSequence::startMicros(uint8_t step) const {
+        return step < this->_count ? this->_records[step].start : 0;
+    }
+
+    uint32_t BootSequence::endMicros(uint8_t step) const {
+        return step < this->_count ? this->_records[step].end : 0;
+    }
+
+    uint32_t BootSequence::busyMicros(uint8_t step) const {
+        return step < this->_count ? this->_records[step].busy : 0;
+    }
+
+    uint32_t BootSequence::elapsedMicros() const {
+        if (!this->_started) return 0;
+        return this->_finished ? this->_endMicros : HAL::micros() - this->_startMicros;
+    }
+
+    uint32_t BootSequence::serialMicros() const {
+        uint32_t total = 0;
+        for (uint8_t i = 0; i < this->_count; i++) {
+            if (this->_records[i].state != BootStepState::Waiting && this->_records[i].state != BootStepState::Running)
+                total += this->_records[i].end - this->_records[i].start;
+        }
+        return total;
+    }
+
+    uint32_t BootSequence::passes() const {
+        return this->_passes;
+    }
+
+    void BootSequence::consoleCommand(void *context, HAL::SerialPort &out, const char *args) {
+        BootSequence *boot = (BootSequence *) context;
+        char elapsed[16], serial[16], line[128];
+        formatMs(elapsed, sizeof(elapsed), boot->elapsedMicros());
+        formatMs(serial, sizeof(serial), boot->serialMicros());
+        const uint8_t failure = boot->firstFailure();
+        snprintf(line, sizeof(line), "boot: %s %s ms, one after another %s ms, %lu passes%s%s",
+                 boot->_finished ? "finished in" : "running for", elapsed, serial, (unsigned long) boot->_passes,
+                 failure < boot->_count ? ", failed at " : "", failure < boot->_count ? boot->name(failure) : "");
+        out.println(line);
+        out.println("  step       start ms  took ms  busy ms  state");
+
+        // each step's span on a common scale, from the first poll() to the last step done
+        const uint32_t scale = boot->elapsedMicros() ? boot->elapsedMicros() : 1;
+        for (uint8_t i = 0; i < boot->_count; i++) {
+            const Record &record = boot->_records[i];
+            const bool open = (record.state == BootStepState::Running);
+            const uint32_t end = open ? boot->elapsedMicros() : record.end;
+            char start[16], took[16], busy[16], bar[TimelineColumns + 1];
+            formatMs(start, sizeof(start), record.start);
+            formatMs(took, sizeof(took), end - record.start);
+            formatMs(busy, sizeof(busy), record.busy);
+            memset(bar, ' ', TimelineColumns);
+            bar[TimelineColumns] = '\0';
+            if (record.state != BootStepState::Waiting && record.state != BootStepState::Skipped) {
+                uint32_t first = (uint32_t) ((uint64_t) record.start * TimelineColumns / scale);
+                uint32_t last = (uint32_t) ((uint64_t) end * TimelineColumns / scale);
+                if (first >= TimelineColumns) first = TimelineColumns - 1;
+                if (last >= TimelineColumns) last = TimelineColumns - 1;
+                for (uint32_t c = first; c <= last; c++)
+                    bar[c] = '#';
+            }
+            snprintf(line, sizeof(line), "  %-10s %8s %8s %8s  %-8s|%s|", boot->name(i), start, took, busy,
+                     bootStepStateName(record.state), bar);
+            out.println(line);
+        }
+    }
+
+    // BOOT JOB
+    //================================================================================================
+    BootJob::BootJob() {
+        this->_task = 0;
+        this->_function = 0;
+        this->_context = 0;
+        this->_result = BootStepResult::Pending;
+    }
+
+    BootJob::~BootJob() {
+        if (this->_task) TaskManager::getInstance()->stop(this->_task);
+    }
+
+    void BootJob::start(const char *name, uint8_t priority, Function function, void *context) {
+        this->_function = function;
+        this->_context = context;
+        this->_result = BootStepResult::Pending;
+        if (RTOS::schedulerStarted()) {
+            // an event task steps once as it starts, then waits for a notification that never comes
+            const TaskSpec spec = {name, priority, TaskStackWords, TaskTrigger::Event, RTOS::WaitForever,
+                                   BootJob::taskStep, this};
+            this->_task = TaskManager::getInstance()->start(spec);
+            if (this->_task) return;
+        }
+        BootJob::taskStep(this, 0);
+    }
+
+    BootStepResult BootJob::result() {
+        const BootStepResult result = this->_result;
+        if (result != BootStepResult::Pending && this->_task) {
+            TaskManager::getInstance()->stop(this->_task);
+            this->_task = 0;
+        }
+        return result;
+    }
+
+    bool BootJob::taskRunning() const {
+        return this->_task != 0;
+    }
+
+    void BootJob::taskStep(void *context, uint32_t notifications) {
+        BootJob *job = (BootJob *) context;
+        if (job->_result != BootStepResult::Pending || !job->_function) return;
+        job->_result = job->_function(job->_context) ? BootStepResult::Done : BootStepResult::Failed;
+    }
+}
@@ -0,0 +1,361 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include <string.h>
+#include "chacha20poly1305.h"
+
+namespace StegoPhone {
+    namespace Crypto {
+        namespace {
+            inline uint32_t load32(const uint8_t *bytes) {
+                return (uint32_t) bytes[0] | ((uint32_t) bytes[1] << 8) | ((uint32_t) bytes[2] << 16) |
+                       ((uint32_t) bytes[3] << 24);
+            }
+
+            inline void store32(uint8_t *bytes, uint32_t value) {
+                bytes[0] = (uint8_t) value;
+                bytes[1] = (uint8_t) (value >> 8);
+                bytes[2] = (uint8_t) (value >> 16);
+                bytes[3] = (uint8_t) (value >> 24);
+            }
+
+            inline void store64(uint8_t *bytes, uint64_t value) {
+                store32(bytes, (uint32_t) value);
+                store32(bytes + 4, (uint32_t) (value >> 32));
+            }
+
+            inline uint32_t rotate(uint32_t value, uint8_t bits) {
+                return (value << bits) | (value >> (32 - bits));
+            }
+
+#define STEGOS_QUARTER_ROUND(a, b, c, d) \
+            a += b; d = rotate(d ^ a, 16); \
+            c += d; b = rotate(b ^ c, 12); \
+            a += b; d = rotate(d ^ a, 8); \
+            c += d; b = rotate(b ^ c, 7)
+
+            // the 20 rounds, column then diagonal, over a copy of the state held in registers
+            inline void rounds(uint32_t *x) {
+                uint32_t x0 = x[0], x1 = x[1], x2 = x[2], x3 = x[3];
+                uint32_t x4 = x[4], x5 = x[5], x6 = x[6], x7 = x[7];
+                uint32_t x8 = x[8], x9 = x[9], x10 = x[10], x11 = x[11];
+                uint32_t x12 = x[12], x13 = x[13], x14 = x[14], x15 = x[15];
+                for (uint8_t round = 0; round < 10; round++) {
+                    STEGOS_QUARTER_ROUND(x0, x4, x8, x12);
+                    STEGOS_QUARTER_ROUND(x1, x5, x9, x13);
+                    STEGOS_QUARTER_ROUND(x2, x6, x10, x14);
+                    STEGOS_QUARTER_ROUND(x3, x7, x11, x15);
+                    STEGOS_QUARTER_ROUND(x0, x5, x10, x15);
+                    STEGOS_QUARTER_ROUND(x1, x6, x11, x12);
+                    STEGOS_QUARTER_ROUND(x2, x7, x8, x13);
+                    STEGOS_QUARTER_ROUND(x3, x4, x9, x14);
+                }
+                x[0] = x0; x[1] = x1; x[2] = x2; x[3] = x3;
+                x[4] = x4; x[5] = x5; x[6] = x6; x[7] = x7;
+                x[8] = x8; x[9] = x9; x[10] = x10; x[11] = x11;
+                x[12] = x12; x[13] = x13; x[14] = x14; x[15] = x15;
+            }
+
+            void setup(uint32_t *state, const uint8_t *key) {
+                // "expand 32-byte k"
+                state[0] = 0x61707865;
+                state[1] = 0x3320646e;
+                state[2] = 0x79622d32;
+                state[3] = 0x6b206574;
+                for (uint8_t i = 0; i < 8; i++)
+                    state[4 + i] = load32(key + 4 * i);
+            }
+
+            // one keystream block; the state's counter word moves on by one
+            void chachaBlock(uint32_t *state, uint8_t *out) {
+                uint32_t x[16];
+                memcpy(x, state, sizeof(x));
+                rounds(x);
+                for (uint8_t i = 0; i < 16; i++)
+                    store32(out + 4 * i, x[i] + state[i]);
+                state[12]++;
+            }
+
+#undef STEGOS_QUARTER_ROUND
+
+            // the AEAD's one time Poly1305 key is the first half of keystream block 0
+            void polyKey(const uint8_t *key, const uint8_t *nonce, uint8_t *out) {
+                ChaCha20 cipher(key, nonce, 0);
+                uint8_t block[ChaCha20::BlockBytes];
+                cipher.block(block);
+                memcpy(out, block, KeyBytes);
+                wipe(block, sizeof(block));
+            }
+
+            void authenticate(const uint8_t *polyKey, const uint8_t *aad, size_t aadLength,
+                              const uint8_t *data, size_t length, uint8_t *tag) {
+                Poly1305 mac(polyKey);
+                mac.update(aad, aadLength);
+                mac.pad();
+                mac.update(data, length);
+                mac.pad();
+                uint8_t lengths[16];
+                store64(lengths, aadLength);
+                store64(lengths + 8, length);
+                mac.update(lengths, sizeof(lengths));
+                mac.finish(tag);
+            }
+        }
+
+        // CHACHA20
+        //================================================================================================
+        ChaCha20::ChaCha20(const uint8_t *key, const uint8_t *nonce, uint32_t counter) {
+            setup(this->_state, key);
+            this->_state[12] = counter;
+            this->_state[13] = load32(nonce);
+            this->_state[14] = load32(nonce + 4);
+            this->_state[15] = load32(nonce + 8);
+            this->_used = BlockBytes;
+        }
+
+        ChaCha20::~ChaCha20() {
+            wipe(this->_state, sizeof(this->_state));
+            wipe(this->_keystream, sizeof(this->_keystream));
+        }
+
+        void ChaCha20::apply(uint8_t *data, size_t length) {
+            size_t i = 0;
+            // the rest of a block a previous call started
+            while (i < length && this->_used < BlockBytes)
+                data[i++] ^= this->_keystream[this->_used++];
+            // whole blocks, a word at a time
+            for (; i + BlockBytes <= length; i += BlockBytes) {
+                chachaBlock(this->_state, this->_keystream);
+                for (uint8_t j = 0; j < BlockBytes; j += 4)
+                    store32(data + i + j, load32(data + i + j) ^ load32(this->_keystream + j));
+            }
+            if (i < length) {
+                chachaBlock(this->_state, this->_keystream);
+                this->_used = 0;
+                while (i < length)
+                    data[i++] ^= this->_keystream[this->_used++];
+            }
+        }
+
+        void ChaCha20::block(uint8_t *out) {
+            chachaBlock(this->_state, out);
+            this->_used = BlockBytes;
+        }
+
+        void hchacha20(const uint8_t *key, const uint8_t *nonce, uint8_t *out) {
+            uint32_t x[16];
+            setup(x, key);
+            for (uint8_t i = 0; i < 4; i++)
+                x[12 + i] = load32(nonce + 4 * i);
+            rounds(x);
+            for (uint8_t i = 0; i < 4; i++) {
+                store32(out + 4 * i, x[i]);
+                store32(out + 16 + 4 * i, x[12 + i]);
+            }
+            wipe(x, sizeof(x));
+        }
+
+        // POLY1305
+        //================================================================================================
+        // h = (h + block + hibit * 2^128) * r mod 2^130 - 5, in five 26 bit limbs: 2^130 folds back in as 5,
+        // so the high products pick up r * 5 (s below) and every partial sum fits 64 bits
+        Poly1305::Poly1305(const uint8_t *key) {
+            // r clamped as the RFC requires
+            this->_r[0] = load32(key) & 0x3ffffff;
+            this->_r[1] = (load32(key + 3) >> 2) & 0x3ffff03;
+            this->_r[2] = (load32(key + 6) >> 4) & 0x3ffc0ff;
+            this->_r[3] = (load32(key + 9) >> 6) & 0x3f03fff;
+            this->_r[4] = (load32(key + 12) >> 8) & 0x00fffff;
+            for (uint8_t i = 0; i < 5; i++)
+                this->_h[i] = 0;
+            for (uint8_t i = 0; i < 4; i++)
+                this->_pad[i] = load32(key + 16 + 4 * i);
+            this->_buffered = 0;
+        }
+
+        Poly1305::~Poly1305() {
+            wipe(this->_r, sizeof(this->_r));
+            wipe(this->_h, sizeof(this->_h));
+            wipe(this->_pad, sizeof(this->_pad));
+            wipe(this->_buffer, sizeof(this->_buffer));
+        }
+
+        void Poly1305::blocks(const uint8_t *data, size_t length, uint32_t hibit) {
+            const uint32_t r0 = this->_r[0], r1 = this->_r[1], r2 = this->_r[2], r3 = this->_r[3], r4 = this->_r[4];
+            const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+            uint32_t h0 = this->_h[0], h1 = this->_h[1], h2 = this->_h[2], h3 = this->_h[3], h4 = this->_h[4];
+            for (; length >= 16; data += 16, length -= 16) {
+                h0 += load32(data) & 0x3ffffff;
+                h1 += (load32(data + 3) >> 2) & 0x3ffffff;
+                h2 += (load32(data + 6) >> 4) & 0x3ffffff;
+                h3 += (load32(data + 9) >> 6) & 0x3ffffff;
+                h4 += (load32(data + 12) >> 8) | hibit;
+
+                const uint64_t d0 = (uint64_t) h0 * r0 + (uint64_t) h1 * s4 + (uint64_t) h2 * s3 +
+                                    (uint64_t) h3 * s2 + (uint64_t) h4 * s1;
+                uint64_t d1 = (uint64_t) h0 * r1 + (uint64_t) h1 * r0 + (uint64_t) h2 * s4 +
+                              (uint64_t) h3 * s3 + (uint64_t) h4 * s2;
+                uint64_t d2 = (uint64_t) h0 * r2 + (uint64_t) h1 * r1 + (uint64_t) h2 * r0 +
+                              (uint64_t) h3 * s4 + (uint64_t) h4 * s3;
+                uint64_t d3 = (uint64_t) h0 * r3 + (uint64_t) h1 * r2 + (uint64_t) h2 * r1 +
+                              (uint64_t) h3 * r0 + (uint64_t) h4 * s4;
+                uint64_t d4 = (uint64_t) h0 * r4 + (uint64_t) h1 * r3 + (uint64_t) h2 * r2 +
+                              (uint64_t) h3 * r1 + (uint64_t) h4 * r0;
+
+                // partial carry: limbs end up just over 26 bits, which the next round absorbs
+                uint32_t carry = (uint32_t) (d0 >> 26);
+                h0 = (uint32_t) d0 & 0x3ffffff;
+                d1 += carry;
+                carry = (uint32_t) (d1 >> 26);
+                h1 = (uint32_t) d1 & 0x3ffffff;
+                d2 += carry;
+                carry = (uint32_t) (d2 >> 26);
+                h2 = (uint32_t) d2 & 0x3ffffff;
+                d3 += carry;
+                carry = (uint32_t) (d3 >> 26);
+                h3 = (uint32_t) d3 & 0x3ffffff;
+                d4 += carry;
+                carry = (uint32_t) (d4 >> 26);
+                h4 = (uint32_t) d4 & 0x3ffffff;
+                h0 += carry * 5;
+                carry = h0 >> 26;
+                h0 &= 0x3ffffff;
+                h1 += carry;
+            }
+            this->_h[0] = h0;
+            this->_h[1] = h1;
+            this->_h[2] = h2;
+            this->_h[3] = h3;
+            this->_h[4] = h4;
+        }
+
+        void Poly1305::update(const uint8_t *data, size_t length) {
+            if (this->_buffered) {
+                size_t take = 16 - this->_buffered;
+                if (take > length) take = length;
+                memcpy(this->_buffer + this->_buffered, data, take);
+                this->_buffered = (uint8_t) (this->_buffered + take);
+                data += take;
+                length -= take;
+                if (this->_buffered < 16) return;
+                this->blocks(this->_buffer, 16, 1 << 24);
+                this->_buffered = 0;
+            }
+            const size_t whole = length & ~(size_t) 15;
+            this->blocks(data, whole, 1 << 24);
+            memcpy(this->_buffer, data + whole, length - whole);
+            this->_buffered = (uint8_t) (length - whole);
+        }
+
+        void Poly1305::pad() {
+            if (!this->_buffered) return;
+            memset(this->_buffer + this->_buffered, 0, 16 - this->_buffered);
+            this->blocks(this->_buffer, 16, 1 << 24);
+            this->_buffered = 0;
+        }
+
+        void Poly1305::finish(uint8_t *tag) {
+            // a short last block carries its own 1 after the data instead of the 2^128 bit
+            if (this->_buffered) {
+                this->_buffer[this->_buffered] = 1;
+                memset(this->_buffer + this->_buffered + 1, 0, 15 - this->_buffered);
+                this->blocks(this->_buffer, 16, 0);
+                this->_buffered = 0;
+            }
+
+            uint32_t h0 = this->_h[0], h1 = this->_h[1], h2 = this->_h[2], h3 = this->_h[3], h4 = this->_h[4];
+            uint32_t carry = h1 >> 26;
+            h1 &= 0x3ffffff;
+            h2 += carry;
+            carry = h2 >> 26;
+            h2 &= 0x3ffffff;
+            h3 += carry;
+            carry = h3 >> 26;
+            h3 &= 0x3ffffff;
+            h4 += carry;
+            carry = h4 >> 26;
+            h4 &= 0x3ffffff;
+            h0 += carry * 5;
+            carry = h0 >> 26;
+            h0 &= 0x3ffffff;
+            h1 += carry;
+
+            // g = h - (2^130 - 5); take it when it did not go negative, without a branch
+            uint32_t g0 = h0 + 5;
+            carry = g0 >> 26;
+            g0 &= 0x3ffffff;
+            uint32_t g1 = h1 + carry;
+            carry = g1 >> 26;
+            g1 &= 0x3ffffff;
+            uint32_t g2 = h2 + carry;
+            carry = g2 >> 26;
+            g2 &= 0x3ffffff;
+            uint32_t g3 = h3 + carry;
+            carry = g3 >> 26;
+            g3 &= 0x3ffffff;
+            const uint32_t g4 = h4 + carry - (1 << 26);
+            const uint32_t keepG = (g4 >> 31) - 1;
+            h0 = (h0 & ~keepG) | (g0 & keepG);
+            h1 = (h1 & ~keepG) | (g1 & keepG);
+            h2 = (h2 & ~keepG) | (g2 & keepG);
+            h3 = (h3 & ~keepG) | (g3 & keepG);
+            h4 = (h4 & ~keepG) | (g4 & keepG);
+
+            // to 128 bits and add the pad, mod 2^128
+            const uint32_t w0 = h0 | (h1 << 26);
+            const uint32_t w1 = (h1 >> 6) | (h2 << 20);
+            const uint32_t w2 = (h2 >> 12) | (h3 << 14);
+            const uint32_t w3 = (h3 >> 18) | (h4 << 8);
+            uint64_t sum = (uint64_t) w0 + this->_pad[0];
+            store32(tag, (uint32_t) sum);
+            sum = (uint64_t) w1 + this->_pad[1] + (sum >> 32);
+            store32(tag + 4, (uint32_t) sum);
+            sum = (uint64_t) w2 + this->_pad[2] + (sum >> 32);
+            store32(tag + 8, (uint32_t) sum);
+            sum = (uint64_t) w3 + this->_pad[3] + (sum >> 32);
+            store32(tag + 12, (uint32_t) sum);
+        }
+
+        // AEAD
+        //================================================================================================
+        void seal(const uint8_t *key, const uint8_t *nonce, const uint8_t *aad, size_t aadLength,
+                  uint8_t *data, size_t length, uint8_t *tag) {
+            uint8_t macKey[KeyBytes];
+            polyKey(key, nonce, macKey);
+            ChaCha20 cipher(key, nonce, 1);
+            cipher.apply(data, length);
+            authenticate(macKey, aad, aadLength, data, length, tag);
+            wipe(macKey, sizeof(macKey));
+        }
+
+        bool open(const uint8_t *key, const uint8_t *nonce, const uint8_t *aad, size_t aadLength,
+                  uint8_t *data, size_t length, const uint8_t *tag) {
+            uint8_t macKey[KeyBytes];
+            uint8_t expected[TagBytes];
+            polyKey(key, nonce, macKey);
+            authenticate(macKey, aad, aadLength, data, length, expected);
+            wipe(macKey, sizeof(macKey));
+            if (!equal(expected, tag, TagBytes)) return false;
+            ChaCha20 cipher(key, nonce, 1);
+            cipher.apply(data, length);
+            return true;
+        }
+
+        bool equal(const uint8_t *a, const uint8_t *b, size_t length) {
+            uint8_t difference = 0;
+            for (size_t i = 0; i < length; i++)
+                difference |= a[i] ^ b[i];
+            return difference == 0;
+        }
+
+        void wipe(void *data, size_t length) {
+            volatile uint8_t *bytes = (volatile uint8_t *) data;
+            while (length--)
+                *bytes++ = 0;
+        }
+    }
+}
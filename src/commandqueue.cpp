@@ -0,0 +1,185 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include <string.h>
+#include "commandqueue.h"
+
+namespace StegoPhone {
+    CommandQueue::CommandQueue(HAL::SerialPort &serialPort, const char *lineEnding, LineBuffer *unsolicited,
+                               TraceChannel traceChannel) : _serialPort(serialPort) {
+        this->_lineEnding = lineEnding;
+        this->_unsolicited = unsolicited;
+        this->_traceChannel = traceChannel;
+        this->_head = 0;
+        this->_count = 0;
+        this->_state = State::Idle;
+        this->_sentMillis = 0;
+        this->_resyncMillis = 0;
+        this->_responseLength = 0;
+        this->_response[0] = '\0';
+        this->_completed = 0;
+        this->_timeouts = 0;
+        this->_discarded = 0;
+        this->_lastLatencyMicros = 0;
+        this->_maxLatencyMicros = 0;
+    }
+
+    bool CommandQueue::submit(const char *command, const PatternMatcher &terminators, uint32_t timeoutMs,
+                              CommandCallback callback, void *context) {
+        if (this->_count >= Depth) return false;
+        Entry &entry = this->_entries[(this->_head + this->_count) % Depth];
+        entry.hasCommand = (command != 0);
+        if (entry.hasCommand) {
+            const size_t length = strlen(command);
+            if (length >= MaxCommandLength) return false;
+            memcpy(entry.command, command, length + 1);
+        }
+        entry.terminators = &terminators;
+        entry.timeoutMs = timeoutMs;
+        entry.callback = callback;
+        entry.context = context;
+        entry.submittedMicros = HAL::micros();
+        this->_count++;
+        if (this->_state == State::Idle) this->start();
+        return true;
+    }
+
+    void CommandQueue::loop() {
+        while (this->_serialPort.available() > 0) {
+            const int c = this->_serialPort.read();
+            if (c < 0) break;
+            STEGOS_TRACE_BYTE(this->_traceChannel, TraceDirection::Rx, c);
+            this->receive((uint8_t) c);
+        }
+        this->expire();
+    }
+
+    void CommandQueue::receive(uint8_t c) {
+        if (this->_state == State::Resyncing) {
+            this->resync(c);
+            return;
+        }
+        if (this->_state != State::AwaitingResponse) {
+            if (this->_unsolicited) this->_unsolicited->push(c);
+            return;
+        }
+        if (this->_responseLength >= ResponseCapacity) {
+            // the byte that does not fit is dropped with the rest of its line
+            this->complete(CommandResult::Overflow, PatternMatcher::NoMatch);
+            if (this->_state == State::Resyncing) this->resync(c);
+            return;
+        }
+        this->_response[this->_responseLength++] = (char) c;
+        const int terminator = this->_scanner.feed(c);
+        if (terminator != PatternMatcher::NoMatch) this->complete(CommandResult::Matched, terminator);
+    }
+
+    void CommandQueue::expire() {
+        if ((this->_state == State::AwaitingResponse) &&
+            (HAL::millis() - this->_sentMillis >= this->_entries[this->_head].timeoutMs)) {
+            this->_timeouts++;
+            this->complete(CommandResult::Timeout, PatternMatcher::NoMatch);
+        }
+        // nothing more of the late response: carry on
+        if ((this->_state == State::Resyncing) && (HAL::millis() - this->_resyncMillis >= ResyncQuietMs))
+            this->start();
+    }
+
+    void CommandQueue::resync(uint8_t c) {
+        this->_discarded++;
+        this->_resyncMillis = HAL::millis();
+        if (c == '\n') this->start();
+    }
+
+    bool CommandQueue::idle() const {
+        return this->_state == State::Idle;
+    }
+
+    const char *CommandQueue::current() const {
+        if (this->_state != State::AwaitingResponse) return 0;
+        const Entry &entry = this->_entries[this->_head];
+        return entry.hasCommand ? entry.command : 0;
+    }
+
+    uint8_t CommandQueue::pending() const {
+        return this->_count;
+    }
+
+    void CommandQueue::clear() {
+        this->_count = 0;
+        this->_state = State::Idle;
+        this->_responseLength = 0;
+    }
+
+    void CommandQueue::start() {
+        if (this->_count == 0) {
+            this->_state = State::Idle;
+            return;
+        }
+        const Entry &entry = this->_entries[this->_head];
+        this->_responseLength = 0;
+        this->_scanner.reset(*entry.terminators);
+        this->_state = State::AwaitingResponse;
+        if (entry.hasCommand) {
+            this->_serialPort.write(entry.command);
+            this->_serialPort.write(this->_lineEnding);
+            STEGOS_TRACE_BYTES(this->_traceChannel, TraceDirection::Tx, entry.command, strlen(entry.command));
+            STEGOS_TRACE_BYTES(this->_traceChannel, TraceDirection::Tx, this->_lineEnding, strlen(this->_lineEnding));
+        }
+        this->_sentMillis = HAL::millis();
+    }
+
+    void CommandQueue::complete(CommandResult result, int terminator) {
+        const Entry entry = this->_entries[this->_head];
+        this->_head = (this->_head + 1) % Depth;
+        this->_count--;
+
+        const uint32_t latency = HAL::micros() - entry.submittedMicros;
+        this->_lastLatencyMicros = latency;
+        if (latency > this->_maxLatencyMicros) this->_maxLatencyMicros = latency;
+        this->_completed++;
+
+        // the callback sees the response before the next command can overwrite it; it may submit, and
+        // after a failure what it submits waits for the resync
+        this->_response[this->_responseLength] = '\0';
+        if (result == CommandResult::Matched) {
+            this->_state = State::Idle;
+        } else {
+            this->_state = State::Resyncing;
+            this->_resyncMillis = HAL::millis();
+        }
+        if (entry.callback) {
+            CommandResponse response;
+            response.result = result;
+            response.terminator = terminator;
+            response.data = this->_response;
+            response.length = this->_responseLength;
+            entry.callback(entry.context, response);
+        }
+        if (this->_state == State::Idle) this->start();
+    }
+
+    uint32_t CommandQueue::completed() const {
+        return this->_completed;
+    }
+
+    uint32_t CommandQueue::timeouts() const {
+        return this->_timeouts;
+    }
+
+    uint32_t CommandQueue::discarded() const {
+        return this->_discarded;
+    }
+
+    uint32_t CommandQueue::lastLatencyMicros() const {
+        return this->_lastLatencyMicros;
+    }
+
+    uint32_t CommandQueue::maxLatencyMicros() const {
+        return this->_maxLatencyMicros;
+    }
+}
@@ -0,0 +1,230 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include <string.h>
+#include "compositor.h"
+#include "profile.h"
+
+namespace StegoPhone {
+    Compositor::Compositor(HAL::Display &display, HAL::DisplayTransport &transport, uint32_t frameIntervalMicros)
+            : _display(display), _transport(transport) {
+        // the display starts cleared (HAL::Display::begin)
+        memset(this->_shadow, 0, sizeof(this->_shadow));
+        memset(this->_spanFirst, 0, sizeof(this->_spanFirst));
+        memset(this->_spanTiles, 0, sizeof(this->_spanTiles));
+        this->_frameIntervalMicros = frameIntervalMicros;
+        this->_lastFrameStart = HAL::micros() - frameIntervalMicros;
+        this->_requested = false;
+        this->_invalid = false;
+        this->_flushing = false;
+        this->_flushTask = 0;
+        this->_committer = 0;
+        this->_frames = 0;
+        this->_deferred = 0;
+        this->_busy = 0;
+        this->_bytesSent = 0;
+        this->_lastFrameBytes = 0;
+        this->_lastFrameMicros = 0;
+        this->_maxFrameMicros = 0;
+        this->_lastCommitMicros = 0;
+        this->_maxCommitMicros = 0;
+    }
+
+    void Compositor::request() {
+        this->_requested = true;
+    }
+
+    bool Compositor::commit() {
+        if (!this->_requested) return false;
+        if (HAL::micros() - this->_lastFrameStart < this->_frameIntervalMicros) {
+            this->_deferred++;
+            return false;
+        }
+        return this->flush();
+    }
+
+    bool Compositor::flush() {
+        // the shadow is still being sent; keep the request for a later tick
+        if (this->_flushing) {
+            this->_busy++;
+            this->_requested = true;
+            return false;
+        }
+        const uint32_t start = HAL::micros();
+        this->_requested = false;
+        uint8_t *buffer = this->_display.getBufferPtr();
+        uint32_t tilesChanged = 0;
+        for (uint8_t row = 0; row < HAL::Display::TileHeight; row++) {
+            const size_t rowOffset = (size_t) row * HAL::Display::Width;
+            int16_t first = -1;
+            int16_t last = -1;
+            for (uint8_t tile = 0; tile < HAL::Display::TileWidth; tile++) {
+                const size_t offset = rowOffset + (size_t) tile * TileBytes;
+                if (this->_invalid || memcmp(buffer + offset, this->_shadow + offset, TileBytes) != 0) {
+                    if (first < 0) first = tile;
+                    last = tile;
+                }
+            }
+            this->_spanTiles[row] = 0;
+            if (first < 0) continue;
+            const size_t offset = rowOffset + (size_t) first * TileBytes;
+            const size_t length = (size_t) (last - first + 1) * TileBytes;
+            memcpy(this->_shadow + offset, buffer + offset, length);
+            this->_spanFirst[row] = (uint8_t) first;
+            this->_spanTiles[row] = (uint8_t) (last - first + 1);
+            tilesChanged += (uint32_t) (last - first + 1);
+        }
+        this->_invalid = false;
+        if (tilesChanged == 0) return false;
+
+        this->_lastFrameStart = start;
+        this->_frames++;
+        this->_lastFrameBytes = tilesChanged * HAL::Display::PanelBytesPerTile;
+        this->_bytesSent += this->_lastFrameBytes;
+        if (this->_flushTask) {
+            this->_flushing = true;
+            this->_flushTask->notify();
+        } else {
+            this->send();
+        }
+        this->_lastCommitMicros = HAL::micros() - start;
+        if (this->_lastCommitMicros > this->_maxCommitMicros) this->_maxCommitMicros = this->_lastCommitMicros;
+        return true;
+    }
+
+    void Compositor::send() {
+        STEGOS_PROFILE_SCOPE(DisplaySend);
+        const uint32_t start = HAL::micros();
+        for (uint8_t row = 0; row < HAL::Display::TileHeight; row++)
+            if (this->_spanTiles[row])
+                this->_transport.sendTiles(this->_shadow, this->_spanFirst[row], row, this->_spanTiles[row]);
+        this->_lastFrameMicros = HAL::micros() - start;
+        if (this->_lastFrameMicros > this->_maxFrameMicros) this->_maxFrameMicros = this->_lastFrameMicros;
+    }
+
+    void Compositor::invalidate() {
+        this->_invalid = true;
+        this->_requested = true;
+    }
+
+    void Compositor::setFrameInterval(uint32_t frameIntervalMicros) {
+        this->_frameIntervalMicros = frameIntervalMicros;
+    }
+
+    uint32_t Compositor::msUntilDue() const {
+        if (!this->_requested || this->_flushing) return RTOS::WaitForever;
+        const uint32_t elapsed = HAL::micros() - this->_lastFrameStart;
+        if (elapsed + 1000 >= this->_frameIntervalMicros) return 1;
+        return (this->_frameIntervalMicros - elapsed + 999) / 1000;
+    }
+
+    void Compositor::setCommitter(ManagedTask *task) {
+        this->_committer = task;
+    }
+
+    // FLUSH TASK
+    //================================================================================================
+    bool Compositor::startFlushTask(uint8_t priority) {
+        if (this->_flushTask) return true;
+        const TaskSpec spec = {"display", priority, FlushTaskStackWords, TaskTrigger::Event, RTOS::WaitForever,
+                               Compositor::flushStep, this};
+        this->_flushTask = TaskManager::getInstance()->start(spec);
+        return this->_flushTask != 0;
+    }
+
+    void Compositor::stopFlushTask() {
+        if (!this->_flushTask) return;
+        // let the frame in flight finish so the panel matches the shadow
+        while (this->_flushing)
+            RTOS::delay(1);
+        ManagedTask *task = this->_flushTask;
+        this->_flushTask = 0;
+        TaskManager::getInstance()->stop(task);
+    }
+
+    bool Compositor::flushTaskRunning() {
+        return this->_flushTask != 0;
+    }
+
+    bool Compositor::flushing() const {
+        return this->_flushing;
+    }
+
+    void Compositor::flushStep(void *context, uint32_t notifications) {
+        Compositor *compositor = (Compositor *) context;
+        if (!compositor->_flushing) return;
+        compositor->send();
+        compositor->_flushing = false;
+        ManagedTask *committer = compositor->_committer;
+        if (committer && compositor->_requested) committer->notify();
+    }
+
+    // STATS
+    //================================================================================================
+    uint32_t Compositor::frames() const {
+        return this->_frames;
+    }
+
+    uint32_t Compositor::deferred() const {
+        return this->_deferred;
+    }
+
+    uint32_t Compositor::busy() const {
+        return this->_busy;
+    }
+
+    uint32_t Compositor::bytesSent() const {
+        return this->_bytesSent;
+    }
+
+    uint32_t Compositor::lastFrameBytes() const {
+        return this->_lastFrameBytes;
+    }
+
+    uint32_t Compositor::lastFrameMicros() const {
+        return this->_lastFrameMicros;
+    }
+
+    uint32_t Compositor::maxFrameMicros() const {
+        return this->_maxFrameMicros;
+    }
+
+    uint32_t Compositor::lastCommitMicros() const {
+        return this->_lastCommitMicros;
+    }
+
+    uint32_t Compositor::maxCommitMicros() const {
+        return this->_maxCommitMicros;
+    }
+
+    void Compositor::consoleCommand(void *context, HAL::SerialPort &out, const char *args) {
+        Compositor *compositor = (Compositor *) context;
+        out.print("display: frames ");
+        out.print((unsigned long) compositor->_frames);
+        out.print(", deferred ");
+        out.print((unsigned long) compositor->_deferred);
+        out.print(", busy ");
+        out.print((unsigned long) compositor->_busy);
+        out.print(", bytes/frame last ");
+        out.print((unsigned long) compositor->_lastFrameBytes);
+        out.print(" avg ");
+        out.print((unsigned long) (compositor->_frames ? compositor->_bytesSent / compositor->_frames : 0));
+        out.print(" (full ");
+        out.print((unsigned long) HAL::Display::PanelBytes);
+        out.println(")");
+        out.print("  send last/max ");
+        out.print((unsigned long) compositor->_lastFrameMicros);
+        out.print("/");
+        out.print((unsigned long) compositor->_maxFrameMicros);
+        out.print(" us, commit last/max ");
+        out.print((unsigned long) compositor->_lastCommitMicros);
+        out.print("/");
+        out.print((unsigned long) compositor->_maxCommitMicros);
+        out.print(" us, ");
+        out.println(compositor->_flushTask ? "flush task" : "inline");
+    }
+}
@@ -0,0 +1,80 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include <string.h>
+#include "console.h"
+
+namespace StegoPhone {
+    Console *Console::_instance = 0;
+
+    Console *Console::getInstance() {
+        if (0 == _instance)
+            _instance = new Console();
+        return _instance;
+    }
+
+    Console::Console() : _serialPort(HAL::consoleSerial()) {
+        this->_commandCount = 0;
+        this->_lineBuffer = new LineBuffer(this->_serialPort, 128);
+        this->_lineBuffer->lineReceived.attach(MethodSlot<Console, LineView>(this, &Console::receiveLine));
+        this->addCommand("help", "list commands", Console::help, this);
+    }
+
+    bool Console::addCommand(const char *name, const char *help, ConsoleHandler handler, void *context) {
+        if (this->_commandCount >= MaxCommands) return false;
+        Command &command = this->_commands[this->_commandCount++];
+        command.name = name;
+        command.help = help;
+        command.handler = handler;
+        command.context = context;
+        return true;
+    }
+
+    void Console::loop() {
+        this->_lineBuffer->loop();
+    }
+
+    void Console::receiveLine(LineView line) {
+        char buf[MaxLineLength + 1];
+        if (line.length > MaxLineLength) {
+            this->_serialPort.println("console: line too long");
+            return;
+        }
+        memcpy(buf, line.data, line.length);
+        buf[line.length] = '\0';
+        this->execute(buf);
+    }
+
+    bool Console::execute(const char *line) {
+        while (*line == ' ') line++;
+        if (*line == '\0') return false;
+        size_t nameLength = 0;
+        while (line[nameLength] != '\0' && line[nameLength] != ' ') nameLength++;
+        const char *args = line + nameLength;
+        while (*args == ' ') args++;
+
+        for (uint8_t i = 0; i < this->_commandCount; i++) {
+            const Command &command = this->_commands[i];
+            if (strlen(command.name) == nameLength && strncmp(command.name, line, nameLength) == 0) {
+                command.handler(command.context, this->_serialPort, args);
+                return true;
+            }
+        }
+        this->_serialPort.print("console: unknown command, try help: ");
+        this->_serialPort.println(line);
+        return false;
+    }
+
+    void Console::help(void *context, HAL::SerialPort &out, const char *args) {
+        Console *console = (Console *) context;
+        for (uint8_t i = 0; i < console->_commandCount; i++) {
+            out.print(console->_commands[i].name);
+            out.print(" - ");
+            out.println(console->_commands[i].help);
+        }
+    }
+}
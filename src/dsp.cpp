@@ -0,0 +1,337 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include <math.h>
+#include "dsp.h"
+
+#if defined(__ARM_FEATURE_DSP)
+#define STEGOS_DSP_SIMD 1
+#else
+#define STEGOS_DSP_SIMD 0
+#endif
+
+namespace StegoPhone {
+    namespace DSP {
+        namespace {
+            // two Q15 samples in one register, the first in the low half
+            inline uint32_t pack(int16_t low, int16_t high) {
+                return (uint16_t) low | ((uint32_t) (uint16_t) high << 16);
+            }
+
+            // two adjacent samples; the M7 takes unaligned word loads
+            inline uint32_t pair(const int16_t *samples) {
+                uint32_t value;
+                memcpy(&value, samples, sizeof(value));
+                return value;
+            }
+
+#if STEGOS_DSP_SIMD
+            // acc + x.lo * y.lo + x.hi * y.hi
+            inline int64_t smlald(uint32_t x, uint32_t y, int64_t acc) {
+                __asm__ ("smlald %Q0, %R0, %1, %2" : "+r" (acc) : "r" (x), "r" (y));
+                return acc;
+            }
+
+            // both halves added, each saturated
+            inline uint32_t qadd16(uint32_t x, uint32_t y) {
+                uint32_t result;
+                __asm__ ("qadd16 %0, %1, %2" : "=r" (result) : "r" (x), "r" (y));
+                return result;
+            }
+
+            inline int32_t ssat16(int32_t value) {
+                int32_t result;
+                __asm__ ("ssat %0, #16, %1" : "=r" (result) : "r" (value));
+                return result;
+            }
+#else
+            // the same instructions in C, so the host runs the target's loops
+            inline int64_t smlald(uint32_t x, uint32_t y, int64_t acc) {
+                return acc + (int32_t) (int16_t) x * (int16_t) y +
+                       (int32_t) (int16_t) (x >> 16) * (int16_t) (y >> 16);
+            }
+
+            inline uint32_t qadd16(uint32_t x, uint32_t y) {
+                return pack(saturate16((int32_t) (int16_t) x + (int16_t) y),
+                            saturate16((int32_t) (int16_t) (x >> 16) + (int16_t) (y >> 16)));
+            }
+
+            inline int32_t ssat16(int32_t value) {
+                return saturate16(value);
+            }
+#endif
+        }
+
+        // DOT PRODUCTS
+        //================================================================================================
+        int64_t dotQ15(const int16_t *a, const int16_t *b, size_t count) {
+            int64_t sum = 0;
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4) {
+                sum = smlald(pair(a + i), pair(b + i), sum);
+                sum = smlald(pair(a + i + 2), pair(b + i + 2), sum);
+            }
+            for (; i < count; i++)
+                sum += (int32_t) a[i] * b[i];
+            return sum;
+        }
+
+        int64_t dotQ31(const int32_t *a, const int32_t *b, size_t count) {
+            int64_t sum = 0;
+            for (size_t i = 0; i < count; i++)
+                sum += ((int64_t) a[i] * b[i]) >> 14;
+            return sum;
+        }
+
+        float dotF32(const float *a, const float *b, size_t count) {
+            float sum = 0;
+            for (size_t i = 0; i < count; i++)
+                sum += a[i] * b[i];
+            return sum;
+        }
+
+        // GAIN AND MIXING
+        //================================================================================================
+        void gainQ15(int16_t *samples, size_t count, int16_t gain, uint8_t shift) {
+            const uint8_t down = (uint8_t) (15 - shift);
+            const int32_t round = down ? (int32_t) 1 << (down - 1) : 0;
+            for (size_t i = 0; i < count; i++) {
+                // |sample * gain| is at most 2^30, so the rounding cannot carry out of 32 bits
+                samples[i] = (int16_t) ssat16(((int32_t) samples[i] * gain + round) >> down);
+            }
+        }
+
+        void gainQ31(int32_t *samples, size_t count, int32_t gain, uint8_t shift) {
+            const uint8_t down = (uint8_t) (31 - shift);
+            const int64_t round = down ? (int64_t) 1 << (down - 1) : 0;
+            for (size_t i = 0; i < count; i++)
+                samples[i] = saturate32(((int64_t) samples[i] * gain + round) >> down);
+        }
+
+        void gainF32(float *samples, size_t count, float gain) {
+            for (size_t i = 0; i < count; i++)
+                samples[i] *= gain;
+        }
+
+        void addQ15(int16_t *samples, const int16_t *other, size_t count) {
+            size_t i = 0;
+            for (; i + 2 <= count; i += 2) {
+                const uint32_t sum = qadd16(pair(samples + i), pair(other + i));
+                memcpy(samples + i, &sum, sizeof(sum));
+            }
+            for (; i < count; i++)
+                samples[i] = saturate16((int32_t) samples[i] + other[i]);
+        }
+
+        void addQ31(int32_t *samples, const int32_t *other, size_t count) {
+            for (size_t i = 0; i < count; i++)
+                samples[i] = saturate32((int64_t) samples[i] + other[i]);
+        }
+
+        void addF32(float *samples, const float *other, size_t count) {
+            for (size_t i = 0; i < count; i++)
+                samples[i] += other[i];
+        }
+
+        // LEVEL
+        //================================================================================================
+        uint32_t peakQ15(const int16_t *samples, size_t count) {
+            uint32_t peak = 0;
+            for (size_t i = 0; i < count; i++) {
+                const int32_t value = samples[i];
+                const uint32_t magnitude = (uint32_t) (value < 0 ? -value : value);
+                if (magnitude > peak) peak = magnitude;
+            }
+            return peak;
+        }
+
+        uint32_t peakQ31(const int32_t *samples, size_t count) {
+            uint32_t peak = 0;
+            for (size_t i = 0; i < count; i++) {
+                const int64_t value = samples[i];
+                const uint32_t magnitude = (uint32_t) (value < 0 ? -value : value);
+                if (magnitude > peak) peak = magnitude;
+            }
+            return peak;
+        }
+
+        float peakF32(const float *samples, size_t count) {
+            float peak = 0;
+            for (size_t i = 0; i < count; i++) {
+                const float magnitude = fabsf(samples[i]);
+                if (magnitude > peak) peak = magnitude;
+            }
+            return peak;
+        }
+
+        uint64_t energyQ15(const int16_t *samples, size_t count) {
+            int64_t sum = 0;
+            size_t i = 0;
+            for (; i + 2 <= count; i += 2) {
+                const uint32_t both = pair(samples + i);
+                sum = smlald(both, both, sum);
+            }
+            for (; i < count; i++)
+                sum += (int32_t) samples[i] * samples[i];
+            return (uint64_t) sum;
+        }
+
+        uint32_t rmsQ15(const int16_t *samples, size_t count) {
+            if (!count) return 0;
+            return isqrt64(energyQ15(samples, count) / count);
+        }
+
+        uint32_t rmsQ31(const int32_t *samples, size_t count) {
+            if (!count) return 0;
+            uint64_t sum = 0;
+            for (size_t i = 0; i < count; i++)
+                sum += (uint64_t) ((int64_t) samples[i] * samples[i]) >> 31;
+            return isqrt64((sum / count) << 31);
+        }
+
+        float rmsF32(const float *samples, size_t count) {
+            if (!count) return 0;
+            float sum = 0;
+            for (size_t i = 0; i < count; i++)
+                sum += samples[i] * samples[i];
+            return sqrtf(sum / count);
+        }
+
+        uint32_t isqrt64(uint64_t value) {
+            uint64_t root = 0;
+            uint64_t bit = (uint64_t) 1 << 62;
+            while (bit > value)
+                bit >>= 2;
+            while (bit) {
+                if (value >= root + bit) {
+                    value -= root + bit;
+                    root = (root >> 1) + bit;
+                } else {
+                    root >>= 1;
+                }
+                bit >>= 2;
+            }
+            return (uint32_t) root;
+        }
+
+        // BIQUAD
+        //================================================================================================
+        BiquadQ15::BiquadQ15(const int16_t *coefficients) {
+            this->_b[0] = coefficients[0];
+            this->_b[1] = coefficients[1];
+            this->_b[2] = coefficients[2];
+            this->_a[0] = (int16_t) -coefficients[3];
+            this->_a[1] = (int16_t) -coefficients[4];
+            this->reset();
+        }
+
+        void BiquadQ15::reset() {
+            this->_x[0] = this->_x[1] = 0;
+            this->_y[0] = this->_y[1] = 0;
+        }
+
+        void BiquadQ15::process(const int16_t *in, int16_t *out, size_t count) {
+            // (b0, b1) against (x[n], x[n-1]) and (b2, -a1) against (x[n-2], y[n-1]): two SMLALDs and a multiply
+            const uint32_t b0b1 = pack(this->_b[0], this->_b[1]);
+            const uint32_t b2a1 = pack(this->_b[2], this->_a[0]);
+            const int32_t a2 = this->_a[1];
+            int16_t x1 = this->_x[0], x2 = this->_x[1];
+            int16_t y1 = this->_y[0], y2 = this->_y[1];
+            for (size_t i = 0; i < count; i++) {
+                const int16_t x0 = in[i];
+                int64_t sum = smlald(b0b1, pack(x0, x1), (int64_t) a2 * y2);
+                sum = smlald(b2a1, pack(x2, y1), sum);
+                const int16_t y0 = (int16_t) ssat16((int32_t) ((sum + (1 << 13)) >> 14));
+                x2 = x1;
+                x1 = x0;
+                y2 = y1;
+                y1 = y0;
+                out[i] = y0;
+            }
+            this->_x[0] = x1;
+            this->_x[1] = x2;
+            this->_y[0] = y1;
+            this->_y[1] = y2;
+        }
+
+        BiquadQ31::BiquadQ31(const int32_t *coefficients) {
+            this->_b[0] = coefficients[0];
+            this->_b[1] = coefficients[1];
+            this->_b[2] = coefficients[2];
+            this->_a[0] = -coefficients[3];
+            this->_a[1] = -coefficients[4];
+            this->reset();
+        }
+
+        void BiquadQ31::reset() {
+            this->_x[0] = this->_x[1] = 0;
+            this->_y[0] = this->_y[1] = 0;
+        }
+
+        void BiquadQ31::process(const int32_t *in, int32_t *out, size_t count) {
+            int32_t x1 = this->_x[0], x2 = this->_x[1];
+            int32_t y1 = this->_y[0], y2 = this->_y[1];
+            for (size_t i = 0; i < count; i++) {
+                const int32_t x0 = in[i];
+                // SMLAL each: the M7 has no dual 32 bit multiply
+                const int64_t sum = (int64_t) this->_b[0] * x0 + (int64_t) this->_b[1] * x1 +
+                                    (int64_t) this->_b[2] * x2 + (int64_t) this->_a[0] * y1 +
+                                    (int64_t) this->_a[1] * y2;
+                const int32_t y0 = saturate32((sum + ((int64_t) 1 << 29)) >> 30);
+                x2 = x1;
+                x1 = x0;
+                y2 = y1;
+                y1 = y0;
+                out[i] = y0;
+            }
+            this->_x[0] = x1;
+            this->_x[1] = x2;
+            this->_y[0] = y1;
+            this->_y[1] = y2;
+        }
+
+        BiquadF32::BiquadF32(const float *coefficients) {
+            this->_b[0] = coefficients[0];
+            this->_b[1] = coefficients[1];
+            this->_b[2] = coefficients[2];
+            this->_a[0] = coefficients[3];
+            this->_a[1] = coefficients[4];
+            this->reset();
+        }
+
+        void BiquadF32::reset() {
+            this->_z[0] = this->_z[1] = 0;
+        }
+
+        void BiquadF32::process(const float *in, float *out, size_t count) {
+            float z0 = this->_z[0], z1 = this->_z[1];
+            for (size_t i = 0; i < count; i++) {
+                const float x = in[i];
+                const float y = this->_b[0] * x + z0;
+                z0 = this->_b[1] * x - this->_a[0] * y + z1;
+                z1 = this->_b[2] * x - this->_a[1] * y;
+                out[i] = y;
+            }
+            this->_z[0] = z0;
+            this->_z[1] = z1;
+        }
+
+        // CONVERSION
+        //================================================================================================
+        void q15ToF32(const int16_t *in, float *out, size_t count) {
+            for (size_t i = 0; i < count; i++)
+                out[i] = in[i] * (1.0f / 32768.0f);
+        }
+
+        void f32ToQ15(const float *in, int16_t *out, size_t count) {
+            for (size_t i = 0; i < count; i++) {
+                const float scaled = floorf(in[i] * 32768.0f + 0.5f);
+                out[i] = (int16_t) (scaled >= 32767.0f ? 32767 : (scaled <= -32768.0f ? -32768 : (int32_t) scaled));
+            }
+        }
+    }
+}
@@ -0,0 +1,479 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stegophone.h"
+#include "esp8266.h"
+#include "trace.h"
+#include "log.h"
+#include "profile.h"
+
+namespace StegoPhone {
+    static const uint8_t IpdPrefixLength = 5; // "+IPD,"
+
+    ESP8266 *ESP8266::_instance = 0;
+
+    ESP8266 *ESP8266::getInstance() {
+        if (0 == _instance)
+            _instance = new ESP8266();
+        return _instance;
+    }
+
+    ESP8266::ESP8266() : _serialPort(StegoPhone::ESP8266Serial) {
+        // nothing unsolicited reaches the queue: URCs are taken out before it
+        this->_commands = new CommandQueue(this->_serialPort, ESP8266Command::LineEnding, 0, TraceChannel::ESP8266);
+        this->_task = 0;
+        this->_setupRequested = false;
+        this->_status = ESP8266Status::Offline;
+        this->_version[0] = '\0';
+        this->_multiplexed = false;
+        this->_wifiConnected = false;
+        this->_linksOpen = 0;
+        this->_rxState = RxState::Line;
+        this->_prefixLength = 0;
+        this->_lineLength = 0;
+        this->_headerLength = 0;
+        this->_headerFields[0] = 0;
+        this->_headerFields[1] = 0;
+        this->_headerField = 0;
+        this->_ring = (uint8_t *) malloc(2 * PayloadCapacity); // mirrored, see header
+        this->_ringHead = 0;
+        this->_payloadStart = 0;
+        this->_payloadRemaining = 0;
+        this->_payloadLink = 0;
+        this->_sendHead = 0;
+        this->_sendCount = 0;
+        this->_urcs = 0;
+        this->_ipdSegments = 0;
+        this->_ipdBytes = 0;
+        this->_ipdErrors = 0;
+        this->_sendsCompleted = 0;
+        this->_sendFailures = 0;
+        this->_bytesSent = 0;
+    }
+
+    void ESP8266::setup() {
+        this->submit(ESP8266Command::EchoOff, ESP8266Command::okOrError(), 0, 0);
+        this->submit(ESP8266Command::Version, ESP8266Command::okOrError(), ESP8266::versionReceived, this);
+        this->submit(ESP8266Command::MultipleConnections, ESP8266Command::okOrError(), ESP8266::multiplexReceived,
+                     this);
+    }
+
+    void ESP8266::requestSetup() {
+        this->_setupRequested = true;
+    }
+
+    bool ESP8266::setupRequested() {
+        return this->_setupRequested;
+    }
+
+    void ESP8266::loop() {
+        STEGOS_PROFILE_SCOPE(ESP8266);
+        if (this->_setupRequested) {
+            this->_setupRequested = false;
+            this->setup();
+        }
+        while (this->_serialPort.available() > 0) {
+            const int c = this->_serialPort.read();
+            if (c < 0) break;
+            STEGOS_TRACE_BYTE(TraceChannel::ESP8266, TraceDirection::Rx, c);
+            this->push((uint8_t) c);
+        }
+        this->_commands->expire();
+    }
+
+    // TASK
+    //================================================================================================
+    bool ESP8266::startTask(uint8_t priority) {
+        if (this->_task) return true;
+        const TaskSpec spec = {"esp8266", priority, TaskStackWords, TaskTrigger::Periodic, IdlePollMs,
+                               ESP8266::taskStep, this};
+        this->_task = TaskManager::getInstance()->start(spec);
+        return this->_task != 0;
+    }
+
+    void ESP8266::stopTask() {
+        if (!this->_task) return;
+        ManagedTask *task = this->_task;
+        this->_task = 0;
+        TaskManager::getInstance()->stop(task);
+    }
+
+    bool ESP8266::taskRunning() {
+        return this->_task != 0;
+    }
+
+    void ESP8266::taskStep(void *context, uint32_t notifications) {
+        ESP8266 *esp8266 = (ESP8266 *) context;
+        esp8266->loop();
+        ManagedTask *task = esp8266->_task;
+        if (task) task->setPeriod(esp8266->busy() ? BusyPollMs : IdlePollMs);
+    }
+
+    bool ESP8266::busy() {
+        return !this->_commands->idle() || this->_sendCount || this->_linksOpen || this->_lineLength ||
+               this->_prefixLength || this->_rxState != RxState::Line;
+    }
+
+    // RECEIVE
+    //================================================================================================
+    void ESP8266::push(const uint8_t *data, size_t length) {
+        while (length--)
+            this->push(*data++);
+    }
+
+    void ESP8266::push(uint8_t c) {
+        switch (this->_rxState) {
+            case RxState::Payload:
+                this->payloadByte(c);
+                break;
+            case RxState::Header:
+                this->headerByte(c);
+                break;
+            default:
+                this->lineByte(c);
+                break;
+        }
+    }
+
+    void ESP8266::lineByte(uint8_t c) {
+        if (this->_lineLength == 0) {
+            if (c == (uint8_t) ESP8266Command::IpdPrefix[this->_prefixLength]) {
+                if (++this->_prefixLength == IpdPrefixLength) {
+                    this->_prefixLength = 0;
+                    this->_headerLength = 0;
+                    this->_headerFields[0] = 0;
+                    this->_headerFields[1] = 0;
+                    this->_headerField = 0;
+                    this->_rxState = RxState::Header;
+                }
+                return;
+            }
+            if (this->_prefixLength) this->releasePrefix();
+            else if (c == (uint8_t) ESP8266Command::SendPrompt) this->prompt();
+        }
+        this->_commands->receive(c);
+        if (c == '\n') {
+            this->lineComplete();
+            return;
+        }
+        if (this->_lineLength < LineCapacity) this->_line[this->_lineLength] = (char) c;
+        this->_lineLength++;
+    }
+
+    // a line that started like "+IPD," but is not one
+    void ESP8266::releasePrefix() {
+        const uint8_t held = this->_prefixLength;
+        this->_prefixLength = 0;
+        for (uint8_t i = 0; i < held; i++) {
+            const uint8_t c = (uint8_t) ESP8266Command::IpdPrefix[i];
+            this->_commands->receive(c);
+            this->_line[this->_lineLength++] = (char) c;
+        }
+    }
+
+    void ESP8266::headerByte(uint8_t c) {
+        bool valid = (++this->_headerLength <= HeaderCapacity);
+        if (valid && c == ':') {
+            // "<link>,<length>" with multiple connections, "<length>" without
+            const uint8_t fields = this->_headerField + 1;
+            const uint32_t link = this->_multiplexed ? this->_headerFields[0] : 0;
+            const uint32_t length = this->_multiplexed ? this->_headerFields[1] : this->_headerFields[0];
+            if ((this->_multiplexed && fields < 2) || link >= MaxLinks) {
+                valid = false;
+            } else {
+                this->_payloadLink = (uint8_t) link;
+                this->_payloadRemaining = length;
+                this->_payloadStart = this->_ringHead;
+                this->_rxState = length ? RxState::Payload : RxState::Line;
+                return;
+            }
+        } else if (valid && c == ',') {
+            if (this->_headerField < 2) this->_headerField++;
+        } else if (valid && this->_headerField < 2) {
+            // the numeric fields; anything after them (AT+CIPDINFO) is skipped
+            if (c < '0' || c > '9' || this->_headerFields[this->_headerField] > 100000) valid = false;
+            else this->_headerFields[this->_headerField] = this->_headerFields[this->_headerField] * 10 + (c - '0');
+        }
+        if (valid) return;
+
+        // not a header after all: count it and let the rest of the line go to the queue
+        this->_ipdErrors++;
+        this->_rxState = RxState::Line;
+        this->_lineLength = LineCapacity + 1;
+        this->lineByte(c);
+    }
+
+    void ESP8266::payloadByte(uint8_t c) {
+        const uint32_t pos = this->_ringHead++;
+        this->_ring[pos & (PayloadCapacity - 1)] = c;
+        this->_ring[(pos & (PayloadCapacity - 1)) + PayloadCapacity] = c;
+        this->_ipdBytes++;
+        if (--this->_payloadRemaining == 0) {
+            this->_ipdSegments++;
+            this->_rxState = RxState::Line;
+            this->emitPayload(false);
+        } else if (this->_ringHead - this->_payloadStart == PayloadCapacity) {
+            // the next byte would overwrite the start of the view
+            this->emitPayload(true);
+        }
+    }
+
+    void ESP8266::emitPayload(bool partial) {
+        IpdView view;
+        view.link = this->_payloadLink;
+        view.data = this->_ring + (this->_payloadStart & (PayloadCapacity - 1));
+        view.length = this->_ringHead - this->_payloadStart;
+        view.partial = partial;
+        this->_payloadStart = this->_ringHead;
+        this->dataReceived.fire(view);
+    }
+
+    // "> " after AT+CIPSEND: write the payload of the send in flight
+    void ESP8266::prompt() {
+        const char *current = this->_commands->current();
+        if (!current || strncmp(current, ESP8266Command::Send, strlen(ESP8266Command::Send)) != 0) return;
+        if (!this->_sendCount) return;
+        PendingSend &send = this->_sends[this->_sendHead];
+        if (send.written) return;
+        send.written = true;
+        this->_serialPort.write(send.data, send.length);
+        STEGOS_TRACE_BYTES(TraceChannel::ESP8266, TraceDirection::Tx, send.data, send.length);
+        this->_bytesSent += send.length;
+    }
+
+    void ESP8266::lineComplete() {
+        size_t length = this->_lineLength;
+        this->_lineLength = 0;
+        if (length > LineCapacity) return;
+        if (length > 0 && this->_line[length - 1] == '\r') length--;
+        if (length == 0) return;
+
+        // "<link>,CONNECT" / "<link>,CLOSED" with multiple connections
+        const char *text = this->_line;
+        int8_t link = -1;
+        if (length > 2 && this->_line[0] >= '0' && this->_line[0] <= '9' && this->_line[1] == ',') {
+            link = (int8_t) (this->_line[0] - '0');
+            text += 2;
+            length -= 2;
+        }
+        struct Code {
+            const char *text;
+            ESP8266Urc urc;
+        };
+        static const Code codes[] = {
+                {ESP8266Command::Ready,          ESP8266Urc::Ready},
+                {ESP8266Command::WifiConnected,  ESP8266Urc::WifiConnected},
+                {ESP8266Command::WifiGotIP,      ESP8266Urc::WifiGotIP},
+                {ESP8266Command::WifiDisconnect, ESP8266Urc::WifiDisconnected},
+                {ESP8266Command::Connect,        ESP8266Urc::LinkConnected},
+                {ESP8266Command::Closed,         ESP8266Urc::LinkClosed}
+        };
+        for (size_t i = 0; i < sizeof(codes) / sizeof(codes[0]); i++) {
+            if (strlen(codes[i].text) != length || memcmp(codes[i].text, text, length) != 0) continue;
+            const bool linkCode = (codes[i].urc == ESP8266Urc::LinkConnected) ||
+                                  (codes[i].urc == ESP8266Urc::LinkClosed);
+            if (linkCode && link < 0) link = 0; // single connection mode
+            else if (!linkCode && link >= 0) return;
+            this->urc(codes[i].urc, link);
+            return;
+        }
+    }
+
+    void ESP8266::urc(ESP8266Urc urc, int8_t link) {
+        switch (urc) {
+            case ESP8266Urc::Ready:
+                // rebooted: echo is back on, connections are gone, bring it up again
+                this->_multiplexed = false;
+                this->_wifiConnected = false;
+                this->_linksOpen = 0;
+                this->setup();
+                break;
+            case ESP8266Urc::WifiConnected:
+            case ESP8266Urc::WifiGotIP:
+                this->_wifiConnected = true;
+                break;
+            case ESP8266Urc::WifiDisconnected:
+                this->_wifiConnected = false;
+                this->_linksOpen = 0;
+                break;
+            case ESP8266Urc::LinkConnected:
+                if (link < MaxLinks) this->_linksOpen |= (uint8_t) (1 << link);
+                break;
+            case ESP8266Urc::LinkClosed:
+                if (link < MaxLinks) this->_linksOpen &= (uint8_t) ~(1 << link);
+                break;
+        }
+        this->_urcs++;
+        ESP8266Event event;
+        event.urc = urc;
+        event.link = link;
+        this->eventReceived.fire(event);
+    }
+
+    // COMMANDS
+    //================================================================================================
+    bool ESP8266::submit(const char *cmd, const PatternMatcher &terminators, CommandCallback callback, void *context,
+                         uint32_t timeoutMs) {
+        return this->_commands->submit(cmd, terminators, timeoutMs, callback, context);
+    }
+
+    bool ESP8266::connect(uint8_t link, const char *host, uint16_t port, CommandCallback callback, void *context) {
+        if (link >= MaxLinks) return false;
+        char cmd[CommandQueue::MaxCommandLength];
+        const int length = snprintf(cmd, sizeof(cmd), "%s%u,\"TCP\",\"%s\",%u", ESP8266Command::Start,
+                                    (unsigned) link, host, (unsigned) port);
+        if (length < 0 || (size_t) length >= sizeof(cmd)) return false;
+        return this->submit(cmd, ESP8266Command::okOrError(), callback, context, ESP8266Command::ConnectTimeoutMs);
+    }
+
+    bool ESP8266::close(uint8_t link, CommandCallback callback, void *context) {
+        if (link >= MaxLinks) return false;
+        char cmd[CommandQueue::MaxCommandLength];
+        snprintf(cmd, sizeof(cmd), "%s%u", ESP8266Command::Close, (unsigned) link);
+        return this->submit(cmd, ESP8266Command::okOrError(), callback, context);
+    }
+
+    bool ESP8266::send(uint8_t link, const uint8_t *data, size_t length, CommandCallback callback, void *context) {
+        if (link >= MaxLinks || length == 0 || length > MaxSendLength || this->_sendCount >= CommandQueue::Depth)
+            return false;
+        char cmd[CommandQueue::MaxCommandLength];
+        if (this->_multiplexed) snprintf(cmd, sizeof(cmd), "%s%u,%u", ESP8266Command::Send, (unsigned) link,
+                                         (unsigned) length);
+        else snprintf(cmd, sizeof(cmd), "%s%u", ESP8266Command::Send, (unsigned) length);
+        const uint32_t wireMs = (uint32_t) (length * 10 * 1000 / StegoPhone::ESP8266SerialRate) + 1;
+        if (!this->submit(cmd, ESP8266Command::sendResult(), ESP8266::sendComplete, this,
+                          ESP8266Command::SendTimeoutMs + wireMs))
+            return false;
+        // the prompt cannot arrive before the next loop(), so the entry is in place in time
+        PendingSend &send = this->_sends[(this->_sendHead + this->_sendCount) % CommandQueue::Depth];
+        send.data = data;
+        send.length = length;
+        send.written = false;
+        send.callback = callback;
+        send.context = context;
+        this->_sendCount++;
+        return true;
+    }
+
+    void ESP8266::sendComplete(void *context, const CommandResponse &response) {
+        ESP8266 *esp8266 = (ESP8266 *) context;
+        if (!esp8266->_sendCount) return;
+        const PendingSend send = esp8266->_sends[esp8266->_sendHead];
+        esp8266->_sendHead = (esp8266->_sendHead + 1) % CommandQueue::Depth;
+        esp8266->_sendCount--;
+        if (response.result == CommandResult::Matched && response.terminator == 0) esp8266->_sendsCompleted++;
+        else esp8266->_sendFailures++;
+        if (send.callback) send.callback(send.context, response);
+    }
+
+    void ESP8266::versionReceived(void *context, const CommandResponse &response) {
+        ESP8266 *esp8266 = (ESP8266 *) context;
+        if (response.result != CommandResult::Matched || response.terminator != 0) {
+            esp8266->_status = ESP8266Status::Error;
+            STEGOS_LOG_WARNING("ESP8266 Failed");
+            return;
+        }
+        esp8266->_status = ESP8266Status::Present;
+        const char *line = strstr(response.data, "AT version:");
+        if (line) {
+            size_t length = strcspn(line, "\r\n");
+            if (length >= VersionCapacity) length = VersionCapacity - 1;
+            memcpy(esp8266->_version, line, length);
+            esp8266->_version[length] = '\0';
+        }
+        STEGOS_LOG_INFO("ESP8266 ....Success: %s", Log::text(esp8266->_version));
+    }
+
+    void ESP8266::multiplexReceived(void *context, const CommandResponse &response) {
+        ESP8266 *esp8266 = (ESP8266 *) context;
+        esp8266->_multiplexed = (response.result == CommandResult::Matched && response.terminator == 0);
+    }
+
+    CommandQueue *ESP8266::commands() {
+        return this->_commands;
+    }
+
+    ESP8266Status ESP8266::status() {
+        return this->_status;
+    }
+
+    const char *ESP8266::version() {
+        return this->_version;
+    }
+
+    bool ESP8266::wifiConnected() {
+        return this->_wifiConnected;
+    }
+
+    bool ESP8266::linkOpen(uint8_t link) {
+        return (link < MaxLinks) && (this->_linksOpen & (1 << link));
+    }
+
+    // STATS
+    //================================================================================================
+    uint32_t ESP8266::urcs() {
+        return this->_urcs;
+    }
+
+    uint32_t ESP8266::ipdSegments() {
+        return this->_ipdSegments;
+    }
+
+    uint64_t ESP8266::ipdBytes() {
+        return this->_ipdBytes;
+    }
+
+    uint32_t ESP8266::ipdErrors() {
+        return this->_ipdErrors;
+    }
+
+    uint32_t ESP8266::sends() {
+        return this->_sendsCompleted;
+    }
+
+    uint32_t ESP8266::sendFailures() {
+        return this->_sendFailures;
+    }
+
+    uint64_t ESP8266::bytesSent() {
+        return this->_bytesSent;
+    }
+
+    void ESP8266::consoleCommand(void *context, HAL::SerialPort &out, const char *args) {
+        ESP8266 *esp8266 = ESP8266::getInstance();
+        out.print("esp8266: ");
+        out.print(esp8266->_status == ESP8266Status::Present ? "present" :
+                  (esp8266->_status == ESP8266Status::Error ? "error" : "offline"));
+        out.print(esp8266->_wifiConnected ? ", wifi up" : ", wifi down");
+        out.print(", links ");
+        out.print((unsigned int) esp8266->_linksOpen, HEX);
+        out.print(esp8266->taskRunning() ? ", task" : ", polled");
+        out.print(", commands ");
+        out.print((unsigned long) esp8266->_commands->completed());
+        out.print(", timeouts ");
+        out.println((unsigned long) esp8266->_commands->timeouts());
+        out.print("  ");
+        out.println(esp8266->_version);
+        out.print("  urcs ");
+        out.print((unsigned long) esp8266->_urcs);
+        out.print(", +IPD ");
+        out.print((unsigned long) esp8266->_ipdSegments);
+        out.print(" segments / ");
+        out.print((unsigned long) esp8266->_ipdBytes);
+        out.print(" bytes, bad headers ");
+        out.print((unsigned long) esp8266->_ipdErrors);
+        out.print(", sends ");
+        out.print((unsigned long) esp8266->_sendsCompleted);
+        out.print(" / ");
+        out.print((unsigned long) esp8266->_bytesSent);
+        out.print(" bytes, failed ");
+        out.println((unsigned long) esp8266->_sendFailures);
+    }
+}
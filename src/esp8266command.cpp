@@ -0,0 +1,22 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include "esp8266command.h"
+
+namespace StegoPhone {
+    namespace ESP8266Command {
+        const PatternMatcher &okOrError() {
+            static const PatternMatcher matcher({Ok, Error, Fail});
+            return matcher;
+        }
+
+        const PatternMatcher &sendResult() {
+            static const PatternMatcher matcher({SendOk, SendFail, Error});
+            return matcher;
+        }
+    }
+}
@@ -0,0 +1,167 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include <stdio.h>
+#include <string.h>
+#include "framecipher.h"
+
+namespace StegoPhone {
+    FrameCipher::FrameCipher() {
+        this->clear();
+        this->resetStats();
+    }
+
+    FrameCipher::~FrameCipher() {
+        this->clear();
+    }
+
+    void FrameCipher::setKey(const uint8_t *key, bool initiator) {
+        memcpy(this->_key, key, Crypto::KeyBytes);
+        this->_txDirection = initiator ? InitiatorSends : ResponderSends;
+        this->_rxDirection = initiator ? ResponderSends : InitiatorSends;
+        this->_txNext = 0;
+        this->_rxNext = 0;
+        this->_rxWindow = 0;
+        this->_keyed = true;
+    }
+
+    void FrameCipher::clear() {
+        Crypto::wipe(this->_key, sizeof(this->_key));
+        this->_keyed = false;
+        this->_txDirection = this->_rxDirection = 0;
+        this->_txNext = this->_rxNext = 0;
+        this->_rxWindow = 0;
+    }
+
+    bool FrameCipher::keyed() const {
+        return this->_keyed;
+    }
+
+    uint8_t *FrameCipher::payload(ModemFrame *frame) {
+        return frame->data + HeaderBytes;
+    }
+
+    void FrameCipher::nonce(uint8_t *out, uint32_t direction, uint32_t sequence) const {
+        memset(out, 0, Crypto::NonceBytes);
+        for (uint8_t i = 0; i < 4; i++) {
+            out[i] = (uint8_t) (direction >> (8 * i));
+            out[4 + i] = (uint8_t) (sequence >> (8 * i));
+        }
+    }
+
+    bool FrameCipher::seal(ModemFrame *frame, uint16_t payloadLength) {
+        if (!this->_keyed || payloadLength > MaxPayload || this->_txNext > UINT32_MAX) return false;
+        const uint32_t sequence = (uint32_t) this->_txNext++;
+        for (uint8_t i = 0; i < HeaderBytes; i++)
+            frame->data[i] = (uint8_t) (sequence >> (8 * i));
+        uint8_t iv[Crypto::NonceBytes];
+        this->nonce(iv, this->_txDirection, sequence);
+        const uint8_t aad = (uint8_t) frame->type;
+        Crypto::seal(this->_key, iv, &aad, 1, payload(frame), payloadLength, payload(frame) + payloadLength);
+        frame->length = (uint16_t) (payloadLength + Overhead);
+        this->_sealed++;
+        this->_bytesSealed += payloadLength;
+        return true;
+    }
+
+    bool FrameCipher::open(ModemFrame *frame) {
+        if (!this->_keyed) return false;
+        if (frame->length < Overhead || frame->length > ModemFrame::Capacity) {
+            this->_badTags++;
+            return false;
+        }
+        uint32_t sequence = 0;
+        for (uint8_t i = 0; i < HeaderBytes; i++)
+            sequence |= (uint32_t) frame->data[i] << (8 * i);
+
+        // the window first: a replay is dropped without spending a tag check on it
+        if (sequence < this->_rxNext) {
+            const uint64_t age = this->_rxNext - 1 - sequence;
+            if (age >= ReplayWindow || (this->_rxWindow >> age) & 1) {
+                this->_replays++;
+                return false;
+            }
+        }
+
+        const uint16_t payloadLength = (uint16_t) (frame->length - Overhead);
+        uint8_t iv[Crypto::NonceBytes];
+        this->nonce(iv, this->_rxDirection, sequence);
+        const uint8_t aad = (uint8_t) frame->type;
+        if (!Crypto::open(this->_key, iv, &aad, 1, payload(frame), payloadLength, payload(frame) + payloadLength)) {
+            this->_badTags++;
+            return false;
+        }
+
+        // only an authentic frame moves the window
+        if (sequence >= this->_rxNext) {
+            const uint64_t shift = (uint64_t) sequence + 1 - this->_rxNext;
+            this->_rxWindow = shift >= ReplayWindow ? 0 : this->_rxWindow << shift;
+            this->_rxWindow |= 1;
+            this->_rxNext = (uint64_t) sequence + 1;
+        } else {
+            this->_rxWindow |= (uint64_t) 1 << (this->_rxNext - 1 - sequence);
+        }
+        frame->length = payloadLength;
+        this->_opened++;
+        this->_bytesOpened += payloadLength;
+        return true;
+    }
+
+    // STATS
+    //================================================================================================
+    uint32_t FrameCipher::sealed() const {
+        return this->_sealed;
+    }
+
+    uint32_t FrameCipher::opened() const {
+        return this->_opened;
+    }
+
+    uint32_t FrameCipher::badTags() const {
+        return this->_badTags;
+    }
+
+    uint32_t FrameCipher::replays() const {
+        return this->_replays;
+    }
+
+    uint64_t FrameCipher::bytesSealed() const {
+        return this->_bytesSealed;
+    }
+
+    uint64_t FrameCipher::bytesOpened() const {
+        return this->_bytesOpened;
+    }
+
+    void FrameCipher::resetStats() {
+        this->_sealed = 0;
+        this->_opened = 0;
+        this->_badTags = 0;
+        this->_replays = 0;
+        this->_bytesSealed = 0;
+        this->_bytesOpened = 0;
+    }
+
+    void FrameCipher::consoleCommand(void *context, HAL::SerialPort &out, const char *args) {
+        FrameCipher *cipher = (FrameCipher *) context;
+        if (strcmp(args, "reset") == 0) {
+            cipher->resetStats();
+            out.println("aead: stats reset");
+            return;
+        }
+        char line[128];
+        snprintf(line, sizeof(line), "aead: chacha20-poly1305, %s, next tx %lu, rx %lu",
+                 cipher->_keyed ? (cipher->_txDirection == InitiatorSends ? "initiator" : "responder") : "no key",
+                 (unsigned long) cipher->_txNext, (unsigned long) cipher->_rxNext);
+        out.println(line);
+        snprintf(line, sizeof(line), "  sealed %lu (%lu bytes), opened %lu (%lu bytes), bad tags %lu, replays %lu",
+                 (unsigned long) cipher->_sealed, (unsigned long) cipher->_bytesSealed,
+                 (unsigned long) cipher->_opened, (unsigned long) cipher->_bytesOpened,
+                 (unsigned long) cipher->_badTags, (unsigned long) cipher->_replays);
+        out.println(line);
+    }
+}
@@ -0,0 +1,133 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include <stdio.h>
+#include <string.h>
+#include "framefec.h"
+
+namespace StegoPhone {
+    FrameFec::FrameFec() : _code(DefaultParity) {
+        this->_depth = DefaultDepth;
+        this->resetStats();
+    }
+
+    bool FrameFec::configure(uint8_t parity, uint8_t depth) {
+        if (depth < 1 || depth > MaxDepth) return false;
+        if (!this->_code.setParity(parity)) return false;
+        this->_depth = depth;
+        return true;
+    }
+
+    uint8_t FrameFec::parity() const {
+        return this->_code.parity();
+    }
+
+    uint8_t FrameFec::depth() const {
+        return this->_depth;
+    }
+
+    uint16_t FrameFec::overhead() const {
+        return (uint16_t) (this->_code.parity() * this->_depth);
+    }
+
+    uint16_t FrameFec::maxPayload() const {
+        const uint16_t overhead = this->overhead();
+        return overhead < ModemFrame::Capacity ? (uint16_t) (ModemFrame::Capacity - overhead) : 0;
+    }
+
+    bool FrameFec::encode(ModemFrame *frame) {
+        if (frame->length > this->maxPayload()) return false;
+        const uint16_t total = (uint16_t) (frame->length + this->overhead());
+        for (uint8_t i = 0; i < this->_depth; i++) {
+            // codeword i: bytes i, i + depth, ...; its check bytes are the last parity() of them
+            const uint16_t count = (uint16_t) ((total - i + this->_depth - 1) / this->_depth);
+            this->_code.encode(frame->data + i, count, this->_depth);
+        }
+        frame->length = total;
+        this->_encoded++;
+        return true;
+    }
+
+    bool FrameFec::decode(ModemFrame *frame) {
+        const uint16_t overhead = this->overhead();
+        if (frame->length < overhead) {
+            this->_failures++;
+            return false;
+        }
+        const uint16_t total = frame->length;
+        uint16_t corrected = 0;
+        bool failed = false;
+        for (uint8_t i = 0; i < this->_depth; i++) {
+            const uint16_t count = (uint16_t) ((total - i + this->_depth - 1) / this->_depth);
+            const int16_t fixed = this->_code.decode(frame->data + i, count, this->_depth);
+            if (fixed < 0)
+                failed = true;
+            else
+                corrected += fixed;
+        }
+        if (failed) {
+            this->_failures++;
+            return false;
+        }
+        frame->length = (uint16_t) (total - overhead);
+        this->_decoded++;
+        if (corrected) {
+            this->_correctedFrames++;
+            this->_correctedBytes += corrected;
+        }
+        return true;
+    }
+
+    // STATS
+    //================================================================================================
+    uint32_t FrameFec::encoded() const {
+        return this->_encoded;
+    }
+
+    uint32_t FrameFec::decoded() const {
+        return this->_decoded;
+    }
+
+    uint32_t FrameFec::correctedFrames() const {
+        return this->_correctedFrames;
+    }
+
+    uint32_t FrameFec::correctedBytes() const {
+        return this->_correctedBytes;
+    }
+
+    uint32_t FrameFec::failures() const {
+        return this->_failures;
+    }
+
+    void FrameFec::resetStats() {
+        this->_encoded = 0;
+        this->_decoded = 0;
+        this->_correctedFrames = 0;
+        this->_correctedBytes = 0;
+        this->_failures = 0;
+    }
+
+    void FrameFec::consoleCommand(void *context, HAL::SerialPort &out, const char *args) {
+        FrameFec *fec = (FrameFec *) context;
+        if (strcmp(args, "reset") == 0) {
+            fec->resetStats();
+            out.println("fec: stats reset");
+            return;
+        }
+        char line[128];
+        snprintf(line, sizeof(line), "fec: reed-solomon, %u parity x %u deep, %u bytes overhead, payload up to %u",
+                 (unsigned int) fec->parity(), (unsigned int) fec->_depth, (unsigned int) fec->overhead(),
+                 (unsigned int) fec->maxPayload());
+        out.println(line);
+        snprintf(line, sizeof(line), "  encoded %lu, decoded %lu, corrected %lu (%lu bytes), failed %lu",
+                 (unsigned long) fec->_encoded, (unsigned long) fec->_decoded,
+                 (unsigned long) fec->_correctedFrames, (unsigned long) fec->_correctedBytes,
+                 (unsigned long) fec->_failures);
+        out.println(line);
+    }
+}
@@ -0,0 +1,258 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include <math.h>
+#include <string.h>
+#include "fskphy.h"
+
+namespace StegoPhone {
+    namespace {
+        // one cycle, indexed by the top byte of a 32 bit phase
+        const uint16_t SineSize = 256;
+        float sine[SineSize];
+        bool sineReady = false;
+
+        constexpr uint32_t phaseIncrement(uint32_t hz) {
+            return (uint32_t) (((uint64_t) hz << 32) / FskPhy::SampleRate);
+        }
+
+        const uint32_t MarkIncrement = phaseIncrement(FskPhy::MarkHz);
+        const uint32_t SpaceIncrement = phaseIncrement(FskPhy::SpaceHz);
+    }
+
+    FskPhy::FskPhy() {
+        if (!sineReady) {
+            for (uint16_t i = 0; i < SineSize; i++)
+                sine[i] = sinf(2.0f * (float) M_PI * i / SineSize);
+            sineReady = true;
+        }
+        this->_txFrame = 0;
+        this->_txIndex = 0;
+        this->_txTotal = 0;
+        this->_txCrc = 0;
+        this->_txByte = 0;
+        this->_txBit = 0;
+        this->_txSample = 0;
+        this->_txPhase = 0;
+        this->_txIncrement = MarkIncrement;
+
+        memset(this->_histI, 0, sizeof(this->_histI));
+        memset(this->_histQ, 0, sizeof(this->_histQ));
+        this->_histIndex = 0;
+        this->_loPhase = 0;
+        this->_pll = 0;
+        this->_lastMark = false;
+
+        this->_rxState = RxState::Hunt;
+        this->_shift = 0;
+        this->_rxByte = 0;
+        this->_rxBits = 0;
+        this->_rxFrame = 0;
+        this->_rxType = ModemFrameType::Data;
+        this->_rxLength = 0;
+        this->_rxIndex = 0;
+        this->_rxCrc = 0;
+        this->_rxCrcLow = 0;
+
+        this->_syncs = 0;
+        this->_crcErrors = 0;
+    }
+
+    const char *FskPhy::name() const {
+        return "fsk1200";
+    }
+
+    uint32_t FskPhy::sampleRate() const {
+        return SampleRate;
+    }
+
+    uint32_t FskPhy::bitRate() const {
+        return BaudRate;
+    }
+
+    uint16_t FskPhy::crcUpdate(uint16_t crc, uint8_t byte) {
+        crc ^= (uint16_t) byte << 8;
+        for (uint8_t i = 0; i < 8; i++)
+            crc = (crc & 0x8000) ? (uint16_t) ((crc << 1) ^ 0x1021) : (uint16_t) (crc << 1);
+        return crc;
+    }
+
+    // TRANSMIT
+    //================================================================================================
+    bool FskPhy::beginFrame(const ModemFrame *frame) {
+        if (this->_txFrame || frame->length > ModemFrame::Capacity) return false;
+        uint16_t crc = crcUpdate(0xFFFF, (uint8_t) frame->type);
+        crc = crcUpdate(crc, (uint8_t) frame->length);
+        for (uint16_t i = 0; i < frame->length; i++)
+            crc = crcUpdate(crc, frame->data[i]);
+        this->_txCrc = crc;
+        this->_txIndex = 0;
+        this->_txTotal = frame->length + OverheadBytes;
+        this->_txBit = 0;
+        this->_txSample = 0;
+        this->_txFrame = frame;
+        return true;
+    }
+
+    bool FskPhy::transmitting() const {
+        return this->_txFrame != 0;
+    }
+
+    uint8_t FskPhy::txByteAt(uint16_t index) const {
+        if (index < PreambleBytes) return PreambleByte;
+        index -= PreambleBytes;
+        if (index == 0) return SyncFirst;
+        if (index == 1) return SyncSecond;
+        if (index == 2) return (uint8_t) this->_txFrame->type;
+        if (index == 3) return (uint8_t) this->_txFrame->length;
+        index -= 4;
+        if (index < this->_txFrame->length) return this->_txFrame->data[index];
+        index -= this->_txFrame->length;
+        if (index == 0) return (uint8_t) this->_txCrc;
+        if (index == 1) return (uint8_t) (this->_txCrc >> 8);
+        return PreambleByte;
+    }
+
+    void FskPhy::modulate(int16_t *samples, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            if (!this->_txFrame) {
+                samples[i] = 0;
+                continue;
+            }
+            if (this->_txSample == 0) {
+                if (this->_txBit == 0) this->_txByte = this->txByteAt(this->_txIndex);
+                this->_txIncrement = ((this->_txByte >> this->_txBit) & 1) ? MarkIncrement : SpaceIncrement;
+            }
+            // the phase carries on across symbols: no clicks to splatter outside the channel
+            samples[i] = (int16_t) (sine[this->_txPhase >> 24] * Amplitude);
+            this->_txPhase += this->_txIncrement;
+            if (++this->_txSample < SamplesPerSymbol) continue;
+            this->_txSample = 0;
+            if (++this->_txBit < 8) continue;
+            this->_txBit = 0;
+            if (++this->_txIndex == this->_txTotal) this->_txFrame = 0;
+        }
+    }
+
+    // RECEIVE
+    //================================================================================================
+    void FskPhy::demodulate(const int16_t *samples, size_t count, ModemFrameSink &sink) {
+        for (size_t i = 0; i < count; i++) {
+            const float x = samples[i] * (1.0f / 32768.0f);
+
+            // mix down against both tones; the oscillators share one phase since space is twice mark
+            const uint8_t index = this->_histIndex;
+            const uint8_t markPhase = (uint8_t) (this->_loPhase >> 24);
+            const uint8_t spacePhase = (uint8_t) (markPhase << 1);
+            this->_histI[0][index] = x * sine[(uint8_t) (markPhase + SineSize / 4)];
+            this->_histQ[0][index] = x * sine[markPhase];
+            this->_histI[1][index] = x * sine[(uint8_t) (spacePhase + SineSize / 4)];
+            this->_histQ[1][index] = x * sine[spacePhase];
+            this->_loPhase += MarkIncrement;
+            this->_histIndex = (uint8_t) ((index + 1) % SamplesPerSymbol);
+
+            // energy at each tone over the last symbol; summed fresh, so nothing drifts
+            float markI = 0, markQ = 0, spaceI = 0, spaceQ = 0;
+            for (uint8_t j = 0; j < SamplesPerSymbol; j++) {
+                markI += this->_histI[0][j];
+                markQ += this->_histQ[0][j];
+                spaceI += this->_histI[1][j];
+                spaceQ += this->_histQ[1][j];
+            }
+            const bool mark = markI * markI + markQ * markQ > spaceI * spaceI + spaceQ * spaceQ;
+
+            // transitions belong half way between samples: pull the clock a quarter of the way there
+            if (mark != this->_lastMark) {
+                this->_pll -= (this->_pll - 32768) / 4;
+                this->_lastMark = mark;
+            }
+            this->_pll += PllStep;
+            if (this->_pll >= 65536) {
+                this->_pll -= 65536;
+                this->bitReceived(mark, sink);
+            }
+        }
+    }
+
+    void FskPhy::bitReceived(bool bit, ModemFrameSink &sink) {
+        if (this->_rxState == RxState::Hunt) {
+            this->_shift = (this->_shift >> 1) | (bit ? 0x80000000u : 0);
+            if ((this->_shift >> 8) != SyncPattern) return;
+            this->_syncs++;
+            this->_rxState = RxState::Type;
+            this->_rxBits = 0;
+            this->_rxCrc = 0xFFFF;
+            this->_rxFrame = sink.frameStart();
+            return;
+        }
+        this->_rxByte = (uint8_t) ((this->_rxByte >> 1) | (bit ? 0x80 : 0));
+        if (++this->_rxBits < 8) return;
+        this->_rxBits = 0;
+        this->byteReceived(this->_rxByte, sink);
+    }
+
+    void FskPhy::byteReceived(uint8_t byte, ModemFrameSink &sink) {
+        switch (this->_rxState) {
+            case RxState::Type:
+                this->_rxType = (ModemFrameType) byte;
+                this->_rxCrc = crcUpdate(this->_rxCrc, byte);
+                this->_rxState = RxState::Length;
+                break;
+            case RxState::Length:
+                this->_rxLength = byte;
+                this->_rxIndex = 0;
+                this->_rxCrc = crcUpdate(this->_rxCrc, byte);
+                this->_rxState = byte ? RxState::Payload : RxState::CrcLow;
+                break;
+            case RxState::Payload:
+                if (this->_rxFrame) this->_rxFrame->data[this->_rxIndex] = byte;
+                this->_rxCrc = crcUpdate(this->_rxCrc, byte);
+                if (++this->_rxIndex == this->_rxLength) this->_rxState = RxState::CrcLow;
+                break;
+            case RxState::CrcLow:
+                this->_rxCrcLow = byte;
+                this->_rxState = RxState::CrcHigh;
+                break;
+            case RxState::CrcHigh: {
+                const bool valid = (uint16_t) (this->_rxCrcLow | (byte << 8)) == this->_rxCrc;
+                if (!valid) this->_crcErrors++;
+                if (this->_rxFrame) {
+                    this->_rxFrame->type = this->_rxType;
+                    this->_rxFrame->length = this->_rxLength;
+                    ModemFrame *frame = this->_rxFrame;
+                    this->_rxFrame = 0;
+                    sink.frameDecoded(frame, valid);
+                }
+                this->_rxState = RxState::Hunt;
+                this->_shift = 0;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    void FskPhy::reset(ModemFrameSink &sink) {
+        this->_txFrame = 0;
+        if (this->_rxFrame) {
+            ModemFrame *frame = this->_rxFrame;
+            this->_rxFrame = 0;
+            frame->length = 0;
+            sink.frameDecoded(frame, false);
+        }
+        this->_rxState = RxState::Hunt;
+        this->_shift = 0;
+    }
+
+    uint32_t FskPhy::syncs() const {
+        return this->_syncs;
+    }
+
+    uint32_t FskPhy::crcErrors() const {
+        return this->_crcErrors;
+    }
+}
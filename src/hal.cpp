@@ -0,0 +1,105 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include <string.h>
+#include "hal.h"
+
+// platform independent parts of the HAL: Print-style formatting on top of SerialPort::write
+
+namespace StegoPhone {
+    namespace HAL {
+        size_t SerialPort::write(const uint8_t *data, size_t length) {
+            size_t written = 0;
+            while (length--)
+                written += this->write(*data++);
+            return written;
+        }
+
+        void SerialPort::flush() {
+        }
+
+        size_t SerialPort::write(const char *str) {
+            if (str == 0) return 0;
+            return this->write((const uint8_t *) str, strlen(str));
+        }
+
+        size_t SerialPort::print(const char *str) {
+            return this->write(str);
+        }
+
+        size_t SerialPort::print(char c) {
+            return this->write((uint8_t) c);
+        }
+
+        size_t SerialPort::print(int n, int base) {
+            return this->print((long) n, base);
+        }
+
+        size_t SerialPort::print(unsigned int n, int base) {
+            return this->printNumber(n, base);
+        }
+
+        size_t SerialPort::print(long n, int base) {
+            if ((base == DEC) && (n < 0)) {
+                const size_t sign = this->write((uint8_t) '-');
+                return sign + this->printNumber(-((unsigned long) n), base);
+            }
+            return this->printNumber((unsigned long) n, base);
+        }
+
+        size_t SerialPort::print(unsigned long n, int base) {
+            return this->printNumber(n, base);
+        }
+
+        size_t SerialPort::println() {
+            return this->write("\r\n");
+        }
+
+        size_t SerialPort::println(const char *str) {
+            const size_t n = this->print(str);
+            return n + this->println();
+        }
+
+        size_t SerialPort::println(char c) {
+            const size_t n = this->print(c);
+            return n + this->println();
+        }
+
+        size_t SerialPort::println(int n, int base) {
+            const size_t len = this->print(n, base);
+            return len + this->println();
+        }
+
+        size_t SerialPort::println(unsigned int n, int base) {
+            const size_t len = this->print(n, base);
+            return len + this->println();
+        }
+
+        size_t SerialPort::println(long n, int base) {
+            const size_t len = this->print(n, base);
+            return len + this->println();
+        }
+
+        size_t SerialPort::println(unsigned long n, int base) {
+            const size_t len = this->print(n, base);
+            return len + this->println();
+        }
+
+        size_t SerialPort::printNumber(unsigned long n, int base) {
+            char buf[8 * sizeof(long) + 1];
+            char *str = &buf[sizeof(buf) - 1];
+            *str = '\0';
+            if (base < 2) base = DEC;
+            do {
+                const char digit = (char) (n % base);
+                n /= base;
+                *--str = digit < 10 ? digit + '0' : digit + 'A' - 10;
+            } while (n);
+            return this->write(str);
+        }
+    }
+}
@@ -0,0 +1,388 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+// HAL implementation for the teensy40 env
+
+#define U8G2_16BIT 1
+
+#include <Arduino.h>
+#include <U8g2lib.h>
+#include <SPI.h>
+#include <Wire.h>
+#include <Entropy.h>
+
+#include "SdFat.h"
+#include "sdios.h"
+#include "FreeStack.h"
+#include "ExFatlib\ExFatLib.h"
+#include "USBHost_t36.h"
+
+#include "hal.h"
+#include "rtos.h"
+#include "stegophone.h"
+
+#define SD_CONFIG SdioConfig(DMA_SDIO)
+
+namespace StegoPhone {
+    namespace HAL {
+        // TIME
+        //================================================================================================
+        uint32_t millis() {
+            return ::millis();
+        }
+
+        uint32_t micros() {
+            return ::micros();
+        }
+
+        void delay(uint32_t ms) {
+            ::delay(ms);
+        }
+
+        // RANDOM
+        //================================================================================================
+        void randomBytes(uint8_t *out, size_t length) {
+            static bool started = false;
+            if (!started) {
+                Entropy.Initialize();
+                started = true;
+            }
+            for (size_t i = 0; i < length; i += 4) {
+                const uint32_t word = Entropy.random();
+                for (size_t b = 0; b < 4 && i + b < length; b++)
+                    out[i + b] = (uint8_t) (word >> (8 * b));
+            }
+        }
+
+        // GPIO
+        //================================================================================================
+        void pinMode(uint8_t pin, PinMode mode) {
+            switch (mode) {
+                case PinMode::Input:
+                    ::pinMode(pin, INPUT);
+                    break;
+                case PinMode::InputPullup:
+                    ::pinMode(pin, INPUT_PULLUP);
+                    break;
+                case PinMode::Output:
+                    ::pinMode(pin, OUTPUT);
+                    break;
+            }
+        }
+
+        void digitalWrite(uint8_t pin, bool value) {
+            ::digitalWrite(pin, value);
+        }
+
+        bool digitalRead(uint8_t pin) {
+            return ::digitalRead(pin);
+        }
+
+        void attachInterrupt(uint8_t pin, InterruptHandler handler, Edge edge) {
+            int mode = CHANGE;
+            if (edge == Edge::Rising) mode = RISING;
+            else if (edge == Edge::Falling) mode = FALLING;
+            ::attachInterrupt(digitalPinToInterrupt(pin), handler, mode);
+        }
+
+        void detachInterrupt(uint8_t pin) {
+            ::detachInterrupt(digitalPinToInterrupt(pin));
+        }
+
+        // SERIAL
+        //================================================================================================
+        template<class T>
+        class ArduinoSerialPort : public SerialPort {
+        public:
+            ArduinoSerialPort(T &port) : _port(port) {
+            }
+
+            void begin(uint32_t baud) override {
+                this->_port.begin(baud);
+            }
+
+            int available() override {
+                return this->_port.available();
+            }
+
+            int read() override {
+                return this->_port.read();
+            }
+
+            size_t write(uint8_t c) override {
+                return this->_port.write(c);
+            }
+
+            size_t write(const uint8_t *data, size_t length) override {
+                return this->_port.write(data, length);
+            }
+
+            void flush() override {
+                this->_port.flush();
+            }
+
+            using SerialPort::write;
+
+        protected:
+            T &_port;
+        };
+
+        SerialPort &consoleSerial() {
+            static ArduinoSerialPort<usb_serial_class> port(Serial);
+            return port;
+        }
+
+        // the ESP8266 driver polls every 20ms when idle (230 bytes at 115200) and a 2KB AT+CIPSEND payload should
+        // not block its task, so Serial1 gets more than its 64 byte buffers
+        static uint8_t esp8266RxMemory[1024];
+        static uint8_t esp8266TxMemory[2048];
+
+        SerialPort &esp8266Serial() {
+            static ArduinoSerialPort<HardwareSerial> port(Serial1);
+            static bool extended = false;
+            if (!extended) {
+                Serial1.addMemoryForRead(esp8266RxMemory, sizeof(esp8266RxMemory));
+                Serial1.addMemoryForWrite(esp8266TxMemory, sizeof(esp8266TxMemory));
+                extended = true;
+            }
+            return port;
+        }
+
+        SerialPort &rn52Serial() {
+            static ArduinoSerialPort<HardwareSerial> port(Serial7);
+            return port;
+        }
+
+        // DISPLAY
+        //================================================================================================
+        class U8G2Display : public Display {
+        public:
+#if STEGOS_DISPLAY_DMA
+            U8G2Display() : _u8g2(U8G2_R0, StegoPhone::OLED_CS_Pin, StegoPhone::OLED_DC_Pin,
+                                  StegoPhone::OLED_RESET_Pin) {
+            }
+#else
+            U8G2Display() : _u8g2(U8G2_R0, StegoPhone::OLED_CLK_Pin, StegoPhone::OLED_SDA_Pin,
+                                  StegoPhone::OLED_CS_Pin, StegoPhone::OLED_DC_Pin, StegoPhone::OLED_RESET_Pin) {
+            }
+#endif
+
+            void begin() override {
+                this->_u8g2.begin();
+            }
+
+            void setFont(Font font) override {
+                if (font == Font::Large) this->_u8g2.setFont(u8g2_font_profont22_tf);
+                else this->_u8g2.setFont(u8g2_font_amstrad_cpc_extended_8f);
+            }
+
+            void clear() override {
+                this->_u8g2.clear();
+            }
+
+            void clearBuffer() override {
+                this->_u8g2.clearBuffer();
+            }
+
+            void drawStr(int16_t x, int16_t y, const char *str) override {
+                this->_u8g2.drawStr(x, y, str);
+            }
+
+            void sendBuffer() override {
+                this->_u8g2.sendBuffer();
+            }
+
+            uint8_t *getBufferPtr() override {
+                return this->_u8g2.getBufferPtr();
+            }
+
+        protected:
+#if STEGOS_DISPLAY_DMA
+            U8G2_SSD1322_NHD_256X64_F_4W_HW_SPI _u8g2;
+#else
+            U8G2_SSD1322_NHD_256X64_F_4W_SW_SPI _u8g2;
+#endif
+        };
+
+        Display &display() {
+            static U8G2Display display;
+            return display;
+        }
+
+        // U8g2 initializes the panel in begin(); after that frames go out through the transport only.
+        // SSD1322: each command byte is followed by its arguments with DC high, as is pixel data.
+#if STEGOS_DISPLAY_DMA
+        static const SPISettings oledSPI(10000000, MSBFIRST, SPI_MODE0); // SSD1322 max 10MHz
+        static volatile bool dmaDone = true;
+        static volatile RTOS::TaskHandle dmaWaiter = 0;
+
+        class SpiDmaBus {
+        public:
+            SpiDmaBus() {
+                this->_event.attachImmediate(SpiDmaBus::transferDone);
+            }
+
+            void command(uint8_t command, const uint8_t *args, uint8_t count) {
+                SPI.beginTransaction(oledSPI);
+                digitalWriteFast(StegoPhone::OLED_CS_Pin, LOW);
+                digitalWriteFast(StegoPhone::OLED_DC_Pin, LOW);
+                SPI.transfer(command);
+                digitalWriteFast(StegoPhone::OLED_DC_Pin, HIGH);
+                for (uint8_t i = 0; i < count; i++)
+                    SPI.transfer(args[i]);
+                digitalWriteFast(StegoPhone::OLED_CS_Pin, HIGH);
+                SPI.endTransaction();
+            }
+
+            // the calling task sleeps until the DMA completion interrupt; before the scheduler it spins
+            void data(const uint8_t *data, size_t length) {
+                dmaWaiter = RTOS::schedulerStarted() ? RTOS::currentTask() : 0;
+                dmaDone = false;
+                SPI.beginTransaction(oledSPI);
+                digitalWriteFast(StegoPhone::OLED_CS_Pin, LOW);
+                digitalWriteFast(StegoPhone::OLED_DC_Pin, HIGH);
+                SPI.transfer(data, nullptr, length, this->_event);
+                while (!dmaDone)
+                    if (dmaWaiter) RTOS::waitNotify(10);
+                digitalWriteFast(StegoPhone::OLED_CS_Pin, HIGH);
+                SPI.endTransaction();
+            }
+
+        protected:
+            static void transferDone(EventResponderRef event) {
+                dmaDone = true;
+                if (dmaWaiter) RTOS::notifyFromISR(dmaWaiter);
+            }
+
+            EventResponder _event;
+        };
+#else
+        class BitBangBus {
+        public:
+            void command(uint8_t command, const uint8_t *args, uint8_t count) {
+                digitalWriteFast(StegoPhone::OLED_CS_Pin, LOW);
+                digitalWriteFast(StegoPhone::OLED_DC_Pin, LOW);
+                shift(command);
+                digitalWriteFast(StegoPhone::OLED_DC_Pin, HIGH);
+                for (uint8_t i = 0; i < count; i++)
+                    shift(args[i]);
+                digitalWriteFast(StegoPhone::OLED_CS_Pin, HIGH);
+            }
+
+            void data(const uint8_t *data, size_t length) {
+                digitalWriteFast(StegoPhone::OLED_CS_Pin, LOW);
+                digitalWriteFast(StegoPhone::OLED_DC_Pin, HIGH);
+                for (size_t i = 0; i < length; i++)
+                    shift(data[i]);
+                digitalWriteFast(StegoPhone::OLED_CS_Pin, HIGH);
+            }
+
+        protected:
+            // SPI mode 0, MSB first, kept under the SSD1322's 10MHz clock
+            static void shift(uint8_t value) {
+                for (uint8_t bit = 0x80; bit; bit >>= 1) {
+                    digitalWriteFast(StegoPhone::OLED_SDA_Pin, (value & bit) ? HIGH : LOW);
+                    delayNanoseconds(50);
+                    digitalWriteFast(StegoPhone::OLED_CLK_Pin, HIGH);
+                    delayNanoseconds(50);
+                    digitalWriteFast(StegoPhone::OLED_CLK_Pin, LOW);
+                }
+            }
+        };
+#endif
+
+        // 1bpp tiles to SSD1322 4bpp rows: two pixels per byte, left one in the high nibble, lit pixels
+        // at full brightness (as U8g2 sends them)
+        template<typename Bus>
+        class SSD1322Transport : public DisplayTransport {
+        public:
+            void sendTiles(const uint8_t *buffer, uint8_t tileX, uint8_t tileY, uint8_t tileWidth) override {
+                if (tileX >= Display::TileWidth || tileY >= Display::TileHeight || tileWidth == 0) return;
+                if (tileX + tileWidth > Display::TileWidth) tileWidth = Display::TileWidth - tileX;
+                // a column address covers 4 pixels; the NHD panel's first column is 0x1C
+                const uint8_t columns[2] = {(uint8_t) (ColumnOffset + tileX * 2),
+                                            (uint8_t) (ColumnOffset + (tileX + tileWidth) * 2 - 1)};
+                const uint8_t rows[2] = {(uint8_t) (tileY * 8), (uint8_t) (tileY * 8 + 7)};
+                const uint8_t *tiles = buffer + (size_t) tileY * Display::Width + (size_t) tileX * 8;
+                const uint16_t pixels = (uint16_t) tileWidth * 8;
+                uint8_t *out = this->_pixels;
+                for (uint8_t y = 0; y < 8; y++)
+                    for (uint16_t x = 0; x < pixels; x += 2)
+                        *out++ = (uint8_t) ((((tiles[x] >> y) & 1) ? 0xF0 : 0x00) |
+                                            (((tiles[x + 1] >> y) & 1) ? 0x0F : 0x00));
+                this->_bus.command(SetColumnAddress, columns, 2);
+                this->_bus.command(SetRowAddress, rows, 2);
+                this->_bus.command(WriteRAM, 0, 0);
+                this->_bus.data(this->_pixels, (size_t) (out - this->_pixels));
+            }
+
+        protected:
+            static const uint8_t SetColumnAddress = 0x15;
+            static const uint8_t SetRowAddress = 0x75;
+            static const uint8_t WriteRAM = 0x5C;
+            static const uint8_t ColumnOffset = 0x1C;
+
+            Bus _bus;
+            uint8_t _pixels[Display::TileWidth * Display::PanelBytesPerTile]; // one tile row
+        };
+
+        DisplayTransport &displayTransport() {
+#if STEGOS_DISPLAY_DMA
+            static SSD1322Transport<SpiDmaBus> transport;
+#else
+            static SSD1322Transport<BitBangBus> transport;
+#endif
+            return transport;
+        }
+
+        // STORAGE
+        //================================================================================================
+        static SdExFat sd;
+
+        bool storageBegin() {
+            return sd.begin(SD_CONFIG);
+        }
+
+        // I2C
+        //================================================================================================
+        void i2cBegin() {
+            Wire.begin();
+        }
+
+        // USB HOST
+        //================================================================================================
+        static USBHost usb;
+        static KeyboardController keyboard(usb);
+        static MouseController mouse(usb);
+
+        void usbBegin() {
+            usb.begin();
+        }
+
+        void usbTask() {
+            usb.Task();
+        }
+
+        void attachKeyboard(const KeyboardHandlers &handlers) {
+            if (handlers.press) keyboard.attachPress(handlers.press);
+            if (handlers.extrasPress) keyboard.attachExtrasPress(handlers.extrasPress);
+            if (handlers.rawPress) keyboard.attachRawPress(handlers.rawPress);
+            if (handlers.rawRelease) keyboard.attachRawRelease(handlers.rawRelease);
+        }
+
+        bool readMouse(MouseReport &report) {
+            if (!mouse.available()) return false;
+            report.buttons = mouse.getButtons();
+            report.mouseX = mouse.getMouseX();
+            report.mouseY = mouse.getMouseY();
+            report.wheel = mouse.getWheel();
+            report.wheelH = mouse.getWheelH();
+            mouse.mouseDataClear();
+            return true;
+        }
+    }
+}
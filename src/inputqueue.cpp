@@ -0,0 +1,175 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include <string.h>
+#include "inputqueue.h"
+
+namespace StegoPhone {
+    static_assert((STEGOS_INPUT_CAPACITY & (STEGOS_INPUT_CAPACITY - 1)) == 0,
+                  "STEGOS_INPUT_CAPACITY must be a power of two");
+
+    InputQueue::InputQueue() {
+        memset(&this->_mouse, 0, sizeof(this->_mouse));
+        this->_mouse.type = InputEventType::Mouse;
+        this->_mousePending = false;
+        this->_queued = 0;
+        this->_dropped = 0;
+        this->_mouseReports = 0;
+        this->_mouseEvents = 0;
+        this->_handled = 0;
+        this->_lastLatencyMicros = 0;
+        this->_maxLatencyMicros = 0;
+        this->_totalLatencyMicros = 0;
+    }
+
+    // PRODUCER
+    //================================================================================================
+    bool InputQueue::push(InputEvent &event) {
+        InputEvent *slot = this->_events.writeSlot();
+        if (!slot) return false;
+        event.micros = HAL::micros();
+        *slot = event;
+        this->_events.commitWrite();
+        this->_queued++;
+        return true;
+    }
+
+    bool InputQueue::pushKey(int unicode) {
+        InputEvent event;
+        memset(&event, 0, sizeof(event));
+        event.type = InputEventType::Key;
+        event.code = (uint16_t) unicode;
+        if (this->push(event)) return true;
+        this->_dropped++;
+        return false;
+    }
+
+    bool InputQueue::pushConsumer(uint32_t top, uint16_t usage) {
+        InputEvent event;
+        memset(&event, 0, sizeof(event));
+        event.type = InputEventType::Consumer;
+        event.page = (uint16_t) (top >> 16);
+        event.code = usage;
+        if (this->push(event)) return true;
+        this->_dropped++;
+        return false;
+    }
+
+    void InputQueue::pushMouse(const HAL::MouseReport &report) {
+        this->_mouseReports++;
+        // a button change ends the movement before it; with the ring full the two merge
+        if (this->_mousePending && report.buttons != this->_mouse.buttons) this->flushMouse();
+        if (!this->_mousePending) {
+            this->_mouse.dx = 0;
+            this->_mouse.dy = 0;
+            this->_mouse.wheel = 0;
+            this->_mouse.wheelH = 0;
+        }
+        this->_mouse.buttons = report.buttons;
+        this->_mouse.dx = saturate16((int32_t) this->_mouse.dx + report.mouseX);
+        this->_mouse.dy = saturate16((int32_t) this->_mouse.dy + report.mouseY);
+        this->_mouse.wheel = saturate8((int32_t) this->_mouse.wheel + report.wheel);
+        this->_mouse.wheelH = saturate8((int32_t) this->_mouse.wheelH + report.wheelH);
+        this->_mousePending = true;
+    }
+
+    bool InputQueue::flushMouse() {
+        if (!this->_mousePending) return false;
+        if (!this->push(this->_mouse)) return false;
+        this->_mousePending = false;
+        this->_mouseEvents++;
+        return true;
+    }
+
+    int16_t InputQueue::saturate16(int32_t value) {
+        if (value > INT16_MAX) return INT16_MAX;
+        if (value < INT16_MIN) return INT16_MIN;
+        return (int16_t) value;
+    }
+
+    int8_t InputQueue::saturate8(int32_t value) {
+        if (value > INT8_MAX) return INT8_MAX;
+        if (value < INT8_MIN) return INT8_MIN;
+        return (int8_t) value;
+    }
+
+    // CONSUMER
+    //================================================================================================
+    bool InputQueue::pop(InputEvent &event) {
+        return this->_events.pop(event);
+    }
+
+    void InputQueue::handled(const InputEvent &event) {
+        this->_lastLatencyMicros = HAL::micros() - event.micros;
+        if (this->_lastLatencyMicros > this->_maxLatencyMicros) this->_maxLatencyMicros = this->_lastLatencyMicros;
+        this->_totalLatencyMicros += this->_lastLatencyMicros;
+        this->_handled++;
+    }
+
+    uint32_t InputQueue::depth() const {
+        return this->_events.size();
+    }
+
+    // STATS
+    //================================================================================================
+    uint32_t InputQueue::queued() const {
+        return this->_queued;
+    }
+
+    uint32_t InputQueue::dropped() const {
+        return this->_dropped;
+    }
+
+    uint32_t InputQueue::mouseReports() const {
+        return this->_mouseReports;
+    }
+
+    uint32_t InputQueue::mouseEvents() const {
+        return this->_mouseEvents;
+    }
+
+    uint32_t InputQueue::handledCount() const {
+        return this->_handled;
+    }
+
+    uint32_t InputQueue::lastLatencyMicros() const {
+        return this->_lastLatencyMicros;
+    }
+
+    uint32_t InputQueue::maxLatencyMicros() const {
+        return this->_maxLatencyMicros;
+    }
+
+    uint32_t InputQueue::averageLatencyMicros() const {
+        return this->_handled ? (uint32_t) (this->_totalLatencyMicros / this->_handled) : 0;
+    }
+
+    void InputQueue::consoleCommand(void *context, HAL::SerialPort &out, const char *args) {
+        InputQueue *input = (InputQueue *) context;
+        out.print("input: queued ");
+        out.print((unsigned long) input->_queued);
+        out.print(", handled ");
+        out.print((unsigned long) input->_handled);
+        out.print(", depth ");
+        out.print((unsigned long) input->depth());
+        out.print("/");
+        out.print((unsigned long) Capacity);
+        out.print(", dropped ");
+        out.println((unsigned long) input->_dropped);
+        out.print("  mouse reports ");
+        out.print((unsigned long) input->_mouseReports);
+        out.print(" -> events ");
+        out.print((unsigned long) input->_mouseEvents);
+        out.print(", latency last/avg/max ");
+        out.print((unsigned long) input->_lastLatencyMicros);
+        out.print("/");
+        out.print((unsigned long) input->averageLatencyMicros());
+        out.print("/");
+        out.print((unsigned long) input->_maxLatencyMicros);
+        out.println(" us");
+    }
+}
@@ -0,0 +1,279 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include <stdio.h>
+#include <string.h>
+#include "jitterbuffer.h"
+
+namespace StegoPhone {
+    JitterBuffer::JitterBuffer() {
+        this->_held = 0;
+        for (uint8_t i = 0; i < Depth; i++)
+            this->_slots[i].frame = 0;
+        this->_frameMicros = DefaultFrameMicros;
+        this->_any = false;
+        this->reset();
+        this->_arrivals = 0;
+        this->_lastTransit = 0;
+        this->_jitter = 0;
+        this->updateTarget();
+        this->resetStats();
+    }
+
+    void JitterBuffer::setFrameMicros(uint32_t micros) {
+        this->_frameMicros = micros ? micros : 1;
+        this->reset();
+        this->_arrivals = 0;
+        this->_jitter = 0;
+        this->updateTarget();
+    }
+
+    uint32_t JitterBuffer::frameMicros() const {
+        return this->_frameMicros;
+    }
+
+    void JitterBuffer::flush() {
+        for (uint8_t i = 0; i < Depth; i++) {
+            if (!this->_slots[i].frame) continue;
+            this->_pool.release(this->_slots[i].frame);
+            this->_slots[i].frame = 0;
+        }
+        this->_any = false;
+        this->_playing = false;
+        this->_next = 0;
+        this->_newest = 0;
+        this->_windowPops = 0;
+        this->_windowLow = 0xff;
+    }
+
+    void JitterBuffer::reset() {
+        if (this->_held) {
+            this->_pool.release(this->_held);
+            this->_held = 0;
+        }
+        this->flush();
+    }
+
+    void JitterBuffer::updateTarget() {
+        uint32_t frames = InitialFrames;
+        if (this->_arrivals >= SettleArrivals) {
+            const uint32_t jitter = this->_jitter >> 4;
+            frames = 1 + (JitterMultiple * jitter + this->_frameMicros - 1) / this->_frameMicros;
+        }
+        this->_target = (uint8_t) (frames > Depth - 2 ? Depth - 2 : frames);
+    }
+
+    bool JitterBuffer::push(uint32_t sequence, const uint8_t *data, uint16_t length, uint32_t nowMicros) {
+        if (length > ModemFrame::Capacity) return false;
+        this->_pushed++;
+
+        // transit is arrival less send time, both in micros; only its changes matter
+        const uint32_t transit = nowMicros - sequence * this->_frameMicros;
+        if (this->_arrivals) {
+            int32_t change = (int32_t) (transit - this->_lastTransit);
+            if (change < 0) change = -change;
+            this->_jitter = (uint32_t) ((int64_t) this->_jitter + change - ((this->_jitter + 8) >> 4));
+        }
+        this->_lastTransit = transit;
+        if (this->_arrivals < SettleArrivals) this->_arrivals++;
+        this->updateTarget();
+
+        if (this->_any) {
+            const int32_t ahead = (int32_t) (sequence - this->_next);
+            if (ahead < 0) {
+                // still filling, an earlier frame may come after a later one: start from it if it fits
+                if (this->_playing || (int32_t) (this->_newest - sequence) > Depth - 1) {
+                    this->_lateDrops++;
+                    return false;
+                }
+                this->_next = sequence;
+            } else if (ahead > Depth - 2) {
+                this->flush();
+                this->_resyncs++;
+            }
+        }
+        if (!this->_any) {
+            this->_next = sequence;
+            this->_newest = sequence;
+            this->_any = true;
+        }
+
+        Slot &slot = this->_slots[sequence % Depth];
+        if (slot.frame) {
+            // the span kept is under Depth, so this can only be the same sequence again
+            this->_duplicates++;
+            return false;
+        }
+        ModemFrame *frame = this->_pool.acquire();
+        if (!frame) return false;
+        frame->type = ModemFrameType::Data;
+        frame->length = length;
+        memcpy(frame->data, data, length);
+        slot.frame = frame;
+        slot.sequence = sequence;
+        slot.arrivalMicros = nowMicros;
+        if ((int32_t) (sequence + 1 - this->_newest) > 0) this->_newest = sequence + 1;
+        return true;
+    }
+
+    PlayoutResult JitterBuffer::pop(uint32_t nowMicros, const ModemFrame *&frame) {
+        frame = 0;
+        if (this->_held) {
+            this->_pool.release(this->_held);
+            this->_held = 0;
+        }
+        if (!this->_playing) {
+            if (!this->_any || this->depth() < this->_target) return PlayoutResult::Waiting;
+            this->_playing = true;
+            this->_windowPops = 0;
+            this->_windowLow = 0xff;
+        }
+
+        // more than the target all through the window: skip a frame
+        const uint8_t depth = this->depth();
+        if (depth < this->_windowLow) this->_windowLow = depth;
+        if (++this->_windowPops >= ShrinkWindow) {
+            if (this->_windowLow > this->_target) {
+                Slot &skipped = this->_slots[this->_next % Depth];
+                if (skipped.frame) {
+                    this->_pool.release(skipped.frame);
+                    skipped.frame = 0;
+                }
+                this->_next++;
+                this->_shrunk++;
+            }
+            this->_windowPops = 0;
+            this->_windowLow = 0xff;
+        }
+
+        Slot &slot = this->_slots[this->_next % Depth];
+        if (slot.frame) {
+            this->_held = slot.frame;
+            slot.frame = 0;
+            this->_next++;
+            const uint32_t latency = nowMicros - slot.arrivalMicros;
+            this->_lastLatency = latency;
+            if (latency > this->_maxLatency) this->_maxLatency = latency;
+            this->_latencySum += latency;
+            this->_played++;
+            frame = this->_held;
+            return PlayoutResult::Frame;
+        }
+        const uint8_t behind = this->depth();
+        if (behind >= this->_target && behind > 1) {
+            this->_next++;
+            this->_lost++;
+            return PlayoutResult::Lost;
+        }
+        this->_stretched++;
+        return PlayoutResult::Stretched;
+    }
+
+    bool JitterBuffer::playing() const {
+        return this->_playing;
+    }
+
+    uint8_t JitterBuffer::depth() const {
+        if (!this->_any) return 0;
+        const int32_t span = (int32_t) (this->_newest - this->_next);
+        return (uint8_t) (span > 0 ? span : 0);
+    }
+
+    uint8_t JitterBuffer::targetFrames() const {
+        return this->_target;
+    }
+
+    uint32_t JitterBuffer::jitterMicros() const {
+        return this->_jitter >> 4;
+    }
+
+    // STATS
+    //================================================================================================
+    uint32_t JitterBuffer::pushed() const {
+        return this->_pushed;
+    }
+
+    uint32_t JitterBuffer::played() const {
+        return this->_played;
+    }
+
+    uint32_t JitterBuffer::lost() const {
+        return this->_lost;
+    }
+
+    uint32_t JitterBuffer::stretched() const {
+        return this->_stretched;
+    }
+
+    uint32_t JitterBuffer::shrunk() const {
+        return this->_shrunk;
+    }
+
+    uint32_t JitterBuffer::lateDrops() const {
+        return this->_lateDrops;
+    }
+
+    uint32_t JitterBuffer::duplicates() const {
+        return this->_duplicates;
+    }
+
+    uint32_t JitterBuffer::resyncs() const {
+        return this->_resyncs;
+    }
+
+    uint32_t JitterBuffer::lastLatencyMicros() const {
+        return this->_lastLatency;
+    }
+
+    uint32_t JitterBuffer::meanLatencyMicros() const {
+        return this->_played ? (uint32_t) (this->_latencySum / this->_played) : 0;
+    }
+
+    uint32_t JitterBuffer::maxLatencyMicros() const {
+        return this->_maxLatency;
+    }
+
+    void JitterBuffer::resetStats() {
+        this->_pushed = 0;
+        this->_played = 0;
+        this->_lost = 0;
+        this->_stretched = 0;
+        this->_shrunk = 0;
+        this->_lateDrops = 0;
+        this->_duplicates = 0;
+        this->_resyncs = 0;
+        this->_lastLatency = 0;
+        this->_maxLatency = 0;
+        this->_latencySum = 0;
+    }
+
+    void JitterBuffer::consoleCommand(void *context, HAL::SerialPort &out, const char *args) {
+        JitterBuffer *buffer = (JitterBuffer *) context;
+        if (strcmp(args, "reset") == 0) {
+            buffer->resetStats();
+            out.println("jitter: stats reset");
+            return;
+        }
+        char line[128];
+        snprintf(line, sizeof(line), "jitter: %s, %lu us frames, depth %u, target %u, jitter %lu us",
+                 buffer->_playing ? "playing" : "filling", (unsigned long) buffer->_frameMicros,
+                 (unsigned int) buffer->depth(), (unsigned int) buffer->_target,
+                 (unsigned long) buffer->jitterMicros());
+        out.println(line);
+        snprintf(line, sizeof(line), "  pushed %lu, played %lu, lost %lu, stretched %lu, shrunk %lu",
+                 (unsigned long) buffer->_pushed, (unsigned long) buffer->_played, (unsigned long) buffer->_lost,
+                 (unsigned long) buffer->_stretched, (unsigned long) buffer->_shrunk);
+        out.println(line);
+        snprintf(line, sizeof(line), "  late %lu, duplicates %lu, resyncs %lu", (unsigned long) buffer->_lateDrops,
+                 (unsigned long) buffer->_duplicates, (unsigned long) buffer->_resyncs);
+        out.println(line);
+        snprintf(line, sizeof(line), "  latency last %lu us, mean %lu us, max %lu us",
+                 (unsigned long) buffer->_lastLatency, (unsigned long) buffer->meanLatencyMicros(),
+                 (unsigned long) buffer->_maxLatency);
+        out.println(line);
+    }
+}
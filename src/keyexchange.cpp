@@ -0,0 +1,250 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include <stdio.h>
+#include <string.h>
+#include "keyexchange.h"
+#include "rtos.h"
+
+namespace StegoPhone {
+    namespace {
+        // HChaCha20 nonce for the session key; any fixed value works, this one names what it is for
+        const uint8_t SessionLabel[16] = {'S', 't', 'e', 'g', 'o', 'P', 'h', 'o', 'n', 'e', ' ', 'k', 'e', 'y', 'x', 0};
+    }
+
+    KeyExchange::KeyExchange(FrameCipher &cipher) : _cipher(cipher) {
+        this->_task = 0;
+        this->_state = KeyExchangeState::Idle;
+        this->_beginRequested = false;
+        this->_abortRequested = false;
+        this->_peerReady = false;
+        this->_initiator = false;
+        this->_initiatorFromKeys = false;
+        this->_sliceSteps = DefaultSliceSteps;
+        memset(this->_secret, 0, sizeof(this->_secret));
+        memset(this->_public, 0, sizeof(this->_public));
+        memset(this->_peer, 0, sizeof(this->_peer));
+        this->resetStats();
+    }
+
+    KeyExchange::~KeyExchange() {
+        this->stopTask();
+        Crypto::wipe(this->_secret, sizeof(this->_secret));
+    }
+
+    void KeyExchange::wake() {
+        if (this->_task) this->_task->notify();
+    }
+
+    void KeyExchange::begin(const uint8_t *secret, bool initiator) {
+        memcpy(this->_secret, secret, sizeof(this->_secret));
+        this->_initiator = initiator;
+        this->_initiatorFromKeys = false;
+        this->_peerReady = false;
+        this->_beginRequested = true;
+        this->wake();
+    }
+
+    void KeyExchange::begin(const uint8_t *secret) {
+        this->begin(secret, false);
+        this->_initiatorFromKeys = true;
+    }
+
+    void KeyExchange::peerKey(const uint8_t *peerPublic) {
+        memcpy(this->_peer, peerPublic, sizeof(this->_peer));
+        this->_peerReady = true;
+        this->wake();
+    }
+
+    void KeyExchange::abort() {
+        this->_abortRequested = true;
+        this->wake();
+    }
+
+    KeyExchangeState KeyExchange::state() const {
+        return this->_state;
+    }
+
+    bool KeyExchange::publicKey(uint8_t *out) const {
+        const KeyExchangeState state = this->_state;
+        // a begin() not taken up yet leaves the last exchange's key in place
+        if (this->_beginRequested) return false;
+        if (state != KeyExchangeState::WaitingPeer && state != KeyExchangeState::ComputingShared &&
+            state != KeyExchangeState::Established) return false;
+        memcpy(out, this->_public, sizeof(this->_public));
+        return true;
+    }
+
+    void KeyExchange::setSliceSteps(uint16_t steps) {
+        this->_sliceSteps = steps ? steps : 1;
+    }
+
+    uint16_t KeyExchange::sliceSteps() const {
+        return this->_sliceSteps;
+    }
+
+    void KeyExchange::finish() {
+        uint8_t shared[Crypto::X25519::Bytes];
+        // equal keys would make both ends initiators, both sending under the same nonces
+        const int order = memcmp(this->_public, this->_peer, sizeof(this->_public));
+        if (this->_job.result(shared) && (!this->_initiatorFromKeys || order != 0)) {
+            uint8_t key[Crypto::KeyBytes];
+            Crypto::hchacha20(shared, SessionLabel, key);
+            this->_cipher.setKey(key, this->_initiatorFromKeys ? order > 0 : this->_initiator);
+            Crypto::wipe(key, sizeof(key));
+            this->_state = KeyExchangeState::Established;
+            this->_established++;
+        } else {
+            this->_state = KeyExchangeState::Failed;
+            this->_failed++;
+        }
+        Crypto::wipe(shared, sizeof(shared));
+        Crypto::wipe(this->_secret, sizeof(this->_secret));
+        this->_job.clear();
+    }
+
+    bool KeyExchange::slice() {
+        if (this->_abortRequested) {
+            this->_abortRequested = false;
+            this->_beginRequested = false;
+            this->_peerReady = false;
+            this->_job.clear();
+            Crypto::wipe(this->_secret, sizeof(this->_secret));
+            this->_state = KeyExchangeState::Idle;
+            return false;
+        }
+        // timed from before any state changes, so the slice is all there is between two reads of micros()
+        const uint32_t start = HAL::micros();
+        if (this->_beginRequested) {
+            this->_beginRequested = false;
+            this->_job.begin(this->_secret, Crypto::X25519::BasePoint);
+            this->_publicMicros = 0;
+            this->_sharedMicros = 0;
+            this->_state = KeyExchangeState::ComputingPublic;
+        }
+        if (this->_state == KeyExchangeState::WaitingPeer && this->_peerReady) {
+            this->_peerReady = false;
+            this->_job.begin(this->_secret, this->_peer);
+            this->_state = KeyExchangeState::ComputingShared;
+        }
+        const KeyExchangeState state = this->_state;
+        if (state != KeyExchangeState::ComputingPublic && state != KeyExchangeState::ComputingShared) return false;
+
+        const bool done = this->_job.step(this->_sliceSteps);
+        if (done) {
+            if (state == KeyExchangeState::ComputingPublic) {
+                this->_job.result(this->_public);
+                this->_job.clear();
+                this->_state = KeyExchangeState::WaitingPeer;
+            } else {
+                this->finish();
+            }
+        }
+        const uint32_t elapsed = HAL::micros() - start;
+        this->_slices++;
+        this->_lastSliceMicros = elapsed;
+        if (elapsed > this->_maxSliceMicros) this->_maxSliceMicros = elapsed;
+        if (state == KeyExchangeState::ComputingPublic)
+            this->_publicMicros += elapsed;
+        else
+            this->_sharedMicros += elapsed;
+
+        // the peer's key may already be here
+        return !done || (this->_state == KeyExchangeState::WaitingPeer && this->_peerReady);
+    }
+
+    bool KeyExchange::startTask(uint8_t priority) {
+        if (this->_task) return true;
+        const TaskSpec spec = {"keyx", priority, TaskStackWords, TaskTrigger::Event, RTOS::WaitForever,
+                               KeyExchange::taskStep, this};
+        this->_task = TaskManager::getInstance()->start(spec);
+        return this->_task != 0;
+    }
+
+    void KeyExchange::stopTask() {
+        if (!this->_task) return;
+        ManagedTask *task = this->_task;
+        this->_task = 0;
+        TaskManager::getInstance()->stop(task);
+    }
+
+    bool KeyExchange::taskRunning() const {
+        return this->_task != 0;
+    }
+
+    void KeyExchange::taskStep(void *context, uint32_t notifications) {
+        KeyExchange *exchange = (KeyExchange *) context;
+        // one slice per step: with more to do, the next comes after a tick's sleep, so the CPU is
+        // handed to every other task, lower priorities too; otherwise wait for begin()/peerKey()
+        ManagedTask *task = exchange->_task;
+        const bool more = exchange->slice();
+        if (task) task->setPeriod(more ? SliceGapMs : RTOS::WaitForever);
+    }
+
+    // STATS
+    //================================================================================================
+    uint32_t KeyExchange::slices() const {
+        return this->_slices;
+    }
+
+    uint32_t KeyExchange::lastSliceMicros() const {
+        return this->_lastSliceMicros;
+    }
+
+    uint32_t KeyExchange::maxSliceMicros() const {
+        return this->_maxSliceMicros;
+    }
+
+    uint32_t KeyExchange::publicMicros() const {
+        return this->_publicMicros;
+    }
+
+    uint32_t KeyExchange::sharedMicros() const {
+        return this->_sharedMicros;
+    }
+
+    uint32_t KeyExchange::established() const {
+        return this->_established;
+    }
+
+    uint32_t KeyExchange::failed() const {
+        return this->_failed;
+    }
+
+    void KeyExchange::resetStats() {
+        this->_slices = 0;
+        this->_lastSliceMicros = 0;
+        this->_maxSliceMicros = 0;
+        this->_publicMicros = 0;
+        this->_sharedMicros = 0;
+        this->_established = 0;
+        this->_failed = 0;
+    }
+
+    void KeyExchange::consoleCommand(void *context, HAL::SerialPort &out, const char *args) {
+        KeyExchange *exchange = (KeyExchange *) context;
+        if (strcmp(args, "reset") == 0) {
+            exchange->resetStats();
+            out.println("keyx: stats reset");
+            return;
+        }
+        static const char *const states[] = {"idle", "computing public", "waiting for peer", "computing shared",
+                                             "established", "failed"};
+        char line[128];
+        snprintf(line, sizeof(line), "keyx: x25519, %s, %u steps/slice, %s", states[(uint8_t) exchange->_state],
+                 (unsigned int) exchange->_sliceSteps, exchange->taskRunning() ? "task" : "polled");
+        out.println(line);
+        snprintf(line, sizeof(line), "  slices %lu, last %lu us, max %lu us, public %lu us, shared %lu us",
+                 (unsigned long) exchange->_slices, (unsigned long) exchange->_lastSliceMicros,
+                 (unsigned long) exchange->_maxSliceMicros, (unsigned long) exchange->_publicMicros,
+                 (unsigned long) exchange->_sharedMicros);
+        out.println(line);
+        snprintf(line, sizeof(line), "  established %lu, failed %lu", (unsigned long) exchange->_established,
+                 (unsigned long) exchange->_failed);
+        out.println(line);
+    }
+}
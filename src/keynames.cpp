@@ -0,0 +1,412 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include "keynames.h"
+#include "hal.h"
+
+// Teensy 4 copies ordinary const data into RAM at startup; .progmem keeps it in flash (read in place)
+#if defined(__IMXRT1062__)
+#define STEGOS_FLASH __attribute__((section(".progmem")))
+#else
+#define STEGOS_FLASH
+#endif
+
+// TABLES
+//================================================================================================
+// each list is written once and expanded into the string pool and the offset tables below
+
+// in code order: the table is indexed by code
+#define STEGOS_CONTROL_KEYS(X) \
+    X(0, "NULL") \
+    X(1, "SOH") \
+    X(2, "STX") \
+    X(3, "ETX") \
+    X(4, "EOT") \
+    X(5, "ENQ") \
+    X(6, "ACK") \
+    X(7, "BEL") \
+    X(8, "BS") \
+    X(9, "HT") \
+    X(10, "LF") \
+    X(11, "VT") \
+    X(12, "FF") \
+    X(13, "CR") \
+    X(14, "SO") \
+    X(15, "SI") \
+    X(16, "DLE") \
+    X(17, "DC1") \
+    X(18, "DC2") \
+    X(19, "DC3") \
+    X(20, "DC4") \
+    X(21, "NAK") \
+    X(22, "SYN") \
+    X(23, "ETB") \
+    X(24, "CAN") \
+    X(25, "EM") \
+    X(26, "SUB") \
+    X(27, "ESC") \
+    X(28, "FS") \
+    X(29, "GS") \
+    X(30, "RS") \
+    X(31, "US") \
+    X(32, "Space")
+
+// ascending KEYD_* values
+#define STEGOS_SPECIAL_KEYS(X) \
+    X(KEYD_F1, "F1") \
+    X(KEYD_F2, "F2") \
+    X(KEYD_F3, "F3") \
+    X(KEYD_F4, "F4") \
+    X(KEYD_F5, "F5") \
+    X(KEYD_F6, "F6") \
+    X(KEYD_F7, "F7") \
+    X(KEYD_F8, "F8") \
+    X(KEYD_F9, "F9") \
+    X(KEYD_F10, "F10") \
+    X(KEYD_F11, "F11") \
+    X(KEYD_F12, "F12") \
+    X(KEYD_INSERT, "Ins") \
+    X(KEYD_HOME, "HOME") \
+    X(KEYD_PAGE_UP, "PUP") \
+    X(KEYD_DELETE, "Del") \
+    X(KEYD_END, "END") \
+    X(KEYD_PAGE_DOWN, "PDN") \
+    X(KEYD_RIGHT, "RIGHT") \
+    X(KEYD_LEFT, "LEFT") \
+    X(KEYD_DOWN, "DN") \
+    X(KEYD_UP, "UP")
+
+// HID Usage Tables, consumer page (0x0C), ascending
+#define STEGOS_CONSUMER_KEYS(X) \
+    X(0x020, "+10") \
+    X(0x021, "+100") \
+    X(0x022, "AM/PM") \
+    X(0x030, "Power") \
+    X(0x031, "Reset") \
+    X(0x032, "Sleep") \
+    X(0x033, "Sleep After") \
+    X(0x034, "Sleep Mode") \
+    X(0x035, "Illumination") \
+    X(0x036, "Function Buttons") \
+    X(0x040, "Menu") \
+    X(0x041, "Menu  Pick") \
+    X(0x042, "Menu Up") \
+    X(0x043, "Menu Down") \
+    X(0x044, "Menu Left") \
+    X(0x045, "Menu Right") \
+    X(0x046, "Menu Escape") \
+    X(0x047, "Menu Value Increase") \
+    X(0x048, "Menu Value Decrease") \
+    X(0x060, "Data On Screen") \
+    X(0x061, "Closed Caption") \
+    X(0x062, "Closed Caption Select") \
+    X(0x063, "VCR/TV") \
+    X(0x064, "Broadcast Mode") \
+    X(0x065, "Snapshot") \
+    X(0x066, "Still") \
+    X(0x080, "Selection") \
+    X(0x081, "Assign Selection") \
+    X(0x082, "Mode Step") \
+    X(0x083, "Recall Last") \
+    X(0x084, "Enter Channel") \
+    X(0x085, "Order Movie") \
+    X(0x086, "Channel") \
+    X(0x087, "Media Selection") \
+    X(0x088, "Media Select Computer") \
+    X(0x089, "Media Select TV") \
+    X(0x08A, "Media Select WWW") \
+    X(0x08B, "Media Select DVD") \
+    X(0x08C, "Media Select Telephone") \
+    X(0x08D, "Media Select Program Guide") \
+    X(0x08E, "Media Select Video Phone") \
+    X(0x08F, "Media Select Games") \
+    X(0x090, "Media Select Messages") \
+    X(0x091, "Media Select CD") \
+    X(0x092, "Media Select VCR") \
+    X(0x093, "Media Select Tuner") \
+    X(0x094, "Quit") \
+    X(0x095, "Help") \
+    X(0x096, "Media Select Tape") \
+    X(0x097, "Media Select Cable") \
+    X(0x098, "Media Select Satellite") \
+    X(0x099, "Media Select Security") \
+    X(0x09A, "Media Select Home") \
+    X(0x09B, "Media Select Call") \
+    X(0x09C, "Channel Increment") \
+    X(0x09D, "Channel Decrement") \
+    X(0x09E, "Media Select SAP") \
+    X(0x0A0, "VCR Plus") \
+    X(0x0A1, "Once") \
+    X(0x0A2, "Daily") \
+    X(0x0A3, "Weekly") \
+    X(0x0A4, "Monthly") \
+    X(0x0B0, "Play") \
+    X(0x0B1, "Pause") \
+    X(0x0B2, "Record") \
+    X(0x0B3, "Fast Forward") \
+    X(0x0B4, "Rewind") \
+    X(0x0B5, "Scan Next Track") \
+    X(0x0B6, "Scan Previous Track") \
+    X(0x0B7, "Stop") \
+    X(0x0B8, "Eject") \
+    X(0x0B9, "Random Play") \
+    X(0x0BA, "Select DisC") \
+    X(0x0BB, "Enter Disc") \
+    X(0x0BC, "Repeat") \
+    X(0x0BD, "Tracking") \
+    X(0x0BE, "Track Normal") \
+    X(0x0BF, "Slow Tracking") \
+    X(0x0C0, "Frame Forward") \
+    X(0x0C1, "Frame Back") \
+    X(0x0C2, "Mark") \
+    X(0x0C3, "Clear Mark") \
+    X(0x0C4, "Repeat From Mark") \
+    X(0x0C5, "Return To Mark") \
+    X(0x0C6, "Search Mark Forward") \
+    X(0x0C7, "Search Mark Backwards") \
+    X(0x0C8, "Counter Reset") \
+    X(0x0C9, "Show Counter") \
+    X(0x0CA, "Tracking Increment") \
+    X(0x0CB, "Tracking Decrement") \
+    X(0x0CD, "Pause/Continue") \
+    X(0x0E0, "Volume") \
+    X(0x0E1, "Balance") \
+    X(0x0E2, "Mute") \
+    X(0x0E3, "Bass") \
+    X(0x0E4, "Treble") \
+    X(0x0E5, "Bass Boost") \
+    X(0x0E6, "Surround Mode") \
+    X(0x0E7, "Loudness") \
+    X(0x0E8, "MPX") \
+    X(0x0E9, "Volume Up") \
+    X(0x0EA, "Volume Down") \
+    X(0x0F0, "Speed Select") \
+    X(0x0F1, "Playback Speed") \
+    X(0x0F2, "Standard Play") \
+    X(0x0F3, "Long Play") \
+    X(0x0F4, "Extended Play") \
+    X(0x0F5, "Slow") \
+    X(0x100, "Fan Enable") \
+    X(0x101, "Fan Speed") \
+    X(0x102, "Light") \
+    X(0x103, "Light Illumination Level") \
+    X(0x104, "Climate Control Enable") \
+    X(0x105, "Room Temperature") \
+    X(0x106, "Security Enable") \
+    X(0x107, "Fire Alarm") \
+    X(0x108, "Police Alarm") \
+    X(0x150, "Balance Right") \
+    X(0x151, "Balance Left") \
+    X(0x152, "Bass Increment") \
+    X(0x153, "Bass Decrement") \
+    X(0x154, "Treble Increment") \
+    X(0x155, "Treble Decrement") \
+    X(0x160, "Speaker System") \
+    X(0x161, "Channel Left") \
+    X(0x162, "Channel Right") \
+    X(0x163, "Channel Center") \
+    X(0x164, "Channel Front") \
+    X(0x165, "Channel Center Front") \
+    X(0x166, "Channel Side") \
+    X(0x167, "Channel Surround") \
+    X(0x168, "Channel Low Frequency Enhancement") \
+    X(0x169, "Channel Top") \
+    X(0x16A, "Channel Unknown") \
+    X(0x170, "Sub-channel") \
+    X(0x171, "Sub-channel Increment") \
+    X(0x172, "Sub-channel Decrement") \
+    X(0x173, "Alternate Audio Increment") \
+    X(0x174, "Alternate Audio Decrement") \
+    X(0x180, "Application Launch Buttons") \
+    X(0x181, "AL Launch Button Configuration Tool") \
+    X(0x182, "AL Programmable Button Configuration") \
+    X(0x183, "AL Consumer Control Configuration") \
+    X(0x184, "AL Word Processor") \
+    X(0x185, "AL Text Editor") \
+    X(0x186, "AL Spreadsheet") \
+    X(0x187, "AL Graphics Editor") \
+    X(0x188, "AL Presentation App") \
+    X(0x189, "AL Database App") \
+    X(0x18A, "AL Email Reader") \
+    X(0x18B, "AL Newsreader") \
+    X(0x18C, "AL Voicemail") \
+    X(0x18D, "AL Contacts/Address Book") \
+    X(0x18E, "AL Calendar/Schedule") \
+    X(0x18F, "AL Task/Project Manager") \
+    X(0x190, "AL Log/Journal/Timecard") \
+    X(0x191, "AL Checkbook/Finance") \
+    X(0x192, "AL Calculator") \
+    X(0x193, "AL A/V Capture/Playback") \
+    X(0x194, "AL Local Machine Browser") \
+    X(0x195, "AL LAN/WAN Browser") \
+    X(0x196, "AL Internet Browser") \
+    X(0x197, "AL Remote Networking/ISP Connect") \
+    X(0x198, "AL Network Conference") \
+    X(0x199, "AL Network Chat") \
+    X(0x19A, "AL Telephony/Dialer") \
+    X(0x19B, "AL Logon") \
+    X(0x19C, "AL Logoff") \
+    X(0x19D, "AL Logon/Logoff") \
+    X(0x19E, "AL Terminal Lock/Screensaver") \
+    X(0x19F, "AL Control Panel") \
+    X(0x1A0, "AL Command Line Processor/Run") \
+    X(0x1A1, "AL Process/Task Manager") \
+    X(0x1A2, "AL Select Tast/Application") \
+    X(0x1A3, "AL Next Task/Application") \
+    X(0x1A4, "AL Previous Task/Application") \
+    X(0x1A5, "AL Preemptive Halt Task/Application") \
+    X(0x200, "Generic GUI Application Controls") \
+    X(0x201, "AC New") \
+    X(0x202, "AC Open") \
+    X(0x203, "AC Close") \
+    X(0x204, "AC Exit") \
+    X(0x205, "AC Maximize") \
+    X(0x206, "AC Minimize") \
+    X(0x207, "AC Save") \
+    X(0x208, "AC Print") \
+    X(0x209, "AC Properties") \
+    X(0x21A, "AC Undo") \
+    X(0x21B, "AC Copy") \
+    X(0x21C, "AC Cut") \
+    X(0x21D, "AC Paste") \
+    X(0x21E, "AC Select All") \
+    X(0x21F, "AC Find") \
+    X(0x220, "AC Find and Replace") \
+    X(0x221, "AC Search") \
+    X(0x222, "AC Go To") \
+    X(0x223, "AC Home") \
+    X(0x224, "AC Back") \
+    X(0x225, "AC Forward") \
+    X(0x226, "AC Stop") \
+    X(0x227, "AC Refresh") \
+    X(0x228, "AC Previous Link") \
+    X(0x229, "AC Next Link") \
+    X(0x22A, "AC Bookmarks") \
+    X(0x22B, "AC History") \
+    X(0x22C, "AC Subscriptions") \
+    X(0x22D, "AC Zoom In") \
+    X(0x22E, "AC Zoom Out") \
+    X(0x22F, "AC Zoom") \
+    X(0x230, "AC Full Screen View") \
+    X(0x231, "AC Normal View") \
+    X(0x232, "AC View Toggle") \
+    X(0x233, "AC Scroll Up") \
+    X(0x234, "AC Scroll Down") \
+    X(0x235, "AC Scroll") \
+    X(0x236, "AC Pan Left") \
+    X(0x237, "AC Pan Right") \
+    X(0x238, "AC Pan") \
+    X(0x239, "AC New Window") \
+    X(0x23A, "AC Tile Horizontally") \
+    X(0x23B, "AC Tile Vertically") \
+    X(0x23C, "AC Format")
+
+namespace StegoPhone {
+    namespace {
+        struct KeyName {
+            uint16_t code;
+            uint16_t name; // offset into the pool
+        };
+
+        // every name back to back, each its own NUL terminated member
+        struct NamePool {
+#define STEGOS_POOL_CONTROL(code, name) char control_##code[sizeof(name)];
+#define STEGOS_POOL_SPECIAL(code, name) char special_##code[sizeof(name)];
+#define STEGOS_POOL_CONSUMER(code, name) char consumer_##code[sizeof(name)];
+            STEGOS_CONTROL_KEYS(STEGOS_POOL_CONTROL)
+            STEGOS_SPECIAL_KEYS(STEGOS_POOL_SPECIAL)
+            STEGOS_CONSUMER_KEYS(STEGOS_POOL_CONSUMER)
+#undef STEGOS_POOL_CONTROL
+#undef STEGOS_POOL_SPECIAL
+#undef STEGOS_POOL_CONSUMER
+        };
+
+#define STEGOS_POOL_STRING(code, name) name,
+        const NamePool pool STEGOS_FLASH = {
+            STEGOS_CONTROL_KEYS(STEGOS_POOL_STRING)
+            STEGOS_SPECIAL_KEYS(STEGOS_POOL_STRING)
+            STEGOS_CONSUMER_KEYS(STEGOS_POOL_STRING)
+        };
+#undef STEGOS_POOL_STRING
+
+#define STEGOS_CONTROL_ENTRY(code, name) {code, offsetof(NamePool, control_##code)},
+#define STEGOS_SPECIAL_ENTRY(code, name) {code, offsetof(NamePool, special_##code)},
+#define STEGOS_CONSUMER_ENTRY(code, name) {code, offsetof(NamePool, consumer_##code)},
+        constexpr KeyName controlKeys[] STEGOS_FLASH = {STEGOS_CONTROL_KEYS(STEGOS_CONTROL_ENTRY)};
+        constexpr KeyName specialKeys[] STEGOS_FLASH = {STEGOS_SPECIAL_KEYS(STEGOS_SPECIAL_ENTRY)};
+        constexpr KeyName consumerKeys[] STEGOS_FLASH = {STEGOS_CONSUMER_KEYS(STEGOS_CONSUMER_ENTRY)};
+#undef STEGOS_CONTROL_ENTRY
+#undef STEGOS_SPECIAL_ENTRY
+#undef STEGOS_CONSUMER_ENTRY
+
+        const size_t ControlCount = sizeof(controlKeys) / sizeof(controlKeys[0]);
+        const size_t SpecialCount = sizeof(specialKeys) / sizeof(specialKeys[0]);
+        const size_t ConsumerCount = sizeof(consumerKeys) / sizeof(consumerKeys[0]);
+
+        constexpr bool ascending(const KeyName *table, size_t count) {
+            for (size_t i = 1; i < count; i++)
+                if (table[i - 1].code >= table[i].code) return false;
+            return true;
+        }
+
+        constexpr bool indexed(const KeyName *table, size_t count) {
+            for (size_t i = 0; i < count; i++)
+                if (table[i].code != i) return false;
+            return true;
+        }
+
+        static_assert(indexed(controlKeys, ControlCount), "control keys must be listed in code order from 0");
+        static_assert(ascending(specialKeys, SpecialCount), "KEYD_* keys must be listed in ascending order");
+        static_assert(ascending(consumerKeys, ConsumerCount), "consumer usages must be listed in ascending order");
+        static_assert(sizeof(NamePool) <= 0xFFFF, "name offsets are 16 bit");
+
+        const char *name(const KeyName &key) {
+            return (const char *) &pool + key.name;
+        }
+
+        const char *find(const KeyName *table, size_t count, int code) {
+            size_t low = 0;
+            size_t high = count;
+            while (low < high) {
+                const size_t mid = (low + high) / 2;
+                if (table[mid].code < code) low = mid + 1;
+                else high = mid;
+            }
+            if (low < count && table[low].code == code) return name(table[low]);
+            return 0;
+        }
+    }
+
+    const char *KeyNames::keyboard(int unicode) {
+        const char *special = KeyNames::special(unicode);
+        if (special) return special;
+        return KeyNames::control(unicode);
+    }
+
+    const char *KeyNames::special(int unicode) {
+        // all KEYD_* codes sit in 0xC2-0xDA
+        if (unicode < specialKeys[0].code || unicode > specialKeys[SpecialCount - 1].code) return 0;
+        return find(specialKeys, SpecialCount, unicode);
+    }
+
+    const char *KeyNames::control(int unicode) {
+        if (unicode < 0 || unicode >= (int) ControlCount) return 0;
+        return name(controlKeys[unicode]);
+    }
+
+    const char *KeyNames::consumer(uint16_t usage) {
+        return find(consumerKeys, ConsumerCount, usage);
+    }
+
+    size_t KeyNames::count() {
+        return ControlCount + SpecialCount + ConsumerCount;
+    }
+
+    size_t KeyNames::flashBytes() {
+        return sizeof(pool) + sizeof(controlKeys) + sizeof(specialKeys) + sizeof(consumerKeys);
+    }
+}
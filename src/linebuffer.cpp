@@ -5,19 +5,28 @@
 //## Made available under the GPLv3
 //################################################################################################
 
+#include <stdlib.h>
 #include "linebuffer.h"
 
 using namespace StegoPhone;
 
-LineBuffer::LineBuffer() {
-    this->_serialBufferDataLength = 0; // no bytes currently stored in the buffer
-    this->_serialBufferSize = 1024; // default to 1k to start. actual size
-    this->_serialBuffer = (char *) malloc(this->_serialBufferSize);
+LineBuffer::LineBuffer(HAL::SerialPort &serialPort, size_t capacity, LineOverflow overflow) : _serialPort(serialPort) {
+    this->_capacity = 16;
+    while (this->_capacity < capacity)
+        this->_capacity <<= 1;
+    this->_mask = this->_capacity - 1;
+    this->_ring = (char *) malloc(2 * this->_capacity); // mirrored, see header
+    this->_head = 0;
+    this->_lineStart = 0;
+    this->_overflow = overflow;
+    this->_discarding = false;
+    this->_linesReceived = 0;
+    this->_overflows = 0;
 }
 
 LineBuffer::~LineBuffer() {
     // will never happen
-    free(this->_serialBuffer);
+    free(this->_ring);
 }
 
 void LineBuffer::setup() {
@@ -25,28 +34,59 @@ void LineBuffer::setup() {
 }
 
 void LineBuffer::loop() {
-    const int bytesAvailable = Serial1.available();
-    const int bufferAvailable = this->_serialBufferSize - _serialBufferDataLength;
-    if (bytesAvailable > 0) {
-        if (bufferAvailable < bytesAvailable) {
-            const int newSize = 2 * _serialBufferSize;
-            char *reallocPtr = (char *) realloc(this->_serialBuffer, newSize);
-            if (reallocPtr != 0) {
-                this->_serialBuffer = reallocPtr;
-                this->_serialBufferSize = newSize;
-                Serial1.readBytes(this->_serialBuffer + this->_serialBufferDataLength, bytesAvailable);
-                _serialBufferDataLength += bytesAvailable;
-
-                const char delims[] = {'\n'};
-                char *line = NULL;
-                line = strtok(_serialBuffer, delims);
-                while (line != NULL) {
-
-                    line = strtok(NULL, delims);
-                }
-            } else {
-                // exception?
-            }
-        }
+    while (this->_serialPort.available() > 0) {
+        const int c = this->_serialPort.read();
+        if (c < 0) break;
+        this->push((uint8_t) c);
     }
-}
\ No newline at end of file
+}
+
+void LineBuffer::push(const uint8_t *data, size_t length) {
+    while (length--)
+        this->push(*data++);
+}
+
+void LineBuffer::push(uint8_t c) {
+    const uint32_t pos = this->_head++;
+    if (c == '\n') {
+        if (this->_discarding) this->_discarding = false;
+        else this->emit(pos, false);
+        this->_lineStart = this->_head;
+        return;
+    }
+    if (this->_discarding) {
+        this->_lineStart = this->_head;
+        return;
+    }
+    this->_ring[pos & this->_mask] = (char) c;
+    this->_ring[(pos & this->_mask) + this->_capacity] = (char) c;
+    if (this->_head - this->_lineStart == this->_capacity) {
+        // pending line fills the ring; the next byte would overwrite its start
+        this->_overflows++;
+        if (this->_overflow == LineOverflow::EmitPartial) this->emit(this->_head, true);
+        else this->_discarding = true;
+        this->_lineStart = this->_head;
+    }
+}
+
+void LineBuffer::emit(uint32_t end, bool partial) {
+    LineView line;
+    line.data = this->_ring + (this->_lineStart & this->_mask);
+    line.length = end - this->_lineStart;
+    line.partial = partial;
+    if (!partial && line.length > 0 && line.data[line.length - 1] == '\r') line.length--;
+    this->_linesReceived++;
+    this->lineReceived.fire(line);
+}
+
+size_t LineBuffer::capacity() const {
+    return this->_capacity;
+}
+
+uint32_t LineBuffer::linesReceived() const {
+    return this->_linesReceived;
+}
+
+uint32_t LineBuffer::overflows() const {
+    return this->_overflows;
+}
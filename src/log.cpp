@@ -0,0 +1,251 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include <string.h>
+#include "log.h"
+
+namespace StegoPhone {
+    static_assert((STEGOS_LOG_CAPACITY & (STEGOS_LOG_CAPACITY - 1)) == 0, "log capacity must be a power of two");
+
+    static const size_t LineLength = 128;
+
+    Log::Cell Log::_cells[Log::Capacity];
+    std::atomic<uint32_t> Log::_enqueuePos(0);
+    std::atomic<uint32_t> Log::_dequeuePos(0);
+    std::atomic<uint32_t> Log::_dropped[4];
+    uint32_t Log::_drained = 0;
+    uint32_t Log::_drainMicros = 0;
+
+    // QUEUE
+    //================================================================================================
+    // cell i is free for position p when its sequence is p and holds a record for p when it is p + 1;
+    // sequences are stored minus i so the zero initialised table starts out valid
+    Log::Cell *Log::reserve() {
+        uint32_t pos = _enqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            const uint32_t index = pos & (Capacity - 1);
+            Cell &cell = _cells[index];
+            const uint32_t sequence = cell.sequence.load(std::memory_order_acquire) + index;
+            const int32_t diff = (int32_t) (sequence - pos);
+            if (diff == 0) {
+                if (_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.position = pos;
+                    return &cell;
+                }
+            } else if (diff < 0) {
+                return 0; // full
+            } else {
+                pos = _enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void Log::publish(Cell *cell) {
+        const uint32_t index = cell->position & (Capacity - 1);
+        cell->sequence.store(cell->position + 1 - index, std::memory_order_release);
+    }
+
+    bool Log::next(LogRecord &record) {
+        uint32_t pos = _dequeuePos.load(std::memory_order_relaxed);
+        Cell *cell;
+        while (true) {
+            const uint32_t index = pos & (Capacity - 1);
+            cell = &_cells[index];
+            const uint32_t sequence = cell->sequence.load(std::memory_order_acquire) + index;
+            const int32_t diff = (int32_t) (sequence - (pos + 1));
+            if (diff == 0) {
+                if (_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false; // empty, or the next record is still being written
+            } else {
+                pos = _dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        record = cell->record;
+        cell->sequence.store(pos + Capacity - (pos & (Capacity - 1)), std::memory_order_release);
+        return true;
+    }
+
+    // ARGUMENTS
+    //================================================================================================
+    LogText Log::text(const char *data, size_t length) {
+        LogText text;
+        text.data = data;
+        text.length = length;
+        return text;
+    }
+
+    LogText Log::text(const char *str) {
+        return text(str, str ? strlen(str) : 0);
+    }
+
+    void Log::pack(LogRecord &record, LogText value) {
+        const size_t length = value.length < LogRecord::TextCapacity - 1 ? value.length : LogRecord::TextCapacity - 1;
+        if (length > 0) memcpy(record.text, value.data, length);
+        record.text[length] = '\0';
+        record.textArgs |= (uint8_t) (1 << record.argCount);
+        record.args[record.argCount++] = 0;
+    }
+
+    // FORMATTING
+    //================================================================================================
+    static size_t appendNumber(char *buf, size_t pos, size_t size, uintptr_t value, uint8_t base, bool upper,
+                               bool negative, uint8_t width, bool zeroPad, bool leftAlign) {
+        char digits[24];
+        uint8_t count = 0;
+        do {
+            const uint8_t digit = (uint8_t) (value % base);
+            digits[count++] = (char) (digit < 10 ? '0' + digit : (upper ? 'A' : 'a') + digit - 10);
+            value /= base;
+        } while (value > 0);
+        const uint8_t length = count + (negative ? 1 : 0);
+        uint8_t pad = width > length ? width - length : 0;
+        if (negative && zeroPad && pos < size) buf[pos++] = '-';
+        if (!leftAlign)
+            for (; pad > 0 && pos < size; pad--) buf[pos++] = zeroPad ? '0' : ' ';
+        if (negative && !zeroPad && pos < size) buf[pos++] = '-';
+        while (count > 0 && pos < size) buf[pos++] = digits[--count];
+        for (; pad > 0 && pos < size; pad--) buf[pos++] = ' ';
+        return pos;
+    }
+
+    size_t Log::format(const LogRecord &record, char *buf, size_t size) {
+        static const char levels[] = {'D', 'I', 'W', 'E'};
+        if (size == 0) return 0;
+        const size_t last = size - 1;
+        size_t pos = appendNumber(buf, 0, last, record.micros, 10, false, false, 10, false, false);
+        if (pos + 3 <= last) {
+            buf[pos++] = ' ';
+            buf[pos++] = levels[(uint8_t) record.level & 3];
+            buf[pos++] = ' ';
+        }
+
+        uint8_t arg = 0;
+        for (const char *f = record.format; *f && pos < last; f++) {
+            if (*f != '%') {
+                buf[pos++] = *f;
+                continue;
+            }
+            f++;
+            if (*f == '%') {
+                buf[pos++] = '%';
+                continue;
+            }
+            bool leftAlign = false;
+            bool zeroPad = false;
+            for (; *f == '-' || *f == '0'; f++) {
+                if (*f == '-') leftAlign = true;
+                else zeroPad = true;
+            }
+            uint8_t width = 0;
+            for (; *f >= '0' && *f <= '9'; f++) width = (uint8_t) (width * 10 + (*f - '0'));
+            while (*f == 'l' || *f == 'h') f++;
+            if (*f == '\0') break;
+            if (arg >= record.argCount) {
+                buf[pos++] = '?';
+                continue;
+            }
+            const intptr_t value = record.args[arg];
+            const bool isText = (record.textArgs & (1 << arg)) != 0;
+            arg++;
+            switch (*f) {
+                case 'd':
+                case 'i':
+                    pos = appendNumber(buf, pos, last, value < 0 ? (uintptr_t) -value : (uintptr_t) value, 10, false,
+                                       value < 0, width, zeroPad, leftAlign);
+                    break;
+                case 'u':
+                    pos = appendNumber(buf, pos, last, (uintptr_t) value, 10, false, false, width, zeroPad, leftAlign);
+                    break;
+                case 'x':
+                case 'X':
+                    pos = appendNumber(buf, pos, last, (uintptr_t) value, 16, *f == 'X', false, width, zeroPad,
+                                       leftAlign);
+                    break;
+                case 'c':
+                    buf[pos++] = (char) value;
+                    break;
+                case 's': {
+                    const char *str = isText ? record.text : (const char *) value;
+                    if (!str) str = "(null)";
+                    const size_t length = strlen(str);
+                    size_t pad = width > length ? width - length : 0;
+                    if (!leftAlign)
+                        for (; pad > 0 && pos < last; pad--) buf[pos++] = ' ';
+                    for (; *str && pos < last; str++) buf[pos++] = *str;
+                    for (; pad > 0 && pos < last; pad--) buf[pos++] = ' ';
+                    break;
+                }
+                default:
+                    buf[pos++] = '?';
+                    break;
+            }
+        }
+        buf[pos] = '\0';
+        return pos;
+    }
+
+    uint32_t Log::drain(HAL::SerialPort &out, uint32_t maxRecords) {
+        LogRecord record;
+        char line[LineLength];
+        uint32_t count = 0;
+        const uint32_t start = HAL::micros();
+        while (count < maxRecords && next(record)) {
+            const size_t length = format(record, line, sizeof(line));
+            out.write((const uint8_t *) line, length);
+            out.println();
+            count++;
+        }
+        _drained += count;
+        if (count > 0) _drainMicros += HAL::micros() - start;
+        return count;
+    }
+
+    // STATS
+    //================================================================================================
+    uint32_t Log::queued() {
+        return _enqueuePos.load(std::memory_order_relaxed) - _dequeuePos.load(std::memory_order_relaxed);
+    }
+
+    uint32_t Log::dropped() {
+        uint32_t total = 0;
+        for (uint8_t i = 0; i < 4; i++)
+            total += _dropped[i].load(std::memory_order_relaxed);
+        return total;
+    }
+
+    uint32_t Log::dropped(LogLevel level) {
+        return _dropped[(uint8_t) level & 3].load(std::memory_order_relaxed);
+    }
+
+    uint32_t Log::drained() {
+        return _drained;
+    }
+
+    uint32_t Log::drainMicros() {
+        return _drainMicros;
+    }
+
+    void Log::consoleCommand(void *context, HAL::SerialPort &out, const char *args) {
+        out.print("log: level ");
+        out.print((int) STEGOS_LOG_LEVEL);
+        out.print(", queued ");
+        out.print((unsigned long) queued());
+        out.print("/");
+        out.print((unsigned long) Capacity);
+        out.print(", drained ");
+        out.print((unsigned long) _drained);
+        out.print(", dropped D/I/W/E ");
+        for (uint8_t i = 0; i < 4; i++) {
+            if (i > 0) out.print("/");
+            out.print((unsigned long) dropped((LogLevel) i));
+        }
+        out.print(", drain ");
+        out.print((unsigned long) (_drained ? _drainMicros / _drained : 0));
+        out.println(" us/record");
+    }
+}
@@ -9,38 +9,13 @@
 #include <Arduino.h>
 #include <FreeRTOS_TEENSY4.h>
 #include "stegophone.h"
+#include "log.h"
+#include "taskmanager.h"
+#include "rtos.h"
 
-// Declare a semaphore handle.
-SemaphoreHandle_t sem;
-char trash = '\0';
-
-void threadLoop2(void *arg) {
-    while (true) {
-        // Check communications with the ESP8266 on TX1/RX1
-        StegoPhone::StegoPhone::ConsoleSerial.println();
-        StegoPhone::StegoPhone::ConsoleSerial.print("Checking ESP8266...");
-        delay(500);
-        StegoPhone::StegoPhone::ESP8266Serial.println("AT+GMR");
-        if (StegoPhone::StegoPhone::recFind(StegoPhone::StegoPhone::ESP8266Serial, "OK", 5000)) {
-            StegoPhone::StegoPhone::ConsoleSerial.println("....Success");
-        } else {
-            StegoPhone::StegoPhone::ConsoleSerial.println("Failed");
-        }
-        // Clear Seria11 RX buffer
-        StegoPhone::StegoPhone::ConsoleSerial.println("Test Complete");
-        StegoPhone::StegoPhone::ConsoleSerial.println();
-        while (StegoPhone::StegoPhone::ESP8266Serial.available() > 0) {
-            trash = StegoPhone::StegoPhone::ESP8266Serial.read();
-        }
-        delay(2000);
-    }
-}
-
-void threadLoop1(void *arg) {
-    while (1) {
-        StegoPhone::StegoPhone::getInstance()->loop();
-        delay(500);
-    }
+// formats queued log records onto the console
+void logStep(void *context, uint32_t notifications) {
+    StegoPhone::Log::drain(StegoPhone::StegoPhone::ConsoleSerial);
 }
 
 time_t getTeensy3Time() {
@@ -53,16 +28,37 @@ void setup() {
     // set the Time library to use Teensy 3.0's RTC to keep time
     setSyncProvider(getTeensy3Time);
 
-    // initialize semaphore
-    sem = xSemaphoreCreateCounting(1, 0);
-    portBASE_TYPE s1, s2;
-    // create task at priority two
-    s1 = xTaskCreate(threadLoop1, NULL, configMINIMAL_STACK_SIZE, NULL, 2, NULL);
-    // create task at priority one
-    s2 = xTaskCreate(threadLoop2, NULL, configMINIMAL_STACK_SIZE, NULL, 1, NULL);
+    // every task is declared to the TaskManager; "tasks" on the console shows how they are doing
+    StegoPhone::TaskManager *tasks = StegoPhone::TaskManager::getInstance();
+
+    // timers: the boot sequence is already armed and its steps run on this task once the scheduler starts
+    const bool timerTask = StegoPhone::StegoPhone::getInstance()->timers()->startTask(2);
+
+    // RN52 events: the interrupt notifies this task directly, above everything else
+    const bool rn52Task = StegoPhone::RN52::getInstance()->startEventTask(3);
+
+    // display frames go out on their own task, below the UI/USB loop; commits only hand them over
+    const bool flushTask = StegoPhone::StegoPhone::getInstance()->compositor()->startFlushTask(1);
+
+    // USB polling above the UI: callbacks only queue input, the UI task (priority two) handles it
+    const bool stegoTasks = StegoPhone::StegoPhone::getInstance()->startTasks(2, 3);
+
+    // call modem: woken per audio block, which has to be done before the next one arrives
+    const bool modemTask = StegoPhone::StegoPhone::getInstance()->modem()->startTask(3);
+
+    // key agreement below the audio and UI tasks: it sleeps a tick between ladder slices, so nothing waits on it long
+    const bool keyTask = StegoPhone::StegoPhone::getInstance()->keyExchange()->startTask(1);
+
+    // ESP8266 driver: URCs, +IPD payloads and command completions, polled faster while anything is open
+    const bool esp8266Task = StegoPhone::ESP8266::getInstance()->startTask(1);
+
+    // log drain shares priority one
+    const StegoPhone::TaskSpec logSpec = {"log", 1, configMINIMAL_STACK_SIZE + 128, StegoPhone::TaskTrigger::Periodic,
+                                          20, logStep, 0};
+    const bool logTask = tasks->start(logSpec) != 0;
 
     // check for creation errors
-    if (sem == NULL || s1 != pdPASS || s2 != pdPASS) {
+    if (!timerTask || !rn52Task || !flushTask || !stegoTasks || !modemTask || !keyTask || !esp8266Task || !logTask) {
         StegoPhone::StegoPhone::ConsoleSerial.println("Creation problem");
         while (1);
     }
@@ -70,7 +66,7 @@ void setup() {
     StegoPhone::StegoPhone::ConsoleSerial.println("Starting the scheduler !");
 
     // start scheduler
-    vTaskStartScheduler();
+    StegoPhone::RTOS::startScheduler();
     StegoPhone::StegoPhone::ConsoleSerial.println("Insufficient RAM");
     while (1);
 }
@@ -0,0 +1,391 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include <stdio.h>
+#include <string.h>
+#include "modemstage.h"
+#include "rtos.h"
+
+namespace StegoPhone {
+    ModemStage::ModemStage(ModemPhy &phy) : _phy(phy) {
+        this->_task = 0;
+        this->_linkState = ModemLinkState::Idle;
+        this->_startRequested = false;
+        this->_stopRequested = false;
+        this->_stateBlocks = 0;
+        this->_linkBlocks = 0;
+        this->_sending = 0;
+        this->_rxRecycledCount = 0;
+        memset(&this->_linkFrame, 0, sizeof(this->_linkFrame));
+        this->_linkPending = false;
+        this->_linkType = ModemFrameType::Announce;
+        this->_linkHeard = false;
+        this->resetStats();
+    }
+
+    ModemPhy &ModemStage::phy() {
+        return this->_phy;
+    }
+
+    uint32_t ModemStage::deadlineMicros() const {
+        return (uint32_t) ((uint64_t) BlockSamples * 1000000 / this->_phy.sampleRate());
+    }
+
+    uint32_t ModemStage::blocksFor(uint32_t ms) const {
+        return (uint32_t) ((uint64_t) ms * this->_phy.sampleRate() / 1000 / BlockSamples);
+    }
+
+    // LINK
+    //================================================================================================
+    void ModemStage::start() {
+        this->_startRequested = true;
+    }
+
+    void ModemStage::stop() {
+        this->_stopRequested = true;
+    }
+
+    ModemLinkState ModemStage::linkState() const {
+        return this->_linkState;
+    }
+
+    void ModemStage::enterState(ModemLinkState state) {
+        this->_linkState = state;
+        this->_stateBlocks = 0;
+    }
+
+    void ModemStage::queueLink(ModemFrameType type, bool heard) {
+        this->_linkType = type;
+        this->_linkHeard = heard;
+        this->_linkPending = true;
+    }
+
+    // Announce until anyone answers; a Hello says "I hear you", and one with heard set "and you hear me".
+    // Whoever gets a Hello is connected and answers a plain one, so a lost answer is repaired by the
+    // next Hello and two connected ends never ping-pong.
+    void ModemStage::linkReceived(const ModemFrame *frame) {
+        const ModemLinkState state = this->_linkState;
+        if (state == ModemLinkState::Idle) return;
+        if (frame->type == ModemFrameType::Announce) {
+            // a peer (re)starting: whatever we had, it does not hear us yet
+            this->enterState(ModemLinkState::Handshaking);
+            this->queueLink(ModemFrameType::Hello, false);
+            this->_linkBlocks = 0;
+            return;
+        }
+        const bool heard = frame->length > 0 && frame->data[0] != 0;
+        if (state != ModemLinkState::Connected) this->enterState(ModemLinkState::Connected);
+        if (!heard) this->queueLink(ModemFrameType::Hello, true);
+    }
+
+    void ModemStage::transmitTick() {
+        this->_stateBlocks++;
+        this->_linkBlocks++;
+        const uint32_t interval = this->blocksFor(AnnounceIntervalMs);
+        switch (this->_linkState) {
+            case ModemLinkState::Announcing:
+                if (this->_linkBlocks >= interval) this->queueLink(ModemFrameType::Announce, false);
+                break;
+            case ModemLinkState::Handshaking:
+                if (this->_stateBlocks >= this->blocksFor(HandshakeTimeoutMs)) {
+                    this->enterState(ModemLinkState::Announcing);
+                    this->queueLink(ModemFrameType::Announce, false);
+                } else if (this->_linkBlocks >= interval) {
+                    this->queueLink(ModemFrameType::Hello, false);
+                }
+                break;
+            default:
+                break;
+        }
+
+        if (this->_phy.transmitting()) return;
+        if (this->_sending) {
+            this->_txPool.release(this->_sending);
+            this->_sending = 0;
+            this->_framesSent++;
+        }
+        // link frames go first: a handshake should not wait behind a queue of data
+        if (this->_linkPending) {
+            this->_linkFrame.type = this->_linkType;
+            this->_linkFrame.length = this->_linkType == ModemFrameType::Hello ? 1 : 0;
+            this->_linkFrame.data[0] = this->_linkHeard ? 1 : 0;
+            this->_phy.beginFrame(&this->_linkFrame);
+            this->_linkPending = false;
+            this->_linkBlocks = 0;
+            return;
+        }
+        ModemFrame *frame;
+        if (this->_txQueue.pop(frame)) {
+            this->_sending = frame;
+            this->_phy.beginFrame(frame);
+        }
+    }
+
+    // AUDIO SIDE
+    //================================================================================================
+    bool ModemStage::pushAudio(const int16_t *samples) {
+        AudioBlock *block = this->_rxAudio.writeSlot();
+        if (!block) {
+            this->_audioOverruns++;
+            return false;
+        }
+        memcpy(block->samples, samples, sizeof(block->samples));
+        this->_rxAudio.commitWrite();
+        if (this->_task) this->_task->notify();
+        return true;
+    }
+
+    bool ModemStage::pullAudio(int16_t *samples) {
+        AudioBlock *block = this->_txAudio.readSlot();
+        if (!block) {
+            memset(samples, 0, sizeof(block->samples));
+            this->_audioUnderruns++;
+            return false;
+        }
+        memcpy(samples, block->samples, sizeof(block->samples));
+        this->_txAudio.commitRead();
+        return true;
+    }
+
+    // MODEM TASK
+    //================================================================================================
+    uint32_t ModemStage::process() {
+        if (this->_stopRequested) {
+            this->_stopRequested = false;
+            this->_startRequested = false;
+            this->_phy.reset(*this);
+            if (this->_sending) this->_txPool.release(this->_sending);
+            this->_sending = 0;
+            ModemFrame *frame;
+            while (this->_txQueue.pop(frame))
+                this->_txPool.release(frame);
+            this->_linkPending = false;
+            this->enterState(ModemLinkState::Idle);
+        }
+        if (this->_startRequested) {
+            this->_startRequested = false;
+            if (this->_linkState == ModemLinkState::Idle) {
+                this->enterState(ModemLinkState::Announcing);
+                this->queueLink(ModemFrameType::Announce, false);
+            }
+        }
+
+        uint32_t processed = 0;
+        const uint32_t deadline = this->deadlineMicros();
+        AudioBlock *in;
+        while ((in = this->_rxAudio.readSlot()) != 0) {
+            const uint32_t start = HAL::micros();
+            const bool running = this->_linkState != ModemLinkState::Idle;
+            if (running) this->_phy.demodulate(in->samples, BlockSamples, *this);
+            this->_rxAudio.commitRead();
+
+            // a block back out for each one in, plus the lead the audio side plays from
+            while (this->_txAudio.size() < TxLeadBlocks + 1) {
+                AudioBlock *out = this->_txAudio.writeSlot();
+                if (!out) break;
+                if (running) {
+                    this->transmitTick();
+                    this->_phy.modulate(out->samples, BlockSamples);
+                } else {
+                    memset(out->samples, 0, sizeof(out->samples));
+                }
+                this->_txAudio.commitWrite();
+            }
+
+            const uint32_t elapsed = HAL::micros() - start;
+            this->_blocks++;
+            this->_lastBlockMicros = elapsed;
+            if (elapsed > this->_maxBlockMicros) this->_maxBlockMicros = elapsed;
+            if (elapsed > deadline) this->_lateBlocks++;
+            this->_busyMicros += elapsed;
+            processed++;
+        }
+        return processed;
+    }
+
+    bool ModemStage::startTask(uint8_t priority) {
+        if (this->_task) return true;
+        const TaskSpec spec = {"modem", priority, TaskStackWords, TaskTrigger::Event, RTOS::WaitForever,
+                               ModemStage::taskStep, this};
+        this->_task = TaskManager::getInstance()->start(spec);
+        return this->_task != 0;
+    }
+
+    void ModemStage::stopTask() {
+        if (!this->_task) return;
+        ManagedTask *task = this->_task;
+        this->_task = 0;
+        TaskManager::getInstance()->stop(task);
+    }
+
+    bool ModemStage::taskRunning() const {
+        return this->_task != 0;
+    }
+
+    void ModemStage::taskStep(void *context, uint32_t notifications) {
+        ((ModemStage *) context)->process();
+    }
+
+    void ModemStage::recycle(ModemFrame *frame) {
+        this->_rxRecycled[this->_rxRecycledCount] = frame;
+        this->_rxRecycledCount = this->_rxRecycledCount + 1;
+    }
+
+    ModemFrame *ModemStage::frameStart() {
+        if (this->_rxRecycledCount) {
+            this->_rxRecycledCount = this->_rxRecycledCount - 1;
+            return this->_rxRecycled[this->_rxRecycledCount];
+        }
+        ModemFrame *frame = this->_rxPool.acquire();
+        if (!frame) this->_framesDropped++;
+        return frame;
+    }
+
+    void ModemStage::frameDecoded(ModemFrame *frame, bool valid) {
+        if (!valid) {
+            this->_frameErrors++;
+            this->recycle(frame);
+            return;
+        }
+        if (frame->type == ModemFrameType::Data || frame->type == ModemFrameType::KeyShare) {
+            this->_framesReceived++;
+            // data from the peer means it is connected, whether or not its Hello got through
+            if (this->_linkState == ModemLinkState::Handshaking) this->enterState(ModemLinkState::Connected);
+            // the queue is as deep as the pool, so it has room for every frame out of it
+            this->_rxQueue.push(frame);
+            return;
+        }
+        if (frame->type == ModemFrameType::Announce || frame->type == ModemFrameType::Hello)
+            this->linkReceived(frame);
+        else
+            this->_frameErrors++;
+        this->recycle(frame);
+    }
+
+    // FRAMES
+    //================================================================================================
+    ModemFrame *ModemStage::acquire() {
+        ModemFrame *frame = this->_txPool.acquire();
+        if (frame) {
+            frame->type = ModemFrameType::Data;
+            frame->length = 0;
+        }
+        return frame;
+    }
+
+    void ModemStage::send(ModemFrame *frame) {
+        // as deep as the pool, as on the receive side
+        this->_txQueue.push(frame);
+    }
+
+    ModemFrame *ModemStage::receive() {
+        ModemFrame *frame;
+        return this->_rxQueue.pop(frame) ? frame : 0;
+    }
+
+    void ModemStage::release(ModemFrame *frame) {
+        this->_rxPool.release(frame);
+    }
+
+    uint32_t ModemStage::receiveFramesFree() const {
+        return this->_rxPool.available() + this->_rxRecycledCount;
+    }
+
+    // STATS
+    //================================================================================================
+    uint32_t ModemStage::blocks() const {
+        return this->_blocks;
+    }
+
+    uint32_t ModemStage::lateBlocks() const {
+        return this->_lateBlocks;
+    }
+
+    uint32_t ModemStage::lastBlockMicros() const {
+        return this->_lastBlockMicros;
+    }
+
+    uint32_t ModemStage::maxBlockMicros() const {
+        return this->_maxBlockMicros;
+    }
+
+    uint64_t ModemStage::busyMicros() const {
+        return this->_busyMicros;
+    }
+
+    uint32_t ModemStage::audioOverruns() const {
+        return this->_audioOverruns;
+    }
+
+    uint32_t ModemStage::audioUnderruns() const {
+        return this->_audioUnderruns;
+    }
+
+    uint32_t ModemStage::framesSent() const {
+        return this->_framesSent;
+    }
+
+    uint32_t ModemStage::framesReceived() const {
+        return this->_framesReceived;
+    }
+
+    uint32_t ModemStage::frameErrors() const {
+        return this->_frameErrors;
+    }
+
+    uint32_t ModemStage::framesDropped() const {
+        return this->_framesDropped;
+    }
+
+    void ModemStage::resetStats() {
+        this->_blocks = 0;
+        this->_lateBlocks = 0;
+        this->_lastBlockMicros = 0;
+        this->_maxBlockMicros = 0;
+        this->_busyMicros = 0;
+        this->_audioOverruns = 0;
+        this->_audioUnderruns = 0;
+        this->_framesSent = 0;
+        this->_framesReceived = 0;
+        this->_frameErrors = 0;
+        this->_framesDropped = 0;
+    }
+
+    void ModemStage::consoleCommand(void *context, HAL::SerialPort &out, const char *args) {
+        ModemStage *stage = (ModemStage *) context;
+        if (strcmp(args, "reset") == 0) {
+            stage->resetStats();
+            out.println("modem: stats reset");
+            return;
+        }
+        static const char *const states[] = {"idle", "announcing", "handshaking", "connected"};
+        const uint32_t deadline = stage->deadlineMicros();
+        // busy time over the audio time it covered, in tenths of a percent
+        const uint64_t audioMicros = (uint64_t) stage->_blocks * deadline;
+        const uint32_t load = audioMicros ? (uint32_t) (stage->_busyMicros * 1000 / audioMicros) : 0;
+        char line[128];
+        snprintf(line, sizeof(line), "modem: %s, %lu bit/s, %s, %s", stage->_phy.name(),
+                 (unsigned long) stage->_phy.bitRate(), states[(uint8_t) stage->_linkState],
+                 stage->taskRunning() ? "task" : "polled");
+        out.println(line);
+        snprintf(line, sizeof(line), "  blocks %lu x %u @ %lu/s, deadline %lu us, last %lu, max %lu, load %lu.%lu%%",
+                 (unsigned long) stage->_blocks, (unsigned int) BlockSamples,
+                 (unsigned long) stage->_phy.sampleRate(), (unsigned long) deadline,
+                 (unsigned long) stage->_lastBlockMicros, (unsigned long) stage->_maxBlockMicros,
+                 (unsigned long) (load / 10), (unsigned long) (load % 10));
+        out.println(line);
+        snprintf(line, sizeof(line), "  late %lu, audio overruns %lu, underruns %lu",
+                 (unsigned long) stage->_lateBlocks, (unsigned long) stage->_audioOverruns,
+                 (unsigned long) stage->_audioUnderruns);
+        out.println(line);
+        snprintf(line, sizeof(line), "  frames sent %lu, received %lu, bad %lu, dropped %lu, free tx %lu rx %lu",
+                 (unsigned long) stage->_framesSent, (unsigned long) stage->_framesReceived,
+                 (unsigned long) stage->_frameErrors, (unsigned long) stage->_framesDropped,
+                 (unsigned long) stage->_txPool.available(), (unsigned long) stage->receiveFramesFree());
+        out.println(line);
+    }
+}
@@ -0,0 +1,123 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include <string.h>
+#include "patternmatcher.h"
+
+namespace StegoPhone {
+    static const uint8_t NoState = 0xFF;
+
+    PatternMatcher::PatternMatcher(const char *pattern) {
+        this->build(&pattern, 1);
+    }
+
+    PatternMatcher::PatternMatcher(std::initializer_list<const char *> patterns) {
+        this->build(patterns.begin(), (uint8_t) patterns.size());
+    }
+
+    PatternMatcher::PatternMatcher(const char *const *patterns, uint8_t count) {
+        this->build(patterns, count);
+    }
+
+    void PatternMatcher::build(const char *const *patterns, uint8_t count) {
+        memset(this->_classOf, 0, sizeof(this->_classOf)); // class 0: bytes in no pattern
+        memset(this->_delta, NoState, sizeof(this->_delta));
+        memset(this->_output, NoMatch, sizeof(this->_output));
+        this->_valid = (count > 0) && (count <= MaxPatterns);
+        this->_patternCount = 0;
+        this->_stateCount = 1;
+        if (!this->_valid) {
+            memset(this->_delta, 0, sizeof(this->_delta));
+            return;
+        }
+
+        // trie, numbering byte classes as they are first seen
+        uint8_t classCount = 1;
+        for (uint8_t p = 0; p < count && this->_valid; p++) {
+            const char *pattern = patterns[p];
+            const size_t length = pattern ? strlen(pattern) : 0;
+            this->_valid = (length > 0) && (length < 256);
+            this->_patterns[p] = pattern;
+            this->_patternLength[p] = (uint8_t) length;
+            uint8_t state = 0;
+            for (size_t i = 0; i < length && this->_valid; i++) {
+                const uint8_t c = (uint8_t) pattern[i];
+                if (this->_classOf[c] == 0) {
+                    if (classCount == MaxClasses) {
+                        this->_valid = false;
+                        break;
+                    }
+                    this->_classOf[c] = classCount++;
+                }
+                uint8_t &child = this->_delta[state][this->_classOf[c]];
+                if (child == NoState) {
+                    if (this->_stateCount == MaxStates) {
+                        this->_valid = false;
+                        break;
+                    }
+                    child = this->_stateCount++;
+                }
+                state = child;
+            }
+            // longest pattern wins when two end on the same state (identical patterns: first wins)
+            if (this->_valid && this->_output[state] == NoMatch) this->_output[state] = (int8_t) p;
+            this->_patternCount++;
+        }
+        if (!this->_valid) {
+            memset(this->_delta, 0, sizeof(this->_delta));
+            memset(this->_output, NoMatch, sizeof(this->_output));
+            return;
+        }
+
+        // breadth first: failure links folded into a complete transition table
+        uint8_t fail[MaxStates];
+        uint8_t queue[MaxStates];
+        uint8_t queueHead = 0;
+        uint8_t queueTail = 0;
+        fail[0] = 0;
+        for (uint8_t a = 0; a < MaxClasses; a++) {
+            uint8_t &child = this->_delta[0][a];
+            if (child == NoState) {
+                child = 0;
+            } else {
+                fail[child] = 0;
+                queue[queueTail++] = child;
+            }
+        }
+        while (queueHead != queueTail) {
+            const uint8_t state = queue[queueHead++];
+            if (this->_output[state] == NoMatch) this->_output[state] = this->_output[fail[state]];
+            for (uint8_t a = 0; a < MaxClasses; a++) {
+                uint8_t &child = this->_delta[state][a];
+                if (child == NoState) {
+                    child = this->_delta[fail[state]][a];
+                } else {
+                    fail[child] = this->_delta[fail[state]][a];
+                    queue[queueTail++] = child;
+                }
+            }
+        }
+    }
+
+    bool PatternMatcher::valid() const {
+        return this->_valid;
+    }
+
+    uint8_t PatternMatcher::patterns() const {
+        return this->_patternCount;
+    }
+
+    const char *PatternMatcher::pattern(int index) const {
+        if (index < 0 || index >= this->_patternCount) return 0;
+        return this->_patterns[index];
+    }
+
+    size_t PatternMatcher::patternLength(int index) const {
+        if (index < 0 || index >= this->_patternCount) return 0;
+        return this->_patternLength[index];
+    }
+}
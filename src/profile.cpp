@@ -0,0 +1,144 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include <stdio.h>
+#include <string.h>
+#include "profile.h"
+
+#if defined(__IMXRT1062__)
+#include <Arduino.h>
+#endif
+
+namespace StegoPhone {
+    bool Profile::enabled() {
+        return STEGOS_PROFILE != 0;
+    }
+
+    uint32_t Profile::ticksPerMicrosecond() {
+#if defined(__IMXRT1062__)
+        return F_CPU_ACTUAL / 1000000;
+#else
+        return 1000;
+#endif
+    }
+
+    uint32_t Profile::bucketLimit(uint8_t bucket) {
+        if (bucket < 4) return bucket;
+        const uint8_t msb = (bucket >> 2) + 1;
+        const uint32_t step = (uint32_t) 1 << (msb - 2);
+        return ((uint32_t) (4 + (bucket & 3)) << (msb - 2)) + (step - 1);
+    }
+
+    const char *Profile::name(ProbeId id) {
+        switch (id) {
+            case ProbeId::Loop:
+                return "loop";
+            case ProbeId::Draw:
+                return "draw";
+            case ProbeId::Commit:
+                return "commit";
+            case ProbeId::DisplaySend:
+                return "display.send";
+            case ProbeId::UsbPoll:
+                return "usb.poll";
+            case ProbeId::UsbCallback:
+                return "usb.callback";
+            case ProbeId::InputEvent:
+                return "input.event";
+            case ProbeId::RN52:
+                return "rn52";
+            case ProbeId::ESP8266:
+                return "esp8266";
+            default:
+                return "?";
+        }
+    }
+
+#if STEGOS_PROFILE
+    Profile::Histogram Profile::_histograms[(uint8_t) ProbeId::Count];
+
+    bool Profile::stats(ProbeId id, ProbeStats &stats) {
+        // a copy, so a probe recording meanwhile cannot move the numbers under the walk
+        const Histogram histogram = _histograms[(uint8_t) id];
+        memset(&stats, 0, sizeof(stats));
+        if (histogram.count == 0) return false;
+        stats.count = histogram.count;
+        stats.min = histogram.min;
+        stats.max = histogram.max;
+
+        // the bucket holding the ceil(count * p)th sample, clamped to what was seen
+        const uint32_t rank50 = (uint32_t) (((uint64_t) histogram.count * 50 + 99) / 100);
+        const uint32_t rank99 = (uint32_t) (((uint64_t) histogram.count * 99 + 99) / 100);
+        uint32_t seen = 0;
+        for (uint8_t i = 0; i < Buckets; i++) {
+            const uint32_t before = seen;
+            seen += histogram.buckets[i];
+            if (before < rank50 && seen >= rank50) stats.p50 = bucketLimit(i);
+            if (before < rank99 && seen >= rank99) {
+                stats.p99 = bucketLimit(i);
+                break;
+            }
+        }
+        if (stats.p50 < stats.min) stats.p50 = stats.min;
+        if (stats.p50 > stats.max) stats.p50 = stats.max;
+        if (stats.p99 < stats.min) stats.p99 = stats.min;
+        if (stats.p99 > stats.max) stats.p99 = stats.max;
+        return true;
+    }
+
+    void Profile::reset() {
+        memset(_histograms, 0, sizeof(_histograms));
+    }
+#else
+    bool Profile::stats(ProbeId id, ProbeStats &stats) {
+        memset(&stats, 0, sizeof(stats));
+        return false;
+    }
+
+    void Profile::reset() {
+    }
+#endif
+
+    // ticks as microseconds with one decimal
+    static void formatTicks(char *buf, size_t size, uint32_t ticks) {
+        const uint32_t perMicro = Profile::ticksPerMicrosecond();
+        const uint64_t tenths = ((uint64_t) ticks * 10 + perMicro / 2) / perMicro;
+        snprintf(buf, size, "%lu.%lu", (unsigned long) (tenths / 10), (unsigned long) (tenths % 10));
+    }
+
+    void Profile::consoleCommand(void *context, HAL::SerialPort &out, const char *args) {
+        if (!enabled()) {
+            out.println("prof: not compiled in (build with -DSTEGOS_PROFILE=1)");
+            return;
+        }
+        if (strcmp(args, "reset") == 0) {
+            reset();
+            out.println("prof: histograms reset");
+            return;
+        }
+        out.print("prof: us, ");
+        out.print((unsigned long) ticksPerMicrosecond());
+        out.println(" ticks/us");
+        out.println("  probe            count       min       p50       p99       max");
+        for (uint8_t i = 0; i < (uint8_t) ProbeId::Count; i++) {
+            ProbeStats stats;
+            if (!Profile::stats((ProbeId) i, stats)) continue;
+            char min[16];
+            char p50[16];
+            char p99[16];
+            char max[16];
+            formatTicks(min, sizeof(min), stats.min);
+            formatTicks(p50, sizeof(p50), stats.p50);
+            formatTicks(p99, sizeof(p99), stats.p99);
+            formatTicks(max, sizeof(max), stats.max);
+            char line[96];
+            snprintf(line, sizeof(line), "  %-12s %9lu %9s %9s %9s %9s", name((ProbeId) i),
+                     (unsigned long) stats.count, min, p50, p99, max);
+            out.println(line);
+        }
+    }
+}
@@ -0,0 +1,176 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include <string.h>
+#include "reedsolomon.h"
+
+// Decoding is the textbook errors-only chain: syndromes S_i = c(2^i), Berlekamp-Massey for the error
+// locator L(x), a Chien search over the codeword's own positions for its roots, and Forney for the
+// values. Symbol k of n sits at power n - 1 - k, so shortened codewords are just leading zeros.
+
+namespace StegoPhone {
+    namespace Fec {
+        namespace {
+            constexpr GaloisTables buildGalois() {
+                GaloisTables tables = {};
+                uint16_t value = 1;
+                for (uint16_t i = 0; i < 255; i++) {
+                    tables.exp[i] = (uint8_t) value;
+                    tables.exp[i + 255] = (uint8_t) value;
+                    tables.log[value] = (uint8_t) i;
+                    value <<= 1;
+                    if (value & 0x100) value ^= 0x11d;
+                }
+                tables.exp[510] = tables.exp[0];
+                tables.exp[511] = tables.exp[1];
+                return tables;
+            }
+        }
+
+        constexpr GaloisTables Galois = buildGalois();
+
+        ReedSolomon::ReedSolomon(uint8_t parity) {
+            this->_parity = 0;
+            if (!this->setParity(parity)) this->setParity(MaxParity);
+        }
+
+        bool ReedSolomon::setParity(uint8_t parity) {
+            if (parity < 1 || parity > MaxParity) return false;
+            // g(x) = (x - 2^0)(x - 2^1)...(x - 2^(parity - 1)), one factor at a time
+            memset(this->_generator, 0, sizeof(this->_generator));
+            this->_generator[0] = 1;
+            for (uint8_t i = 0; i < parity; i++) {
+                const uint8_t root = Galois.exp[i];
+                for (uint8_t j = (uint8_t) (i + 1); j > 0; j--)
+                    this->_generator[j] ^= multiply(this->_generator[j - 1], root);
+            }
+            this->_parity = parity;
+            return true;
+        }
+
+        uint8_t ReedSolomon::parity() const {
+            return this->_parity;
+        }
+
+        void ReedSolomon::encode(uint8_t *data, uint16_t count, uint16_t stride) const {
+            const uint8_t parity = this->_parity;
+            if (count < parity || count > MaxLength) return;
+            // the remainder of message * x^parity over g(x), shifted through as each symbol comes
+            uint8_t remainder[MaxParity];
+            memset(remainder, 0, parity);
+            const uint16_t message = (uint16_t) (count - parity);
+            for (uint16_t k = 0; k < message; k++) {
+                const uint8_t feedback = data[k * stride] ^ remainder[0];
+                if (feedback) {
+                    const uint16_t logFeedback = Galois.log[feedback];
+                    for (uint8_t j = 0; j + 1 < parity; j++) {
+                        const uint8_t g = this->_generator[j + 1];
+                        remainder[j] = remainder[j + 1] ^ (g ? Galois.exp[logFeedback + Galois.log[g]] : 0);
+                    }
+                    const uint8_t g = this->_generator[parity];
+                    remainder[parity - 1] = g ? Galois.exp[logFeedback + Galois.log[g]] : 0;
+                } else {
+                    memmove(remainder, remainder + 1, parity - 1);
+                    remainder[parity - 1] = 0;
+                }
+            }
+            for (uint8_t j = 0; j < parity; j++)
+                data[(message + j) * stride] = remainder[j];
+        }
+
+        int16_t ReedSolomon::decode(uint8_t *data, uint16_t count, uint16_t stride) const {
+            const uint8_t parity = this->_parity;
+            if (count < parity || count > MaxLength) return -1;
+
+            uint8_t syndromes[MaxParity];
+            uint8_t any = 0;
+            for (uint8_t i = 0; i < parity; i++) {
+                uint8_t s = 0;
+                for (uint16_t k = 0; k < count; k++)
+                    s = (s ? Galois.exp[Galois.log[s] + i] : 0) ^ data[k * stride];
+                syndromes[i] = s;
+                any |= s;
+            }
+            if (!any) return 0;
+
+            // Berlekamp-Massey
+            uint8_t locator[MaxParity + 1] = {1};
+            uint8_t previous[MaxParity + 1] = {1};
+            uint8_t scratch[MaxParity + 1];
+            uint8_t degree = 0;
+            uint8_t shift = 1;
+            uint8_t previousDiscrepancy = 1;
+            for (uint8_t r = 0; r < parity; r++) {
+                uint8_t discrepancy = syndromes[r];
+                for (uint8_t i = 1; i <= degree; i++)
+                    discrepancy ^= multiply(locator[i], syndromes[r - i]);
+                if (!discrepancy) {
+                    shift++;
+                    continue;
+                }
+                const uint8_t scale = divide(discrepancy, previousDiscrepancy);
+                memcpy(scratch, locator, sizeof(scratch));
+                for (uint8_t i = 0; i + shift <= parity; i++)
+                    locator[i + shift] ^= multiply(scale, previous[i]);
+                if (2 * degree <= r) {
+                    degree = (uint8_t) (r + 1 - degree);
+                    memcpy(previous, scratch, sizeof(previous));
+                    previousDiscrepancy = discrepancy;
+                    shift = 1;
+                } else {
+                    shift++;
+                }
+            }
+            if (2 * degree > parity) return -1;
+
+            // Chien search: symbol k is in error when L(2^-(count - 1 - k)) = 0
+            uint16_t positions[MaxParity / 2];
+            uint8_t found = 0;
+            for (uint16_t k = 0; k < count; k++) {
+                const uint16_t inverse = (uint16_t) ((255 - (count - 1 - k)) % 255);
+                uint8_t sum = locator[0];
+                uint16_t power = 0;
+                for (uint8_t j = 1; j <= degree; j++) {
+                    power = (uint16_t) ((power + inverse) % 255);
+                    if (locator[j]) sum ^= Galois.exp[Galois.log[locator[j]] + power];
+                }
+                if (sum) continue;
+                if (found == degree) return -1;
+                positions[found++] = k;
+            }
+            if (found != degree) return -1;
+
+            // Forney: e = X * O(1/X) / L'(1/X), with O(x) = S(x) L(x) mod x^parity
+            uint8_t evaluator[MaxParity];
+            for (uint8_t i = 0; i < parity; i++) {
+                uint8_t sum = 0;
+                for (uint8_t j = 0; j <= degree && j <= i; j++)
+                    sum ^= multiply(locator[j], syndromes[i - j]);
+                evaluator[i] = sum;
+            }
+            uint8_t values[MaxParity / 2];
+            for (uint8_t e = 0; e < found; e++) {
+                const uint16_t location = (uint16_t) (count - 1 - positions[e]); // X = 2^location
+                const uint16_t inverse = (uint16_t) ((255 - location) % 255);
+                uint8_t numerator = 0, denominator = 0;
+                uint16_t power = 0;
+                for (uint8_t i = 0; i < parity; i++) {
+                    if (evaluator[i]) numerator ^= Galois.exp[Galois.log[evaluator[i]] + power];
+                    // the formal derivative keeps the odd terms, one power down
+                    if ((i & 1) && i <= degree && locator[i])
+                        denominator ^= Galois.exp[Galois.log[locator[i]] + (power + 255 - inverse) % 255];
+                    power = (uint16_t) ((power + inverse) % 255);
+                }
+                if (!denominator) return -1;
+                values[e] = multiply(Galois.exp[location], divide(numerator, denominator));
+            }
+            for (uint8_t e = 0; e < found; e++)
+                data[positions[e] * stride] ^= values[e];
+            return found;
+        }
+    }
+}
@@ -5,9 +5,13 @@
 //## Made available under the GPLv3
 //################################################################################################
 
+#include <stdlib.h>
+#include <string.h>
 #include "stegophone.h"
 #include "rn52.h"
 #include "linebuffer.h"
+#include "log.h"
+#include "profile.h"
 
 namespace StegoPhone {
     RN52 *RN52::_instance = 0;
@@ -19,20 +23,79 @@ namespace StegoPhone {
     }
 
     RN52::RN52() {
-        this->_lineBuffer = new LineBuffer;
+        this->_lineBuffer = new LineBuffer(StegoPhone::RN52Serial);
+        this->_lineBuffer->lineReceived.attach(MethodSlot<RN52, LineView>(this, &RN52::receiveLine));
+        this->_commands = new CommandQueue(StegoPhone::RN52Serial, RN52Command::LineEnding, this->_lineBuffer,
+                                          TraceChannel::RN52);
+        this->_statusWord = 0;
+        this->_statusUpdates = 0;
+        this->_status = RN52Status::Offline;
+        this->_enabled = false;
+        this->_cmd = false;
+        this->_powerUpRequested = false;
+        this->_poweringUp = false;
+        this->_bannerSeen = false;
+        this->_powerUpMillis = 0;
         this->interruptOccurred = false; // updated by ISR if RN52 has an event
+        this->_interruptPending = false;
+        this->_interruptMicros = 0;
+        this->_interruptCount = 0;
+        this->_eventTask = 0;
+        this->_interruptLatencyMicros = 0;
+        this->_maxInterruptLatencyMicros = 0;
     }
 
     void RN52::intRN52Update() // (static isr)
     {
-        RN52::getInstance()->interruptOccurred = true;
+        RN52 *rn52 = RN52::getInstance();
+        rn52->_interruptCount++;
+        if (!rn52->_interruptPending) {
+            rn52->_interruptMicros = HAL::micros();
+            rn52->_interruptPending = true;
+        }
+        ManagedTask *task = rn52->_eventTask;
+        if (task) task->notifyFromISR();
+        else rn52->interruptOccurred = true;
+    }
+
+    bool RN52::startEventTask(uint8_t priority) {
+        if (this->_eventTask) return true;
+        const TaskSpec spec = {"rn52", priority, EventTaskStackWords, TaskTrigger::Event, IdlePollMs, RN52::eventStep,
+                               this};
+        ManagedTask *task = TaskManager::getInstance()->start(spec);
+        if (!task) return false;
+        this->_eventTask = task;
+        // an event that arrived while polled is handed over
+        if (this->interruptOccurred) {
+            this->interruptOccurred = false;
+            task->notify();
+        }
+        return true;
+    }
+
+    void RN52::stopEventTask() {
+        if (!this->_eventTask) return;
+        ManagedTask *task = this->_eventTask;
+        this->_eventTask = 0;
+        TaskManager::getInstance()->stop(task);
+    }
+
+    bool RN52::eventTaskRunning() {
+        return this->_eventTask != 0;
+    }
+
+    void RN52::eventStep(void *context, uint32_t notifications) {
+        RN52 *rn52 = (RN52 *) context;
+        rn52->service(notifications > 0);
+        ManagedTask *task = rn52->_eventTask;
+        if (task) task->setPeriod(rn52->_commands->idle() && !rn52->_poweringUp ? IdlePollMs : BusyPollMs);
     }
 
     bool RN52::setup() {
-        pinMode(StegoPhone::rn52ENPin, OUTPUT);
-        pinMode(StegoPhone::rn52CMDPin, OUTPUT);
-        pinMode(StegoPhone::rn52SPISel, OUTPUT);
-        digitalWrite(StegoPhone::rn52SPISel, false);
+        HAL::pinMode(StegoPhone::rn52ENPin, HAL::PinMode::Output);
+        HAL::pinMode(StegoPhone::rn52CMDPin, HAL::PinMode::Output);
+        HAL::pinMode(StegoPhone::rn52SPISel, HAL::PinMode::Output);
+        HAL::digitalWrite(StegoPhone::rn52SPISel, false);
 
         // force modes/init
         this->_cmd = true;
@@ -44,15 +107,26 @@ namespace StegoPhone {
     }
 
     void RN52::loop() {
-        //this->_lineBuffer->loop();
+        const bool event = this->interruptOccurred;
+        this->interruptOccurred = false;
+        this->service(event);
+    }
+
+    void RN52::service(bool event) {
+        STEGOS_PROFILE_SCOPE(RN52);
+        if (this->_powerUpRequested) {
+            this->_powerUpRequested = false;
+            if (!this->setup() || !this->powerUp()) this->_status = RN52Status::Error;
+        }
 
-        StegoPhone *stego = StegoPhone::StegoPhone::getInstance();
+        // responses, timeouts and unsolicited lines
+        this->_commands->loop();
+        if (this->_poweringUp) this->checkPowerUp();
 
         // blink if you can hear me
-        if (this->interruptOccurred) {
-            stego->toggleUserLED();
+        if (event) {
+            StegoPhone::StegoPhone::getInstance()->toggleUserLED();
             this->updateStatus();
-            this->interruptOccurred = false;
         }
     }
 
@@ -66,7 +140,7 @@ namespace StegoPhone {
 
     void RN52::setEnable(bool newValue) {
         this->_enabled = newValue;
-        digitalWrite(StegoPhone::StegoPhone::rn52ENPin, this->_enabled);
+        HAL::digitalWrite(StegoPhone::StegoPhone::rn52ENPin, this->_enabled);
     }
 
     bool RN52::Enable() {
@@ -78,18 +152,49 @@ namespace StegoPhone {
 
         // waitfor CMD
         char buf[1024];
-        bool matched = this->readSerialUntil("CMD\r\n", buf, sizeof(buf), 5000);
+        bool matched = this->readSerialUntil(RN52Command::CmdBanner, buf, sizeof(buf), RN52Command::BootTimeoutMs);
+        return this->enabled(matched);
+    }
+
+    void RN52::requestPowerUp() {
+        this->_status = RN52Status::Offline;
+        this->_powerUpRequested = true;
+        ManagedTask *task = this->_eventTask;
+        if (task) task->notify();
+    }
+
+    bool RN52::powerUp() {
+        if (this->_enabled || this->_poweringUp) {
+            this->exceptionOccurred = true;
+            return false;
+        }
+        this->_bannerSeen = false;
+        this->_powerUpMillis = HAL::millis();
+        this->_poweringUp = true;
+        this->setEnable(true);
+        return true;
+    }
+
+    RN52Status RN52::checkPowerUp() {
+        if (!this->_poweringUp) return this->_status;
+        const bool matched = this->_bannerSeen;
+        if (!matched && HAL::millis() - this->_powerUpMillis < RN52Command::BootTimeoutMs) return RN52Status::Offline;
+        this->_poweringUp = false;
+        this->enabled(matched);
+        return this->_status;
+    }
+
+    bool RN52::enabled(bool matched) {
         if (!matched) {
             this->exceptionOccurred = true;
+            this->_status = RN52Status::Error;
             this->Disable();
         } else {
             this->_enabled = true;
-            attachInterrupt(digitalPinToInterrupt(StegoPhone::StegoPhone::rn52InterruptPin), intRN52Update, FALLING);
-
-            bool matched = this->rn52Exec("D", buf, sizeof(buf), "END\r\n");
-            if (!matched) {
+            this->_status = RN52Status::Present;
+            HAL::attachInterrupt(StegoPhone::StegoPhone::rn52InterruptPin, intRN52Update, HAL::Edge::Falling);
 
-            }
+            this->submit(RN52Command::DumpSettings, RN52Command::dumpEnd(), 0, 0);
         }
 
         return this->_enabled;
@@ -97,13 +202,13 @@ namespace StegoPhone {
 
     bool RN52::Disable() {
         this->setEnable(false);
-        detachInterrupt(digitalPinToInterrupt(StegoPhone::StegoPhone::rn52InterruptPin));
+        HAL::detachInterrupt(StegoPhone::StegoPhone::rn52InterruptPin);
         return !this->_enabled;
     }
 
     void RN52::setCmdModeEnable(bool newValue) {
         this->_cmd = newValue;
-        digitalWrite(StegoPhone::StegoPhone::rn52ENPin, !this->_cmd); // Active LOW
+        HAL::digitalWrite(StegoPhone::StegoPhone::rn52ENPin, !this->_cmd); // Active LOW
     }
 
     bool RN52::CmdMode() {
@@ -123,7 +228,9 @@ namespace StegoPhone {
     void RN52::rn52Command(const char *cmd) {
         if (this->exceptionOccurred) return;
         StegoPhone::StegoPhone::RN52Serial.write(cmd);
-        StegoPhone::StegoPhone::RN52Serial.write('\n');
+        StegoPhone::StegoPhone::RN52Serial.write((uint8_t) '\n');
+        STEGOS_TRACE_BYTES(TraceChannel::RN52, TraceDirection::Tx, cmd, strlen(cmd));
+        STEGOS_TRACE_BYTE(TraceChannel::RN52, TraceDirection::Tx, '\n');
     }
 
     void RN52::flushSerial() {
@@ -133,86 +240,113 @@ namespace StegoPhone {
 
     bool RN52::readSerialUntil(const char *match, char *buf, const uint32_t bufferSize, uint32_t timeout) {
         memset(buf, 0, bufferSize);
-        unsigned long startMillis = millis();
+        const PatternMatcher matcher(match);
+        PatternScanner scanner(matcher);
+        unsigned long startMillis = HAL::millis();
         bool matched = false;
-        int bufReceived = 0;
-        while (!matched && (bufReceived < (bufferSize - 1)) && (millis() - startMillis < timeout)) {
+        uint32_t bufReceived = 0;
+        while (!matched && (HAL::millis() - startMillis < timeout)) {
             if (StegoPhone::StegoPhone::RN52Serial.available() > 0) {
                 const char c = (char) StegoPhone::StegoPhone::RN52Serial.read();
+                STEGOS_TRACE_BYTE(TraceChannel::RN52, TraceDirection::Rx, c);
 
-                StegoPhone::StegoPhone::ConsoleSerial.print("BT: ");
-                StegoPhone::StegoPhone::ConsoleSerial.print(c, DEC);
-                StegoPhone::StegoPhone::ConsoleSerial.print(" - ");
-                StegoPhone::StegoPhone::ConsoleSerial.print(c, HEX);
-                StegoPhone::StegoPhone::ConsoleSerial.print(" -> ");
-                StegoPhone::StegoPhone::ConsoleSerial.println(c);
-
-                buf[bufReceived++] = c;
-
-                // last bytes of buffer must = match value
-                int matchLen = max(min(bufReceived, strlen(match)), bufferSize - 1);
-                if (matchLen == 0) continue;
-                if (strncmp(match, buf + (bufferSize - (matchLen + 1)), matchLen) == 0) { // +1 to leave null
-                    matched = true;
-                }
+                // keep what fits (leaving the null), match on everything
+                if (bufReceived < bufferSize - 1) buf[bufReceived++] = c;
+                matched = (scanner.feed((uint8_t) c) != PatternMatcher::NoMatch);
             }
         }
         return matched;
     }
 
-    bool RN52::rn52Exec(const char *cmd, char *buf, const int bufferSize, const char *match, const int interDelay, const int timeout) {
+    bool RN52::submit(const char *cmd, const PatternMatcher &terminators, CommandCallback callback, void *context,
+                      uint32_t timeoutMs) {
         if (this->exceptionOccurred) return false;
-        if (bufferSize < 1) return false;
-        flushSerial();
-        rn52Command(cmd);
-        delay(interDelay);
-        bool matched = readSerialUntil(match, buf, bufferSize, 500); // 1/2 second to complete command
-        return matched;
+        return this->_commands->submit(cmd, terminators, timeoutMs, callback, context);
+    }
+
+    void RN52::requestStatus() {
+        this->submit(RN52Command::QueryStatus, RN52Command::lineEnd(), RN52::statusReceived, this);
     }
 
-    unsigned short RN52::rn52Status(char *hexArray) {
-        if (this->exceptionOccurred) return 0;
-        char result[10]; // need 8, allow serbuf to pick up 10 to be sure for leftovers
-        bool matched = rn52Exec("Q", result, sizeof(result), "\r\n");
-        StegoPhone::StegoPhone::ConsoleSerial.println(matched ? "Matched:" : "No match:");
-        for (int i = 0; i < sizeof(result); i++) {
-            StegoPhone::StegoPhone::ConsoleSerial.print(result[i], DEC);
-            StegoPhone::StegoPhone::ConsoleSerial.print(" - ");
-            StegoPhone::StegoPhone::ConsoleSerial.print(result[i], HEX);
-            StegoPhone::StegoPhone::ConsoleSerial.print(" -> ");
-            StegoPhone::StegoPhone::ConsoleSerial.println((char) result[i]);
+    void RN52::statusReceived(void *context, const CommandResponse &response) {
+        RN52 *rn52 = (RN52 *) context;
+        const bool matched = (response.result == CommandResult::Matched);
+        const char *data = response.data;
+        const size_t length = response.length;
+        // the raw response is in the trace ("trace" on the console)
+        if (!matched) STEGOS_LOG_WARNING("RN52 Status: no response");
+
+        // status is 4 hex digits before the line end
+        char hexStatus[5];
+        memset(hexStatus, 0, sizeof(hexStatus));
+        if (matched && length >= 6) {
+            memcpy(hexStatus, data + length - 6, 4);
+            rn52->_statusWord = (uint16_t) strtoul(hexStatus, 0, 16);
+            rn52->_statusUpdates++;
         }
 
-        // for (uint8_t i = 4; i < sizeof(result); i++)
-        //     result[i] = '\0'; // although null term'd at 10, data ends after 0-3. knock out the rest
-        StegoPhone::StegoPhone::ConsoleSerial.println(result);
-        for (int i = 0; i < 5; i++) // copy through term to output array
-            hexArray[i] = result[i];
+        STEGOS_LOG_INFO("RN52 Status DEC / HEX: %u / %X : orig=%s", rn52->_statusWord, rn52->_statusWord,
+                        Log::text(hexStatus));
+    }
+
+    uint16_t RN52::statusWord() {
+        return this->_statusWord;
+    }
 
-        StegoPhone::getInstance()->drawDisplay(0, 50, "RN52:", true, false);
-        StegoPhone::getInstance()->drawDisplay(80, 50, "          ", true, false);
-        StegoPhone::getInstance()->drawDisplay(80, 50, hexArray, true, false);
+    uint32_t RN52::statusUpdates() {
+        return this->_statusUpdates;
+    }
 
-        return 0;
-        // unsigned short retval = strtol(result, NULL, 16); // return decimal value
-        // return retval;
+    CommandQueue *RN52::commands() {
+        return this->_commands;
     }
 
-    void RN52::receiveLine(char *line) {
-        Serial.print("RN52 RX: ");
-        Serial.print(line);
+    void RN52::receiveLine(LineView line) {
+        if (this->_poweringUp && !line.partial && line.length == 3 && memcmp(line.data, "CMD", 3) == 0)
+            this->_bannerSeen = true;
+        STEGOS_LOG_INFO("RN52 RX: %s", Log::text(line.data, line.length));
     }
 
     // after an interrupt, poll the RN52 for its new status
     void RN52::updateStatus() {
-        char hexStatus[5];
-        const unsigned short s = this->rn52Status(hexStatus);
-        Serial.print("RN52 Status DEC / HEX: ");
-        Serial.print(s, DEC);
-        Serial.print(" / ");
-        Serial.print(s, HEX);
-        Serial.print(" : orig=");
-        Serial.println(hexStatus);
+        if (this->_interruptPending) {
+            const uint32_t latency = HAL::micros() - this->_interruptMicros;
+            this->_interruptPending = false;
+            this->_interruptLatencyMicros = latency;
+            if (latency > this->_maxInterruptLatencyMicros) this->_maxInterruptLatencyMicros = latency;
+        }
+        this->requestStatus();
+    }
+
+    uint32_t RN52::interruptCount() {
+        return this->_interruptCount;
+    }
+
+    uint32_t RN52::interruptLatencyMicros() {
+        return this->_interruptLatencyMicros;
+    }
+
+    uint32_t RN52::maxInterruptLatencyMicros() {
+        return this->_maxInterruptLatencyMicros;
+    }
+
+    void RN52::consoleCommand(void *context, HAL::SerialPort &out, const char *args) {
+        RN52 *rn52 = RN52::getInstance();
+        out.print("rn52: status ");
+        out.print((unsigned int) rn52->_statusWord, HEX);
+        out.print(rn52->eventTaskRunning() ? ", event task" : ", polled");
+        out.print(", interrupts ");
+        out.print((unsigned long) rn52->_interruptCount);
+        out.print(", latency last/max ");
+        out.print((unsigned long) rn52->_interruptLatencyMicros);
+        out.print("/");
+        out.print((unsigned long) rn52->_maxInterruptLatencyMicros);
+        out.print(" us, commands ");
+        out.print((unsigned long) rn52->_commands->completed());
+        out.print(", timeouts ");
+        out.print((unsigned long) rn52->_commands->timeouts());
+        out.print(", stale bytes dropped ");
+        out.println((unsigned long) rn52->_commands->discarded());
     }
 
     RN52Status RN52::status() {
@@ -0,0 +1,32 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include "rn52command.h"
+
+namespace StegoPhone {
+    namespace RN52Command {
+        const PatternMatcher &cmdBanner() {
+            static const PatternMatcher matcher(CmdBanner);
+            return matcher;
+        }
+
+        const PatternMatcher &dumpEnd() {
+            static const PatternMatcher matcher(DumpEnd);
+            return matcher;
+        }
+
+        const PatternMatcher &lineEnd() {
+            static const PatternMatcher matcher(LineEnd);
+            return matcher;
+        }
+
+        const PatternMatcher &ackOrError() {
+            static const PatternMatcher matcher({Ack, Error, Unknown});
+            return matcher;
+        }
+    }
+}
@@ -0,0 +1,95 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+// RTOS shim for the teensy40 env
+
+#include <Arduino.h>
+#include <FreeRTOS_TEENSY4.h>
+
+#include "rtos.h"
+
+namespace StegoPhone {
+    namespace RTOS {
+        static TickType_t ticks(uint32_t ms) {
+            if (ms == WaitForever) return portMAX_DELAY;
+            return pdMS_TO_TICKS(ms);
+        }
+
+        // TASKS
+        //================================================================================================
+        bool createTask(TaskFunction function, const char *name, uint16_t stackWords, void *arg, uint8_t priority,
+                        TaskHandle *handle) {
+            return xTaskCreate(function, name, stackWords, arg, priority, (TaskHandle_t *) handle) == pdPASS;
+        }
+
+        void deleteTask(TaskHandle task) {
+            vTaskDelete((TaskHandle_t) task);
+        }
+
+        void startScheduler() {
+            vTaskStartScheduler();
+        }
+
+        bool schedulerStarted() {
+            return xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED;
+        }
+
+        TaskHandle currentTask() {
+            return xTaskGetCurrentTaskHandle();
+        }
+
+        void delay(uint32_t ms) {
+            vTaskDelay(ticks(ms));
+        }
+
+        uint32_t tickCount() {
+            return xTaskGetTickCount();
+        }
+
+        bool delayUntil(uint32_t &lastWake, uint32_t periodMs) {
+            const TickType_t period = ticks(periodMs);
+            TickType_t wake = (TickType_t) lastWake;
+            const bool late = (TickType_t) (xTaskGetTickCount() - wake) >= period;
+            if (!late) vTaskDelayUntil(&wake, period);
+            else wake += period;
+            lastWake = wake;
+            return !late;
+        }
+
+        void yield() {
+            taskYIELD();
+        }
+
+        uint32_t stackUnusedWords(TaskHandle task) {
+            return uxTaskGetStackHighWaterMark((TaskHandle_t) task);
+        }
+
+        void enterCritical() {
+            taskENTER_CRITICAL();
+        }
+
+        void exitCritical() {
+            taskEXIT_CRITICAL();
+        }
+
+        // NOTIFICATIONS
+        //================================================================================================
+        void notify(TaskHandle task) {
+            xTaskNotifyGive((TaskHandle_t) task);
+        }
+
+        void notifyFromISR(TaskHandle task) {
+            BaseType_t woken = pdFALSE;
+            vTaskNotifyGiveFromISR((TaskHandle_t) task, &woken);
+            portYIELD_FROM_ISR(woken);
+        }
+
+        uint32_t waitNotify(uint32_t timeoutMs) {
+            return ulTaskNotifyTake(pdTRUE, ticks(timeoutMs));
+        }
+    }
+}
@@ -0,0 +1,56 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _SIM_BENCH_H_
+#define _SIM_BENCH_H_
+
+#include <stdint.h>
+
+// Scenarios run by the native simulator binary. Each one registers itself by name:
+//
+//     SIM_BENCH(boot, "time StegoPhone::setup() against the simulated board") { ... }
+//
+// and is selected on the command line (no arguments runs all of them).
+
+namespace StegoPhone {
+    namespace Sim {
+        typedef void (*BenchFunction)();
+
+        class BenchRegistrar {
+        public:
+            BenchRegistrar(const char *name, const char *description, BenchFunction function);
+        };
+
+        // one result line: "<bench>.<label>  <value> <unit>"
+        void report(const char *label, double value, const char *unit);
+
+        // known-answer check; a failure is reported and makes the simulator exit non-zero
+        bool check(bool condition, const char *what);
+
+        // boots the StegoPhone singleton against the simulated board, once: setup(), then loop() until
+        // the status is Ready (or the boot failed), then until the RN52's start up traffic is done
+        void bootOnce();
+
+        // setup() to the status entering Ready, measured by that one boot; 0 if it never got there
+        struct BootTimes {
+            uint64_t readySimMicros;
+            uint64_t readyHostMicros;
+        };
+
+        const BootTimes &bootTimes();
+
+        // host time source for measurements, in nanoseconds
+        uint64_t hostNanos();
+    }
+}
+
+#define SIM_BENCH(name, description) \
+    static void simBench_##name(); \
+    static StegoPhone::Sim::BenchRegistrar simBenchRegistrar_##name(#name, description, simBench_##name); \
+    static void simBench_##name()
+
+#endif //_SIM_BENCH_H_
@@ -0,0 +1,298 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+// ChaCha20-Poly1305: RFC 8439 test vectors, in place sealing of modem frames with the replay window,
+// and cost per byte against what the modem can carry
+
+#include <stdio.h>
+#include <string.h>
+#include "sim.h"
+#include "bench.h"
+#include "stegophone.h"
+#include "console.h"
+#include "chacha20poly1305.h"
+#include "framecipher.h"
+#include "fskphy.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using namespace StegoPhone;
+
+namespace {
+    const char Sunscreen[] = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the "
+                             "future, sunscreen would be it.";
+
+    size_t fromHex(const char *hex, uint8_t *out) {
+        size_t count = 0;
+        for (; hex[0] && hex[1]; hex += 2) {
+            unsigned int value;
+            sscanf(hex, "%2x", &value);
+            out[count++] = (uint8_t) value;
+        }
+        return count;
+    }
+
+    void sequence(uint8_t *out, uint8_t first, size_t count) {
+        for (size_t i = 0; i < count; i++)
+            out[i] = (uint8_t) (first + i);
+    }
+
+    uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return 0;
+#endif
+    }
+
+    // RFC 8439 2.4.2, 2.5.2, 2.6.2 and 2.8.2
+    void vectors() {
+        uint8_t key[32], nonce[12], data[128], expected[128], tag[16], expectedTag[16];
+        const size_t length = sizeof(Sunscreen) - 1;
+
+        sequence(key, 0, 32);
+        fromHex("000000000000004a00000000", nonce);
+        memcpy(data, Sunscreen, length);
+        fromHex("6e2e359a2568f98041ba0728dd0d6981e97e7aec1d4360c20a27afccfd9fae0bf91b65c5524733ab8f593dabcd62b357"
+                "1639d624e65152ab8f530c359f0861d807ca0dbf500d6a6156a38e088a22b65e52bc514d16ccf806818ce91ab7793736"
+                "5af90bbf74a35be6b40b8eedf2785e42874d", expected);
+        Crypto::ChaCha20 whole(key, nonce, 1);
+        whole.apply(data, length);
+        Sim::check(memcmp(data, expected, length) == 0, "RFC 8439 2.4.2 ChaCha20 encryption");
+        // the same stream cut into odd pieces
+        memcpy(data, Sunscreen, length);
+        Crypto::ChaCha20 pieces(key, nonce, 1);
+        pieces.apply(data, 1);
+        pieces.apply(data + 1, 70);
+        pieces.apply(data + 71, length - 71);
+        Sim::check(memcmp(data, expected, length) == 0, "ChaCha20 keystream carries across calls");
+
+        fromHex("85d6be7857556d337f4452fe42d506a80103808afb0db2fd4abff6af4149f51b", key);
+        fromHex("a8061dc1305136c6c22b8baf0c0127a9", expectedTag);
+        const char *message = "Cryptographic Forum Research Group";
+        Crypto::Poly1305 mac(key);
+        mac.update((const uint8_t *) message, 5);
+        mac.update((const uint8_t *) message + 5, strlen(message) - 5);
+        mac.finish(tag);
+        Sim::check(memcmp(tag, expectedTag, 16) == 0, "RFC 8439 2.5.2 Poly1305");
+
+        // 2.6.2: the one time key is keystream block 0
+        sequence(key, 0x80, 32);
+        fromHex("000000000001020304050607", nonce);
+        fromHex("8ad5a08b905f81cc815040274ab29471a833b637e3fd0da508dbb8e2fdd1a646", expected);
+        Crypto::ChaCha20 generator(key, nonce, 0);
+        generator.block(data);
+        Sim::check(memcmp(data, expected, 32) == 0, "RFC 8439 2.6.2 Poly1305 key generation");
+
+        uint8_t aad[12];
+        fromHex("50515253c0c1c2c3c4c5c6c7", aad);
+        fromHex("070000004041424344454647", nonce);
+        fromHex("d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d63dbea45e8ca9671282fafb69da92728b"
+                "1a71de0a9e060b2905d6a5b67ecd3b3692ddbd7f2d778b8c9803aee328091b58fab324e4fad675945585808b4831d7bc"
+                "3ff4def08e4b7a9de576d26586cec64b6116", expected);
+        fromHex("1ae10b594f09e26a7e902ecbd0600691", expectedTag);
+        memcpy(data, Sunscreen, length);
+        Crypto::seal(key, nonce, aad, sizeof(aad), data, length, tag);
+        Sim::check(memcmp(data, expected, length) == 0 && memcmp(tag, expectedTag, 16) == 0,
+                   "RFC 8439 2.8.2 AEAD seal");
+        Sim::check(Crypto::open(key, nonce, aad, sizeof(aad), data, length, tag) &&
+                   memcmp(data, Sunscreen, length) == 0, "RFC 8439 2.8.2 AEAD open");
+        Crypto::seal(key, nonce, aad, sizeof(aad), data, length, tag);
+        tag[15] ^= 0x01;
+        Sim::check(!Crypto::open(key, nonce, aad, sizeof(aad), data, length, tag) &&
+                   memcmp(data, expected, length) == 0, "AEAD open rejects a bad tag and leaves the data");
+    }
+
+    // fill a frame's payload in place, as the app would
+    void fill(ModemFrame *frame, uint16_t length, uint8_t seed) {
+        frame->type = ModemFrameType::Data;
+        uint8_t *payload = FrameCipher::payload(frame);
+        for (uint16_t i = 0; i < length; i++)
+            payload[i] = (uint8_t) (seed + i * 7);
+    }
+
+    bool intact(ModemFrame *frame, uint16_t length, uint8_t seed) {
+        const uint8_t *payload = FrameCipher::payload(frame);
+        for (uint16_t i = 0; i < length; i++) {
+            if (payload[i] != (uint8_t) (seed + i * 7)) return false;
+        }
+        return frame->length == length;
+    }
+
+    void frames() {
+        uint8_t key[32];
+        sequence(key, 0x40, 32);
+        FrameCipher alice, bob;
+        ModemFrame frame;
+        Sim::check(!alice.seal(&frame, 10), "no sealing without a key");
+        alice.setKey(key, true);
+        bob.setKey(key, false);
+
+        fill(&frame, FrameCipher::MaxPayload, 1);
+        Sim::check(alice.seal(&frame, FrameCipher::MaxPayload) &&
+                   frame.length == ModemFrame::Capacity - FrameFec::DefaultOverhead,
+                   "a full payload seals into one frame, with room for FEC");
+        FrameFec fec;
+        Sim::check(fec.encode(&frame) && frame.length == ModemFrame::Capacity && fec.decode(&frame),
+                   "a full sealed frame FEC codes into one frame");
+        Sim::check(!intact(&frame, FrameCipher::MaxPayload, 1), "payload encrypted where it lies");
+        Sim::check(bob.open(&frame) && intact(&frame, FrameCipher::MaxPayload, 1), "opened in place");
+        Sim::check(!alice.seal(&frame, FrameCipher::MaxPayload + 1), "payload past MaxPayload refused");
+
+        // a frame looped back to its sender is under the other direction's nonce
+        fill(&frame, 20, 2);
+        alice.seal(&frame, 20);
+        ModemFrame copy = frame;
+        Sim::check(!alice.open(&copy), "own frames do not open");
+
+        // replays, reordering inside the window and frames older than it
+        Sim::check(bob.open(&frame) && intact(&frame, 20, 2), "in order");
+        fill(&frame, 20, 2);
+        Sim::check(!bob.open(&copy), "replay dropped");
+        ModemFrame held[4];
+        for (uint8_t i = 0; i < 4; i++) {
+            fill(&held[i], 30, (uint8_t) (10 + i));
+            alice.seal(&held[i], 30);
+        }
+        bool reordered = bob.open(&held[3]) && bob.open(&held[1]) && bob.open(&held[2]) && bob.open(&held[0]);
+        for (uint8_t i = 0; i < 4; i++)
+            reordered = reordered && intact(&held[i], 30, (uint8_t) (10 + i));
+        Sim::check(reordered, "reordered frames inside the window open");
+        ModemFrame old;
+        fill(&old, 8, 3);
+        alice.seal(&old, 8);
+        for (uint8_t i = 0; i < FrameCipher::ReplayWindow; i++) {
+            fill(&frame, 8, 4);
+            alice.seal(&frame, 8);
+            bob.open(&frame);
+        }
+        Sim::check(!bob.open(&old), "frames older than the window dropped");
+
+        // tampering anywhere: header, ciphertext, tag, type
+        const uint32_t badBefore = bob.badTags();
+        const uint8_t offsets[] = {0, FrameCipher::HeaderBytes + 3, FrameCipher::HeaderBytes + 40 + 5};
+        for (uint8_t i = 0; i < 3; i++) {
+            fill(&frame, 40, 5);
+            alice.seal(&frame, 40);
+            frame.data[offsets[i]] ^= 0x80;
+            Sim::check(!bob.open(&frame), "tampered frame rejected");
+        }
+        fill(&frame, 40, 5);
+        alice.seal(&frame, 40);
+        frame.type = ModemFrameType::Hello;
+        Sim::check(!bob.open(&frame), "frame type is authenticated");
+        frame.length = FrameCipher::Overhead - 1;
+        Sim::check(!bob.open(&frame), "short frame rejected");
+        Sim::check(bob.badTags() - badBefore == 5 && bob.replays() == 2, "tag failures and replays counted");
+
+        fill(&frame, 0, 0);
+        Sim::check(alice.seal(&frame, 0) && bob.open(&frame) && frame.length == 0, "empty payload");
+
+        // a new key starts both ends over
+        alice.setKey(key, true);
+        bob.setKey(key, false);
+        fill(&frame, 12, 6);
+        Sim::check(alice.seal(&frame, 12) && frame.data[0] == 0 && bob.open(&frame), "rekey restarts the sequence");
+        alice.clear();
+        Sim::check(!alice.keyed() && !alice.seal(&frame, 12), "cleared cipher refuses to seal");
+    }
+
+    // cost per payload byte for a data frame's worth, against the modem's bit rate
+    void speed() {
+        uint8_t key[32], nonce[12];
+        sequence(key, 1, 32);
+        sequence(nonce, 2, 12);
+        static uint8_t buffer[4096];
+        memset(buffer, 0x5a, sizeof(buffer));
+        const int rounds = 2000;
+        char label[64];
+
+        struct Case {
+            const char *name;
+            size_t length;
+        };
+        static const Case cases[] = {{"chacha20_4k", 4096}, {"poly1305_4k", 4096}};
+        for (uint8_t c = 0; c < 2; c++) {
+            const size_t length = cases[c].length;
+            const uint64_t startCycles = cycles();
+            const uint64_t start = Sim::hostNanos();
+            for (int r = 0; r < rounds / 10; r++) {
+                if (c == 0) {
+                    Crypto::ChaCha20 cipher(key, nonce, 1);
+                    cipher.apply(buffer, length);
+                } else {
+                    uint8_t tag[16];
+                    Crypto::Poly1305 mac(key);
+                    mac.update(buffer, length);
+                    mac.finish(tag);
+                }
+            }
+            const uint64_t bytes = (uint64_t) length * (rounds / 10);
+            const uint64_t nanos = Sim::hostNanos() - start;
+            const uint64_t spent = cycles() - startCycles;
+            snprintf(label, sizeof(label), "%s_host", cases[c].name);
+            Sim::report(label, (double) nanos / bytes, "ns/byte");
+            if (spent) {
+                snprintf(label, sizeof(label), "%s_tsc_host", cases[c].name);
+                Sim::report(label, (double) spent / bytes, "cycles/byte");
+            }
+        }
+
+        // whole frames through FrameCipher, a batch at a time: all sealed, then all opened at the other end
+        uint8_t sessionKey[32];
+        sequence(sessionKey, 9, 32);
+        FrameCipher alice, bob;
+        alice.setKey(sessionKey, true);
+        bob.setKey(sessionKey, false);
+        const uint8_t batch = 16;
+        static ModemFrame batchFrames[batch];
+        bool ok = true;
+        uint64_t sealNanos = 0, openNanos = 0, sealCycles = 0, openCycles = 0;
+        for (int r = 0; r < rounds / batch; r++) {
+            for (uint8_t i = 0; i < batch; i++)
+                fill(&batchFrames[i], FrameCipher::MaxPayload, (uint8_t) (r + i));
+            uint64_t startCycles = cycles();
+            uint64_t start = Sim::hostNanos();
+            for (uint8_t i = 0; i < batch; i++)
+                ok = alice.seal(&batchFrames[i], FrameCipher::MaxPayload) && ok;
+            sealNanos += Sim::hostNanos() - start;
+            sealCycles += cycles() - startCycles;
+            startCycles = cycles();
+            start = Sim::hostNanos();
+            for (uint8_t i = 0; i < batch; i++)
+                ok = bob.open(&batchFrames[i]) && ok;
+            openNanos += Sim::hostNanos() - start;
+            openCycles += cycles() - startCycles;
+        }
+        Sim::check(ok && bob.opened() == (uint32_t) (rounds / batch * batch), "every timed frame opened");
+        const double bytes = (double) FrameCipher::MaxPayload * (rounds / batch * batch);
+        Sim::report("seal_frame_host", sealNanos / bytes, "ns/byte");
+        Sim::report("open_frame_host", openNanos / bytes, "ns/byte");
+        if (sealCycles) {
+            Sim::report("seal_frame_tsc_host", sealCycles / bytes, "cycles/byte");
+            Sim::report("open_frame_tsc_host", openCycles / bytes, "cycles/byte");
+        }
+
+        // payload the host could seal and open per second, as a multiple of the modem's bit rate
+        const double bitsPerSecond = bytes * 8 / ((sealNanos + openNanos) / 1e9);
+        Sim::report("headroom_over_modem_host", bitsPerSecond / FskPhy::BaudRate, "x");
+        Sim::report("overhead_per_frame", FrameCipher::Overhead, "bytes");
+    }
+}
+
+SIM_BENCH(aead, "ChaCha20-Poly1305: RFC 8439 vectors, in place frame sealing and replay window, cost per byte") {
+    vectors();
+    frames();
+    speed();
+
+    Sim::bootOnce();
+    const uint32_t before = Sim::console().bytesWritten;
+    Console::getInstance()->execute("aead");
+    Sim::check(Sim::console().bytesWritten > before, "aead console command prints");
+}
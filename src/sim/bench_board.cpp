@@ -0,0 +1,267 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+// whole-board scenarios: boot path, RN52 round trips and the render path
+
+#include "sim.h"
+#include "bench.h"
+#include "stegophone.h"
+#include "rtos.h"
+
+using namespace StegoPhone;
+
+SIM_BENCH(boot, "StegoPhone::setup() against the simulated board") {
+    // measured by the one boot, whichever scenario ran it
+    Sim::bootOnce();
+    Sim::report("time_to_ready_sim", Sim::bootTimes().readySimMicros / 1000.0, "ms");
+    Sim::report("time_to_ready_host", Sim::bootTimes().readyHostMicros / 1000.0, "ms");
+    Sim::check(Sim::bootTimes().readySimMicros > 0, "time to Ready measured");
+    Sim::report("rn52_commands", Sim::rn52Device().commandsHandled, "cmds");
+    Sim::report("panel_bytes", (double) Sim::panel().bytesSent, "bytes");
+    Sim::check(StegoPhone::StegoPhone::getInstance()->status() == StegoStatus::Ready, "status is Ready after setup");
+}
+
+SIM_BENCH(rn52, "RN52 event interrupt to status update") {
+    Sim::bootOnce();
+    RN52 *rn52 = RN52::getInstance();
+    const uint32_t updates = rn52->statusUpdates();
+    const uint64_t consoleStart = Sim::console().bytesWritten;
+    const uint64_t simStart = Sim::nowMicros();
+    Sim::rn52Device().raiseEvent(0x3004);
+    while (rn52->statusUpdates() == updates && Sim::nowMicros() - simStart < 1000000)
+        rn52->loop();
+    Sim::report("event_to_status_sim", (Sim::nowMicros() - simStart) / 1000.0, "ms");
+    Sim::report("event_console_bytes", (double) (Sim::console().bytesWritten - consoleStart), "bytes");
+    Sim::check(rn52->statusWord() == 0x3004, "status word read back after event");
+}
+
+SIM_BENCH(render, "label updates: full frame per draw vs dirty-tile compositor") {
+    Sim::bootOnce();
+    StegoPhone::StegoPhone *stego = StegoPhone::StegoPhone::getInstance();
+    Sim::FrameBufferDisplay &frame = Sim::frameBuffer();
+    Sim::PanelTransport &panel = Sim::panel();
+    const int rounds = 200;
+
+    // what drawDisplay used to do: a full sendBuffer() after each of the three draws of a key press
+    uint64_t bytesStart = panel.bytesSent;
+    uint64_t hostStart = Sim::hostMicros();
+    for (int i = 0; i < rounds; i++) {
+        const char key[2] = {(char) ('a' + (i % 26)), '\0'};
+        frame.drawStr(0, 10, "Key: ");
+        frame.sendBuffer();
+        frame.drawStr(60, 10, "      ");
+        frame.sendBuffer();
+        frame.drawStr(60, 10, key);
+        frame.sendBuffer();
+    }
+    Sim::report("full_frames_host", (Sim::hostMicros() - hostStart) / (double) rounds, "us/update");
+    Sim::report("full_frames_bytes", (panel.bytesSent - bytesStart) / (double) rounds, "bytes/update");
+    stego->compositor()->invalidate();
+    stego->commitDisplay(true);
+
+    // the same three draws, one commit per tick
+    const uint32_t framesStart = stego->compositor()->frames();
+    bytesStart = panel.bytesSent;
+    hostStart = Sim::hostMicros();
+    for (int i = 0; i < rounds; i++) {
+        stego->drawDisplay(0, 10, "Key: ", true, false);
+        stego->drawDisplay(60, 10, "      ", true, false);
+        stego->drawDisplay(60, 10, (char) ('a' + (i % 26)), true, false);
+        stego->commitDisplay(true);
+    }
+    Sim::report("compositor_host", (Sim::hostMicros() - hostStart) / (double) rounds, "us/update");
+    Sim::report("compositor_bytes", (panel.bytesSent - bytesStart) / (double) rounds, "bytes/update");
+    Sim::report("compositor_frames", (stego->compositor()->frames() - framesStart) / (double) rounds, "frames/update");
+    Sim::report("frame_time_max_host", stego->compositor()->maxFrameMicros(), "us");
+    Sim::check(panel.panelPixel(60 + 1, 10 - 6) || panel.panelPixel(60 + 2, 10 - 6), "last key label reached the panel");
+    bool panelMatches = true;
+    for (int16_t y = 0; y < HAL::Display::Height; y++)
+        for (int16_t x = 0; x < HAL::Display::Width; x++)
+            panelMatches = panelMatches && (frame.pixel(x, y) == panel.panelPixel(x, y));
+    Sim::check(panelMatches, "panel matches the buffer after commit");
+
+    // a burst of updates inside one frame interval: one frame now, the rest coalesced into the next
+    const uint32_t burstFrames = stego->compositor()->frames();
+    stego->commitDisplay();
+    for (int i = 0; i < 50; i++) {
+        stego->drawDisplay(60, 10, (char) ('A' + (i % 26)), true, false);
+        stego->commitDisplay();
+    }
+    HAL::delay(Compositor::DefaultFrameIntervalMicros / 1000 + 1);
+    stego->commitDisplay();
+    Sim::report("burst_frames", stego->compositor()->frames() - burstFrames, "frames/50 updates");
+    Sim::check(stego->compositor()->frames() - burstFrames <= 3, "frame cap coalesced the burst");
+}
+
+SIM_BENCH(rn52irq, "RN52 interrupt to updateStatus(): 500ms polling loop vs event task notification") {
+    Sim::bootOnce();
+    StegoPhone::StegoPhone *stego = StegoPhone::StegoPhone::getInstance();
+    RN52 *rn52 = RN52::getInstance();
+    const int events = 8;
+
+    // the old threadLoop1: StegoPhone::loop() then delay(500), events landing at arbitrary phase
+    double polledTotal = 0;
+    uint32_t polledWorst = 0;
+    for (int i = 0; i < events; i++) {
+        const uint32_t updates = rn52->statusUpdates();
+        HAL::delay(150); // event line back up
+        // the event lands part way through the loop's delay(500)
+        Sim::rn52Device().raiseEvent(0x2000 + i);
+        HAL::delay(500 - (137 * i) % 500);
+        stego->loop();
+        while (rn52->statusUpdates() == updates) {
+            HAL::delay(500);
+            stego->loop();
+        }
+        polledTotal += rn52->interruptLatencyMicros();
+        if (rn52->interruptLatencyMicros() > polledWorst) polledWorst = rn52->interruptLatencyMicros();
+    }
+    Sim::report("polled_latency_avg_sim", polledTotal / events / 1000.0, "ms");
+    Sim::report("polled_latency_max_sim", polledWorst / 1000.0, "ms");
+
+    // the event task, woken straight from the ISR
+    if (!Sim::check(rn52->startEventTask(3), "event task created")) return;
+    RTOS::startScheduler();
+    double notifiedTotal = 0;
+    double statusTotal = 0;
+    uint32_t notifiedWorst = 0;
+    bool allRead = true;
+    for (int i = 0; i < events; i++) {
+        const uint32_t updates = rn52->statusUpdates();
+        HAL::delay(150 + 61 * i);
+        const uint64_t raised = Sim::nowMicros();
+        Sim::rn52Device().raiseEvent(0x3000 + i);
+        while (rn52->statusUpdates() == updates && Sim::nowMicros() - raised < 1000000)
+            HAL::delay(1); // the main task idles; the event task takes the CPU
+        statusTotal += Sim::nowMicros() - raised;
+        notifiedTotal += rn52->interruptLatencyMicros();
+        if (rn52->interruptLatencyMicros() > notifiedWorst) notifiedWorst = rn52->interruptLatencyMicros();
+        allRead = allRead && (rn52->statusWord() == 0x3000 + i);
+    }
+    rn52->stopEventTask();
+    Sim::report("notified_latency_avg_sim", notifiedTotal / events / 1000.0, "ms");
+    Sim::report("notified_latency_max_sim", notifiedWorst / 1000.0, "ms");
+    Sim::report("notified_event_to_status_sim", statusTotal / events / 1000.0, "ms");
+    Sim::check(allRead, "event task read every new status word");
+    Sim::check(rn52->interruptCount() >= (uint32_t) (2 * events), "every event interrupted");
+}
+
+SIM_BENCH(flush, "full frame over a 10MHz wire: sent inline by the UI vs handed to the flush task") {
+    Sim::bootOnce();
+    StegoPhone::StegoPhone *stego = StegoPhone::StegoPhone::getInstance();
+    Compositor *compositor = stego->compositor();
+    Sim::FrameBufferDisplay &frame = Sim::frameBuffer();
+    Sim::PanelTransport &panel = Sim::panel();
+    RN52 *rn52 = RN52::getInstance();
+    RTOS::startScheduler();
+    panel.wireBitsPerSecond = 10000000;
+
+    // inline: the committing task owns the wire until the last byte is out
+    compositor->invalidate();
+    uint64_t simStart = Sim::nowMicros();
+    stego->commitDisplay(true);
+    Sim::report("inline_commit_sim", (Sim::nowMicros() - simStart) / 1000.0, "ms");
+
+    // flush task below the UI: commit only diffs and copies into the back buffer
+    if (!Sim::check(compositor->startFlushTask(1), "flush task created")) return;
+    if (!Sim::check(rn52->startEventTask(3), "event task created")) return;
+    HAL::delay(150); // event line back up
+    const uint32_t busyStart = compositor->busy();
+    compositor->invalidate();
+    simStart = Sim::nowMicros();
+    const uint64_t hostStart = Sim::hostMicros();
+    const bool handedOver = stego->commitDisplay(true);
+    Sim::report("task_commit_sim", (Sim::nowMicros() - simStart) / 1000.0, "ms");
+    Sim::report("task_commit_host", (double) (Sim::hostMicros() - hostStart), "us");
+    Sim::check(handedOver && compositor->flushing(), "frame handed to the flush task");
+
+    // the UI draws the next frame while the first is on the wire; its commit waits for a later tick
+    stego->drawDisplay(0, 30, "next frame", true, false);
+    Sim::check(!stego->commitDisplay(true), "commit held while the flush task is sending");
+    Sim::check(compositor->busy() > busyStart, "held commit counted as busy");
+
+    // an RN52 event in the middle of the send is served right away
+    const uint32_t updates = rn52->statusUpdates();
+    const uint64_t raised = Sim::nowMicros();
+    Sim::rn52Device().raiseEvent(0x3100);
+    while (rn52->statusUpdates() == updates && Sim::nowMicros() - raised < 1000000)
+        HAL::delay(1);
+    Sim::report("rn52_event_to_status_during_flush_sim", (Sim::nowMicros() - raised) / 1000.0, "ms");
+    Sim::check(rn52->statusWord() == 0x3100, "status read while a frame was being sent");
+
+    while (compositor->flushing())
+        HAL::delay(1);
+    Sim::report("frame_send_sim", compositor->lastFrameMicros() / 1000.0, "ms");
+    Sim::check(stego->commitDisplay(true), "held frame goes out once the wire is free");
+    compositor->stopFlushTask();
+    rn52->stopEventTask();
+    panel.wireBitsPerSecond = 0;
+
+    bool panelMatches = true;
+    for (int16_t y = 0; y < HAL::Display::Height; y++)
+        for (int16_t x = 0; x < HAL::Display::Width; x++)
+            panelMatches = panelMatches && (frame.pixel(x, y) == panel.panelPixel(x, y));
+    Sim::check(panelMatches, "panel matches the buffer after the flush task stops");
+}
+
+SIM_BENCH(framewake, "held frames: out when the interval ends or the flush task is done, not on the next input") {
+    Sim::bootOnce();
+    StegoPhone::StegoPhone *stego = StegoPhone::StegoPhone::getInstance();
+    Compositor *compositor = stego->compositor();
+    Sim::PanelTransport &panel = Sim::panel();
+    RTOS::startScheduler();
+    if (!Sim::check(stego->startTasks(2, 3) && compositor->startFlushTask(1), "UI and flush tasks created")) return;
+    ManagedTask *ui = TaskManager::getInstance()->find("ui");
+    HAL::delay(50);
+
+    // a second frame inside the interval is deferred; the UI wakes for it when the interval ends
+    const uint32_t before = compositor->frames();
+    stego->drawDisplay(0, 30, "frame one", true, false);
+    ui->notify();
+    for (int i = 0; i < 1000 && compositor->frames() == before; i++)
+        HAL::delay(1);
+    const uint32_t frames = compositor->frames();
+    const uint32_t deferred = compositor->deferred();
+    const uint64_t firstSent = Sim::nowMicros();
+    stego->drawDisplay(0, 30, "frame two", true, false);
+    ui->notify();
+    while (compositor->frames() == frames && Sim::nowMicros() - firstSent < 1000000)
+        HAL::delay(1);
+    const uint64_t deferredWait = Sim::nowMicros() - firstSent;
+    Sim::report("deferred_frame_wait_sim", deferredWait / 1000.0, "ms");
+    Sim::check(compositor->deferred() > deferred, "second frame deferred by the interval");
+    Sim::check(compositor->frames() == frames + 1 && deferredWait <= Compositor::DefaultFrameIntervalMicros + 3000,
+               "deferred frame out when the interval ends");
+
+    // a frame held while the flush task sends goes out when the send is done
+    panel.wireBitsPerSecond = 1000000;
+    compositor->setFrameInterval(0);
+    compositor->invalidate();
+    ui->notify();
+    HAL::delay(1);
+    const uint32_t busy = compositor->busy();
+    stego->drawDisplay(0, 30, "frame three", true, false);
+    ui->notify();
+    HAL::delay(1);
+    Sim::check(compositor->busy() > busy && compositor->flushing(), "frame held while the flush task sends");
+    const uint32_t held = compositor->frames();
+    while (compositor->flushing())
+        HAL::delay(1);
+    const uint64_t sendDone = Sim::nowMicros();
+    while (compositor->frames() == held && Sim::nowMicros() - sendDone < 1000000)
+        HAL::delay(1);
+    const uint64_t busyWait = Sim::nowMicros() - sendDone;
+    Sim::report("busy_frame_wait_sim", busyWait / 1000.0, "ms");
+    Sim::check(compositor->frames() == held + 1 && busyWait <= 3000, "held frame out once the send is done");
+
+    while (compositor->flushing())
+        HAL::delay(1);
+    compositor->setFrameInterval(Compositor::DefaultFrameIntervalMicros);
+    panel.wireBitsPerSecond = 0;
+    compositor->stopFlushTask();
+    stego->stopTasks();
+}
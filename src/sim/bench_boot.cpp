@@ -0,0 +1,150 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+// boot sequence: a small table of steps on the simulated clock (a slow module powering up, a card
+// that keeps the CPU busy, a step waiting on two others, a failure skipping its dependents), then the
+// firmware's own boot on a board whose display, card and USB take their time, with those inits on
+// boot jobs, and its timeline on the console
+
+#include <string.h>
+#include "sim.h"
+#include "bench.h"
+#include "stegophone.h"
+#include "console.h"
+#include "bootsequence.h"
+
+using namespace StegoPhone;
+
+namespace {
+    uint64_t powerStart = 0;
+    bool cardFails = false;
+
+    // a module booting its own firmware: started, then waited on
+    BootStepResult power(void *context, bool first) {
+        if (first) powerStart = Sim::nowMicros();
+        return Sim::nowMicros() - powerStart >= 300000 ? BootStepResult::Done : BootStepResult::Pending;
+    }
+
+    // blocks the CPU for its whole init
+    BootStepResult card(void *context, bool first) {
+        HAL::delay(80);
+        return cardFails ? BootStepResult::Failed : BootStepResult::Done;
+    }
+
+    BootStepResult usb(void *context, bool first) {
+        HAL::delay(20);
+        return BootStepResult::Done;
+    }
+
+    BootStepResult logo(void *context, bool first) {
+        HAL::delay(10);
+        return BootStepResult::Done;
+    }
+
+    const uint8_t Power = 0, Card = 1, Usb = 2, Logo = 3;
+
+    constexpr BootStep TestSteps[] = {
+            {"power", 0, power},
+            {"card", 0, card},
+            {"usb", 0, usb},
+            {"logo", bootAfter(Power) | bootAfter(Card), logo},
+    };
+
+    static_assert(bootStepsOrdered(TestSteps), "test table ordered");
+
+    constexpr BootStep Backwards[] = {
+            {"first", bootAfter(1), usb},
+            {"second", 0, usb},
+    };
+
+    static_assert(!bootStepsOrdered(Backwards), "a step depending on one below it is refused");
+
+    uint8_t stepIndex(BootSequence *boot, const char *name) {
+        uint8_t step = 0;
+        while (step < boot->count() && strcmp(boot->name(step), name) != 0)
+            step++;
+        return step;
+    }
+
+    // polled every ms, as the firmware's timer does
+    void run(BootSequence &boot) {
+        for (int i = 0; i < 5000 && !boot.poll(); i++)
+            HAL::delay(1);
+    }
+
+    void engine() {
+        cardFails = false;
+        BootSequence boot(TestSteps, sizeof(TestSteps) / sizeof(TestSteps[0]), 0);
+        run(boot);
+        Sim::check(boot.finished() && !boot.failed() && boot.firstFailure() == boot.count(),
+                   "bootseq: every step done");
+        // one pass: the sim clock only moves by a microsecond or so between calls
+        Sim::check(boot.startMicros(Power) < 100 && boot.startMicros(Card) < 100 &&
+                   boot.startMicros(Usb) - boot.endMicros(Card) < 100 && boot.endMicros(Card) < 80000 + 100,
+                   "bootseq: independent steps start in the first pass");
+        Sim::check(boot.busyMicros(Power) < 10000 && boot.busyMicros(Card) >= 80000,
+                   "bootseq: a waiting step costs little, a blocking one its whole init");
+        Sim::check(boot.startMicros(Logo) >= boot.endMicros(Power) && boot.startMicros(Logo) >= boot.endMicros(Card),
+                   "bootseq: a step waits for everything it depends on");
+        Sim::report("elapsed_sim", boot.elapsedMicros() / 1000.0, "ms");
+        Sim::report("one_after_another_sim", boot.serialMicros() / 1000.0, "ms");
+        Sim::check(boot.elapsedMicros() < boot.serialMicros() && boot.elapsedMicros() <= 300000 + 10000 + 2000,
+                   "bootseq: the card and USB overlap the module powering up");
+
+        // the card fails: the logo is skipped, the rest still finishes
+        cardFails = true;
+        BootSequence failing(TestSteps, sizeof(TestSteps) / sizeof(TestSteps[0]), 0);
+        run(failing);
+        Sim::check(failing.finished() && failing.failed() && failing.firstFailure() == Card &&
+                   failing.state(Logo) == BootStepState::Skipped && failing.done(Power) && failing.done(Usb),
+                   "bootseq: a failure skips its dependents only");
+    }
+
+    void firmware() {
+        Sim::bootOnce();
+        StegoPhone::StegoPhone *stego = StegoPhone::StegoPhone::getInstance();
+        BootSequence *boot = stego->bootSequence();
+        Sim::check(boot->finished() && !boot->failed() && stego->status() == StegoStatus::Ready,
+                   "bootseq: firmware booted to Ready");
+
+        // the display, RN52 power up, SD card and USB host all start on the first pass, and the three
+        // blocking inits run on boot jobs, so they overlap each other as well as the RN52
+        const uint8_t display = stepIndex(boot, "display"), rn52 = stepIndex(boot, "rn52");
+        const uint8_t sd = stepIndex(boot, "sd"), usb = stepIndex(boot, "usb");
+        const uint8_t parallel[] = {display, rn52, sd, usb};
+        bool overlapped = true;
+        for (size_t a = 0; a < sizeof(parallel); a++) {
+            for (size_t b = 0; b < sizeof(parallel); b++) {
+                if (parallel[a] >= boot->count() || boot->startMicros(parallel[a]) >= boot->endMicros(parallel[b]))
+                    overlapped = false;
+            }
+        }
+        Sim::check(overlapped, "bootseq: display, RN52, SD and USB all under way at once");
+        // the card's init blocks its job, not the wheel: its step only polls, and the 1ms boot timer
+        // keeps firing through it
+        const Sim::InitDelays &delays = Sim::initDelays();
+        Sim::check(boot->busyMicros(sd) < 1000 && boot->busyMicros(display) < 1000 && boot->busyMicros(usb) < 1000,
+                   "bootseq: blocking inits cost the wheel almost nothing");
+        Sim::check(boot->passes() >= boot->elapsedMicros() / 1000 * 9 / 10, "bootseq: the wheel kept ticking");
+        Sim::check(boot->elapsedMicros() < boot->serialMicros() &&
+                   boot->elapsedMicros() <= delays.cardMs * 1000 + 5000,
+                   "bootseq: the boot takes about as long as its slowest init");
+        Sim::report("firmware_elapsed_sim", boot->elapsedMicros() / 1000.0, "ms");
+        Sim::report("firmware_one_after_another_sim", boot->serialMicros() / 1000.0, "ms");
+        Sim::report("firmware_passes", boot->passes(), "passes");
+
+        const uint32_t before = Sim::console().bytesWritten;
+        Console::getInstance()->execute("boot");
+        Sim::check(Sim::console().bytesWritten - before > 100u * boot->count(),
+                   "boot console command prints a timeline");
+    }
+}
+
+SIM_BENCH(bootseq, "boot sequence: dependencies, overlapped steps, failures, and the firmware's boot timeline") {
+    engine();
+    firmware();
+}
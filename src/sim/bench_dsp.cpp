@@ -0,0 +1,345 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+// DSP kernels: fixed point results bit exact against straightforward references (odd lengths and
+// unaligned buffers included), float within rounding, and throughput in samples per second
+
+#include <math.h>
+#include <string.h>
+#include "sim.h"
+#include "bench.h"
+#include "dsp.h"
+
+using namespace StegoPhone;
+
+namespace {
+    const size_t SignalLength = 4096;
+    const uint16_t Taps = 32;
+    const size_t BlockSamples = 192;
+
+    uint32_t seed = 0x2545F491;
+
+    uint32_t random32() {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    }
+
+    // mostly noise, with runs at both rails so saturation and -32768 get exercised
+    void fillQ15(int16_t *samples, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            const uint32_t r = random32();
+            if ((r & 0xFF) < 8) samples[i] = (r & 0x100) ? 32767 : -32768;
+            else samples[i] = (int16_t) (r >> 16);
+        }
+    }
+
+    void fillQ31(int32_t *samples, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            const uint32_t r = random32();
+            if ((r & 0xFF) < 8) samples[i] = (r & 0x100) ? INT32_MAX : INT32_MIN;
+            else samples[i] = (int32_t) random32();
+        }
+    }
+
+    int32_t clamp(int64_t value, int64_t low, int64_t high) {
+        return (int32_t) (value < low ? low : (value > high ? high : value));
+    }
+
+    int64_t roundShift(int64_t value, uint8_t down) {
+        return down ? (value + ((int64_t) 1 << (down - 1))) >> down : value;
+    }
+
+    uint32_t referenceSqrt(uint64_t value) {
+        uint64_t root = (uint64_t) sqrt((double) value);
+        while (root * root > value)
+            root--;
+        while ((root + 1) * (root + 1) <= value)
+            root++;
+        return (uint32_t) root;
+    }
+
+    // windowed sinc low pass at fraction of the sample rate, magnitudes summing under 2
+    void designFir(double *h, uint16_t taps, double cutoff) {
+        double sum = 0;
+        for (uint16_t i = 0; i < taps; i++) {
+            const double t = i - (taps - 1) / 2.0;
+            const double sinc = t == 0 ? 2 * cutoff : sin(2 * M_PI * cutoff * t) / (M_PI * t);
+            const double window = 0.54 - 0.46 * cos(2 * M_PI * i / (taps - 1));
+            h[i] = sinc * window;
+            sum += h[i];
+        }
+        for (uint16_t i = 0; i < taps; i++)
+            h[i] /= sum;
+    }
+
+    // RBJ low pass, normalised: b0 b1 b2 a1 a2
+    void designLowPass(double *c, double hz, double rate) {
+        const double w = 2 * M_PI * hz / rate;
+        const double alpha = sin(w) / (2 * 0.7071);
+        const double a0 = 1 + alpha;
+        c[0] = (1 - cos(w)) / 2 / a0;
+        c[1] = (1 - cos(w)) / a0;
+        c[2] = c[0];
+        c[3] = -2 * cos(w) / a0;
+        c[4] = (1 - alpha) / a0;
+    }
+
+    // block sizes that wander, so state carried between calls is part of every comparison
+    size_t nextBlock(size_t i) {
+        static const size_t sizes[] = {1, 7, 64, 13, 192, 2, 33};
+        return sizes[i % (sizeof(sizes) / sizeof(sizes[0]))];
+    }
+
+    int16_t q15In[SignalLength + 1];
+    int16_t q15Other[SignalLength + 1];
+    int16_t q15Out[SignalLength];
+    int32_t q31In[SignalLength];
+    int32_t q31Other[SignalLength];
+    int32_t q31Out[SignalLength];
+    float f32In[SignalLength];
+    float f32Out[SignalLength];
+
+    template<typename Kernel>
+    double samplesPerSecond(Kernel kernel) {
+        const int rounds = 2000;
+        const uint64_t start = Sim::hostNanos();
+        for (int i = 0; i < rounds; i++)
+            kernel();
+        const uint64_t nanos = Sim::hostNanos() - start;
+        return nanos ? (double) rounds * BlockSamples * 1e9 / nanos : 0;
+    }
+}
+
+SIM_BENCH(dsp, "DSP kernels: bit exact fixed point against references, throughput in samples/s") {
+    fillQ15(q15In, SignalLength + 1);
+    fillQ15(q15Other, SignalLength + 1);
+    fillQ31(q31In, SignalLength);
+    fillQ31(q31Other, SignalLength);
+
+    // DOT PRODUCTS, every length up to 40 and both alignments
+    bool dotExact = true;
+    for (size_t offset = 0; offset < 2; offset++) {
+        for (size_t length = 0; length <= 40; length++) {
+            int64_t reference = 0;
+            int64_t reference31 = 0;
+            for (size_t i = 0; i < length; i++) {
+                reference += (int64_t) q15In[offset + i] * q15Other[i];
+                reference31 += ((int64_t) q31In[offset + i] * q31Other[i]) >> 14;
+            }
+            dotExact = dotExact && DSP::dotQ15(q15In + offset, q15Other, length) == reference &&
+                       DSP::dotQ31(q31In + offset, q31Other, length) == reference31;
+        }
+    }
+    Sim::check(dotExact, "dotQ15/dotQ31 exact");
+
+    // GAIN AND MIXING
+    bool gainExact = true;
+    static const int16_t gains[] = {32767, 16384, -12345, -32768, 3};
+    for (size_t g = 0; g < sizeof(gains) / sizeof(gains[0]); g++) {
+        for (uint8_t shift = 0; shift <= 15; shift += 5) {
+            memcpy(q15Out, q15In + 1, sizeof(q15Out));
+            DSP::gainQ15(q15Out, 999, gains[g], shift);
+            for (size_t i = 0; i < 999 && gainExact; i++)
+                gainExact = q15Out[i] == clamp(roundShift((int64_t) q15In[1 + i] * gains[g], 15 - shift),
+                                               -32768, 32767);
+            memcpy(q31Out, q31In, sizeof(q31Out));
+            const int32_t gain31 = (int32_t) gains[g] << 16;
+            DSP::gainQ31(q31Out, 999, gain31, shift);
+            for (size_t i = 0; i < 999 && gainExact; i++)
+                gainExact = q31Out[i] == clamp(roundShift((int64_t) q31In[i] * gain31, 31 - shift),
+                                               INT32_MIN, INT32_MAX);
+        }
+    }
+    Sim::check(gainExact, "gainQ15/gainQ31 exact, saturating");
+
+    memcpy(q15Out, q15In + 1, sizeof(q15Out));
+    DSP::addQ15(q15Out, q15Other, 1001);
+    memcpy(q31Out, q31In, sizeof(q31Out));
+    DSP::addQ31(q31Out, q31Other, 1001);
+    bool addExact = true;
+    for (size_t i = 0; i < 1001 && addExact; i++)
+        addExact = q15Out[i] == clamp((int32_t) q15In[1 + i] + q15Other[i], -32768, 32767) &&
+                   q31Out[i] == clamp((int64_t) q31In[i] + q31Other[i], INT32_MIN, INT32_MAX);
+    Sim::check(addExact, "addQ15/addQ31 exact, saturating");
+
+    // LEVEL
+    bool levelExact = true;
+    for (size_t length = 1; length < 300 && levelExact; length += 37) {
+        uint32_t peak = 0;
+        uint32_t peak31 = 0;
+        uint64_t energy = 0;
+        uint64_t energy31 = 0;
+        for (size_t i = 0; i < length; i++) {
+            const int64_t x = q15In[1 + i];
+            const int64_t y = q31In[i];
+            peak = (uint32_t) (x < 0 ? -x : x) > peak ? (uint32_t) (x < 0 ? -x : x) : peak;
+            peak31 = (uint32_t) (y < 0 ? -y : y) > peak31 ? (uint32_t) (y < 0 ? -y : y) : peak31;
+            energy += (uint64_t) (x * x);
+            energy31 += (uint64_t) (y * y) >> 31;
+        }
+        levelExact = DSP::peakQ15(q15In + 1, length) == peak && DSP::peakQ31(q31In, length) == peak31 &&
+                     DSP::energyQ15(q15In + 1, length) == energy &&
+                     DSP::rmsQ15(q15In + 1, length) == referenceSqrt(energy / length) &&
+                     DSP::rmsQ31(q31In, length) == referenceSqrt((energy31 / length) << 31);
+    }
+    const int16_t rail[4] = {-32768, -32768, -32768, -32768};
+    Sim::check(levelExact && DSP::peakQ15(rail, 4) == 32768 && DSP::rmsQ15(rail, 4) == 32768,
+               "peak/energy/rms exact");
+    bool sqrtExact = true;
+    for (int i = 0; i < 10000 && sqrtExact; i++) {
+        const uint64_t value = ((uint64_t) random32() << 32 | random32()) >> (random32() & 63);
+        sqrtExact = DSP::isqrt64(value) == referenceSqrt(value);
+    }
+    Sim::check(sqrtExact && DSP::isqrt64(UINT64_MAX) == 0xFFFFFFFFu, "isqrt64 exact");
+
+    // FIR, a 32 tap low pass run in wandering block sizes
+    double h[Taps];
+    designFir(h, Taps, 0.2);
+    int16_t h15[Taps];
+    int32_t h31[Taps];
+    float hf[Taps];
+    for (uint16_t i = 0; i < Taps; i++) {
+        h15[i] = (int16_t) lround(h[i] * 32768);
+        h31[i] = (int32_t) llround(h[i] * 2147483648.0);
+        hf[i] = (float) h[i];
+    }
+    DSP::FirQ15<Taps> fir15(h15);
+    DSP::FirQ31<Taps> fir31(h31);
+    for (size_t done = 0, block = 0; done < SignalLength; block++) {
+        size_t count = nextBlock(block);
+        if (count > SignalLength - done) count = SignalLength - done;
+        fir15.process(q15In + done, q15Out + done, count);
+        fir31.process(q31In + done, q31Out + done, count);
+        done += count;
+    }
+    bool firExact = true;
+    for (size_t n = 0; n < SignalLength && firExact; n++) {
+        int64_t sum = 0;
+        int64_t sum31 = 0;
+        for (uint16_t k = 0; k < Taps && k <= n; k++) {
+            sum += (int64_t) h15[k] * q15In[n - k];
+            sum31 += (int64_t) h31[k] * q31In[n - k];
+        }
+        firExact = q15Out[n] == clamp(roundShift(sum, 15), -32768, 32767) &&
+                   q31Out[n] == clamp(roundShift(sum31, 31), INT32_MIN, INT32_MAX);
+    }
+    Sim::check(firExact, "FirQ15/FirQ31 exact across blocks");
+
+    // float against double
+    DSP::q15ToF32(q15In, f32In, SignalLength);
+    DSP::FirF32<Taps> firF(hf);
+    firF.process(f32In, f32Out, SignalLength);
+    double firError = 0;
+    for (size_t n = 0; n < SignalLength; n++) {
+        double sum = 0;
+        for (uint16_t k = 0; k < Taps && k <= n; k++)
+            sum += (double) hf[k] * f32In[n - k];
+        firError = fabs(sum - f32Out[n]) > firError ? fabs(sum - f32Out[n]) : firError;
+    }
+    Sim::report("fir_f32_max_error", firError * 1e6, "ppm of full scale");
+    Sim::check(firError < 1e-5, "FirF32 within float rounding");
+
+    // BIQUAD, a 1 kHz low pass at 9600/s, quantised
+    double c[5];
+    designLowPass(c, 1000, 9600);
+    int16_t c15[5];
+    int32_t c31[5];
+    float cf[5];
+    for (int i = 0; i < 5; i++) {
+        c15[i] = (int16_t) lround(c[i] * 16384);
+        c31[i] = (int32_t) llround(c[i] * 1073741824.0);
+        cf[i] = (float) c[i];
+    }
+    // half scale input: a low pass overshoots a full scale square edge
+    for (size_t i = 0; i < SignalLength; i++) {
+        q15Other[i] = (int16_t) (q15In[i] / 2);
+        q31Other[i] = q31In[i] / 2;
+    }
+    DSP::BiquadQ15 biquad15(c15);
+    DSP::BiquadQ31 biquad31(c31);
+    for (size_t done = 0, block = 0; done < SignalLength; block++) {
+        size_t count = nextBlock(block);
+        if (count > SignalLength - done) count = SignalLength - done;
+        biquad15.process(q15Other + done, q15Out + done, count);
+        biquad31.process(q31Other + done, q31Out + done, count);
+        done += count;
+    }
+    bool biquadExact = true;
+    int64_t x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+    int64_t u1 = 0, u2 = 0, v1 = 0, v2 = 0;
+    for (size_t n = 0; n < SignalLength && biquadExact; n++) {
+        const int64_t x0 = q15Other[n];
+        const int64_t y0 = clamp(roundShift(c15[0] * x0 + c15[1] * x1 + c15[2] * x2 - c15[3] * y1 - c15[4] * y2, 14),
+                                 -32768, 32767);
+        const int64_t u0 = q31Other[n];
+        const int64_t v0 = clamp(roundShift(c31[0] * u0 + c31[1] * u1 + c31[2] * u2 - c31[3] * v1 - c31[4] * v2, 30),
+                                 INT32_MIN, INT32_MAX);
+        biquadExact = q15Out[n] == y0 && q31Out[n] == v0;
+        x2 = x1;
+        x1 = x0;
+        y2 = y1;
+        y1 = y0;
+        u2 = u1;
+        u1 = u0;
+        v2 = v1;
+        v1 = v0;
+    }
+    Sim::check(biquadExact, "BiquadQ15/BiquadQ31 exact across blocks");
+
+    DSP::BiquadF32 biquadF(cf);
+    DSP::q15ToF32(q15Other, f32In, SignalLength);
+    biquadF.process(f32In, f32Out, SignalLength);
+    double biquadError = 0;
+    double w1 = 0, w2 = 0, z1 = 0, z2 = 0;
+    for (size_t n = 0; n < SignalLength; n++) {
+        const double w0 = f32In[n];
+        const double z0 = cf[0] * w0 + cf[1] * w1 + cf[2] * w2 - cf[3] * z1 - cf[4] * z2;
+        biquadError = fabs(z0 - f32Out[n]) > biquadError ? fabs(z0 - f32Out[n]) : biquadError;
+        w2 = w1;
+        w1 = w0;
+        z2 = z1;
+        z1 = z0;
+    }
+    Sim::report("biquad_f32_max_error", biquadError * 1e6, "ppm of full scale");
+    Sim::check(biquadError < 1e-5, "BiquadF32 within float rounding");
+
+    int16_t roundTrip[4];
+    const float edges[4] = {1.0f, -1.0f, 0.5f, -0.0000152f};
+    DSP::f32ToQ15(edges, roundTrip, 4);
+    Sim::check(roundTrip[0] == 32767 && roundTrip[1] == -32768 && roundTrip[2] == 16384 && roundTrip[3] == 0,
+               "float to Q15 rounds and saturates");
+
+    // THROUGHPUT, one 20ms modem block at a time
+    int16_t *block15 = q15Out;
+    int32_t *block31 = q31Out;
+    float *blockF = f32Out;
+    memcpy(block15, q15Other, BlockSamples * sizeof(int16_t));
+    memcpy(block31, q31Other, BlockSamples * sizeof(int32_t));
+    memcpy(blockF, f32In, BlockSamples * sizeof(float));
+    volatile int64_t sink = 0;
+    Sim::report("fir32_q15_host", samplesPerSecond([&]() { fir15.process(block15, block15, BlockSamples); }) / 1e6,
+                "Msamples/s");
+    Sim::report("fir32_q31_host", samplesPerSecond([&]() { fir31.process(block31, block31, BlockSamples); }) / 1e6,
+                "Msamples/s");
+    Sim::report("fir32_f32_host", samplesPerSecond([&]() { firF.process(blockF, blockF, BlockSamples); }) / 1e6,
+                "Msamples/s");
+    Sim::report("biquad_q15_host",
+                samplesPerSecond([&]() { biquad15.process(block15, block15, BlockSamples); }) / 1e6, "Msamples/s");
+    Sim::report("biquad_q31_host",
+                samplesPerSecond([&]() { biquad31.process(block31, block31, BlockSamples); }) / 1e6, "Msamples/s");
+    Sim::report("biquad_f32_host",
+                samplesPerSecond([&]() { biquadF.process(blockF, blockF, BlockSamples); }) / 1e6, "Msamples/s");
+    Sim::report("gain_q15_host", samplesPerSecond([&]() { DSP::gainQ15(block15, BlockSamples, 32000); }) / 1e6,
+                "Msamples/s");
+    Sim::report("dot_q15_host",
+                samplesPerSecond([&]() { sink = sink + DSP::dotQ15(block15, q15In, BlockSamples); }) / 1e6,
+                "Msamples/s");
+    Sim::report("rms_q15_host",
+                samplesPerSecond([&]() { sink = sink + DSP::rmsQ15(block15, BlockSamples); }) / 1e6, "Msamples/s");
+}
@@ -0,0 +1,233 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+// ESP8266 driver against the scripted modem: bring up, URCs, +IPD payloads that look like responses,
+// payloads and URCs inside a command's response, receive rate at 115200 and pipelined sends
+
+#include <string.h>
+#include <string>
+#include "sim.h"
+#include "bench.h"
+#include "stegophone.h"
+#include "rtos.h"
+
+using namespace StegoPhone;
+
+namespace {
+    // consumer: expects a running byte pattern unless collecting
+    struct Sink {
+        uint32_t views;
+        uint32_t partials;
+        uint64_t bytes;
+        uint32_t mismatches;
+        uint8_t next;
+        bool collect;
+        std::string collected;
+    };
+    Sink sink;
+
+    uint32_t urcsSeen[6];
+
+    struct Completion {
+        uint32_t count;
+        uint32_t matched;
+        std::string response;
+    };
+
+    void dataReceived(IpdView view) {
+        sink.views++;
+        if (view.partial) sink.partials++;
+        sink.bytes += view.length;
+        if (sink.collect) {
+            sink.collected.append((const char *) view.data, view.length);
+            return;
+        }
+        for (size_t i = 0; i < view.length; i++)
+            if (view.data[i] != sink.next++) sink.mismatches++;
+    }
+
+    void eventReceived(ESP8266Event event) {
+        urcsSeen[(int) event.urc]++;
+    }
+
+    void completed(void *context, const CommandResponse &response) {
+        Completion *completion = (Completion *) context;
+        completion->count++;
+        if (response.result == CommandResult::Matched && response.terminator == 0) completion->matched++;
+        completion->response.assign(response.data, response.length);
+    }
+
+    // polled mode: the driver's loop() and a millisecond of simulated time per pass
+    void pump(uint32_t ms) {
+        ESP8266 *esp8266 = ESP8266::getInstance();
+        for (uint32_t i = 0; i < ms; i++) {
+            esp8266->loop();
+            HAL::delay(1);
+        }
+        esp8266->loop();
+    }
+
+    void resetSink(bool collect) {
+        sink.views = 0;
+        sink.partials = 0;
+        sink.bytes = 0;
+        sink.mismatches = 0;
+        sink.next = 0;
+        sink.collect = collect;
+        sink.collected.clear();
+    }
+
+    // "\r\n+IPD,<link>,<length>:" and a pattern payload continuing from next
+    size_t buildIpd(uint8_t *out, uint8_t link, size_t length, uint8_t &next) {
+        const int header = snprintf((char *) out, 32, "\r\n+IPD,%u,%u:", link, (unsigned) length);
+        for (size_t i = 0; i < length; i++)
+            out[header + i] = next++;
+        return header + length;
+    }
+}
+
+SIM_BENCH(esp8266, "ESP8266 driver: URCs, zero-copy +IPD, responses around payloads, 115200 receive rate") {
+    Sim::bootOnce();
+    ESP8266 *esp8266 = ESP8266::getInstance();
+    Sim::ESP8266Device &modem = Sim::esp8266Device();
+    static bool attached = false;
+    if (!attached) {
+        esp8266->dataReceived.attach(FunctionSlot<IpdView>(dataReceived));
+        esp8266->eventReceived.attach(FunctionSlot<ESP8266Event>(eventReceived));
+        attached = true;
+    }
+
+    // bring up, queued by setup(): echo off, AT+GMR, multiple connections
+    pump(20);
+    Sim::check(esp8266->status() == ESP8266Status::Present, "modem present after bring up");
+    Sim::check(strncmp(esp8266->version(), "AT version:1.2.0.0", 18) == 0, "firmware version from AT+GMR");
+
+    Completion gmr = {0, 0, std::string()};
+    const uint64_t gmrStart = Sim::nowMicros();
+    esp8266->submit(ESP8266Command::Version, ESP8266Command::okOrError(), completed, &gmr);
+    while (gmr.count == 0 && Sim::nowMicros() - gmrStart < 100000)
+        pump(1);
+    Sim::report("at_gmr_latency_sim", (Sim::nowMicros() - gmrStart) / 1000.0, "ms");
+    Sim::check(gmr.matched == 1, "AT+GMR answered OK");
+
+    // URCs, alone
+    const uint32_t urcStart = esp8266->urcs();
+    modem.sendUnsolicited("WIFI CONNECTED\r\nWIFI GOT IP\r\n");
+    pump(5);
+    Sim::check(esp8266->urcs() - urcStart == 2 && esp8266->wifiConnected() &&
+               urcsSeen[(int) ESP8266Urc::WifiGotIP] > 0, "WIFI URCs decoded and signalled");
+
+    Completion connect = {0, 0, std::string()};
+    esp8266->connect(0, "192.168.4.1", 5000, completed, &connect);
+    pump(40);
+    Sim::check(connect.matched == 1 && esp8266->linkOpen(0), "link 0 open on its CONNECT");
+
+    // a payload full of things that look like responses and URCs, arriving while AT+GMR is in flight
+    resetSink(true);
+    static const char trap[] = "\r\nOK\r\n+IPD,0,9:\r\nSEND OK\r\n0,CLOSED\r\nERROR\r\n";
+    modem.sendIPD(0, (const uint8_t *) trap, sizeof(trap) - 1);
+    gmr = Completion{0, 0, std::string()};
+    esp8266->submit(ESP8266Command::Version, ESP8266Command::okOrError(), completed, &gmr);
+    pump(30);
+    Sim::check(sink.collected == trap, "payload delivered as sent");
+    Sim::check(gmr.matched == 1 && gmr.response.find("SDK version") != std::string::npos &&
+               gmr.response.find("+IPD") == std::string::npos, "payload kept out of the response in flight");
+    Sim::check(esp8266->linkOpen(0), "CLOSED inside a payload is not a URC");
+
+    // a payload and a URC inside a response
+    resetSink(true);
+    modem.script("AT+CIPSTATUS", "STATUS:3\r\n+IPD,0,6:OK\r\n\r\n1,CONNECT\r\n+CIPSTATUS:0,\"TCP\",\"192.168.4.1\","
+                                 "5000,4321,0\r\n\r\nOK\r\n");
+    Completion status = {0, 0, std::string()};
+    esp8266->submit("AT+CIPSTATUS", ESP8266Command::okOrError(), completed, &status);
+    pump(30);
+    modem.clearScripts();
+    Sim::check(status.matched == 1 && status.response.find("+CIPSTATUS:0") != std::string::npos,
+               "response completes");
+    Sim::check(sink.collected == "OK\r\n\r\n", "payload taken out of the response");
+    Sim::check(esp8266->linkOpen(1), "URC inside the response decoded");
+
+    // a +IPD larger than the ring goes out in ring sized views
+    resetSink(false);
+    static uint8_t ipd[3200];
+    uint8_t next = 0;
+    size_t ipdLength = buildIpd(ipd, 0, 3000, next);
+    Sim::esp8266Link().deviceSend(ipd, ipdLength);
+    pump(300);
+    Sim::check(sink.bytes == 3000 && sink.mismatches == 0 && sink.partials == 1, "3000 bytes as 2048 + 952");
+
+    // a header that does not parse is counted, and the next line still decodes
+    const uint32_t errorsStart = esp8266->ipdErrors();
+    modem.sendUnsolicited("\r\n+IPD,x\r\n1,CLOSED\r\n");
+    pump(5);
+    Sim::check(esp8266->ipdErrors() - errorsStart == 1 && !esp8266->linkOpen(1), "bad header skipped");
+
+    // parser cost per received byte, fed from memory; 1280 bytes keeps the pattern running across rounds
+    resetSink(false);
+    next = 0;
+    ipdLength = buildIpd(ipd, 0, 1280, next);
+    const int rounds = 200;
+    const uint64_t start = Sim::hostNanos();
+    for (int i = 0; i < rounds; i++)
+        esp8266->push(ipd, ipdLength);
+    const double parseNanos = (Sim::hostNanos() - start) / (double) (rounds * ipdLength);
+    Sim::report("ipd_parse_host", parseNanos, "ns/byte");
+    Sim::check(sink.views == (uint32_t) rounds && sink.mismatches == 0, "every payload intact, one view each");
+
+    // bulk receive on the driver's task: 64KB of 1460 byte segments back to back at 115200
+    RTOS::startScheduler();
+    if (!Sim::check(esp8266->startTask(2), "ESP8266 task created")) return;
+    resetSink(false);
+    const int segments = 45;
+    const uint64_t bulkStart = Sim::nowMicros();
+    next = 0;
+    uint64_t wireBytes = 0;
+    for (int i = 0; i < segments; i++) {
+        ipdLength = buildIpd(ipd, 0, 1460, next);
+        Sim::esp8266Link().deviceSend(ipd, ipdLength);
+        wireBytes += ipdLength;
+    }
+    while (sink.bytes < (uint64_t) segments * 1460 && Sim::nowMicros() - bulkStart < 10000000)
+        HAL::delay(5);
+    const double seconds = (Sim::nowMicros() - bulkStart) / 1000000.0;
+    const double lineRate = 115200 / 10.0;
+    Sim::report("ipd_receive_rate_sim", sink.bytes / seconds / 1000.0, "KB/s");
+    Sim::report("ipd_receive_of_line_rate", 100.0 * sink.bytes / seconds / lineRate, "%");
+    Sim::report("ipd_wire_overhead", 100.0 * (wireBytes - sink.bytes) / wireBytes, "%");
+    Sim::check(sink.bytes == (uint64_t) segments * 1460 && sink.mismatches == 0, "64KB received intact");
+    Sim::check(sink.bytes / seconds >= 0.95 * lineRate * sink.bytes / wireBytes, "receive keeps up with the line");
+
+    // pipelined sends with a command between them; each payload is written at its prompt
+    static uint8_t outgoing[3][ESP8266::MaxSendLength];
+    std::string expected;
+    for (int i = 0; i < 3; i++) {
+        for (size_t j = 0; j < sizeof(outgoing[i]); j++)
+            outgoing[i][j] = (uint8_t) ('A' + i + (j % 7));
+        expected.append((const char *) outgoing[i], sizeof(outgoing[i]));
+    }
+    modem.sendPayloads.clear();
+    Completion sends = {0, 0, std::string()};
+    gmr = Completion{0, 0, std::string()};
+    const uint32_t sendsStart = esp8266->sends();
+    bool queued = esp8266->send(0, outgoing[0], sizeof(outgoing[0]), completed, &sends);
+    queued = esp8266->submit(ESP8266Command::Version, ESP8266Command::okOrError(), completed, &gmr) && queued;
+    queued = esp8266->send(0, outgoing[1], sizeof(outgoing[1]), completed, &sends) && queued;
+    queued = esp8266->send(0, outgoing[2], sizeof(outgoing[2]), completed, &sends) && queued;
+    const uint64_t sendStart = Sim::nowMicros();
+    while (sends.count < 3 && Sim::nowMicros() - sendStart < 2000000)
+        HAL::delay(5);
+    Sim::report("send_6kb_sim", (Sim::nowMicros() - sendStart) / 1000.0, "ms");
+    Sim::check(queued && sends.matched == 3 && gmr.matched == 1, "three sends and a command complete");
+    Sim::check(modem.sendPayloads == expected && esp8266->sends() - sendsStart == 3, "payloads written in order");
+
+    Completion close = {0, 0, std::string()};
+    esp8266->close(0, completed, &close);
+    HAL::delay(20);
+    esp8266->stopTask();
+    Sim::check(close.matched == 1 && !esp8266->linkOpen(0), "link 0 closed");
+    Sim::report("urcs", esp8266->urcs(), "urcs");
+}
@@ -0,0 +1,239 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+// Reed-Solomon FEC: a known answer, correction up to the limit in every codeword and across
+// interleaved bursts, throughput on the host, and post-FEC frame error rate against overhead over
+// Gilbert-Elliott burst channels (a good state with rare bit errors, a bad one where a third of the
+// bits flip, bursts of a given mean length)
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "sim.h"
+#include "bench.h"
+#include "console.h"
+#include "framefec.h"
+
+using namespace StegoPhone;
+
+namespace {
+    uint32_t seed = 1;
+
+    uint32_t next() {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    }
+
+    double uniform() {
+        return (next() & 0xffffff) / 16777216.0;
+    }
+
+    void randomPayload(ModemFrame &frame, uint16_t length) {
+        frame.type = ModemFrameType::Data;
+        frame.length = length;
+        for (uint16_t i = 0; i < length; i++)
+            frame.data[i] = (uint8_t) next();
+    }
+
+    // RS(255, 223) parity of the message 0, 1, ... 222, from an independent long division
+    void knownAnswer() {
+        static const uint8_t expected[32] = {0x41, 0x84, 0x11, 0x83, 0xb1, 0x1f, 0xdb, 0x53, 0x74, 0x21, 0x93,
+                                             0x96, 0x96, 0xcd, 0xa7, 0x0e, 0x1d, 0xb5, 0xc8, 0x66, 0x84, 0xaf,
+                                             0x22, 0x25, 0x64, 0xb8, 0x9c, 0xc6, 0x06, 0x9f, 0x17, 0x2e};
+        Fec::ReedSolomon code(32);
+        uint8_t codeword[255];
+        for (uint16_t i = 0; i < 223; i++)
+            codeword[i] = (uint8_t) i;
+        code.encode(codeword, 255);
+        Sim::check(memcmp(codeword + 223, expected, sizeof(expected)) == 0, "fec: RS(255,223) known answer");
+        codeword[3] ^= 0x5a;
+        codeword[200] ^= 0x01;
+        codeword[254] ^= 0xff;
+        const int16_t fixed = code.decode(codeword, 255);
+        bool restored = fixed == 3;
+        for (uint16_t i = 0; i < 223; i++)
+            restored = restored && codeword[i] == i;
+        Sim::check(restored && memcmp(codeword + 223, expected, sizeof(expected)) == 0,
+                   "fec: RS(255,223) corrects scattered errors");
+    }
+
+    // up to parity / 2 random byte errors in each codeword, then one burst of depth * parity / 2 bytes
+    void correction(uint8_t parity, uint8_t depth) {
+        FrameFec fec;
+        fec.configure(parity, depth);
+        ModemFrame frame, original;
+        bool scattered = true, burst = true;
+        for (int trial = 0; trial < 200; trial++) {
+            randomPayload(original, (uint16_t) (next() % (fec.maxPayload() + 1)));
+            frame = original;
+            fec.encode(&frame);
+            const uint16_t total = frame.length;
+            const ModemFrame encoded = frame;
+            for (uint8_t c = 0; c < depth; c++) {
+                const uint16_t count = (uint16_t) ((total - c + depth - 1) / depth);
+                for (uint8_t e = 0; e < parity / 2; e++)
+                    frame.data[c + depth * (next() % count)] ^= (uint8_t) (1 + next() % 255);
+            }
+            scattered = scattered && fec.decode(&frame) && frame.length == original.length &&
+                        memcmp(frame.data, original.data, original.length) == 0;
+
+            frame = encoded;
+            const uint16_t span = (uint16_t) (depth * (parity / 2));
+            const uint16_t start = (uint16_t) (next() % (total - span + 1));
+            for (uint16_t i = start; i < start + span; i++)
+                frame.data[i] ^= (uint8_t) (1 + next() % 255);
+            burst = burst && fec.decode(&frame) && memcmp(frame.data, original.data, original.length) == 0;
+        }
+        char label[96];
+        snprintf(label, sizeof(label), "fec %ux%u: parity / 2 errors per codeword corrected",
+                 (unsigned int) parity, (unsigned int) depth);
+        Sim::check(scattered, label);
+        snprintf(label, sizeof(label), "fec %ux%u: bursts of depth * parity / 2 bytes corrected",
+                 (unsigned int) parity, (unsigned int) depth);
+        Sim::check(burst, label);
+    }
+
+    // payload megabytes per second through encode, a clean decode, and a decode fixing parity / 4
+    // errors per codeword
+    void throughput(uint8_t parity, uint8_t depth) {
+        FrameFec fec;
+        fec.configure(parity, depth);
+        ModemFrame frame, encoded;
+        randomPayload(frame, fec.maxPayload());
+        const uint16_t payload = frame.length;
+        const int rounds = 4000;
+
+        uint64_t start = Sim::hostNanos();
+        for (int r = 0; r < rounds; r++) {
+            frame.length = payload;
+            fec.encode(&frame);
+        }
+        const double encodeNanos = (double) (Sim::hostNanos() - start);
+        encoded = frame;
+
+        start = Sim::hostNanos();
+        for (int r = 0; r < rounds; r++) {
+            frame = encoded;
+            fec.decode(&frame);
+        }
+        const double cleanNanos = (double) (Sim::hostNanos() - start);
+
+        ModemFrame damaged = encoded;
+        for (uint16_t i = 0; i < (uint16_t) (depth * (parity / 4)); i++)
+            damaged.data[(i * 37) % encoded.length] ^= 0x3c;
+        start = Sim::hostNanos();
+        for (int r = 0; r < rounds; r++) {
+            frame = damaged;
+            fec.decode(&frame);
+        }
+        const double dirtyNanos = (double) (Sim::hostNanos() - start);
+
+        const double bytes = (double) payload * rounds;
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%ux%u_encode_host", (unsigned int) parity, (unsigned int) depth);
+        Sim::report(buf, bytes / encodeNanos * 1000, "MB/s");
+        snprintf(buf, sizeof(buf), "%ux%u_decode_clean_host", (unsigned int) parity, (unsigned int) depth);
+        Sim::report(buf, bytes / cleanNanos * 1000, "MB/s");
+        snprintf(buf, sizeof(buf), "%ux%u_decode_errors_host", (unsigned int) parity, (unsigned int) depth);
+        Sim::report(buf, bytes / dirtyNanos * 1000, "MB/s");
+    }
+
+    struct Channel {
+        const char *name;
+        double goodToBad; // per bit
+        double badToGood; // per bit: bursts average 1 / badToGood bits
+        double goodBer;
+        double badBer;
+    };
+
+    // a frame's bytes through the channel, whose state carries over from frame to frame
+    void transmit(const Channel &channel, bool &bad, uint8_t *data, uint16_t length) {
+        for (uint16_t i = 0; i < length; i++) {
+            for (uint8_t bit = 0; bit < 8; bit++) {
+                bad = bad ? uniform() >= channel.badToGood : uniform() < channel.goodToBad;
+                if (uniform() < (bad ? channel.badBer : channel.goodBer)) data[i] ^= (uint8_t) (1 << bit);
+            }
+        }
+    }
+
+    // frames of 255 bytes on the air; a frame is in error when its payload is not delivered intact
+    double frameErrorRate(const Channel &channel, uint8_t parity, uint8_t depth, uint32_t frames) {
+        seed = 777;
+        FrameFec fec;
+        if (parity) fec.configure(parity, depth);
+        const uint16_t payload = parity ? fec.maxPayload() : ModemFrame::Capacity;
+        bool bad = false;
+        uint32_t errors = 0;
+        ModemFrame frame, original;
+        for (uint32_t f = 0; f < frames; f++) {
+            randomPayload(original, payload);
+            frame = original;
+            if (parity) fec.encode(&frame);
+            transmit(channel, bad, frame.data, frame.length);
+            const bool delivered = parity ? fec.decode(&frame) : true;
+            if (!delivered || memcmp(frame.data, original.data, payload) != 0) errors++;
+        }
+        return (double) errors / frames;
+    }
+}
+
+SIM_BENCH(fec, "Reed-Solomon FEC with interleaving: correction limits, MB/s, FER over burst channels") {
+    knownAnswer();
+    static const uint8_t shapes[][2] = {{32, 1}, {16, 2}, {8, 4}, {16, 1}, {4, 8}};
+    for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++)
+        correction(shapes[s][0], shapes[s][1]);
+
+    FrameFec defaults;
+    ModemFrame frame;
+    randomPayload(frame, defaults.maxPayload() + 1);
+    Sim::check(!defaults.encode(&frame) && frame.length == defaults.maxPayload() + 1,
+               "fec: payload past maxPayload refused");
+    frame.length = 3;
+    Sim::check(!defaults.decode(&frame) && defaults.failures() == 1, "fec: frame shorter than the overhead fails");
+
+    for (size_t s = 0; s < 3; s++)
+        throughput(shapes[s][0], shapes[s][1]);
+
+    // post-FEC frame error rate against overhead, 255 byte frames on the air
+    static const Channel channels[] = {
+            {"short_bursts", 2e-4, 0.1, 1e-5, 0.3},  // bursts of about 10 bits
+            {"long_bursts", 5e-5, 0.02, 1e-5, 0.3},  // about 50 bits, a 40ms click at 1200 baud
+    };
+    static const uint8_t configs[][2] = {{0, 0}, {8, 1}, {4, 2}, {16, 1}, {8, 2}, {4, 4},
+                                         {32, 1}, {16, 2}, {8, 4}, {32, 2}, {16, 4}};
+    const uint32_t frames = 3000;
+    for (size_t c = 0; c < sizeof(channels) / sizeof(channels[0]); c++) {
+        double none = 0, best16 = 1, best32 = 1, best64 = 1;
+        for (size_t k = 0; k < sizeof(configs) / sizeof(configs[0]); k++) {
+            const uint8_t parity = configs[k][0], depth = configs[k][1];
+            const double fer = frameErrorRate(channels[c], parity, depth, frames);
+            char buf[64];
+            if (parity)
+                snprintf(buf, sizeof(buf), "%s_fer_%ux%u_overhead_%u%%", channels[c].name, (unsigned int) parity,
+                         (unsigned int) depth, (unsigned int) ((parity * depth * 100 + 127) / 255));
+            else
+                snprintf(buf, sizeof(buf), "%s_fer_no_fec", channels[c].name);
+            Sim::report(buf, fer * 100, "%");
+            const uint16_t overhead = (uint16_t) (parity * depth);
+            if (!parity) none = fer;
+            if (overhead == 16 && fer < best16) best16 = fer;
+            if (overhead == 32 && fer < best32) best32 = fer;
+            if (overhead == 64 && fer < best64) best64 = fer;
+        }
+        std::string label = std::string("fec ") + channels[c].name + ": 12.5% overhead cuts FER tenfold";
+        Sim::check(none > 0.05 && best32 * 10 <= none, label.c_str());
+        label = std::string("fec ") + channels[c].name + ": more overhead, fewer frame errors";
+        Sim::check(best64 <= best32 && best32 <= best16 && best16 < none, label.c_str());
+    }
+
+    Sim::bootOnce();
+    const uint32_t before = Sim::console().bytesWritten;
+    Console::getInstance()->execute("fec");
+    Sim::check(Sim::console().bytesWritten > before, "fec console command prints");
+}
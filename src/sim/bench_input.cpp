@@ -0,0 +1,118 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+// USB input: work done inside the keyboard callback, overflow and mouse coalescing, and key press
+// to handled latency with the 500ms UI loop against the USB and UI tasks
+
+#include "sim.h"
+#include "bench.h"
+#include "stegophone.h"
+#include "rtos.h"
+
+using namespace StegoPhone;
+
+SIM_BENCH(input, "USB input: queued callbacks, mouse coalescing, press to handled latency") {
+    Sim::bootOnce();
+    StegoPhone::StegoPhone *stego = StegoPhone::StegoPhone::getInstance();
+    InputQueue *input = stego->input();
+    const int rounds = 2000;
+
+    // callback cost: what used to run inside usb.Task() against what runs there now
+    stego->handleInput();
+    uint64_t start = Sim::hostNanos();
+    for (int i = 0; i < rounds; i++) {
+        Sim::pressKey(KEYD_F1 + (i % 12));
+        stego->pollUSB();
+        stego->handleInput();
+    }
+    const double wholePress = (Sim::hostNanos() - start) / (double) rounds;
+    start = Sim::hostNanos();
+    for (int i = 0; i < rounds; i++) {
+        Sim::pressKey(KEYD_F1 + (i % 12));
+        stego->pollUSB();
+        if ((i % 16) == 15) {
+            const uint64_t paused = Sim::hostNanos();
+            stego->handleInput();
+            start += Sim::hostNanos() - paused;
+        }
+    }
+    const double callbackOnly = (Sim::hostNanos() - start) / (double) rounds;
+    stego->handleInput();
+    Sim::report("usb_pass_with_handling_host", wholePress, "ns/key");
+    Sim::report("usb_pass_queue_only_host", callbackOnly, "ns/key");
+
+    // the UI stalls: the ring holds Capacity keys, the rest are counted as dropped
+    const uint32_t droppedStart = input->dropped();
+    for (uint32_t i = 0; i < InputQueue::Capacity + 8; i++)
+        Sim::pressKey('a' + (i % 26));
+    stego->pollUSB();
+    Sim::check(input->dropped() - droppedStart == 8, "keys past capacity dropped and counted");
+    Sim::check(stego->handleInput() == InputQueue::Capacity, "a full ring handled in one pass");
+
+    // a burst of mouse reports becomes one event per poll, split where the buttons change
+    const uint32_t reportsStart = input->mouseReports();
+    const uint32_t eventsStart = input->mouseEvents();
+    HAL::MouseReport report = {0, 1, -1, 0, 0};
+    for (int i = 0; i < 100; i++) {
+        report.buttons = (i < 60) ? 0 : 1;
+        Sim::moveMouse(report);
+    }
+    stego->pollUSB();
+    InputEvent first;
+    InputEvent second;
+    const bool popped = input->pop(first) && input->pop(second);
+    Sim::check(popped && first.dx == 60 && first.dy == -60 && first.buttons == 0 && second.dx == 40 &&
+               second.buttons == 1, "movement summed, split at the button change");
+    Sim::report("mouse_reports", input->mouseReports() - reportsStart, "reports");
+    Sim::report("mouse_events", input->mouseEvents() - eventsStart, "events");
+    stego->handleInput();
+
+    // the old threadLoop1: usb.Task() and the handlers every 500ms
+    const int presses = 8;
+    double polledTotal = 0;
+    double polledWorst = 0;
+    for (int i = 0; i < presses; i++) {
+        const uint32_t handled = input->handledCount();
+        const uint64_t pressed = Sim::nowMicros();
+        Sim::pressKey('0' + i);
+        HAL::delay(500 - (137 * i) % 500);
+        while (input->handledCount() == handled) {
+            stego->loop();
+            if (input->handledCount() == handled) HAL::delay(500);
+        }
+        const double latency = (double) (Sim::nowMicros() - pressed);
+        polledTotal += latency;
+        if (latency > polledWorst) polledWorst = latency;
+    }
+    Sim::report("polled_press_to_handled_avg_sim", polledTotal / presses / 1000.0, "ms");
+    Sim::report("polled_press_to_handled_max_sim", polledWorst / 1000.0, "ms");
+
+    // USB task polling every USBPollMs, waking the UI task
+    RTOS::startScheduler();
+    if (!Sim::check(stego->startTasks(2, 3), "UI and USB tasks created")) return;
+    HAL::delay(10);
+    double taskTotal = 0;
+    double taskWorst = 0;
+    const uint32_t latencyStart = input->handledCount();
+    for (int i = 0; i < presses; i++) {
+        const uint32_t handled = input->handledCount();
+        HAL::delay(3 + 7 * i);
+        const uint64_t pressed = Sim::nowMicros();
+        Sim::pressKey('0' + i);
+        while (input->handledCount() == handled && Sim::nowMicros() - pressed < 1000000)
+            HAL::delay(1);
+        const double latency = (double) (Sim::nowMicros() - pressed);
+        taskTotal += latency;
+        if (latency > taskWorst) taskWorst = latency;
+    }
+    stego->stopTasks();
+    Sim::report("task_press_to_handled_avg_sim", taskTotal / presses / 1000.0, "ms");
+    Sim::report("task_press_to_handled_max_sim", taskWorst / 1000.0, "ms");
+    Sim::report("queue_to_handled_max_sim", input->maxLatencyMicros() / 1000.0, "ms");
+    Sim::check(input->handledCount() - latencyStart == (uint32_t) presses, "every press handled by the UI task");
+    Sim::check(taskWorst <= (StegoPhone::StegoPhone::USBPollMs + 2) * 1000.0, "handled within a USB poll");
+}
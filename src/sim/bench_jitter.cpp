@@ -0,0 +1,250 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+// jitter buffer against synthetic arrival traces on a virtual clock: frames sent every 20ms, each
+// delayed by a base plus a drawn jitter (so they can overtake each other), some never arriving; the
+// playout side pops every 20ms at its own phase. Played frames must come out in order and intact,
+// and the counters must account for every frame that arrived.
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "sim.h"
+#include "bench.h"
+#include "console.h"
+#include "jitterbuffer.h"
+
+using namespace StegoPhone;
+
+namespace {
+    const uint32_t FrameMicros = 20000;
+    const uint32_t BaseDelayMicros = 60000;
+    const uint32_t PopPhaseMicros = 7000; // playout clock offset from the sender's
+    const uint16_t PayloadBytes = 48;
+
+    struct Trace {
+        const char *name;
+        uint32_t frames;
+        uint32_t firstSequence;
+        double jitterMs;     // standard deviation of the delay, gaussian
+        double rampToMs;     // when non zero, the deviation slides from jitterMs to this over the trace
+        double lossFraction;
+        uint32_t stallAt;    // frames sent from here until stallMs later are held, then arrive together
+        double stallMs;
+        uint32_t jumpAt;     // from here the sender's sequence jumps by jumpBy
+        uint32_t jumpBy;
+    };
+
+    struct Arrival {
+        uint32_t micros;
+        uint32_t sequence;
+    };
+
+    struct Outcome {
+        uint32_t sent, arrived, played, lost, stretched, shrunk, late, resyncs;
+        uint32_t meanLatency, maxLatency, jitter;
+        uint8_t earlyTarget, lastTarget, lastDepth;
+        bool ordered, intact;
+    };
+
+    uint32_t seed = 1;
+
+    double uniform() {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return (seed & 0xffffff) / 16777216.0;
+    }
+
+    double gaussian() {
+        double sum = 0;
+        for (int i = 0; i < 12; i++)
+            sum += uniform();
+        return sum - 6;
+    }
+
+    // the sequence, then bytes that follow from it
+    void fill(uint32_t sequence, uint8_t *out) {
+        memcpy(out, &sequence, sizeof(sequence));
+        for (uint16_t i = sizeof(sequence); i < PayloadBytes; i++)
+            out[i] = (uint8_t) (sequence * 31 + i);
+    }
+
+    Outcome run(const Trace &trace) {
+        seed = 12345;
+        std::vector<Arrival> arrivals;
+        Outcome outcome = {};
+        const double stallStart = trace.stallAt * (double) FrameMicros;
+        for (uint32_t i = 0; i < trace.frames; i++) {
+            outcome.sent++;
+            if (uniform() < trace.lossFraction) continue;
+            double deviation = trace.jitterMs;
+            if (trace.rampToMs > 0) deviation += (trace.rampToMs - trace.jitterMs) * i / trace.frames;
+            double delay = BaseDelayMicros + gaussian() * deviation * 1000;
+            if (delay < 0) delay = 0;
+            double released = (double) i * FrameMicros;
+            if (trace.stallAt && released >= stallStart && released < stallStart + trace.stallMs * 1000)
+                released = stallStart + trace.stallMs * 1000;
+            uint32_t sequence = trace.firstSequence + i;
+            if (trace.jumpAt && i >= trace.jumpAt) sequence += trace.jumpBy;
+            const Arrival arrival = {(uint32_t) (released + delay), sequence};
+            arrivals.push_back(arrival);
+        }
+        outcome.arrived = (uint32_t) arrivals.size();
+        std::stable_sort(arrivals.begin(), arrivals.end(),
+                         [](const Arrival &a, const Arrival &b) { return a.micros < b.micros; });
+
+        JitterBuffer buffer;
+        buffer.setFrameMicros(FrameMicros);
+        outcome.ordered = outcome.intact = true;
+        bool first = true;
+        uint32_t last = 0;
+        size_t next = 0;
+        const uint32_t end = arrivals.back().micros + 40 * FrameMicros;
+        uint8_t payload[PayloadBytes];
+        for (uint32_t now = PopPhaseMicros; now < end; now += FrameMicros) {
+            for (; next < arrivals.size() && arrivals[next].micros <= now; next++) {
+                fill(arrivals[next].sequence, payload);
+                buffer.push(arrivals[next].sequence, payload, PayloadBytes, arrivals[next].micros);
+            }
+            if (now / FrameMicros == 50) outcome.earlyTarget = buffer.targetFrames();
+            const ModemFrame *frame;
+            const PlayoutResult result = buffer.pop(now, frame);
+            if (next == arrivals.size() && buffer.depth() == 0) break;
+            if (result != PlayoutResult::Frame) continue;
+            uint32_t sequence;
+            memcpy(&sequence, frame->data, sizeof(sequence));
+            fill(sequence, payload);
+            if (frame->length != PayloadBytes || memcmp(frame->data, payload, PayloadBytes) != 0)
+                outcome.intact = false;
+            if (!first && (int32_t) (sequence - last) <= 0 && trace.jumpAt == 0) outcome.ordered = false;
+            last = sequence;
+            first = false;
+        }
+        outcome.played = buffer.played();
+        outcome.lost = buffer.lost();
+        outcome.stretched = buffer.stretched();
+        outcome.shrunk = buffer.shrunk();
+        outcome.late = buffer.lateDrops();
+        outcome.resyncs = buffer.resyncs();
+        outcome.meanLatency = buffer.meanLatencyMicros();
+        outcome.maxLatency = buffer.maxLatencyMicros();
+        outcome.jitter = buffer.jitterMicros();
+        outcome.lastTarget = buffer.targetFrames();
+        outcome.lastDepth = buffer.depth();
+        return outcome;
+    }
+
+    void report(const Trace &trace, const Outcome &outcome) {
+        static const struct {
+            const char *suffix;
+            const char *unit;
+        } fields[] = {{"played", "frames"}, {"lost", "frames"}, {"stretched", "frames"}, {"shrunk", "frames"},
+                      {"late", "frames"}, {"jitter", "ms"}, {"target", "frames"}, {"mean_latency", "ms"},
+                      {"max_latency", "ms"}};
+        const double values[] = {(double) outcome.played, (double) outcome.lost, (double) outcome.stretched,
+                                 (double) outcome.shrunk, (double) outcome.late, outcome.jitter / 1000.0,
+                                 (double) outcome.lastTarget, outcome.meanLatency / 1000.0,
+                                 outcome.maxLatency / 1000.0};
+        for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+            char buf[64];
+            snprintf(buf, sizeof(buf), "%s_%s", trace.name, fields[i].suffix);
+            Sim::report(buf, values[i], fields[i].unit);
+        }
+        std::string label = std::string("jitter ") + trace.name + ": played in order and intact";
+        Sim::check(outcome.ordered && outcome.intact, label.c_str());
+        // every frame that arrived was played, given up on before it came, or dropped to shrink (a resync
+        // throws away what was buffered)
+        if (trace.jumpAt) return;
+        label = std::string("jitter ") + trace.name + ": every arrival accounted for";
+        Sim::check(outcome.played + outcome.late <= outcome.arrived &&
+                   outcome.played + outcome.late + outcome.shrunk >= outcome.arrived, label.c_str());
+    }
+}
+
+SIM_BENCH(jitter, "adaptive jitter buffer over synthetic arrival traces: loss, lateness, delay, counters") {
+    //                    name      frames first       jitter ramp loss stall      jump
+    const Trace steady = {"steady", 1000, 0, 0, 0, 0, 0, 0, 0, 0};
+    const Trace gauss = {"gauss15", 3000, 0, 15, 0, 0, 0, 0, 0, 0};
+    const Trace ramp = {"ramp", 3000, 0, 1, 25, 0, 0, 0, 0, 0};
+    const Trace loss = {"loss5", 3000, 0, 2, 0, 0.05, 0, 0, 0, 0};
+    const Trace stall = {"stall", 1000, 0, 0, 0, 0, 300, 200, 0, 0};
+    const Trace wrap = {"wrap", 1000, 0xfffffe00u, 5, 0, 0, 0, 0, 0, 0};
+    const Trace jump = {"jump", 1000, 0, 0, 0, 0, 0, 0, 500, 100000};
+
+    // no jitter: the least delay there is, nothing concealed after the start
+    Outcome outcome = run(steady);
+    report(steady, outcome);
+    Sim::check(outcome.lost == 0 && outcome.late == 0 && outcome.stretched <= 1 && outcome.lastTarget == 1,
+               "jitter steady: one frame of delay, nothing concealed");
+    Sim::check(outcome.meanLatency <= FrameMicros, "jitter steady: under a frame in the buffer");
+
+    // gaussian delay: the target follows the jitter and late frames stay rare
+    outcome = run(gauss);
+    report(gauss, outcome);
+    const double expected = 15000 * 2 / sqrt(M_PI); // mean |D| for independent gaussian delays
+    Sim::check(outcome.jitter > expected * 0.7 && outcome.jitter < expected * 1.4,
+               "jitter gauss15: estimate near mean |D| of the trace");
+    Sim::check(outcome.late + outcome.lost <= outcome.sent / 50, "jitter gauss15: under 2% late or concealed");
+
+    // jitter growing through the call: the delay grows with it
+    outcome = run(ramp);
+    report(ramp, outcome);
+    Sim::check(outcome.lastTarget > outcome.earlyTarget + 1, "jitter ramp: target delay follows the jitter up");
+    Sim::check(outcome.late + outcome.lost <= outcome.sent / 50, "jitter ramp: under 2% late or concealed");
+
+    // random loss: every gap concealed, none of it taken for lateness
+    outcome = run(loss);
+    report(loss, outcome);
+    Sim::check(outcome.lost + outcome.stretched >= outcome.sent - outcome.arrived && outcome.late <= 3,
+               "jitter loss5: gaps concealed, not late");
+
+    // a 200ms stall: stretched through it, then shrunk back to the target
+    outcome = run(stall);
+    report(stall, outcome);
+    Sim::check(outcome.lost == 0 && outcome.late == 0 && outcome.played == outcome.arrived - outcome.shrunk,
+               "jitter stall: nothing lost across the stall");
+    Sim::check(outcome.stretched >= 8 && outcome.shrunk >= 8, "jitter stall: stretched, then shrunk back");
+
+    // sequence wrap, and a sender that jumps ahead
+    outcome = run(wrap);
+    report(wrap, outcome);
+    Sim::check(outcome.resyncs == 0 && outcome.played + outcome.shrunk + outcome.late == outcome.arrived,
+               "jitter wrap: sequence wraps through");
+    outcome = run(jump);
+    report(jump, outcome);
+    Sim::check(outcome.resyncs == 1 && outcome.played + outcome.shrunk >= outcome.arrived - JitterBuffer::Depth,
+               "jitter jump: resyncs once and carries on");
+
+    // duplicates and frames too long
+    JitterBuffer buffer;
+    uint8_t payload[PayloadBytes];
+    fill(7, payload);
+    const bool once = buffer.push(7, payload, PayloadBytes, 0);
+    const bool twice = buffer.push(7, payload, PayloadBytes, 100);
+    const bool tooLong = buffer.push(8, payload, ModemFrame::Capacity + 1, 200);
+    Sim::check(once && !twice && !tooLong && buffer.duplicates() == 1, "jitter: duplicates and overlong rejected");
+
+    Sim::bootOnce();
+    const uint32_t before = Sim::console().bytesWritten;
+    Console::getInstance()->execute("jitter");
+    Sim::check(Sim::console().bytesWritten > before, "jitter console command prints");
+
+    // cost per push + pop
+    JitterBuffer timed;
+    const uint32_t rounds = 200000;
+    const uint64_t start = Sim::hostNanos();
+    const ModemFrame *frame;
+    for (uint32_t i = 0; i < rounds; i++) {
+        timed.push(i, payload, PayloadBytes, i * FrameMicros);
+        timed.pop(i * FrameMicros + PopPhaseMicros, frame);
+    }
+    Sim::report("push_pop_host", (double) (Sim::hostNanos() - start) / rounds, "ns");
+}
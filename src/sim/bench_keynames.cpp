@@ -0,0 +1,100 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+// key name lookups from the flash tables against the two std::maps OnUSBKeyboardPress used to
+// build on every key press
+
+#include <string.h>
+#include <map>
+#include <string>
+
+#include "sim.h"
+#include "bench.h"
+#include "keynames.h"
+
+using namespace StegoPhone;
+
+namespace {
+    // a mix of what a keyboard sends: mostly printable, some control and navigation keys
+    const int keys[] = {'h', 'e', 'l', 'l', 'o', ' ', 13, KEYD_UP, 'W', KEYD_F5, 8, '1', 27, KEYD_PAGE_DOWN, '.', 9};
+    const int keyCount = sizeof(keys) / sizeof(keys[0]);
+
+    // the old per-press work: both maps built (55 nodes and strings), searched, destroyed
+    const char *mapLookup(int unicode, std::string &out) {
+        std::map<int, std::string> specialKeys;
+        for (int code = 0xC2; code <= 0xDA; code++)
+            if (KeyNames::special(code)) specialKeys[code] = KeyNames::special(code);
+        std::map<int, std::string> controlKeys;
+        for (int code = 0; code <= 32; code++)
+            controlKeys[code] = KeyNames::control(code);
+        std::map<int, std::string>::iterator key = specialKeys.find(unicode);
+        if (key != specialKeys.end()) {
+            out = key->second;
+            return out.c_str();
+        }
+        if (unicode <= 32) {
+            key = controlKeys.find(unicode);
+            if (key != controlKeys.end()) {
+                out = key->second;
+                return out.c_str();
+            }
+        }
+        return 0;
+    }
+}
+
+SIM_BENCH(keynames, "key name lookup: flash tables vs std::map built per key press") {
+    Sim::check(strcmp(KeyNames::keyboard(KEYD_UP), "UP") == 0, "KEYD_UP is UP");
+    Sim::check(strcmp(KeyNames::keyboard(KEYD_F12), "F12") == 0, "KEYD_F12 is F12");
+    Sim::check(strcmp(KeyNames::keyboard(0), "NULL") == 0 && strcmp(KeyNames::keyboard(13), "CR") == 0,
+               "control codes named");
+    Sim::check(strcmp(KeyNames::keyboard(32), "Space") == 0, "32 is Space");
+    Sim::check(!KeyNames::keyboard('a') && !KeyNames::keyboard(33) && !KeyNames::keyboard(-1),
+               "printable and out of range keys unnamed");
+    Sim::check(!KeyNames::special(0xC1) && !KeyNames::special(0xCE) && !KeyNames::special(0xDB),
+               "gaps around KEYD_* unnamed");
+    Sim::check(strcmp(KeyNames::consumer(0x20), "+10") == 0 && strcmp(KeyNames::consumer(0x23C), "AC Format") == 0,
+               "first and last consumer usages named");
+    Sim::check(strcmp(KeyNames::consumer(0xE9), "Volume Up") == 0, "consumer 0xE9 is Volume Up");
+    Sim::check(!KeyNames::consumer(0) && !KeyNames::consumer(0xCC) && !KeyNames::consumer(0x23D),
+               "unassigned consumer usages unnamed");
+
+    int agree = 0;
+    std::string scratch;
+    for (int code = -1; code < 0x100; code++) {
+        const char *table = KeyNames::keyboard(code);
+        const char *map = mapLookup(code, scratch);
+        agree += (!table && !map) || (table && map && strcmp(table, map) == 0);
+    }
+    Sim::check(agree == 0x101, "tables and maps name the same keys");
+
+    const int rounds = 20000;
+    volatile size_t sink = 0;
+    uint64_t start = Sim::hostNanos();
+    for (int i = 0; i < rounds / 10; i++) {
+        const char *name = mapLookup(keys[i % keyCount], scratch);
+        sink += name ? (size_t) name[0] : 0;
+    }
+    Sim::report("map_per_press_host", (Sim::hostNanos() - start) / (double) (rounds / 10), "ns/key");
+
+    start = Sim::hostNanos();
+    for (int i = 0; i < rounds; i++) {
+        const char *name = KeyNames::keyboard(keys[i % keyCount]);
+        sink += name ? (size_t) name[0] : 0;
+    }
+    Sim::report("table_keyboard_host", (Sim::hostNanos() - start) / (double) rounds, "ns/key");
+
+    start = Sim::hostNanos();
+    for (int i = 0; i < rounds; i++) {
+        const char *name = KeyNames::consumer((uint16_t) (0x20 + (i * 7) % 0x220));
+        sink += name ? (size_t) name[0] : 0;
+    }
+    Sim::report("table_consumer_host", (Sim::hostNanos() - start) / (double) rounds, "ns/usage");
+
+    Sim::report("names", (double) KeyNames::count(), "names");
+    Sim::report("flash_bytes", (double) KeyNames::flashBytes(), "bytes");
+}
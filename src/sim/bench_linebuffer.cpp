@@ -0,0 +1,78 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <algorithm>
+#include <vector>
+
+#include "sim.h"
+#include "bench.h"
+#include "linebuffer.h"
+
+using namespace StegoPhone;
+
+namespace {
+    std::vector<std::string> received;
+    uint64_t receivedBytes = 0;
+    bool keep = true;
+
+    void onLine(LineView line) {
+        receivedBytes += line.length;
+        if (keep) received.push_back(std::string(line.data, line.length));
+    }
+}
+
+SIM_BENCH(linebuffer, "ring LineBuffer split throughput, wraparound and overflow policy") {
+    Sim::ConsoleLink idle; // nothing to read; lines are pushed directly
+    LineBuffer lines(idle, 64, LineOverflow::DiscardLine);
+    lines.lineReceived.attach(FunctionSlot<LineView>(onLine));
+
+    // lines that straddle the end of the 64 byte ring come out intact
+    std::string stream;
+    std::vector<std::string> expected;
+    for (int i = 0; i < 40; i++) {
+        char line[48];
+        snprintf(line, sizeof(line), "BTName=StegoPhone-%d%s", i, (i % 3) ? "-extra-padding" : "");
+        expected.push_back(line);
+        stream += line;
+        stream += "\r\n";
+    }
+    // followed by a line too long for the ring, then one more
+    stream += std::string(100, 'x') + "\r\nAOK\r\n";
+    expected.push_back("AOK");
+    for (size_t i = 0; i < stream.size(); i += 7)
+        lines.push((const uint8_t *) stream.data() + i, std::min<size_t>(7, stream.size() - i));
+    Sim::check(received == expected, "lines survive wraparound, overlong line discarded");
+    Sim::check(lines.overflows() == 1, "one overflow counted");
+
+    LineBuffer partial(idle, 64, LineOverflow::EmitPartial);
+    partial.lineReceived.attach(FunctionSlot<LineView>(onLine));
+    received.clear();
+    const std::string longLine = std::string(150, 'y') + "\n";
+    partial.push((const uint8_t *) longLine.data(), longLine.size());
+    Sim::check(received.size() == 3 && received[0].size() == 64 && received[2].size() == 22,
+               "overlong line emitted as 64+64+22");
+
+    // throughput on a continuous stream of RN52 sized lines
+    keep = false;
+    LineBuffer bulk(idle, 1024);
+    bulk.lineReceived.attach(FunctionSlot<LineView>(onLine));
+    std::string chunk;
+    while (chunk.size() < 4096)
+        chunk += "AOK\r\n3004\r\nBTA=0006664B2D1C\r\n";
+    const int rounds = 2000;
+    receivedBytes = 0;
+    const uint64_t start = Sim::hostNanos();
+    for (int i = 0; i < rounds; i++)
+        bulk.push((const uint8_t *) chunk.data(), chunk.size());
+    const uint64_t elapsed = Sim::hostNanos() - start;
+    Sim::report("split_cost", elapsed / (double) (rounds * chunk.size()), "ns/byte");
+    Sim::report("lines", bulk.linesReceived(), "lines");
+    Sim::check(bulk.overflows() == 0, "no overflow on bulk stream");
+}
@@ -0,0 +1,97 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+// asynchronous log queue: deferred formatting, compile-time levels, drop accounting and the cost of
+// a record at the call site against printing it inline
+
+#include <string.h>
+
+#include "sim.h"
+#include "bench.h"
+#include "log.h"
+
+using namespace StegoPhone;
+
+namespace {
+    // the formatted message without the timestamp and level prefix
+    bool formatsAs(const char *expected) {
+        LogRecord record;
+        char line[128];
+        if (!Log::next(record)) return false;
+        Log::format(record, line, sizeof(line));
+        return strlen(line) > 13 && strcmp(line + 13, expected) == 0;
+    }
+}
+
+SIM_BENCH(log, "async log queue vs inline console printing") {
+    Sim::ConsoleLink sink;
+    sink.echo = false;
+    Log::drain(sink);
+
+    // deferred formatting
+    char scratch[8] = "stack";
+    STEGOS_LOG_INFO("RN52 Status DEC / HEX: %u / %X : orig=%s", 12292u, 0x3004, Log::text(scratch));
+    scratch[0] = 'X'; // copied at the call, not at the drain
+    STEGOS_LOG_WARNING("pad [%5d] [%-4s] [%04x] [%c] %%", -42, "ab", 0xbe, 'z');
+    STEGOS_LOG_ERROR("missing %d");
+    Sim::check(formatsAs("RN52 Status DEC / HEX: 12292 / 3004 : orig=stack"), "unsigned, hex and copied text");
+    Sim::check(formatsAs("pad [  -42] [ab  ] [00be] [z] %"), "width, alignment and zero padding");
+    Sim::check(formatsAs("missing ?"), "missing argument marked");
+
+    // debug is compiled out at the default level
+    const uint32_t queuedBefore = Log::queued();
+    STEGOS_LOG_DEBUG("never queued %d", 1);
+    Sim::check(STEGOS_LOG_LEVEL > 0 ? Log::queued() == queuedBefore : true, "debug compiled out");
+
+    // a full queue drops and counts, then drains in order
+    const uint32_t droppedBefore = Log::dropped(LogLevel::Info);
+    for (uint32_t i = 0; i < Log::Capacity + 10; i++)
+        STEGOS_LOG_INFO("record %u", i);
+    Sim::check(Log::dropped(LogLevel::Info) - droppedBefore == 10, "overflow dropped and counted");
+    LogRecord record;
+    uint32_t inOrder = 0;
+    while (Log::next(record))
+        if ((uint32_t) record.args[0] == inOrder) inOrder++;
+    Sim::check(inOrder == Log::Capacity, "queued records come out in order");
+
+    // many laps around the ring
+    bool laps = true;
+    for (uint32_t i = 0; i < Log::Capacity * 50; i++) {
+        STEGOS_LOG_INFO("lap %u", i);
+        laps = laps && Log::next(record) && (uint32_t) record.args[0] == i;
+    }
+    Sim::check(laps, "write/read alternating across 50 laps");
+
+    // cost at the call site: queue a record vs format and print it inline
+    const int rounds = 100000;
+    uint64_t start = Sim::hostNanos();
+    for (int i = 0; i < rounds; i++) {
+        sink.print("RN52 Status DEC / HEX: ");
+        sink.print(i, DEC);
+        sink.print(" / ");
+        sink.print(i, HEX);
+        sink.print(" : orig=");
+        sink.println("3004");
+    }
+    Sim::report("inline_print_host", (Sim::hostNanos() - start) / (double) rounds, "ns/record");
+
+    double writeNanos = 0;
+    double drainNanos = 0;
+    for (int done = 0; done < rounds; done += Log::Capacity) {
+        start = Sim::hostNanos();
+        for (uint32_t i = 0; i < Log::Capacity; i++)
+            STEGOS_LOG_INFO("RN52 Status DEC / HEX: %u / %X : orig=%s", i, i, Log::text("3004"));
+        writeNanos += Sim::hostNanos() - start;
+        start = Sim::hostNanos();
+        Log::drain(sink);
+        drainNanos += Sim::hostNanos() - start;
+    }
+    const int written = (rounds + Log::Capacity - 1) / Log::Capacity * Log::Capacity;
+    Sim::report("queued_write_host", writeNanos / written, "ns/record");
+    Sim::report("deferred_drain_host", drainNanos / written, "ns/record");
+    Sim::report("record_size", sizeof(LogRecord), "bytes");
+}
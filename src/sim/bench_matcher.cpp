@@ -0,0 +1,130 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+// streaming PatternMatcher against the per-byte tail compare of readSerialUntil and the
+// String/indexOf accumulation of recFind
+
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "sim.h"
+#include "bench.h"
+#include "patternmatcher.h"
+
+using namespace StegoPhone;
+
+namespace {
+    const char *const terminators[] = {"OK\r\n", "ERROR\r\n", "CMD\r\n", "END\r\n", "AOK\r\n", "ERR\r\n"};
+    const uint8_t terminatorCount = sizeof(terminators) / sizeof(terminators[0]);
+
+    // longest terminator ending at the end of text, or -1
+    int reference(const std::string &text) {
+        int best = -1;
+        size_t bestLength = 0;
+        for (uint8_t p = 0; p < terminatorCount; p++) {
+            const size_t length = strlen(terminators[p]);
+            if (length > text.size() || length <= bestLength) continue;
+            if (text.compare(text.size() - length, length, terminators[p]) == 0) {
+                best = p;
+                bestLength = length;
+            }
+        }
+        return best;
+    }
+
+    // readSerialUntil's intent: compare the match against the buffer tail on every byte
+    bool tailCompare(const char *stream, size_t length, const char *match) {
+        const size_t matchLength = strlen(match);
+        for (size_t received = 1; received <= length; received++)
+            if (received >= matchLength && strncmp(match, stream + received - matchLength, matchLength) == 0)
+                return true;
+        return false;
+    }
+
+    // recFind: append to a String, indexOf over the whole accumulation on every byte
+    bool accumulateFind(const char *stream, size_t length, const char *target) {
+        std::string buffer;
+        for (size_t i = 0; i < length; i++) {
+            buffer += stream[i];
+            if (buffer.find(target) != std::string::npos) return true;
+        }
+        return false;
+    }
+
+    bool scan(const PatternMatcher &matcher, const char *stream, size_t length) {
+        PatternScanner scanner(matcher);
+        for (size_t i = 0; i < length; i++)
+            if (scanner.feed((uint8_t) stream[i]) != PatternMatcher::NoMatch) return true;
+        return false;
+    }
+
+    volatile bool sink;
+}
+
+SIM_BENCH(matcher, "streaming multi-pattern matcher vs readSerialUntil/recFind") {
+    const PatternMatcher matcher(terminators, terminatorCount);
+    Sim::check(matcher.valid(), "terminator set fits the matcher");
+
+    // against a brute force reference on a random stream of terminator fragments
+    const char *fragments[] = {"O", "K", "\r\n", "ER", "ROR", "CMD", "AOK", "EN", "D", "ERR", "x", "\r"};
+    srand(52);
+    std::string text;
+    PatternScanner scanner(matcher);
+    int mismatches = 0;
+    int matches = 0;
+    for (int i = 0; i < 20000; i++) {
+        const char *fragment = fragments[rand() % (sizeof(fragments) / sizeof(fragments[0]))];
+        for (; *fragment; fragment++) {
+            text += *fragment;
+            const int got = scanner.feed((uint8_t) *fragment);
+            if (got != reference(text)) mismatches++;
+            if (got != PatternMatcher::NoMatch) matches++;
+        }
+        if (text.size() > 16) text.erase(0, text.size() - 16);
+    }
+    Sim::check(mismatches == 0, "matcher agrees with brute force on every byte");
+    Sim::report("reference_matches", matches, "matches");
+
+    const PatternMatcher ok("OK\r\n");
+    const size_t lengths[] = {64, 512, 4096};
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        // device chatter with the terminator at the very end
+        std::string stream;
+        while (stream.size() < lengths[l] - 4)
+            stream += "AT version:1.2.0.0\r\n";
+        stream.resize(lengths[l] - 4);
+        stream += "OK\r\n";
+        const int rounds = (int) (2000000 / lengths[l]) + 1;
+        char label[48];
+
+        uint64_t start = Sim::hostNanos();
+        for (int r = 0; r < rounds; r++)
+            sink = scan(ok, stream.data(), stream.size());
+        snprintf(label, sizeof(label), "matcher_%u", (unsigned) lengths[l]);
+        Sim::report(label, (Sim::hostNanos() - start) / (double) rounds / stream.size(), "ns/byte");
+
+        start = Sim::hostNanos();
+        for (int r = 0; r < rounds; r++)
+            sink = scan(matcher, stream.data(), stream.size());
+        snprintf(label, sizeof(label), "matcher_6_patterns_%u", (unsigned) lengths[l]);
+        Sim::report(label, (Sim::hostNanos() - start) / (double) rounds / stream.size(), "ns/byte");
+
+        start = Sim::hostNanos();
+        for (int r = 0; r < rounds; r++)
+            sink = tailCompare(stream.data(), stream.size(), "OK\r\n");
+        snprintf(label, sizeof(label), "tail_compare_%u", (unsigned) lengths[l]);
+        Sim::report(label, (Sim::hostNanos() - start) / (double) rounds / stream.size(), "ns/byte");
+
+        const int findRounds = lengths[l] > 512 ? 4 : rounds / 8 + 1;
+        start = Sim::hostNanos();
+        for (int r = 0; r < findRounds; r++)
+            sink = accumulateFind(stream.data(), stream.size(), "OK\r\n");
+        snprintf(label, sizeof(label), "recfind_accumulate_%u", (unsigned) lengths[l]);
+        Sim::report(label, (Sim::hostNanos() - start) / (double) findRounds / stream.size(), "ns/byte");
+    }
+}
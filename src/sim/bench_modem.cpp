@@ -0,0 +1,313 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+// call modem: two stages in loopback through a simulated voice channel (300-3400 Hz, noise, delay);
+// link handshake, frames intact, frame error rate against SNR and block time against the deadline
+
+#include <math.h>
+#include <string.h>
+#include <string>
+#include "sim.h"
+#include "bench.h"
+#include "stegophone.h"
+#include "console.h"
+#include "fskphy.h"
+#include "modemstage.h"
+#include "rtos.h"
+
+using namespace StegoPhone;
+
+namespace {
+    // RBJ cookbook second order section, transposed direct form II
+    struct Biquad {
+        float b0, b1, b2, a1, a2;
+        float z1, z2;
+
+        void design(bool highpass, float hz, float rate) {
+            const float w = 2.0f * (float) M_PI * hz / rate;
+            const float alpha = sinf(w) / (2.0f * 0.7071f);
+            const float c = cosf(w);
+            const float a0 = 1.0f + alpha;
+            b1 = (highpass ? -(1.0f + c) : (1.0f - c)) / a0;
+            b0 = (highpass ? (1.0f + c) / 2.0f : (1.0f - c) / 2.0f) / a0;
+            b2 = b0;
+            a1 = -2.0f * c / a0;
+            a2 = (1.0f - alpha) / a0;
+            z1 = z2 = 0;
+        }
+
+        float step(float x) {
+            const float y = b0 * x + z1;
+            z1 = b1 * x - a1 * y + z2;
+            z2 = b2 * x - a2 * y;
+            return y;
+        }
+    };
+
+    // one direction of a phone call: white noise at snrDb below the modem's tones (over the full band),
+    // a fourth order 300-3400 Hz band pass and DelaySamples of latency, off the symbol grid
+    class VoiceChannel {
+    public:
+        static const uint16_t DelaySamples = 37;
+
+        VoiceChannel(uint32_t seed) : _seed(seed), _spare(0), _haveSpare(false), _delayIndex(0) {
+            const float rate = (float) FskPhy::SampleRate;
+            _filters[0].design(true, 300, rate);
+            _filters[1].design(true, 300, rate);
+            _filters[2].design(false, 3400, rate);
+            _filters[3].design(false, 3400, rate);
+            memset(_delay, 0, sizeof(_delay));
+            setSnr(20);
+        }
+
+        void setSnr(float snrDb) {
+            const float signalPower = (float) FskPhy::Amplitude * FskPhy::Amplitude / 2.0f;
+            _noiseRms = sqrtf(signalPower / powf(10.0f, snrDb / 10.0f));
+        }
+
+        void run(int16_t *samples, size_t count) {
+            for (size_t i = 0; i < count; i++) {
+                float x = samples[i] + _noiseRms * gaussian();
+                for (int f = 0; f < 4; f++)
+                    x = _filters[f].step(x);
+                if (x > 32767.0f) x = 32767.0f;
+                if (x < -32768.0f) x = -32768.0f;
+                samples[i] = _delay[_delayIndex];
+                _delay[_delayIndex] = (int16_t) x;
+                _delayIndex = (uint16_t) ((_delayIndex + 1) % DelaySamples);
+            }
+        }
+
+    protected:
+        float uniform() {
+            // xorshift32, repeatable
+            _seed ^= _seed << 13;
+            _seed ^= _seed >> 17;
+            _seed ^= _seed << 5;
+            return (_seed >> 8) * (1.0f / 16777216.0f);
+        }
+
+        float gaussian() {
+            if (_haveSpare) {
+                _haveSpare = false;
+                return _spare;
+            }
+            float u = uniform();
+            while (u <= 0)
+                u = uniform();
+            const float r = sqrtf(-2.0f * logf(u));
+            const float theta = 2.0f * (float) M_PI * uniform();
+            _spare = r * sinf(theta);
+            _haveSpare = true;
+            return r * cosf(theta);
+        }
+
+        uint32_t _seed;
+        float _spare;
+        bool _haveSpare;
+        float _noiseRms;
+        Biquad _filters[4];
+        int16_t _delay[DelaySamples];
+        uint16_t _delayIndex;
+    };
+
+    FskPhy phyA;
+    FskPhy phyB;
+    ModemStage stageA(phyA);
+    ModemStage stageB(phyB);
+    VoiceChannel channelAB(0x12345678);
+    VoiceChannel channelBA(0x9E3779B9);
+    uint32_t ticks = 0;
+
+    // 20ms of call: each side plays a block into the channel and gets the other's, then processes
+    void tick() {
+        int16_t block[ModemStage::BlockSamples];
+        stageA.pullAudio(block);
+        channelAB.run(block, ModemStage::BlockSamples);
+        stageB.pushAudio(block);
+        stageB.pullAudio(block);
+        channelBA.run(block, ModemStage::BlockSamples);
+        stageA.pushAudio(block);
+        stageA.process();
+        stageB.process();
+        ticks++;
+    }
+
+    struct Transfer {
+        uint32_t sent;
+        uint32_t received;
+        uint32_t corrupt;
+        uint32_t ticks;
+    };
+
+    // frames of length bytes A to B: a sequence number then a pattern keyed to it
+    Transfer transfer(uint32_t frames, uint16_t length) {
+        Transfer result = {0, 0, 0, 0};
+        const uint32_t start = ticks;
+        uint32_t idle = 0;
+        while (idle < 50) {
+            ModemFrame *frame;
+            while (result.sent < frames && (frame = stageA.acquire()) != 0) {
+                frame->length = length;
+                frame->data[0] = (uint8_t) result.sent;
+                for (uint16_t i = 1; i < length; i++)
+                    frame->data[i] = (uint8_t) (result.sent * 7 + i);
+                stageA.send(frame);
+                result.sent++;
+            }
+            tick();
+            while ((frame = stageB.receive()) != 0) {
+                bool intact = frame->length == length;
+                for (uint16_t i = 1; i < length && intact; i++)
+                    intact = frame->data[i] == (uint8_t) (frame->data[0] * 7 + i);
+                if (intact) result.received++;
+                else result.corrupt++;
+                stageB.release(frame);
+            }
+            // done once everything is sent and the channel has been quiet a while
+            if (result.sent == frames && !phyA.transmitting()) idle++;
+        }
+        result.ticks = ticks - start - idle;
+        return result;
+    }
+}
+
+SIM_BENCH(modem, "call modem: loopback through a noisy voice channel, handshake, FER vs SNR, block deadline") {
+    const uint32_t deadline = stageA.deadlineMicros();
+    Sim::check(deadline == 20000, "20ms blocks");
+
+    // idle: silence out, nothing decoded
+    for (int i = 0; i < 10; i++)
+        tick();
+    Sim::check(stageA.linkState() == ModemLinkState::Idle && stageB.framesReceived() == 0, "idle until started");
+
+    // handshake: A announces first, B joins a little later
+    stageA.start();
+    for (int i = 0; i < 15; i++)
+        tick();
+    stageB.start();
+    const uint32_t handshakeStart = ticks;
+    while ((stageA.linkState() != ModemLinkState::Connected || stageB.linkState() != ModemLinkState::Connected) &&
+           ticks - handshakeStart < 500)
+        tick();
+    Sim::report("handshake_audio", (ticks - handshakeStart) * 20.0, "ms");
+    Sim::check(stageA.linkState() == ModemLinkState::Connected && stageB.linkState() == ModemLinkState::Connected,
+               "both ends connected");
+
+    // a clean-ish line: every frame intact, at close to the line rate
+    stageA.resetStats();
+    stageB.resetStats();
+    const uint16_t length = 64;
+    Transfer clean = transfer(100, length);
+    const double seconds = clean.ticks * 0.02;
+    Sim::report("goodput_20db", clean.received * length * 8 / seconds, "bit/s");
+    Sim::report("goodput_of_line_rate", 100.0 * clean.received * length * 8 / seconds / phyA.bitRate(), "%");
+    Sim::check(clean.received == 100 && clean.corrupt == 0, "100 frames intact at 20dB");
+    Sim::check(stageA.framesSent() == 100 && stageB.framesDropped() == 0, "every frame back in its pool");
+
+    // frame error rate as the line gets worse
+    static const float snrs[] = {12, 9, 6, 3};
+    for (size_t i = 0; i < sizeof(snrs) / sizeof(snrs[0]); i++) {
+        channelAB.setSnr(snrs[i]);
+        Transfer noisy = transfer(100, length);
+        char label[32];
+        snprintf(label, sizeof(label), "fer_%ddb", (int) snrs[i]);
+        Sim::report(label, 100.0 - noisy.received, "%");
+        Sim::check(noisy.corrupt == 0, "the CRC keeps corrupt frames out");
+        if (snrs[i] >= 9) Sim::check(noisy.received >= 95, "FER under 5% down to 9dB");
+    }
+    channelAB.setSnr(20);
+
+    // per block cost against the 20ms deadline, both directions in one block
+    const double meanMicros = stageB.blocks() ? (double) stageB.busyMicros() / stageB.blocks() : 0;
+    Sim::report("block_mean_host", meanMicros, "us");
+    Sim::report("block_max_host", stageB.maxBlockMicros(), "us");
+    Sim::report("block_load_host", 100.0 * meanMicros / deadline, "%");
+    Sim::report("samples_per_second_host", meanMicros > 0 ? ModemStage::BlockSamples * 1e6 / meanMicros : 0,
+                "samples/s");
+    Sim::check(stageA.lateBlocks() == 0 && stageB.lateBlocks() == 0, "no block over its deadline");
+    Sim::check(stageA.audioUnderruns() == 0 && stageB.audioUnderruns() == 0 && stageB.audioOverruns() == 0,
+               "audio never starved or dropped");
+
+    // a modem task that stops keeping up loses whole blocks, counted
+    int16_t silence[ModemStage::BlockSamples];
+    memset(silence, 0, sizeof(silence));
+    for (int i = 0; i <= ModemStage::BlockDepth; i++)
+        stageB.pushAudio(silence);
+    Sim::check(stageB.audioOverruns() == 1, "overrun counted");
+    stageB.process();
+
+    // B on its own task while this task takes and releases what it decodes: the task drops link and
+    // bad frames at the same time, onto its own list, and every receive frame ends up free again
+    RTOS::startScheduler();
+    stageB.resetStats();
+    if (Sim::check(stageB.startTask(3), "receiving stage task created")) {
+        channelAB.setSnr(6);
+        uint32_t sent = 0, received = 0;
+        int16_t block[ModemStage::BlockSamples];
+        for (int i = 0; i < 1500; i++) {
+            ModemFrame *frame;
+            while (sent < 200 && (frame = stageA.acquire()) != 0) {
+                frame->length = 16;
+                memset(frame->data, (uint8_t) sent, 16);
+                stageA.send(frame);
+                sent++;
+            }
+            stageA.pullAudio(block);
+            channelAB.run(block, ModemStage::BlockSamples);
+            stageB.pushAudio(block);
+            HAL::delay(1);
+            if (stageB.pullAudio(block)) {
+                channelBA.run(block, ModemStage::BlockSamples);
+                stageA.pushAudio(block);
+            }
+            stageA.process();
+            while ((frame = stageB.receive()) != 0) {
+                received++;
+                stageB.release(frame);
+            }
+        }
+        HAL::delay(5);
+        stageB.stopTask();
+        Sim::report("task_frames_received", received, "frames");
+        Sim::report("task_frames_bad", stageB.frameErrors(), "frames");
+        Sim::check(received > 100 && stageB.frameErrors() > 0, "frames taken by the app and dropped by the task");
+        Sim::check(stageB.receiveFramesFree() == ModemStage::FrameDepth && stageB.framesDropped() == 0,
+                   "every receive frame free again, none lost or doubled");
+        channelAB.setSnr(20);
+    }
+
+    // stop: both go idle; the peer notices nothing until it restarts
+    stageA.stop();
+    stageB.stop();
+    tick();
+    Sim::check(stageA.linkState() == ModemLinkState::Idle && stageB.linkState() == ModemLinkState::Idle, "stopped");
+
+    // the firmware's stage: on its event task, and driving the call state
+    Sim::bootOnce();
+    StegoPhone::StegoPhone *stego = StegoPhone::StegoPhone::getInstance();
+    ModemStage *modem = stego->modem();
+    modem->start();
+    stego->loop();
+    Sim::check(modem->linkState() == ModemLinkState::Announcing, "firmware stage announcing");
+    RTOS::startScheduler();
+    if (Sim::check(modem->startTask(3), "modem task created")) {
+        const uint32_t blocksBefore = modem->blocks();
+        modem->pushAudio(silence);
+        HAL::delay(5);
+        Sim::check(modem->blocks() == blocksBefore + 1, "a pushed block wakes the task");
+        modem->stop();
+        modem->pushAudio(silence);
+        HAL::delay(5);
+        modem->stopTask();
+        Sim::check(modem->linkState() == ModemLinkState::Idle, "firmware stage stopped");
+    }
+
+    const uint64_t consoleStart = Sim::console().bytesWritten;
+    Console::getInstance()->execute("modem");
+    Sim::check(Sim::console().bytesWritten - consoleStart > 150, "modem stats printed");
+}
@@ -0,0 +1,80 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+// profiling probes: histogram percentiles against known samples, the cost of a probe, and the
+// firmware's own probes filled by a few UI passes
+
+#include "sim.h"
+#include "bench.h"
+#include "stegophone.h"
+#include "console.h"
+#include "profile.h"
+
+using namespace StegoPhone;
+
+SIM_BENCH(prof, "profiling probes: log-bucket percentiles, probe cost, firmware hot paths") {
+    if (!Sim::check(Profile::enabled(), "native build profiles")) return;
+#if STEGOS_PROFILE
+    // every value lands in a bucket whose limit covers it and whose predecessor's does not
+    bool bucketsCover = true;
+    for (uint32_t value = 1; value < 0x80000000u && bucketsCover; value += 1 + value / 7) {
+        const uint8_t bucket = Profile::bucket(value);
+        bucketsCover = (Profile::bucketLimit(bucket) >= value) &&
+                       (bucket == 0 || Profile::bucketLimit(bucket - 1) < value) &&
+                       (Profile::bucketLimit(bucket) - value <= value / 4);
+    }
+    Sim::check(bucketsCover && Profile::bucket(0xFFFFFFFFu) == Profile::Buckets - 1, "buckets cover 32 bits");
+
+    // 1..1000: p50 is 500 and p99 990, give or take a quarter bucket
+    Profile::reset();
+    for (uint32_t i = 1; i <= 1000; i++)
+        Profile::record(ProbeId::Draw, i);
+    ProbeStats known;
+    Profile::stats(ProbeId::Draw, known);
+    Sim::report("known_p50", known.p50, "ticks");
+    Sim::report("known_p99", known.p99, "ticks");
+    Sim::check(known.count == 1000 && known.min == 1 && known.max == 1000, "count, min and max exact");
+    Sim::check(known.p50 >= 500 && known.p50 <= 625 && known.p99 >= 990 && known.p99 <= 1000,
+               "percentiles within a bucket");
+
+    // what a probe costs on the host: two clock reads and the histogram update
+    Profile::reset();
+    const int rounds = 1000000;
+    const uint64_t start = Sim::hostNanos();
+    for (int i = 0; i < rounds; i++) {
+        STEGOS_PROFILE_SCOPE(Draw);
+    }
+    Sim::report("probe_cost_host", (Sim::hostNanos() - start) / (double) rounds, "ns/scope");
+
+    // the firmware's probes over a few UI passes with typing
+    Sim::bootOnce();
+    StegoPhone::StegoPhone *stego = StegoPhone::StegoPhone::getInstance();
+    Profile::reset();
+    for (int i = 0; i < 50; i++) {
+        Sim::pressKey('a' + (i % 26));
+        stego->loop();
+        HAL::delay(40);
+    }
+    bool everyProbe = true;
+    for (uint8_t i = 0; i < (uint8_t) ProbeId::Count; i++) {
+        ProbeStats stats;
+        if (!Profile::stats((ProbeId) i, stats)) {
+            everyProbe = false;
+            continue;
+        }
+        std::string label = std::string(Profile::name((ProbeId) i)) + "_p50_host";
+        Sim::report(label.c_str(), stats.p50 / 1000.0, "us");
+        label = std::string(Profile::name((ProbeId) i)) + "_p99_host";
+        Sim::report(label.c_str(), stats.p99 / 1000.0, "us");
+    }
+    Sim::check(everyProbe, "every probe recorded");
+
+    const uint64_t consoleStart = Sim::console().bytesWritten;
+    Console::getInstance()->execute("prof");
+    Sim::check(Sim::console().bytesWritten - consoleStart > 400, "histograms printed");
+#endif
+}
@@ -0,0 +1,163 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+// polyphase resampler between the Bluetooth SCO rates and the modem's 9600/s: rate and block size
+// invariance, SNR of in band tones, rejection of what would alias, and cost per output sample
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "sim.h"
+#include "bench.h"
+#include "resampler.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using namespace StegoPhone;
+
+namespace {
+    const size_t InputLength = 9600;
+    const size_t Settle = 256; // outputs skipped while the filter fills
+
+    int16_t input[InputLength];
+    int16_t output[InputLength * 2 + 16];
+    int16_t blocked[InputLength * 2 + 16];
+
+    void tone(double hz, double rate, double amplitude) {
+        for (size_t i = 0; i < InputLength; i++)
+            input[i] = (int16_t) lround(amplitude * 32767 * sin(2 * M_PI * hz * i / rate));
+    }
+
+    double rms(const int16_t *samples, size_t count) {
+        double sum = 0;
+        for (size_t i = 0; i < count; i++)
+            sum += (double) samples[i] * samples[i];
+        return count ? sqrt(sum / count) : 0;
+    }
+
+    // least squares fit of a tone at hz; what it does not explain is noise, images and aliases
+    double snr(const int16_t *samples, size_t count, double hz, double rate) {
+        double ss = 0, cc = 0, sc = 0, ys = 0, yc = 0;
+        for (size_t n = 0; n < count; n++) {
+            const double s = sin(2 * M_PI * hz * n / rate);
+            const double c = cos(2 * M_PI * hz * n / rate);
+            ss += s * s;
+            cc += c * c;
+            sc += s * c;
+            ys += samples[n] * s;
+            yc += samples[n] * c;
+        }
+        const double determinant = ss * cc - sc * sc;
+        const double a = (ys * cc - yc * sc) / determinant;
+        const double b = (yc * ss - ys * sc) / determinant;
+        double signal = 0, residual = 0;
+        for (size_t n = 0; n < count; n++) {
+            const double fit = a * sin(2 * M_PI * hz * n / rate) + b * cos(2 * M_PI * hz * n / rate);
+            signal += fit * fit;
+            residual += (samples[n] - fit) * (samples[n] - fit);
+        }
+        return 10 * log10(signal / (residual > 0 ? residual : 1e-9));
+    }
+
+    uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return 0;
+#endif
+    }
+
+    template<typename Converter>
+    void measure(const char *name, double inRate, double outRate, const double *tones, size_t toneCount,
+                 double alias, double minSnr, double minRejection) {
+        std::string label;
+
+        // one call and wandering blocks give the same samples, Up per Down
+        tone(tones[0], inRate, 0.5);
+        Converter whole;
+        const size_t produced = whole.process(input, InputLength, output);
+        Converter pieces;
+        size_t done = 0;
+        size_t piecesProduced = 0;
+        static const size_t sizes[] = {1, 160, 7, 320, 33, 2, 80};
+        for (size_t block = 0; done < InputLength; block++) {
+            size_t count = sizes[block % (sizeof(sizes) / sizeof(sizes[0]))];
+            if (count > InputLength - done) count = InputLength - done;
+            piecesProduced += pieces.process(input + done, count, blocked + piecesProduced);
+            done += count;
+        }
+        label = std::string(name) + ": output count and blocks";
+        Sim::check(produced * (size_t) inRate == InputLength * (size_t) outRate && piecesProduced == produced &&
+                   memcmp(output, blocked, produced * sizeof(int16_t)) == 0, label.c_str());
+
+        // in band tones
+        for (size_t i = 0; i < toneCount; i++) {
+            tone(tones[i], inRate, 0.5);
+            Converter converter;
+            const size_t count = converter.process(input, InputLength, output);
+            const double measured = snr(output + Settle, count - Settle, tones[i], outRate);
+            char buf[64];
+            snprintf(buf, sizeof(buf), "%s_snr_%dhz", name, (int) tones[i]);
+            Sim::report(buf, measured, "dB");
+            label = std::string(name) + ": in band SNR";
+            Sim::check(measured >= minSnr, label.c_str());
+        }
+
+        // going down, a tone above the output's Nyquist rate should not come through
+        char buf[64];
+        Converter converter;
+        if (alias > 0) {
+            tone(alias, inRate, 0.5);
+            const size_t count = converter.process(input, InputLength, output);
+            const double rejection = 20 * log10(rms(input, InputLength) /
+                                                (rms(output + Settle, count - Settle) + 1e-9));
+            snprintf(buf, sizeof(buf), "%s_alias_rejection_%dhz", name, (int) alias);
+            Sim::report(buf, rejection, "dB");
+            label = std::string(name) + ": alias rejection";
+            Sim::check(rejection >= minRejection, label.c_str());
+        }
+
+        // cost per output sample, in 20ms blocks
+        tone(tones[0], inRate, 0.5);
+        const size_t block = (size_t) (inRate / 50);
+        const int rounds = 500;
+        converter.process(input, block, output);
+        size_t outputs = 0;
+        const uint64_t startCycles = cycles();
+        const uint64_t start = Sim::hostNanos();
+        for (int r = 0; r < rounds; r++)
+            outputs += converter.process(input, block, output);
+        const uint64_t nanos = Sim::hostNanos() - start;
+        const uint64_t spent = cycles() - startCycles;
+        snprintf(buf, sizeof(buf), "%s_host", name);
+        Sim::report(buf, (double) nanos / outputs, "ns/sample");
+        if (spent) {
+            snprintf(buf, sizeof(buf), "%s_tsc_host", name);
+            Sim::report(buf, (double) spent / outputs, "cycles/sample");
+        }
+    }
+}
+
+SIM_BENCH(resampler, "polyphase resampler: SCO 8k/16k to and from 9600/s, SNR, alias rejection, cost") {
+    // the tables are built by the compiler
+    static_assert(DSP::Sco8kToModem::Table.coefficients[0][11] > 16384, "coefficient table built at compile time");
+    int32_t dc = 0;
+    for (uint16_t j = 0; j < 24; j++)
+        dc += DSP::Sco8kToModem::Table.coefficients[3][j];
+    Sim::check(dc > 32700 && dc < 32836, "every phase has unity gain at DC");
+
+    // going up, images of the top of the band land in band at the output rate and count against the SNR
+    static const double narrow[] = {1000, 2400, 3400};
+    static const double wide[] = {1000, 2400, 4000};
+    measure<DSP::Sco8kToModem>("sco8k_to_modem", 8000, 9600, narrow, 3, 0, 60, 0);
+    measure<DSP::ModemToSco8k>("modem_to_sco8k", 9600, 8000, narrow, 3, 4600, 60, 50);
+    measure<DSP::Sco16kToModem>("sco16k_to_modem", 16000, 9600, wide, 3, 6000, 60, 50);
+    measure<DSP::ModemToSco16k>("modem_to_sco16k", 9600, 16000, wide, 3, 0, 60, 0);
+}
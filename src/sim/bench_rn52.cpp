@@ -0,0 +1,134 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+// RN52 command latency: queued CommandQueue against the old blocking rn52Exec sequence; then a reply
+// that arrives after its command timed out, which must not complete the next one
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+#include "bench.h"
+#include "stegophone.h"
+
+using namespace StegoPhone;
+
+namespace {
+    // rn52Exec as it was: flush, write, delay(interDelay), then busy-poll for up to 500ms. The old
+    // tail comparison never matched "\r\n", so a correct one is used here to give this path its
+    // best case.
+    bool blockingExec(const char *cmd, char *buf, size_t bufferSize, const char *match) {
+        HAL::SerialPort &serial = StegoPhone::StegoPhone::RN52Serial;
+        while (serial.available() > 0)
+            serial.read();
+        serial.write(cmd);
+        serial.write((uint8_t) '\n');
+        HAL::delay(100);
+        const size_t matchLength = strlen(match);
+        const uint32_t start = HAL::millis();
+        size_t received = 0;
+        while ((received < bufferSize - 1) && (HAL::millis() - start < 500)) {
+            if (serial.available() > 0) {
+                buf[received++] = (char) serial.read();
+                if (received >= matchLength && memcmp(buf + received - matchLength, match, matchLength) == 0)
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    int queuedMatched = 0;
+
+    void onQueued(void *context, const CommandResponse &response) {
+        if (response.result == CommandResult::Matched) queuedMatched++;
+    }
+
+    struct Answer {
+        CommandResult result;
+        char data[32];
+    };
+
+    void onAnswer(void *context, const CommandResponse &response) {
+        Answer *answer = (Answer *) context;
+        answer->result = response.result;
+        snprintf(answer->data, sizeof(answer->data), "%s", response.data);
+    }
+
+    void runUntilIdle(CommandQueue &queue) {
+        for (int i = 0; i < 1000 && !queue.idle(); i++) {
+            HAL::delay(1);
+            queue.loop();
+        }
+    }
+
+    // a queue on a link of its own, the device's replies sent by hand
+    void lateReply() {
+        Sim::SerialLink link("late");
+        CommandQueue queue(link, "\n");
+        Answer first = {CommandResult::Matched, ""}, second = {CommandResult::Timeout, ""};
+
+        // "Q" times out; its reply turns up 30ms later, while "V" is queued behind it
+        queue.submit("Q", RN52Command::lineEnd(), 20, onAnswer, &first);
+        queue.submit("V", RN52Command::lineEnd(), 200, onAnswer, &second);
+        HAL::delay(21);
+        queue.loop();
+        Sim::check(first.result == CommandResult::Timeout && queue.current() == 0,
+                   "rn52cmd: timed out, next command held back");
+        link.deviceSend("0003\r\n", 9000);
+        link.deviceSend("RN52 v1.16\r\n", 5000);
+        runUntilIdle(queue);
+        Sim::check(second.result == CommandResult::Matched && strcmp(second.data, "RN52 v1.16\r\n") == 0,
+                   "rn52cmd: late reply dropped, next command gets its own");
+        Sim::check(queue.discarded() == 6, "rn52cmd: late reply counted as dropped");
+
+        // no late reply at all: the next command goes out once the line has been quiet
+        queue.submit("Q", RN52Command::lineEnd(), 20, onAnswer, &first);
+        queue.submit("V", RN52Command::lineEnd(), 200, onAnswer, &second);
+        const uint64_t start = Sim::nowMicros();
+        for (int i = 0; i < 1000 && (queue.current() == 0 || strcmp(queue.current(), "V") != 0); i++) {
+            HAL::delay(1);
+            queue.loop();
+        }
+        Sim::check(Sim::nowMicros() - start <= (20 + CommandQueue::ResyncQuietMs + 2) * 1000ull,
+                   "rn52cmd: silent timeout resynchronised after the quiet time");
+        queue.clear();
+    }
+}
+
+SIM_BENCH(rn52cmd, "RN52 command latency, blocking rn52Exec path vs CommandQueue") {
+    Sim::bootOnce();
+    RN52 *rn52 = RN52::getInstance();
+    const int rounds = 8;
+    char buf[16];
+
+    int blockingMatched = 0;
+    uint64_t simStart = Sim::nowMicros();
+    uint64_t hostStart = Sim::hostMicros();
+    for (int i = 0; i < rounds; i++)
+        if (blockingExec(RN52Command::QueryStatus, buf, sizeof(buf), RN52Command::LineEnd)) blockingMatched++;
+    Sim::report("blocking_latency_sim", (Sim::nowMicros() - simStart) / 1000.0 / rounds, "ms/cmd");
+    Sim::report("blocking_cpu_host", (Sim::hostMicros() - hostStart) / 1000.0 / rounds, "ms/cmd");
+    Sim::check(blockingMatched == rounds, "blocking path matched every Q");
+
+    // all eight queued back to back; the caller is free between loop() calls
+    CommandQueue *commands = rn52->commands();
+    queuedMatched = 0;
+    simStart = Sim::nowMicros();
+    for (int i = 0; i < rounds; i++)
+        Sim::check(rn52->submit(RN52Command::QueryStatus, RN52Command::lineEnd(), onQueued, 0), "queue accepts Q");
+    uint32_t loops = 0;
+    while (!commands->idle()) {
+        commands->loop();
+        loops++;
+    }
+    Sim::report("queued_latency_sim", (Sim::nowMicros() - simStart) / 1000.0 / rounds, "ms/cmd");
+    Sim::report("queue_worst_latency_since_boot", commands->maxLatencyMicros() / 1000.0, "ms");
+    Sim::report("queued_loop_calls", loops / (double) rounds, "calls/cmd");
+    Sim::check(queuedMatched == rounds, "queued path matched every Q");
+
+    lateReply();
+}
@@ -0,0 +1,247 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+// status machine: the engine on a small table with explicit times (dispatch, ignored events,
+// timeouts, the trace ring, set up phases, dispatch cost), then the firmware's table through a whole
+// call: RN52 ringing and answered, the quiet modem against a peer stage in loopback, the key
+// agreement, hang up, and the announce and ring timeouts
+
+#include <string.h>
+#include "sim.h"
+#include "bench.h"
+#include "stegophone.h"
+#include "console.h"
+#include "fskphy.h"
+#include "modemstage.h"
+#include "keyexchange.h"
+
+using namespace StegoPhone;
+
+namespace {
+    uint32_t actions = 0;
+
+    void countAction(void *context) {
+        actions++;
+    }
+
+    typedef StegoStatus S;
+    typedef StegoEvent E;
+
+    constexpr StatusTransition TestTransitions[] = {
+            {S::Ready, E::CallRinging, S::IncomingRinging, 100, countAction},
+            {S::IncomingRinging, E::Timeout, S::Ready, 0, 0},
+            {S::IncomingRinging, E::CallActive, S::CallConnected, 0, countAction},
+            {S::CallConnected, E::ModemConnected, S::QuietModemConnected, 0, 0},
+            {S::QuietModemConnected, E::KeyAgreed, S::EncryptedDataEstablished, 0, 0},
+            {S::EncryptedDataEstablished, E::CallEnded, S::Ready, 0, 0},
+    };
+
+    static_assert(transitionsUnique(TestTransitions), "test table rows unique");
+
+    constexpr StatusDispatch TestIndex = buildDispatch(TestTransitions);
+
+    static_assert(TestIndex.row[(uint8_t) S::IncomingRinging][(uint8_t) E::CallActive] == 2 &&
+                  TestIndex.row[(uint8_t) S::Ready][(uint8_t) E::CallActive] == StatusDispatch::NoTransition,
+                  "dispatch index resolved by the compiler");
+
+    void engine() {
+        actions = 0;
+        StatusMachine machine(TestTransitions, TestIndex, 0, S::Ready);
+        Sim::check(!machine.dispatch(E::CallActive, 1000) && machine.ignored() == 1 && machine.status() == S::Ready,
+                   "state: event with no row ignored");
+
+        // ring, then the timeout 100ms on
+        Sim::check(machine.dispatch(E::CallRinging, 2000) && machine.status() == S::IncomingRinging && actions == 1,
+                   "state: row taken, action run");
+        Sim::check(!machine.poll(101999) && machine.status() == S::IncomingRinging, "state: timeout not yet due");
+        Sim::check(machine.poll(102000) && machine.status() == S::Ready && machine.timeouts() == 1,
+                   "state: timeout fires on time");
+        Sim::check(!machine.poll(500000), "state: no timeout armed in Ready");
+
+        // a whole call, phase by phase
+        machine.dispatch(E::CallRinging, 1000000);
+        machine.dispatch(E::CallActive, 1250000);
+        machine.dispatch(E::ModemConnected, 3250000);
+        machine.dispatch(E::KeyAgreed, 3750000);
+        Sim::check(machine.status() == S::EncryptedDataEstablished && !machine.poll(9000000),
+                   "state: call set up, timeout disarmed by leaving the state");
+        typedef StatusMachine::SetupPhase P;
+        Sim::check(machine.phase(P::Answer).lastMicros == 250000 && machine.phase(P::Modem).lastMicros == 2000000 &&
+                   machine.phase(P::Keys).lastMicros == 500000 && machine.phase(P::Total).lastMicros == 2500000,
+                   "state: set up phases timed");
+
+        StatusMachine::TraceEntry entry;
+        Sim::check(machine.recent(0, entry) && entry.from == S::QuietModemConnected && entry.event == E::KeyAgreed &&
+                   entry.to == S::EncryptedDataEstablished && entry.micros == 3750000, "state: latest transition traced");
+        Sim::check(machine.recent(5, entry) && entry.event == E::CallRinging && entry.micros == 2000 &&
+                   !machine.recent(6, entry), "state: trace goes back to the first transition");
+
+        // the ring keeps the last TraceDepth
+        machine.dispatch(E::CallEnded, 4000000);
+        for (uint32_t i = 0; i < StatusMachine::TraceDepth; i++) {
+            machine.dispatch(E::CallRinging, 5000000 + i * 10);
+            machine.dispatch(E::Timeout, 5000005 + i * 10);
+        }
+        const uint8_t depth = StatusMachine::TraceDepth;
+        Sim::check(machine.recent(depth - 1, entry) && !machine.recent(depth, entry) &&
+                   entry.micros == 5000000 + (depth / 2) * 10, "state: trace ring wraps");
+
+        // dispatch cost: ring and time out, over and over
+        const uint32_t rounds = 500000;
+        const uint64_t start = Sim::hostNanos();
+        for (uint32_t i = 0; i < rounds; i++) {
+            machine.dispatch(E::CallRinging, i);
+            machine.dispatch(E::Timeout, i);
+        }
+        Sim::report("dispatch_host", (double) (Sim::hostNanos() - start) / (2.0 * rounds), "ns");
+        Sim::check(machine.status() == S::Ready, "state: back in Ready");
+    }
+
+    StegoPhone::StegoPhone *stego = 0;
+    FskPhy peerPhy;
+    ModemStage peer(peerPhy);
+
+    // the RN52 reports a new connection state; loop() until it has been read
+    void rn52Reports(uint16_t statusWord) {
+        RN52 *rn52 = RN52::getInstance();
+        HAL::delay(150); // event line back up
+        const uint32_t updates = rn52->statusUpdates();
+        const uint64_t raised = Sim::nowMicros();
+        Sim::rn52Device().raiseEvent(statusWord);
+        while (rn52->statusUpdates() == updates && Sim::nowMicros() - raised < 1000000) {
+            HAL::delay(1);
+            stego->loop();
+        }
+        stego->loop();
+    }
+
+    // 20ms of call between the firmware's modem and the peer, then a UI pass
+    void tick() {
+        int16_t block[ModemStage::BlockSamples];
+        ModemStage *modem = stego->modem();
+        modem->pullAudio(block);
+        peer.pushAudio(block);
+        peer.pullAudio(block);
+        modem->pushAudio(block);
+        peer.process();
+        Sim::warp(20000);
+        stego->loop();
+    }
+
+    bool tickUntil(StegoStatus status, uint32_t limit) {
+        for (uint32_t i = 0; i < limit && stego->status() != status; i++)
+            tick();
+        return stego->status() == status;
+    }
+
+    void firmware() {
+        Sim::bootOnce();
+        stego = StegoPhone::StegoPhone::getInstance();
+        StatusMachine *machine = stego->statusMachine();
+        rn52Reports(0x0003); // connected to the phone, no call
+        Sim::check(stego->status() == S::Ready, "state: firmware Ready with no call");
+        machine->resetStats();
+
+        // ringing, answered: the modem starts announcing and the peer answers
+        rn52Reports(0x0005);
+        Sim::check(stego->status() == S::IncomingRinging, "state: RN52 ringing");
+        HAL::delay(800);
+        rn52Reports(0x0006);
+        Sim::check(stego->modem()->linkState() == ModemLinkState::Announcing &&
+                   stego->status() == S::QuietModemAnnouncing, "state: answered, modem announcing");
+        peer.start();
+        // connecting starts the key agreement, so QuietModemConnected lasts no longer than the first slice
+        Sim::check(tickUntil(S::EncryptionHandshaking, 500), "state: quiet modem connected, keys started");
+
+        // the key agreement, started by the firmware on connecting: its public key comes over the modem
+        // in a KeyShare frame, the peer's goes back the same way
+        FrameCipher peerCipher;
+        KeyExchange peerKeys(peerCipher);
+        uint8_t secret[32], theirs[32];
+        for (uint8_t i = 0; i < 32; i++)
+            secret[i] = (uint8_t) (i * 29 + 7);
+        peerKeys.begin(secret);
+        while (peerKeys.slice()) {
+        }
+        peerKeys.publicKey(theirs);
+        bool shared = false;
+        for (uint32_t i = 0; i < 500 && !shared; i++) {
+            tick();
+            ModemFrame *frame;
+            while ((frame = peer.receive()) != 0) {
+                if (frame->type == ModemFrameType::KeyShare && frame->length == sizeof(theirs)) {
+                    peerKeys.peerKey(frame->data);
+                    shared = true;
+                }
+                peer.release(frame);
+            }
+        }
+        Sim::check(shared && stego->status() == S::EncryptionHandshaking, "state: firmware key share received");
+        while (peerKeys.slice()) {
+        }
+        ModemFrame *reply = peer.acquire();
+        if (reply) {
+            reply->type = ModemFrameType::KeyShare;
+            reply->length = sizeof(theirs);
+            memcpy(reply->data, theirs, sizeof(theirs));
+            peer.send(reply);
+        }
+        Sim::check(tickUntil(S::EncryptedDataEstablished, 500), "state: encrypted data established");
+
+        // one key, opposite roles: a frame sealed on one end opens on the other
+        ModemFrame sealed;
+        sealed.type = ModemFrameType::Data;
+        memcpy(FrameCipher::payload(&sealed), "hello", 5);
+        Sim::check(peerCipher.keyed() && stego->cipher()->seal(&sealed, 5) && peerCipher.open(&sealed) &&
+                   memcmp(FrameCipher::payload(&sealed), "hello", 5) == 0, "state: both ends share the session key");
+
+        typedef StatusMachine::SetupPhase P;
+        Sim::report("answer_sim", machine->phase(P::Answer).lastMicros / 1000.0, "ms");
+        Sim::report("modem_handshake_sim", machine->phase(P::Modem).lastMicros / 1000.0, "ms");
+        Sim::report("key_agreement_sim", machine->phase(P::Keys).lastMicros / 1000.0, "ms");
+        Sim::report("call_setup_total_sim", machine->phase(P::Total).lastMicros / 1000.0, "ms");
+        Sim::check(machine->phase(P::Total).count == 1 &&
+                   machine->phase(P::Total).lastMicros ==
+                   machine->phase(P::Modem).lastMicros + machine->phase(P::Keys).lastMicros,
+                   "state: set up phases add up");
+
+        // hang up: modem and keys stopped
+        rn52Reports(0x0003);
+        tick();
+        Sim::check(stego->status() == S::Ready && stego->modem()->linkState() == ModemLinkState::Idle &&
+                   stego->keyExchange()->state() == KeyExchangeState::Idle, "state: hang up back to Ready");
+        peer.stop();
+        peer.process();
+
+        // a call to a plain phone: announcing times out, the call goes on without the modem
+        rn52Reports(0x0006);
+        Sim::check(stego->status() == S::QuietModemAnnouncing, "state: announcing to a plain phone");
+        const uint32_t timeouts = machine->timeouts();
+        Sim::check(tickUntil(S::CallConnected, StegoPhone::StegoPhone::PeerTimeoutMs / 20 + 10) &&
+                   machine->timeouts() == timeouts + 1, "state: announcing timed out");
+        tick();
+        Sim::check(stego->modem()->linkState() == ModemLinkState::Idle && stego->status() == S::CallConnected,
+                   "state: modem stopped, call still up");
+        rn52Reports(0x0003);
+
+        // ringing nobody answers, and no word from the RN52 after
+        rn52Reports(0x0005);
+        HAL::delay(StegoPhone::StegoPhone::RingTimeoutMs);
+        stego->loop();
+        Sim::check(stego->status() == S::Ready && machine->timeouts() == timeouts + 2, "state: ringing timed out");
+        rn52Reports(0x0003);
+
+        const uint32_t before = Sim::console().bytesWritten;
+        Console::getInstance()->execute("state");
+        Sim::check(Sim::console().bytesWritten - before > 300, "state console command prints the trace");
+    }
+}
+
+SIM_BENCH(state, "status machine: table dispatch, timeouts, trace ring, call set up phases through a whole call") {
+    engine();
+    firmware();
+}
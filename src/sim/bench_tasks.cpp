@@ -0,0 +1,114 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+// TaskManager on the host scheduler: periodic and event triggers, CPU share, worst step and overruns,
+// then the firmware's own tasks declared through it
+
+#include "sim.h"
+#include "bench.h"
+#include "stegophone.h"
+#include "console.h"
+#include "taskmanager.h"
+
+using namespace StegoPhone;
+
+namespace {
+    uint32_t eventsSeen = 0;
+
+    // 2ms of CPU per step
+    void busyStep(void *context, uint32_t notifications) {
+        Sim::warp(2000);
+    }
+
+    // 2.5ms: not a whole number of ticks
+    void fractionStep(void *context, uint32_t notifications) {
+        Sim::warp(2500);
+    }
+
+    void eventStep(void *context, uint32_t notifications) {
+        eventsSeen += notifications;
+    }
+}
+
+SIM_BENCH(tasks, "TaskManager: triggers, CPU share, worst step, overruns and the firmware tasks") {
+    Sim::bootOnce();
+    RTOS::startScheduler();
+    TaskManager *manager = TaskManager::getInstance();
+    const uint8_t countStart = manager->count();
+
+    const TaskSpec busySpec = {"busy", 2, 256, TaskTrigger::Periodic, 10, busyStep, 0};
+    const TaskSpec eventSpec = {"event", 2, 256, TaskTrigger::Event, RTOS::WaitForever, eventStep, 0};
+    ManagedTask *busy = manager->start(busySpec);
+    ManagedTask *event = manager->start(eventSpec);
+    if (!Sim::check(busy && event, "tasks created")) return;
+    Sim::check(manager->find("busy") == busy && manager->count() == countStart + 2, "tasks registered");
+
+    // let both run their first step, then measure 500ms
+    HAL::delay(1);
+    manager->resetStats();
+    const uint32_t seenStart = eventsSeen;
+    for (int i = 0; i < 100; i++) {
+        if (i % 2) event->notify();
+        HAL::delay(5);
+    }
+    const TaskStats busyStats = busy->stats();
+    const TaskStats eventStats = event->stats();
+    Sim::report("periodic_steps", busyStats.steps, "steps/500ms");
+    Sim::report("periodic_cpu", manager->cpuPermille(busy) / 10.0, "%");
+    Sim::report("periodic_max_step_sim", busyStats.maxStepMicros / 1000.0, "ms");
+    Sim::report("event_steps", eventStats.steps, "steps/50 notifies");
+    Sim::check(busyStats.steps >= 49 && busyStats.steps <= 51, "10ms period kept");
+    Sim::check(manager->cpuPermille(busy) >= 190 && manager->cpuPermille(busy) <= 210, "2ms in 10ms is 20% CPU");
+    Sim::check(busyStats.maxStepMicros >= 2000 && busyStats.maxStepMicros < 2100, "worst step is the 2ms of work");
+    Sim::check(busyStats.overruns == 0, "no overruns within the period");
+    Sim::check(eventStats.steps == 50 && eventsSeen - seenStart == 50, "one step per notify");
+    Sim::check(busyStats.stackUnusedWords == RTOS::StackUnknown, "no stack high water on host threads");
+
+    // a period shorter than the work: every step overruns, and still sleeps a tick so main gets to run
+    busy->setPeriod(1);
+    HAL::delay(20);
+    Sim::check(busy->stats().overruns > 0, "overruns counted when a step outlasts its period");
+    manager->stop(busy);
+
+    // steps that end part way into a tick: woken on the period from the last wake, so they do not drift
+    const TaskSpec fractionSpec = {"fraction", 2, 256, TaskTrigger::Periodic, 10, fractionStep, 0};
+    ManagedTask *fraction = manager->start(fractionSpec);
+    if (!Sim::check(fraction != 0, "task created")) return;
+    HAL::delay(1);
+    const uint32_t fractionStart = fraction->stats().steps;
+    HAL::delay(1000);
+    const uint32_t fractionSteps = fraction->stats().steps - fractionStart;
+    Sim::report("fraction_steps", fractionSteps, "steps/s");
+    Sim::check(fractionSteps == 100 && fraction->stats().overruns == 0, "10ms period kept with 2.5ms steps");
+    manager->stop(fraction);
+    manager->stop(event);
+    Sim::check(manager->count() == countStart, "stopped tasks leave the table");
+
+    // the firmware's tasks, idle: rn52 events, USB polling, UI and display flushes
+    StegoPhone::StegoPhone *stego = StegoPhone::StegoPhone::getInstance();
+    const bool started = RN52::getInstance()->startEventTask(3) && stego->startTasks(2, 3) &&
+                         stego->compositor()->startFlushTask(1);
+    if (!Sim::check(started, "firmware tasks created")) return;
+    manager->resetStats();
+    Sim::pressKey('x');
+    HAL::delay(1000);
+    const char *const names[] = {"rn52", "usb", "ui", "display"};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        ManagedTask *task = manager->find(names[i]);
+        if (!Sim::check(task != 0, "firmware task registered")) continue;
+        std::string label = std::string(names[i]) + "_steps";
+        Sim::report(label.c_str(), task->stats().steps, "steps/s");
+    }
+    const uint64_t consoleStart = Sim::console().bytesWritten;
+    Console::getInstance()->execute("tasks");
+    Sim::check(Sim::console().bytesWritten - consoleStart > 200, "tasks table printed");
+
+    stego->compositor()->stopFlushTask();
+    stego->stopTasks();
+    RN52::getInstance()->stopEventTask();
+    Sim::check(manager->count() == countStart, "firmware tasks stopped");
+}
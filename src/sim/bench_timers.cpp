@@ -0,0 +1,301 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+// timer wheel on a virtual clock (microseconds handed to advance() and arm()): one shot and periodic
+// timers on their tick, every level and past the top, cancel and re-arm from callbacks, the micros()
+// wrap, an arm after an idle gap, random timers against a reference, arm/cancel and per tick cost;
+// then the wheel's own task on the simulated RTOS and the boot sequence the firmware runs on it
+
+#include <string.h>
+#include <vector>
+#include "sim.h"
+#include "bench.h"
+#include "stegophone.h"
+#include "console.h"
+#include "timerwheel.h"
+#include "rtos.h"
+
+using namespace StegoPhone;
+
+namespace {
+    uint32_t seed = 0x2545F491;
+
+    uint32_t next() {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    }
+
+    // a timer that notes when it fired, on the clock the test hands the wheel
+    struct Probe {
+        Timer timer;
+        TimerWheel *wheel;
+        uint64_t *clock;
+        uint64_t firedAt;
+        uint32_t count;
+        Timer *cancels;   // cancelled from the callback
+        uint32_t rearmMs; // re-armed from the callback, one shot
+
+        Probe() : timer(Probe::fire, this), wheel(0), clock(0), firedAt(0), count(0), cancels(0), rearmMs(0) {
+        }
+
+        static void fire(void *context) {
+            Probe *probe = (Probe *) context;
+            probe->firedAt = *probe->clock;
+            probe->count++;
+            if (probe->cancels) probe->wheel->cancel(probe->cancels);
+            if (probe->rearmMs) {
+                const uint32_t ms = probe->rearmMs;
+                probe->rearmMs = 0;
+                probe->wheel->arm(&probe->timer, ms, 0, (uint32_t) *probe->clock);
+            }
+        }
+    };
+
+    // the clock is kept in 64 bits; the wheel sees its low 32 like HAL::micros()
+    struct Clock {
+        TimerWheel wheel;
+        uint64_t now;
+        uint64_t start;
+
+        explicit Clock(uint64_t start) : wheel((uint32_t) start), now(start), start(start) {
+        }
+
+        // when a timer armed now for ms is due: the wheel counts whole ms from its construction
+        uint64_t dueAt(uint32_t ms) const {
+            return this->start + ((this->now - this->start) / 1000 + ms) * 1000;
+        }
+
+        void attach(Probe &probe) {
+            probe.wheel = &this->wheel;
+            probe.clock = &this->now;
+        }
+
+        // in steps of stepMicros, as a service task would
+        uint32_t run(uint64_t micros, uint32_t stepMicros = 1000) {
+            uint32_t fired = 0;
+            const uint64_t end = this->now + micros;
+            while (this->now < end) {
+                this->now += (end - this->now < stepMicros) ? end - this->now : stepMicros;
+                fired += this->wheel.advance((uint32_t) this->now);
+            }
+            return fired;
+        }
+    };
+
+    void basics() {
+        Clock clock(0);
+        Probe once, periodic, far, beyond;
+        clock.attach(once);
+        clock.attach(periodic);
+        clock.attach(far);
+        clock.attach(beyond);
+        Sim::check(clock.wheel.msUntilNext() == RTOS::WaitForever, "timers: nothing armed, nothing to wait for");
+
+        clock.wheel.arm(&once.timer, 30, 0, (uint32_t) clock.now);
+        Sim::check(once.timer.armed() && clock.wheel.msUntilNext() == 30, "timers: next due in 30ms");
+        clock.run(29000);
+        Sim::check(once.count == 0, "timers: one shot not early");
+        clock.run(1000);
+        Sim::check(once.count == 1 && once.firedAt == 30000 && !once.timer.armed() && clock.wheel.armedCount() == 0,
+                   "timers: one shot on its tick");
+
+        // periodic: every 20ms, on phase
+        clock.wheel.arm(&periodic.timer, 20, 20, (uint32_t) clock.now);
+        clock.run(1000000);
+        Sim::check(periodic.count == 50 && periodic.firedAt == 1030000 && periodic.timer.armed(),
+                   "timers: periodic, 50 times a second on phase");
+        Sim::check(clock.wheel.cancel(&periodic.timer) && !clock.wheel.cancel(&periodic.timer) &&
+                   !periodic.timer.armed(), "timers: cancel once");
+
+        // every level: 100ms, 10s, 20 minutes, and 5 hours past the top of the wheel
+        const uint32_t delays[] = {100, 10000, 1200000, 18000000};
+        for (size_t d = 0; d < sizeof(delays) / sizeof(delays[0]); d++) {
+            far.count = 0;
+            const uint64_t start = clock.now;
+            clock.wheel.arm(&far.timer, delays[d], 0, (uint32_t) clock.now);
+            clock.run((uint64_t) delays[d] * 1000 + 5000, 1000000); // in big steps: the wheel catches up
+            Sim::check(far.count == 1, "timers: long delay fired once");
+            // caught up tick by tick, so it fired late by the rest of its step, never early
+            Sim::check(far.firedAt >= start + (uint64_t) delays[d] * 1000, "timers: long delay never early");
+        }
+        const uint32_t cascaded = clock.wheel.cascaded();
+        Sim::check(cascaded > 0, "timers: far timers cascaded down");
+
+        // due on the very tick its level 1 slot cascades on: 128ms from tick 0
+        Clock edgeClock(0);
+        Probe edge;
+        edgeClock.attach(edge);
+        edgeClock.wheel.arm(&edge.timer, TimerWheel::Slots, 0, (uint32_t) edgeClock.now);
+        edgeClock.run((uint64_t) TimerWheel::Slots * 1000 + 5000);
+        Sim::check(edge.count == 1 && edge.firedAt == (uint64_t) TimerWheel::Slots * 1000,
+                   "timers: due on a cascade tick, fires on it");
+
+        // exact, in 1ms steps, across a cascade of every level
+        clock.wheel.arm(&beyond.timer, 262200, 0, (uint32_t) clock.now);
+        clock.run(262200000);
+        Sim::check(beyond.count == 1 && beyond.firedAt == clock.now, "timers: 262s timer on its tick in 1ms steps");
+        Sim::report("late_mean_virtual", clock.wheel.meanLateMicros(), "us");
+
+        // re-arm moves; a callback cancels another and re-arms itself
+        once.count = 0;
+        clock.wheel.arm(&once.timer, 50, 0, (uint32_t) clock.now);
+        clock.wheel.arm(&once.timer, 10, 0, (uint32_t) clock.now);
+        Sim::check(clock.wheel.armedCount() == 1, "timers: re-arm does not double count");
+        clock.run(10000);
+        Sim::check(once.count == 1, "timers: re-armed timer fires at the new time");
+        Probe victim;
+        clock.attach(victim);
+        once.cancels = &victim.timer;
+        once.rearmMs = 5;
+        clock.wheel.arm(&victim.timer, 20, 0, (uint32_t) clock.now);
+        clock.wheel.arm(&once.timer, 10, 0, (uint32_t) clock.now);
+        clock.run(40000);
+        Sim::check(once.count == 3 && victim.count == 0 && clock.wheel.armedCount() == 0,
+                   "timers: callback cancels another and re-arms itself");
+    }
+
+    void wrap() {
+        // HAL::micros() wraps every 71 minutes
+        Clock clock(0xFFFFF000);
+        Probe probe;
+        clock.attach(probe);
+        clock.wheel.arm(&probe.timer, 10, 10, (uint32_t) clock.now);
+        clock.run(100000);
+        Sim::check(probe.count == 10 && probe.firedAt == 0xFFFFF000ull + 100000, "timers: across the micros() wrap");
+    }
+
+    // armed after a long stretch with no advance(), as when the wheel's task sleeps with nothing armed:
+    // counted from the arm, not from the last advance()
+    void idleGap() {
+        Clock clock(0);
+        Probe probe;
+        clock.attach(probe);
+        clock.run(5000);
+        clock.now += 10000000;
+        const uint64_t due = clock.dueAt(30);
+        clock.wheel.arm(&probe.timer, 30, 0, (uint32_t) clock.now);
+        // the task, woken by the arm, catches up on the gap
+        Sim::check(clock.wheel.advance((uint32_t) clock.now) == 0 && clock.wheel.msUntilNext() == 30,
+                   "timers: after an idle gap, nothing overdue and next due in 30ms");
+        clock.run(29000);
+        Sim::check(probe.count == 0, "timers: armed after an idle gap, not overdue");
+        clock.run(1000);
+        Sim::check(probe.count == 1 && probe.firedAt == due && due == 10035000 && clock.wheel.lastLateMicros() == 0,
+                   "timers: armed after an idle gap, on its tick");
+    }
+
+    // random delays, re-arms and cancels in random steps, against when each should have fired
+    void randomTimers() {
+        const size_t count = 2000;
+        Clock clock(12345);
+        std::vector<Probe> probes(count);
+        std::vector<uint64_t> due(count, 0);
+        for (size_t i = 0; i < count; i++) {
+            clock.attach(probes[i]);
+            probes[i].timer.setCallback(Probe::fire, &probes[i]);
+        }
+        uint32_t expected = 0, wrong = 0;
+        uint64_t maxLate = 0;
+        for (int round = 0; round < 4000; round++) {
+            const size_t i = next() % count;
+            const uint32_t action = next() % 8;
+            if (action < 5) {
+                const uint32_t ms = (action < 3) ? next() % 100 : next() % 120000;
+                if (!probes[i].timer.armed()) expected++;
+                clock.wheel.arm(&probes[i].timer, ms, 0, (uint32_t) clock.now);
+                due[i] = clock.dueAt(ms);
+            } else if (action < 7 && probes[i].timer.armed()) {
+                clock.wheel.cancel(&probes[i].timer);
+                expected--;
+            }
+            const uint32_t step = 1 + next() % 30000;
+            for (size_t p = 0; p < count; p++)
+                probes[p].firedAt = 0;
+            clock.run(step, 1 + next() % 5000);
+            for (size_t p = 0; p < count; p++) {
+                if (!probes[p].firedAt) continue;
+                if (probes[p].firedAt < due[p]) wrong++;
+                if (probes[p].firedAt - due[p] > maxLate) maxLate = probes[p].firedAt - due[p];
+            }
+        }
+        clock.run(200000000, 50000);
+        uint32_t fired = 0;
+        for (size_t p = 0; p < count; p++)
+            fired += probes[p].count;
+        Sim::check(wrong == 0, "timers: random timers never early");
+        Sim::check(fired == expected && clock.wheel.armedCount() == 0, "timers: every armed timer fired exactly once");
+        Sim::check(maxLate < 5000 + 1000, "timers: late by at most the advance step");
+    }
+
+    void cost() {
+        Clock clock(0);
+        const size_t count = 10000;
+        std::vector<Probe> probes(count);
+        for (size_t i = 0; i < count; i++)
+            clock.attach(probes[i]);
+        uint64_t start = Sim::hostNanos();
+        for (size_t i = 0; i < count; i++)
+            clock.wheel.arm(&probes[i].timer, 1 + next() % 3600000, 0, (uint32_t) clock.now);
+        Sim::report("arm_host", (double) (Sim::hostNanos() - start) / count, "ns");
+        start = Sim::hostNanos();
+        clock.run(60000000);
+        Sim::report("advance_per_tick_10k_armed_host", (double) (Sim::hostNanos() - start) / 60000, "ns");
+        start = Sim::hostNanos();
+        uint32_t cancelled = 0;
+        for (size_t i = 0; i < count; i++)
+            cancelled += clock.wheel.cancel(&probes[i].timer);
+        Sim::report("cancel_host", (double) (Sim::hostNanos() - start) / count, "ns");
+        Sim::check(clock.wheel.armedCount() == 0 && cancelled + clock.wheel.fired() == count,
+                   "timers: cancelled or fired, all of them");
+    }
+
+    // on the wheel's own task, armed from the main task
+    void service() {
+        TimerWheel wheel(HAL::micros());
+        Probe probes[3];
+        uint64_t clock = 0;
+        for (int i = 0; i < 3; i++) {
+            probes[i].wheel = &wheel;
+            probes[i].clock = &clock;
+        }
+        RTOS::startScheduler();
+        if (!Sim::check(wheel.startTask(3), "timers: service task created")) return;
+        wheel.arm(&probes[0].timer, 250, 0, HAL::micros());
+        wheel.arm(&probes[1].timer, 40, 40, HAL::micros());
+        wheel.arm(&probes[2].timer, 10000, 0, HAL::micros());
+        HAL::delay(1000);
+        wheel.cancel(&probes[1].timer);
+        wheel.cancel(&probes[2].timer);
+        wheel.stopTask();
+        Sim::check(probes[0].count == 1 && probes[1].count >= 24 && probes[1].count <= 25 && probes[2].count == 0,
+                   "timers: service task ran what was due");
+        Sim::report("service_late_max_sim", wheel.maxLateMicros(), "us");
+        Sim::report("service_late_mean_sim", wheel.meanLateMicros(), "us");
+        Sim::check(wheel.late() == 0, "timers: service task on time");
+    }
+}
+
+SIM_BENCH(timers, "timer wheel: virtual clock exactness, levels, wrap, random vs reference, cost, service task") {
+    basics();
+    wrap();
+    idleGap();
+    randomTimers();
+    cost();
+    service();
+
+    // the boot sequence ran on the firmware's wheel
+    Sim::bootOnce();
+    TimerWheel *timers = StegoPhone::StegoPhone::getInstance()->timers();
+    Sim::check(!StegoPhone::StegoPhone::getInstance()->booting() &&
+               timers->fired() >= StegoPhone::StegoPhone::getInstance()->bootSequence()->passes(),
+               "timers: boot sequence ran from the wheel");
+    const uint32_t before = Sim::console().bytesWritten;
+    Console::getInstance()->execute("timers");
+    Sim::check(Sim::console().bytesWritten > before, "timers console command prints");
+}
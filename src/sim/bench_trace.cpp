@@ -0,0 +1,98 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+// binary trace ring: ordering, overwrite accounting, console dump, and the per-byte cost against
+// the five console prints it replaced in the RN52 RX path
+
+#include <algorithm>
+
+#include "sim.h"
+#include "bench.h"
+#include "console.h"
+#include "rn52.h"
+#include "trace.h"
+
+using namespace StegoPhone;
+
+SIM_BENCH(trace, "deferred binary trace vs per-byte console printing") {
+    if (!Sim::check(Trace::enabled(), "native build traces (-DSTEGOS_TRACE=1)")) return;
+    Sim::bootOnce();
+
+    // records come back in order, then the ring is empty
+    Trace::clear();
+    const char *probe = "Q\n0000\r\n";
+    STEGOS_TRACE_BYTES(TraceChannel::RN52, TraceDirection::Tx, probe, 2);
+    STEGOS_TRACE_BYTES(TraceChannel::RN52, TraceDirection::Rx, probe + 2, 6);
+    TraceRecord record;
+    bool ordered = true;
+    for (int i = 0; i < 8; i++)
+        ordered = ordered && Trace::next(record) && record.value == (uint8_t) probe[i] &&
+                  record.direction == (i < 2 ? TraceDirection::Tx : TraceDirection::Rx);
+    Sim::check(ordered, "records read back in order with direction");
+    Sim::check(!Trace::next(record), "ring empty after reading everything");
+
+    // overrun: only the newest Capacity records survive, the rest are counted as lost
+    const uint32_t lostBefore = Trace::lost();
+    for (uint32_t i = 0; i < Trace::Capacity + 100; i++)
+        STEGOS_TRACE_BYTE(TraceChannel::ESP8266, TraceDirection::Rx, i);
+    uint32_t survivors = 0;
+    bool newest = true;
+    while (Trace::next(record)) {
+        newest = newest && (record.value == (uint8_t) (100 + survivors));
+        survivors++;
+    }
+    Sim::check(survivors == Trace::Capacity && newest, "overrun keeps the newest records");
+    Sim::check(Trace::lost() - lostBefore == 100, "overrun counted as lost");
+
+    // an RN52 status round trip lands in the trace and dumps from the console
+    RN52 *rn52 = RN52::getInstance();
+    const uint32_t updates = rn52->statusUpdates();
+    const uint64_t consoleStart = Sim::console().bytesWritten;
+    rn52->requestStatus();
+    while (rn52->statusUpdates() == updates && !rn52->commands()->idle())
+        rn52->loop();
+    Sim::report("status_console_bytes", (double) (Sim::console().bytesWritten - consoleStart), "bytes");
+    const uint32_t recorded = Trace::recorded();
+    Console::getInstance()->execute("trace");
+    Sim::check(Trace::recorded() == recorded && !Trace::next(record), "console dump drained the ring");
+
+    // cost per traced byte against the old five prints per byte
+    Sim::ConsoleLink sink;
+    sink.echo = false;
+    const int bytes = 200000;
+    uint64_t start = Sim::hostNanos();
+    for (int i = 0; i < bytes; i++) {
+        const char c = (char) ('0' + (i & 0x3F));
+        sink.print("BT: ");
+        sink.print(c, DEC);
+        sink.print(" - ");
+        sink.print(c, HEX);
+        sink.print(" -> ");
+        sink.println(c);
+    }
+    Sim::report("print_per_byte_host", (Sim::hostNanos() - start) / (double) bytes, "ns/byte");
+    Sim::report("print_console_bytes", sink.bytesWritten / (double) bytes, "bytes/byte");
+
+    // best of three; most of the cost is the simulated clock, which polls every device, whereas on
+    // target micros() is a few cycles
+    double traceNanos = 1e9;
+    double clockNanos = 1e9;
+    volatile uint32_t now = 0;
+    for (int pass = 0; pass < 3; pass++) {
+        start = Sim::hostNanos();
+        for (int i = 0; i < bytes; i++)
+            STEGOS_TRACE_BYTE(TraceChannel::RN52, TraceDirection::Rx, i);
+        traceNanos = std::min(traceNanos, (Sim::hostNanos() - start) / (double) bytes);
+        start = Sim::hostNanos();
+        for (int i = 0; i < bytes; i++)
+            now += HAL::micros();
+        clockNanos = std::min(clockNanos, (Sim::hostNanos() - start) / (double) bytes);
+    }
+    Sim::report("trace_per_byte_host", traceNanos, "ns/byte");
+    Sim::report("sim_clock_host", clockNanos, "ns/call");
+    Trace::clear();
+}
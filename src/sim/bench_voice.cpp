@@ -0,0 +1,492 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+// LPC vocoder: 8 kHz WAV fixtures through each mode, checked for pitch, voicing, level and spectral
+// envelope against what the fixture was built from, plus concealment and encode + decode time against
+// real time. The fixtures are synthesised (glottal pulses through formant resonators, filtered noise,
+// silence) and go through RIFF images so a recording can take their place: STEGOS_VOICE_WAV names an
+// 8 kHz mono 16 bit file to run through every mode as well.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "sim.h"
+#include "bench.h"
+#include "voicecodec.h"
+
+using namespace StegoPhone;
+
+namespace {
+    const double Rate = VoiceSampleRate;
+    const size_t ClipSamples = 8000; // a second
+    const size_t SkipFrames = 2;     // while the analysis history fills
+
+    struct Clip {
+        std::vector<int16_t> samples;
+        double f0Start, f0End; // 0 for unvoiced
+    };
+
+    // WAV FIXTURES
+    //================================================================================================
+    void put16(std::vector<uint8_t> &out, uint32_t value) {
+        out.push_back((uint8_t) value);
+        out.push_back((uint8_t) (value >> 8));
+    }
+
+    void put32(std::vector<uint8_t> &out, uint32_t value) {
+        put16(out, value & 0xffff);
+        put16(out, value >> 16);
+    }
+
+    void putTag(std::vector<uint8_t> &out, const char *tag) {
+        out.insert(out.end(), tag, tag + 4);
+    }
+
+    std::vector<uint8_t> wavImage(const std::vector<int16_t> &samples) {
+        std::vector<uint8_t> out;
+        const uint32_t dataBytes = (uint32_t) samples.size() * 2;
+        putTag(out, "RIFF");
+        put32(out, 36 + dataBytes);
+        putTag(out, "WAVE");
+        putTag(out, "fmt ");
+        put32(out, 16);
+        put16(out, 1); // PCM
+        put16(out, 1);
+        put32(out, VoiceSampleRate);
+        put32(out, VoiceSampleRate * 2);
+        put16(out, 2);
+        put16(out, 16);
+        putTag(out, "data");
+        put32(out, dataBytes);
+        for (size_t i = 0; i < samples.size(); i++)
+            put16(out, (uint16_t) samples[i]);
+        return out;
+    }
+
+    uint32_t get32(const uint8_t *p) {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+    }
+
+    // 8 kHz mono 16 bit PCM only; other chunks skipped
+    bool readWav(const std::vector<uint8_t> &image, std::vector<int16_t> &samples) {
+        if (image.size() < 12 || memcmp(&image[0], "RIFF", 4) != 0 || memcmp(&image[8], "WAVE", 4) != 0)
+            return false;
+        bool format = false;
+        size_t at = 12;
+        while (at + 8 <= image.size()) {
+            const uint32_t size = get32(&image[at + 4]);
+            const uint8_t *body = &image[at + 8];
+            if (at + 8 + size > image.size()) return false;
+            if (memcmp(&image[at], "fmt ", 4) == 0) {
+                if (size < 16) return false;
+                format = (body[0] | (body[1] << 8)) == 1 && (body[2] | (body[3] << 8)) == 1 &&
+                         get32(body + 4) == VoiceSampleRate && (body[14] | (body[15] << 8)) == 16;
+                if (!format) return false;
+            } else if (memcmp(&image[at], "data", 4) == 0) {
+                if (!format) return false;
+                samples.resize(size / 2);
+                for (size_t i = 0; i < samples.size(); i++)
+                    samples[i] = (int16_t) (body[2 * i] | (body[2 * i + 1] << 8));
+                return true;
+            }
+            at += 8 + size + (size & 1);
+        }
+        return false;
+    }
+
+    // two pole resonator at hz with the given bandwidth, unity gain at its peak
+    struct Resonator {
+        double a1, a2, gain, y1, y2;
+
+        Resonator(double hz, double bandwidth) {
+            const double r = exp(-M_PI * bandwidth / Rate);
+            a1 = 2 * r * cos(2 * M_PI * hz / Rate);
+            a2 = -r * r;
+            gain = 1 - r;
+            y1 = y2 = 0;
+        }
+
+        double step(double x) {
+            const double y = gain * x + a1 * y1 + a2 * y2;
+            y2 = y1;
+            y1 = y;
+            return y;
+        }
+    };
+
+    void normalise(std::vector<double> &signal, double peak, std::vector<int16_t> &out) {
+        double most = 0;
+        for (size_t i = 0; i < signal.size(); i++)
+            most = fmax(most, fabs(signal[i]));
+        out.resize(signal.size());
+        for (size_t i = 0; i < signal.size(); i++)
+            out[i] = (int16_t) lround(signal[i] / (most > 0 ? most : 1) * peak * 32767);
+    }
+
+    // glottal pulses with f0 gliding from f0Start to f0End, three formants, lip radiation
+    Clip vowel(double f0Start, double f0End, const double *formants, double peak) {
+        std::vector<double> signal(ClipSamples);
+        Resonator f1(formants[0], 80), f2(formants[1], 100), f3(formants[2], 150);
+        double phase = 0, glottis1 = 0, glottis2 = 0, previous = 0;
+        for (size_t n = 0; n < ClipSamples; n++) {
+            const double f0 = f0Start + (f0End - f0Start) * n / ClipSamples;
+            phase += f0 / Rate;
+            double pulse = 0;
+            if (phase >= 1) {
+                phase -= 1;
+                pulse = 1;
+            }
+            // -12dB/octave glottal roll off
+            glottis1 = 0.96 * glottis1 + pulse;
+            glottis2 = 0.96 * glottis2 + glottis1;
+            const double tract = f3.step(f2.step(f1.step(glottis2)));
+            signal[n] = tract - previous;
+            previous = tract;
+        }
+        Clip clip;
+        normalise(signal, peak, clip.samples);
+        clip.f0Start = f0Start;
+        clip.f0End = f0End;
+        return clip;
+    }
+
+    // white noise through a resonance around 2.5 kHz, like /sh/
+    Clip fricative(double peak) {
+        std::vector<double> signal(ClipSamples);
+        Resonator shaping(2500, 800);
+        srand(7);
+        for (size_t n = 0; n < ClipSamples; n++)
+            signal[n] = shaping.step((double) rand() / RAND_MAX - 0.5);
+        Clip clip;
+        normalise(signal, peak, clip.samples);
+        clip.f0Start = clip.f0End = 0;
+        return clip;
+    }
+
+    // MEASUREMENT
+    //================================================================================================
+    struct Run {
+        std::vector<uint8_t> bits;
+        std::vector<int16_t> decoded;
+        std::vector<VoiceParams> params;
+        std::vector<int16_t> voicing;
+    };
+
+    Run code(VoiceMode mode, const std::vector<int16_t> &samples) {
+        const VoiceModeInfo &info = voiceModeInfo(mode);
+        const size_t frames = samples.size() / info.frameSamples;
+        VoiceEncoder encoder(mode);
+        VoiceDecoder decoder(mode);
+        Run run;
+        run.bits.resize(frames * info.frameBytes);
+        run.decoded.resize(frames * info.frameSamples);
+        for (size_t f = 0; f < frames; f++) {
+            encoder.encode(&samples[f * info.frameSamples], &run.bits[f * info.frameBytes]);
+            decoder.decode(&run.bits[f * info.frameBytes], &run.decoded[f * info.frameSamples]);
+            run.params.push_back(encoder.lastParams());
+            run.voicing.push_back(encoder.lastVoicing());
+        }
+        return run;
+    }
+
+    double rms(const int16_t *samples, size_t count) {
+        double sum = 0;
+        for (size_t i = 0; i < count; i++)
+            sum += (double) samples[i] * samples[i];
+        return count ? sqrt(sum / count) : 0;
+    }
+
+    // reflection coefficients to A(z) = 1 + sum a[j] z^-j
+    void stepUp(const double *k, double *a) {
+        double previous[VoiceParams::Order + 1];
+        a[0] = 1;
+        for (int i = 1; i <= VoiceParams::Order; i++) {
+            memcpy(previous, a, sizeof(previous));
+            for (int j = 1; j < i; j++)
+                a[j] = previous[j] + k[i - 1] * previous[i - j];
+            a[i] = k[i - 1];
+        }
+    }
+
+    // the reference envelope: the same window over the same pre-emphasised speech, in double
+    void referenceLpc(const int16_t *frame, size_t frameSamples, const int16_t *lead, double *a) {
+        const size_t length = VoiceEncoder::WindowLead + frameSamples;
+        std::vector<double> x(length);
+        for (size_t i = 0; i < length; i++) {
+            const double current = i < VoiceEncoder::WindowLead ? lead[i] : frame[i - VoiceEncoder::WindowLead];
+            double previous = 0;
+            if (i > 0)
+                previous = i - 1 < VoiceEncoder::WindowLead ? lead[i - 1] : frame[i - 1 - VoiceEncoder::WindowLead];
+            x[i] = (current - 0.9375 * previous) * (0.54 - 0.46 * cos(2 * M_PI * i / (length - 1)));
+        }
+        double r[VoiceParams::Order + 1];
+        for (int k = 0; k <= VoiceParams::Order; k++) {
+            r[k] = 0;
+            for (size_t n = k; n < length; n++)
+                r[k] += x[n] * x[n - k];
+        }
+        r[0] *= 1.0001;
+        for (int i = 0; i <= VoiceParams::Order; i++)
+            a[i] = 0;
+        a[0] = 1;
+        double error = r[0];
+        double previous[VoiceParams::Order + 1];
+        for (int i = 1; i <= VoiceParams::Order && error > 0; i++) {
+            double sum = r[i];
+            for (int j = 1; j < i; j++)
+                sum += a[j] * r[i - j];
+            const double k = -sum / error;
+            memcpy(previous, a, sizeof(previous));
+            for (int j = 1; j < i; j++)
+                a[j] = previous[j] + k * previous[i - j];
+            a[i] = k;
+            error *= 1 - k * k;
+        }
+    }
+
+    // the decoder's envelope, from the LARs it was sent
+    void decodedLpc(const VoiceParams &params, double *a) {
+        double k[VoiceParams::Order];
+        for (int i = 0; i < VoiceParams::Order; i++) {
+            const double lar = fabs((double) params.lar[i]);
+            double magnitude = lar < 11059 ? 2 * lar : (lar < 20070 ? lar + 11059 : lar / 4 + 26112);
+            magnitude = fmin(magnitude, 32767) / 32768;
+            k[i] = params.lar[i] < 0 ? -magnitude : magnitude;
+        }
+        stepUp(k, a);
+    }
+
+    // rms difference in dB between the two all pole envelopes 1/|A|^2, each levelled to 0dB mean
+    double spectralDistance(const double *a, const double *b) {
+        const int points = 64;
+        double la[points], lb[points], meanA = 0, meanB = 0;
+        for (int p = 0; p < points; p++) {
+            const double w = M_PI * (p + 0.5) / points;
+            double ra = 0, ia = 0, rb = 0, ib = 0;
+            for (int j = 0; j <= VoiceParams::Order; j++) {
+                ra += a[j] * cos(w * j);
+                ia -= a[j] * sin(w * j);
+                rb += b[j] * cos(w * j);
+                ib -= b[j] * sin(w * j);
+            }
+            la[p] = -10 * log10(ra * ra + ia * ia);
+            lb[p] = -10 * log10(rb * rb + ib * ib);
+            meanA += la[p] / points;
+            meanB += lb[p] / points;
+        }
+        double sum = 0;
+        for (int p = 0; p < points; p++) {
+            const double d = (la[p] - meanA) - (lb[p] - meanB);
+            sum += d * d;
+        }
+        return sqrt(sum / points);
+    }
+
+    struct Quality {
+        double voiced;      // fraction of frames
+        double pitchHits;   // fraction of voiced frames within 5% (2 samples) of the true period
+        double levelDb;     // decoded over original
+        double distanceDb;  // mean envelope distance
+    };
+
+    Quality measure(VoiceMode mode, const Clip &clip, const Run &run) {
+        const VoiceModeInfo &info = voiceModeInfo(mode);
+        const size_t frames = run.params.size();
+        Quality quality = {0, 0, 0, 0};
+        size_t voiced = 0, hits = 0, counted = 0;
+        for (size_t f = SkipFrames; f < frames; f++) {
+            counted++;
+            const VoiceParams &params = run.params[f];
+            if (params.lag) {
+                voiced++;
+                const double centre = (f + 0.5) * info.frameSamples;
+                const double f0 = clip.f0Start + (clip.f0End - clip.f0Start) * centre / clip.samples.size();
+                const double period = f0 > 0 ? Rate / f0 : 0;
+                if (period > 0 && fabs(params.lag - period) <= fmax(2, period * 0.05)) hits++;
+            }
+            double reference[VoiceParams::Order + 1], decoded[VoiceParams::Order + 1];
+            const int16_t *frame = &clip.samples[f * info.frameSamples];
+            referenceLpc(frame, info.frameSamples, frame - VoiceEncoder::WindowLead, reference);
+            decodedLpc(params, decoded);
+            quality.distanceDb += spectralDistance(reference, decoded);
+        }
+        quality.voiced = counted ? (double) voiced / counted : 0;
+        quality.pitchHits = voiced ? (double) hits / voiced : 0;
+        quality.distanceDb /= counted ? counted : 1;
+        const size_t skip = SkipFrames * info.frameSamples;
+        const size_t count = run.decoded.size() - skip;
+        const double original = rms(&clip.samples[skip], count);
+        const double decoded = rms(&run.decoded[skip], count);
+        quality.levelDb = original > 0 && decoded > 0 ? 20 * log10(decoded / original) : 0;
+        return quality;
+    }
+
+    const char *modeName(VoiceMode mode) {
+        return mode == VoiceMode::Bits3200 ? "3200" : (mode == VoiceMode::Bits2400 ? "2400" : "1200");
+    }
+
+    void reportQuality(const char *mode, const char *clip, const Quality &quality) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%s_%s_voiced", mode, clip);
+        Sim::report(buf, quality.voiced * 100, "%");
+        snprintf(buf, sizeof(buf), "%s_%s_pitch_hits", mode, clip);
+        Sim::report(buf, quality.pitchHits * 100, "%");
+        snprintf(buf, sizeof(buf), "%s_%s_level", mode, clip);
+        Sim::report(buf, quality.levelDb, "dB");
+        snprintf(buf, sizeof(buf), "%s_%s_envelope_distance", mode, clip);
+        Sim::report(buf, quality.distanceDb, "dB");
+    }
+}
+
+SIM_BENCH(voice, "LPC vocoder at 3200/2400/1200 bit/s: pitch, voicing, level, envelope, concealment, cost") {
+    static const VoiceMode modes[] = {VoiceMode::Bits3200, VoiceMode::Bits2400, VoiceMode::Bits1200};
+    for (size_t m = 0; m < 3; m++) {
+        const VoiceModeInfo &info = voiceModeInfo(modes[m]);
+        Sim::check(info.frameBytes * 8 * 1000 == info.bitRate * info.frameMs &&
+                   info.frameSamples == VoiceSampleRate / 1000 * info.frameMs &&
+                   info.frameSamples % VoiceDecoder::SubframeSamples == 0 &&
+                   info.frameSamples <= VoiceEncoder::MaxFrameSamples &&
+                   info.frameBytes <= VoiceEncoder::MaxFrameBytes, "voice: mode frame sizes");
+    }
+
+    // the fixtures, through RIFF images and back
+    static const double aFormants[] = {730, 1090, 2440};
+    static const double iFormants[] = {270, 2290, 3010};
+    Clip clips[4] = {vowel(100, 140, aFormants, 0.5), vowel(140, 100, iFormants, 0.3), fricative(0.2), Clip()};
+    clips[3].samples.assign(ClipSamples, 0);
+    clips[3].f0Start = clips[3].f0End = 0;
+    static const char *const clipNames[] = {"a", "i", "sh", "silence"};
+    for (size_t c = 0; c < 4; c++) {
+        std::vector<int16_t> back;
+        const bool read = readWav(wavImage(clips[c].samples), back);
+        Sim::check(read && back == clips[c].samples, "voice: WAV fixture round trip");
+    }
+
+    for (size_t m = 0; m < 3; m++) {
+        const VoiceMode mode = modes[m];
+        const VoiceModeInfo &info = voiceModeInfo(mode);
+        const char *name = modeName(mode);
+        std::string label;
+
+        // bit exact from a reset: same bits, same samples
+        const Run first = code(mode, clips[0].samples);
+        const Run second = code(mode, clips[0].samples);
+        label = std::string("voice ") + name + ": deterministic";
+        Sim::check(first.bits == second.bits && first.decoded == second.decoded, label.c_str());
+        uint32_t crc = 2166136261u; // FNV-1a of the bit stream, to compare against a target run
+        for (size_t i = 0; i < first.bits.size(); i++)
+            crc = (crc ^ first.bits[i]) * 16777619u;
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%s_a_stream_fnv", name);
+        Sim::report(buf, crc, "");
+
+        for (size_t c = 0; c < 3; c++) {
+            const Run run = c == 0 ? first : code(mode, clips[c].samples);
+            const Quality quality = measure(mode, clips[c], run);
+            reportQuality(name, clipNames[c], quality);
+            if (clips[c].f0Start > 0) {
+                label = std::string("voice ") + name + " " + clipNames[c] + ": voiced";
+                Sim::check(quality.voiced >= 0.9, label.c_str());
+                label = std::string("voice ") + name + " " + clipNames[c] + ": pitch within 5%";
+                Sim::check(quality.pitchHits >= 0.9, label.c_str());
+            } else {
+                label = std::string("voice ") + name + " " + clipNames[c] + ": unvoiced";
+                Sim::check(quality.voiced <= 0.1, label.c_str());
+            }
+            label = std::string("voice ") + name + " " + clipNames[c] + ": level within 3dB";
+            Sim::check(fabs(quality.levelDb) <= 3, label.c_str());
+            label = std::string("voice ") + name + " " + clipNames[c] + ": envelope distance";
+            Sim::check(quality.distanceDb <= (mode == VoiceMode::Bits3200 ? 2.5 : 3.5), label.c_str());
+        }
+
+        // silence in, all zero levels and silence out
+        const Run quiet = code(mode, clips[3].samples);
+        bool silent = true;
+        for (size_t f = 0; f < quiet.params.size(); f++)
+            silent = silent && quiet.params[f].rms[0] == 0 && quiet.params[f].rms[1] == 0;
+        label = std::string("voice ") + name + ": silence stays silent";
+        Sim::check(silent && rms(&quiet.decoded[0], quiet.decoded.size()) == 0, label.c_str());
+
+        // lost frames fade out over ConcealFrames, then silence
+        {
+            VoiceDecoder decoder(mode);
+            std::vector<int16_t> out(info.frameSamples);
+            const size_t frames = first.params.size();
+            for (size_t f = 0; f < frames / 2; f++)
+                decoder.decode(&first.bits[f * info.frameBytes], &out[0]);
+            double level = rms(&out[0], out.size());
+            const double before = level;
+            bool fading = true;
+            for (uint8_t lost = 1; lost <= VoiceDecoder::ConcealFrames + 2; lost++) {
+                decoder.conceal(&out[0]);
+                const double now = rms(&out[0], out.size());
+                fading = fading && now < level * 0.9 + 1;
+                level = now;
+            }
+            label = std::string("voice ") + name + ": concealment fades to silence";
+            Sim::check(fading && level == 0, label.c_str());
+            decoder.decode(&first.bits[(frames / 2) * info.frameBytes], &out[0]);
+            label = std::string("voice ") + name + ": decoding resumes after a loss";
+            Sim::check(rms(&out[0], out.size()) > before * 0.1, label.c_str());
+        }
+
+        // encode + decode per frame against the frame's duration, best of five passes over /a/
+        const size_t frames = clips[0].samples.size() / info.frameSamples;
+        uint64_t best = 0;
+        for (int pass = 0; pass < 5; pass++) {
+            VoiceEncoder encoder(mode);
+            VoiceDecoder decoder(mode);
+            uint8_t bits[VoiceEncoder::MaxFrameBytes];
+            int16_t out[VoiceEncoder::MaxFrameSamples];
+            const uint64_t start = Sim::hostNanos();
+            for (size_t f = 0; f < frames; f++) {
+                encoder.encode(&clips[0].samples[f * info.frameSamples], bits);
+                decoder.decode(bits, out);
+            }
+            const uint64_t nanos = Sim::hostNanos() - start;
+            if (!pass || nanos < best) best = nanos;
+        }
+        const double micros = best / 1000.0 / frames;
+        snprintf(buf, sizeof(buf), "%s_host_per_%ums_frame", name, (unsigned int) info.frameMs);
+        Sim::report(buf, micros, "us");
+        snprintf(buf, sizeof(buf), "%s_host_real_time", name);
+        Sim::report(buf, micros / (info.frameMs * 1000.0) * 100, "%");
+        label = std::string("voice ") + name + ": faster than real time";
+        Sim::check(micros < info.frameMs * 1000.0, label.c_str());
+    }
+
+    // a recording, when there is one
+    const char *path = getenv("STEGOS_VOICE_WAV");
+    if (path) {
+        std::vector<uint8_t> image;
+        FILE *file = fopen(path, "rb");
+        if (file) {
+            uint8_t chunk[4096];
+            size_t got;
+            while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0)
+                image.insert(image.end(), chunk, chunk + got);
+            fclose(file);
+        }
+        Clip recording;
+        recording.f0Start = recording.f0End = 0;
+        Sim::check(readWav(image, recording.samples), "voice: STEGOS_VOICE_WAV is 8 kHz mono 16 bit PCM");
+        for (size_t m = 0; m < 3 && recording.samples.size() >= 8 * VoiceEncoder::MaxFrameSamples; m++) {
+            const Run run = code(modes[m], recording.samples);
+            const Quality quality = measure(modes[m], recording, run);
+            char buf[64];
+            snprintf(buf, sizeof(buf), "%s_recording_voiced", modeName(modes[m]));
+            Sim::report(buf, quality.voiced * 100, "%");
+            snprintf(buf, sizeof(buf), "%s_recording_level", modeName(modes[m]));
+            Sim::report(buf, quality.levelDb, "dB");
+            snprintf(buf, sizeof(buf), "%s_recording_envelope_distance", modeName(modes[m]));
+            Sim::report(buf, quality.distanceDb, "dB");
+        }
+    }
+}
@@ -0,0 +1,333 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+// X25519 key agreement: RFC 7748 test vectors, the ladder stopped and resumed at any step, two key
+// exchanges keying each other's ciphers, total time and worst slice time against slice size, and how
+// long an equal priority task waits on it under the scheduler
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "sim.h"
+#include "bench.h"
+#include "stegophone.h"
+#include "console.h"
+#include "chacha20poly1305.h"
+#include "x25519.h"
+#include "keyexchange.h"
+#include "framecipher.h"
+#include "taskmanager.h"
+#include "rtos.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using namespace StegoPhone;
+
+namespace {
+    void fromHex(const char *hex, uint8_t *out) {
+        for (size_t i = 0; hex[0] && hex[1]; hex += 2, i++) {
+            unsigned int value;
+            sscanf(hex, "%2x", &value);
+            out[i] = (uint8_t) value;
+        }
+    }
+
+    bool same(const uint8_t *bytes, const char *hex) {
+        uint8_t expected[32];
+        fromHex(hex, expected);
+        return memcmp(bytes, expected, 32) == 0;
+    }
+
+    uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return 0;
+#endif
+    }
+
+    const char *AlicePrivate = "77076d0a7318a57d3c16c17251b26645df4c2f87ebc0992ab177fba51db92c2a";
+    const char *AlicePublic = "8520f0098930a754748b7ddcb43ef75a0dbf3a0d26381af4eba4a98eaa9b4e6a";
+    const char *BobPrivate = "5dab087e624a8a4b79e17f8b83800ee66f3bb1292618b6fd1c2f8b27ff88e0eb";
+    const char *BobPublic = "de9edb7d7b7dc1b4d35b61c2ece435373f8343c85b78674dadfc7e146f882b4f";
+    const char *Shared = "4a5d9d5ba4ce2de1728e3bf480350f25e07e21c947d19e3376f09b3c1e161742";
+
+    void vectors() {
+        uint8_t scalar[32], point[32], out[32];
+
+        // RFC 7748 5.2: the second u has its top bit set, which must be ignored
+        fromHex("a546e36bf0527c9d3b16154b82465edd62144c0ac1fc5a18506a2244ba449ac4", scalar);
+        fromHex("e6db6867583030db3594c1a424b15f7c726624ec26b3353b10a903a6d0ab1c4c", point);
+        Sim::check(Crypto::X25519::compute(out, scalar, point) &&
+                   same(out, "c3da55379de9c6908e94ea4df28d084f32eccf03491c71f754b4075577a28552"),
+                   "RFC 7748 5.2 vector 1");
+        fromHex("4b66e9d4d1b4673c5ad22691957d6af5c11b6421e0ea01d42ca4169e7918ba0d", scalar);
+        fromHex("e5210f12786811d3f4b7959d0538ae2c31dbe7106fc03c3efc4cd549c715a493", point);
+        Sim::check(Crypto::X25519::compute(out, scalar, point) &&
+                   same(out, "95cbde9476e8907d7aade45cb4b873f88b595a68799fa152e6f8f7647aac7957"),
+                   "RFC 7748 5.2 vector 2");
+
+        // 5.2 iterated: k = X25519(k, u), u = old k, from k = u = 9
+        uint8_t k[32] = {9}, u[32] = {9};
+        bool iterated = true;
+        for (uint16_t i = 1; i <= 1000; i++) {
+            Crypto::X25519::compute(out, k, u);
+            memcpy(u, k, 32);
+            memcpy(k, out, 32);
+            if (i == 1)
+                iterated = same(k, "422c8e7a6227d7bca1350b3e2bb7279f7897b87bb6854b783c60e80311ae3079");
+        }
+        Sim::check(iterated, "RFC 7748 5.2 after one iteration");
+        Sim::check(same(k, "684cf59ba83309552800ef566f2f4d3c1c3887c49360e3875f2eb94d99532c51"),
+                   "RFC 7748 5.2 after 1000 iterations");
+
+        // 6.1 Diffie-Hellman
+        fromHex(AlicePrivate, scalar);
+        Crypto::X25519::compute(out, scalar, Crypto::X25519::BasePoint);
+        Sim::check(same(out, AlicePublic), "RFC 7748 6.1 Alice's public key");
+        fromHex(BobPublic, point);
+        Sim::check(Crypto::X25519::compute(out, scalar, point) && same(out, Shared), "RFC 7748 6.1 Alice's shared");
+        fromHex(BobPrivate, scalar);
+        Crypto::X25519::compute(out, scalar, Crypto::X25519::BasePoint);
+        Sim::check(same(out, BobPublic), "RFC 7748 6.1 Bob's public key");
+        fromHex(AlicePublic, point);
+        Sim::check(Crypto::X25519::compute(out, scalar, point) && same(out, Shared), "RFC 7748 6.1 Bob's shared");
+
+        // a small order point gives all zeros, which the caller has to refuse
+        memset(point, 0, sizeof(point));
+        Sim::check(!Crypto::X25519::compute(out, scalar, point), "small order point refused");
+
+        // HChaCha20, draft-irtf-cfrg-xchacha 2.2.1
+        uint8_t key[32], nonce[16];
+        for (uint8_t i = 0; i < 32; i++)
+            key[i] = i;
+        fromHex("000000090000004a0000000031415927", nonce);
+        Crypto::hchacha20(key, nonce, out);
+        Sim::check(same(out, "82413b4227b27bfed30e42508a877d73a0f9e4d58a74a853c12ec41326d3ecdc"), "HChaCha20 vector");
+    }
+
+    // stopped after every n steps and resumed, the answer does not change
+    void resumable() {
+        uint8_t scalar[32], point[32], out[32];
+        fromHex(AlicePrivate, scalar);
+        fromHex(BobPublic, point);
+        static const uint16_t sizes[] = {1, 7, 16, 64, Crypto::X25519::TotalSteps};
+        bool ok = true;
+        for (uint8_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            Crypto::X25519 job;
+            job.begin(scalar, point);
+            uint16_t calls = 0;
+            while (!job.step(sizes[s]))
+                calls++;
+            ok = ok && job.result(out) && same(out, Shared) && job.stepsLeft() == 0 &&
+                 calls + 1 == (Crypto::X25519::TotalSteps + sizes[s] - 1) / sizes[s];
+        }
+        Sim::check(ok, "same result whatever the slice size");
+    }
+
+    // total time for one multiplication, and the worst slice for a range of slice sizes
+    void timing() {
+        uint8_t scalar[32], out[32];
+        fromHex(AlicePrivate, scalar);
+        Crypto::X25519::compute(out, scalar, Crypto::X25519::BasePoint);
+        uint64_t best = UINT64_MAX, bestCycles = UINT64_MAX;
+        uint64_t start, startCycles;
+        for (int r = 0; r < 20; r++) {
+            start = Sim::hostNanos();
+            startCycles = cycles();
+            Crypto::X25519::compute(out, scalar, Crypto::X25519::BasePoint);
+            const uint64_t spent = cycles() - startCycles;
+            const uint64_t nanos = Sim::hostNanos() - start;
+            if (nanos < best) best = nanos;
+            if (spent < bestCycles) bestCycles = spent;
+        }
+        Sim::report("x25519_host", best / 1000.0, "us");
+        if (bestCycles) Sim::report("x25519_tsc_host", (double) bestCycles, "cycles");
+
+        // the host takes the CPU away now and then (a scheduler tick is milliseconds), so each size runs
+        // several times and reports its best run's worst slice
+        static const uint16_t sizes[] = {1, 4, 16, 64, Crypto::X25519::TotalSteps};
+        const int runs = 9;
+        char label[64];
+        for (uint8_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            uint64_t worst = UINT64_MAX, worstCycles = UINT64_MAX;
+            for (int r = 0; r < runs; r++) {
+                Crypto::X25519 job;
+                job.begin(scalar, Crypto::X25519::BasePoint);
+                uint64_t runWorst = 0, runWorstCycles = 0;
+                bool done = false;
+                while (!done) {
+                    start = Sim::hostNanos();
+                    startCycles = cycles();
+                    done = job.step(sizes[s]);
+                    const uint64_t sliceCycles = cycles() - startCycles;
+                    const uint64_t slice = Sim::hostNanos() - start;
+                    if (slice > runWorst) runWorst = slice;
+                    if (sliceCycles > runWorstCycles) runWorstCycles = sliceCycles;
+                }
+                if (runWorst < worst) worst = runWorst;
+                if (runWorstCycles < worstCycles) worstCycles = runWorstCycles;
+            }
+            snprintf(label, sizeof(label), "slice_%u_steps_worst_host", (unsigned int) sizes[s]);
+            Sim::report(label, worst / 1000.0, "us");
+            if (worstCycles) {
+                snprintf(label, sizeof(label), "slice_%u_steps_worst_tsc_host", (unsigned int) sizes[s]);
+                Sim::report(label, (double) worstCycles, "cycles");
+            }
+        }
+    }
+
+    // two ends, polled: each key exchange keys its cipher, and the ciphers talk to each other
+    void exchange() {
+        FrameCipher alice, bob;
+        KeyExchange aliceKeys(alice), bobKeys(bob);
+        uint8_t secret[32], alicePublic[32], bobPublic[32];
+        fromHex(AlicePrivate, secret);
+        aliceKeys.begin(secret, true);
+        fromHex(BobPrivate, secret);
+        bobKeys.begin(secret, false);
+        Sim::check(!aliceKeys.publicKey(alicePublic), "no public key before it is computed");
+        while (aliceKeys.slice()) {
+        }
+        while (bobKeys.slice()) {
+        }
+        Sim::check(aliceKeys.state() == KeyExchangeState::WaitingPeer && aliceKeys.publicKey(alicePublic) &&
+                   same(alicePublic, AlicePublic), "Alice's public key");
+        Sim::check(bobKeys.publicKey(bobPublic) && same(bobPublic, BobPublic), "Bob's public key");
+        aliceKeys.peerKey(bobPublic);
+        bobKeys.peerKey(alicePublic);
+        while (aliceKeys.slice()) {
+        }
+        while (bobKeys.slice()) {
+        }
+        Sim::check(aliceKeys.state() == KeyExchangeState::Established &&
+                   bobKeys.state() == KeyExchangeState::Established && alice.keyed() && bob.keyed(),
+                   "both ends established");
+        const uint16_t expectedSlices = 2 * ((Crypto::X25519::TotalSteps + KeyExchange::DefaultSliceSteps - 1) /
+                                             KeyExchange::DefaultSliceSteps);
+        Sim::check(aliceKeys.slices() == expectedSlices, "slices of DefaultSliceSteps");
+        Sim::report("keyx_public_host", aliceKeys.publicMicros(), "us");
+        Sim::report("keyx_shared_host", aliceKeys.sharedMicros(), "us");
+        Sim::report("keyx_max_slice_host", aliceKeys.maxSliceMicros(), "us");
+
+        ModemFrame frame;
+        frame.type = ModemFrameType::Data;
+        memcpy(FrameCipher::payload(&frame), "hello", 5);
+        Sim::check(alice.seal(&frame, 5) && bob.open(&frame) && frame.length == 5 &&
+                   memcmp(FrameCipher::payload(&frame), "hello", 5) == 0, "agreed keys open each other's frames");
+
+        // a peer sending a small order point gets nowhere
+        FrameCipher carol;
+        KeyExchange carolKeys(carol);
+        carolKeys.begin(secret, true);
+        while (carolKeys.slice()) {
+        }
+        uint8_t zero[32] = {0};
+        carolKeys.peerKey(zero);
+        while (carolKeys.slice()) {
+        }
+        Sim::check(carolKeys.state() == KeyExchangeState::Failed && !carol.keyed() && carolKeys.failed() == 1,
+                   "small order peer key fails the exchange");
+        carolKeys.abort();
+        carolKeys.slice();
+        Sim::check(carolKeys.state() == KeyExchangeState::Idle, "abort goes back to idle");
+    }
+
+    // an equal priority task ticking every ms while the firmware's key task runs: whether it gets in
+    // between slices of one multiplication, and how late it gets. Both sit above whatever tasks earlier
+    // scenarios left running, so what happens is down to the key task alone.
+    const uint8_t ProbePriority = 4;
+    const uint32_t ProbePeriodMs = 1;
+
+    struct Probe {
+        KeyExchange *keys;
+        uint32_t last;
+        uint32_t worstGap;
+        uint32_t ticks;
+        uint32_t midTicks; // ticks with a multiplication half done
+    };
+
+    void probeStep(void *context, uint32_t notifications) {
+        Probe *probe = (Probe *) context;
+        const uint32_t now = HAL::micros();
+        if (probe->ticks && now - probe->last > probe->worstGap) probe->worstGap = now - probe->last;
+        probe->last = now;
+        probe->ticks++;
+        const KeyExchangeState state = probe->keys->state();
+        if (state == KeyExchangeState::ComputingPublic || state == KeyExchangeState::ComputingShared)
+            probe->midTicks++;
+    }
+
+    // over a few back to back exchanges. The gap and the slices are host time, where a thread handoff
+    // now and then waits out a host scheduler tick, so they are reported and not checked; the
+    // mid-multiplication count only depends on the simulated scheduler.
+    void scheduled(KeyExchange *keys, uint16_t sliceSteps, uint32_t &worstGap, uint32_t &maxSlice,
+                   uint32_t &midTicks) {
+        uint8_t secret[32], peer[32];
+        fromHex(AlicePrivate, secret);
+        fromHex(BobPublic, peer);
+        keys->setSliceSteps(sliceSteps);
+        worstGap = 0;
+        maxSlice = 0;
+        midTicks = 0;
+        Probe probe = {keys, 0, 0, 0, 0};
+        const TaskSpec spec = {"probe", ProbePriority, 256, TaskTrigger::Periodic, ProbePeriodMs, probeStep, &probe};
+        ManagedTask *task = TaskManager::getInstance()->start(spec);
+        if (!Sim::check(task != 0, "probe task created")) return;
+        keys->resetStats();
+        HAL::delay(3);
+        for (int exchange = 0; exchange < 12; exchange++) {
+            // the state still reads Established until the task takes up begin(): count instead
+            const uint32_t established = keys->established();
+            keys->begin(secret, true);
+            keys->peerKey(peer);
+            for (int i = 0; i < 200 && keys->established() == established; i++)
+                HAL::delay(1);
+            Sim::check(keys->established() == established + 1, "key task established");
+        }
+        HAL::delay(3);
+        TaskManager::getInstance()->stop(task);
+        worstGap = probe.worstGap;
+        maxSlice = keys->maxSliceMicros();
+        midTicks = probe.midTicks;
+    }
+}
+
+SIM_BENCH(x25519, "X25519: RFC 7748 vectors, resumable ladder, total and worst slice time, key exchange") {
+    vectors();
+    resumable();
+    timing();
+    exchange();
+
+    // the firmware's key exchange on its own task, sleeping between slices
+    Sim::bootOnce();
+    KeyExchange *keys = StegoPhone::StegoPhone::getInstance()->keyExchange();
+    RTOS::startScheduler();
+    if (Sim::check(keys->startTask(ProbePriority), "key task created")) {
+        uint32_t slicedGap, maxSlice, slicedMid, wholeGap, wholeSlice, wholeMid;
+        scheduled(keys, KeyExchange::DefaultSliceSteps, slicedGap, maxSlice, slicedMid);
+        const uint32_t exchangeMicros = keys->publicMicros() + keys->sharedMicros();
+        scheduled(keys, Crypto::X25519::TotalSteps, wholeGap, wholeSlice, wholeMid);
+        Sim::report("task_max_slice_host", maxSlice, "us");
+        Sim::report("task_exchange_cpu_host", exchangeMicros, "us");
+        Sim::report("probe_worst_gap_sliced_host", slicedGap, "us");
+        Sim::report("probe_worst_gap_unsliced_host", wholeGap, "us");
+        Sim::report("probe_ticks_mid_multiplication_sliced", slicedMid, "ticks");
+        Sim::check(slicedMid > 0, "other tasks run between slices");
+        Sim::check(wholeMid == 0, "unsliced, nothing runs until a multiplication is done");
+        keys->setSliceSteps(KeyExchange::DefaultSliceSteps);
+        keys->abort();
+        HAL::delay(2);
+        keys->stopTask();
+    }
+
+    const uint32_t before = Sim::console().bytesWritten;
+    Console::getInstance()->execute("keyx");
+    Sim::check(Sim::console().bytesWritten > before, "keyx console command prints");
+}
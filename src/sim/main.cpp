@@ -0,0 +1,135 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+// native env entry point: runs the registered simulator scenarios
+//   program [-v] [bench ...]
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "sim.h"
+#include "bench.h"
+#include "stegophone.h"
+#include "log.h"
+
+namespace StegoPhone {
+    namespace Sim {
+        struct Bench {
+            const char *name;
+            const char *description;
+            BenchFunction function;
+        };
+
+        static std::vector<Bench> &benches() {
+            static std::vector<Bench> list;
+            return list;
+        }
+
+        static const char *currentBench = "";
+        static int failures = 0;
+
+        BenchRegistrar::BenchRegistrar(const char *name, const char *description, BenchFunction function) {
+            Bench bench;
+            bench.name = name;
+            bench.description = description;
+            bench.function = function;
+            benches().push_back(bench);
+        }
+
+        void report(const char *label, double value, const char *unit) {
+            printf("%s.%-36s %14.3f %s\n", currentBench, label, value, unit);
+            fflush(stdout);
+        }
+
+        bool check(bool condition, const char *what) {
+            if (!condition) {
+                printf("%s: CHECK FAILED: %s\n", currentBench, what);
+                failures++;
+            }
+            return condition;
+        }
+
+        BootTimes &bootTimesFor() {
+            static BootTimes times = {0, 0};
+            return times;
+        }
+
+        void bootOnce() {
+            static bool booted = false;
+            if (booted) return;
+            booted = true;
+            StegoPhone *stego = StegoPhone::getInstance();
+            const uint32_t simStart = HAL::micros();
+            const uint64_t hostStart = hostMicros();
+            stego->setup();
+            // the scheduler starts after setup(), as on the board, so the boot jobs get tasks of their own;
+            // the boot sequence runs from the timer wheel, serviced by loop() on this task
+            RTOS::startScheduler();
+            for (int i = 0; i < 10000 && stego->booting(); i++) {
+                HAL::delay(1);
+                stego->loop();
+            }
+            // when Ready was entered, from the status trace rather than this loop's 1ms steps
+            StatusMachine::TraceEntry entry;
+            if (stego->status() == StegoStatus::Ready && stego->statusMachine()->recent(0, entry)) {
+                bootTimesFor().readySimMicros = entry.micros - simStart;
+                bootTimesFor().readyHostMicros = hostMicros() - hostStart;
+            }
+            // the settings dump queued at power up; scenarios start with the RN52 line quiet
+            RN52 *rn52 = RN52::getInstance();
+            for (int i = 0; i < 1000 && !rn52->commands()->idle(); i++) {
+                HAL::delay(1);
+                stego->loop();
+            }
+        }
+
+        const BootTimes &bootTimes() {
+            return bootTimesFor();
+        }
+
+        uint64_t hostNanos() {
+            return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    using namespace StegoPhone::Sim;
+    std::vector<const char *> selected;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            console().echo = true;
+        } else if (strcmp(argv[i], "-l") == 0) {
+            for (size_t b = 0; b < benches().size(); b++)
+                printf("%-16s %s\n", benches()[b].name, benches()[b].description);
+            return 0;
+        } else {
+            selected.push_back(argv[i]);
+        }
+    }
+
+    int ran = 0;
+    for (size_t b = 0; b < benches().size(); b++) {
+        bool wanted = selected.empty();
+        for (size_t s = 0; s < selected.size(); s++)
+            wanted = wanted || (strcmp(selected[s], benches()[b].name) == 0);
+        if (!wanted) continue;
+        currentBench = benches()[b].name;
+        benches()[b].function();
+        // stands in for the log task
+        StegoPhone::Log::drain(console());
+        ran++;
+    }
+    if (ran == 0) {
+        printf("no matching scenario, -l lists them\n");
+        return 2;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,299 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#ifndef _SIM_H_
+#define _SIM_H_
+
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "hal.h"
+
+// Host simulation of the StegoPhone board (native env). The clock runs in real time, except that
+// delay() warps it forward instead of sleeping, so boot countdowns cost nothing while busy-polls
+// and serial transfers still take (simulated) wall time.
+
+namespace StegoPhone {
+    namespace Sim {
+        // CLOCK
+        //================================================================================================
+        uint64_t nowMicros();
+
+        void warp(uint64_t us);
+
+        // host time, excluding warps; used to measure CPU cost of the code under test
+        uint64_t hostMicros();
+
+        // DEVICES
+        //================================================================================================
+        class Device {
+        public:
+            virtual ~Device() {
+            }
+
+            // byte written by the firmware towards the device
+            virtual void receive(uint8_t c) {
+            }
+
+            // firmware changed the level of an output pin
+            virtual void pinChanged(uint8_t pin, bool level) {
+            }
+
+            // advance device state to the current simulated time
+            virtual void tick(uint64_t nowUs) {
+            }
+        };
+
+        void addDevice(Device *device);
+
+        // ticks every device; called whenever the firmware looks at time or serial state
+        void poll();
+
+        // UART
+        //================================================================================================
+        // firmware side of a simulated UART. Bytes sent by the attached device are paced at the
+        // configured baud rate (10 bit times per byte) and become readable once they are due.
+        class SerialLink : public HAL::SerialPort {
+        public:
+            SerialLink(const char *name);
+
+            void attach(Device *device);
+
+            void begin(uint32_t baud) override;
+
+            int available() override;
+
+            int read() override;
+
+            size_t write(uint8_t c) override;
+
+            using HAL::SerialPort::write;
+
+            // device side
+            void deviceSend(const char *data, uint64_t delayUs = 0);
+
+            void deviceSend(const uint8_t *data, size_t length, uint64_t delayUs = 0);
+
+            uint64_t byteTimeUs() const;
+
+            const char *name() const;
+
+            uint64_t bytesToDevice;
+            uint64_t bytesFromDevice;
+
+        protected:
+            struct Pending {
+                uint64_t dueUs;
+                uint8_t c;
+            };
+
+            const char *_name;
+            Device *_device;
+            uint32_t _baud;
+            uint64_t _lineFreeUs;
+            std::deque<Pending> _rx;
+        };
+
+        // console; echoes to stdout unless quiet, input can be injected
+        class ConsoleLink : public HAL::SerialPort {
+        public:
+            ConsoleLink();
+
+            void begin(uint32_t baud) override;
+
+            int available() override;
+
+            int read() override;
+
+            size_t write(uint8_t c) override;
+
+            using HAL::SerialPort::write;
+
+            void inject(const char *input);
+
+            bool echo;
+            uint64_t bytesWritten;
+
+        protected:
+            std::deque<uint8_t> _input;
+        };
+
+        SerialLink &rn52Link();
+
+        SerialLink &esp8266Link();
+
+        ConsoleLink &console();
+
+        // GPIO
+        //================================================================================================
+        // drive an input pin from a device; fires an attached interrupt handler on a matching edge
+        void drivePin(uint8_t pin, bool level);
+
+        bool pinLevel(uint8_t pin);
+
+        // RN52
+        //================================================================================================
+        class RN52Device : public Device {
+        public:
+            RN52Device(SerialLink &link, uint8_t enablePin, uint8_t interruptPin);
+
+            void receive(uint8_t c) override;
+
+            void pinChanged(uint8_t pin, bool level) override;
+
+            void tick(uint64_t nowUs) override;
+
+            // change the status word and pull the event line low for 100ms, like a call event
+            void raiseEvent(uint16_t status);
+
+            bool powered() const;
+
+            uint32_t bootMs;
+            uint32_t commandsHandled;
+
+        protected:
+            void execute();
+
+            SerialLink &_link;
+            uint8_t _enablePin;
+            uint8_t _interruptPin;
+            bool _powered;
+            uint16_t _status;
+            uint64_t _releaseInterruptUs;
+            std::string _line;
+        };
+
+        // ESP8266
+        //================================================================================================
+        // AT firmware stand-in: echo (ATE0), AT+GMR, AT+CIPMUX, AT+CIPSTART/AT+CIPCLOSE and AT+CIPSEND with
+        // its prompt. A script replaces the reply to one command; URCs and +IPD payloads go out at any time.
+        class ESP8266Device : public Device {
+        public:
+            ESP8266Device(SerialLink &link);
+
+            void receive(uint8_t c) override;
+
+            // answer command with reply (after the echo, if on) instead of the built in response
+            void script(const char *command, const char *reply, uint64_t delayUs = 0);
+
+            void clearScripts();
+
+            void sendUnsolicited(const char *data, uint64_t delayUs = 0);
+
+            // "+IPD,<link>,<length>:" (no link without AT+CIPMUX=1) and the payload
+            void sendIPD(uint8_t link, const uint8_t *data, size_t length, uint64_t delayUs = 0);
+
+            uint32_t commandsHandled;
+            std::string sendPayloads; // what AT+CIPSEND wrote, in order
+
+        protected:
+            struct Script {
+                std::string command;
+                std::string reply;
+                uint64_t delayUs;
+            };
+
+            void execute();
+
+            SerialLink &_link;
+            std::string _line;
+            bool _echo;
+            bool _multiplexed;
+            size_t _sendRemaining; // payload bytes still expected after the prompt
+            size_t _sendLength;
+            std::vector<Script> _scripts;
+        };
+
+        RN52Device &rn52Device();
+
+        ESP8266Device &esp8266Device();
+
+        // DISPLAY
+        //================================================================================================
+        // in-memory SSD1322 behind the transport: keeps what the panel shows, in the Display tile layout,
+        // and counts what would go over the wire. With wireBitsPerSecond set, a send also takes that long
+        // on the simulated clock; a task doing it is blocked meanwhile, as on DMA.
+        class PanelTransport : public HAL::DisplayTransport {
+        public:
+            // column, row and write RAM commands with their arguments
+            static const size_t CommandBytes = 7;
+
+            PanelTransport();
+
+            void sendTiles(const uint8_t *buffer, uint8_t tileX, uint8_t tileY, uint8_t tileWidth) override;
+
+            bool panelPixel(int16_t x, int16_t y) const;
+
+            uint32_t wireBitsPerSecond;
+            uint64_t spansSent;
+            uint64_t bytesSent;
+
+        protected:
+            uint8_t _panel[HAL::Display::BufferSize];
+            uint64_t _owedMicros;
+        };
+
+        PanelTransport &panel();
+
+        // U8g2 stand-in: same buffer layout, sendBuffer() goes through the panel transport
+        class FrameBufferDisplay : public HAL::Display {
+        public:
+            FrameBufferDisplay();
+
+            void begin() override;
+
+            void setFont(HAL::Font font) override;
+
+            void clear() override;
+
+            void clearBuffer() override;
+
+            void drawStr(int16_t x, int16_t y, const char *str) override;
+
+            void sendBuffer() override;
+
+            uint8_t *getBufferPtr() override;
+
+            bool pixel(int16_t x, int16_t y) const;
+
+            uint64_t framesSent;
+
+        protected:
+            void setPixel(int16_t x, int16_t y, bool on);
+
+            HAL::Font _font;
+            uint8_t _buffer[BufferSize];
+        };
+
+        FrameBufferDisplay &frameBuffer();
+
+        // BOARD
+        //================================================================================================
+        // how long the blocking inits take on the simulated board, each a HAL::delay(): the clock warps
+        // while nothing else can run, and only the calling task waits once the scheduler runs
+        struct InitDelays {
+            uint32_t displayMs; // SSD1322 reset and init sequence
+            uint32_t cardMs;    // SD card power up and ACMD41 until it is ready
+            uint32_t usbMs;     // USB host controller and PHY reset
+        };
+
+        InitDelays &initDelays();
+
+        // USB
+        //================================================================================================
+        // delivered to the keyboard callbacks by the next HAL::usbTask()
+        void pressKey(int unicode);
+
+        void pressExtrasKey(uint32_t top, uint16_t key);
+
+        void moveMouse(const HAL::MouseReport &report);
+    }
+}
+
+#endif //_SIM_H_
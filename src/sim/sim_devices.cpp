@@ -0,0 +1,191 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "sim.h"
+
+namespace StegoPhone {
+    namespace Sim {
+        // RN52
+        //================================================================================================
+        RN52Device::RN52Device(SerialLink &link, uint8_t enablePin, uint8_t interruptPin) : _link(link) {
+            this->_enablePin = enablePin;
+            this->_interruptPin = interruptPin;
+            this->_powered = false;
+            this->_status = 0x0000;
+            this->_releaseInterruptUs = 0;
+            this->bootMs = 50;
+            this->commandsHandled = 0;
+            drivePin(interruptPin, true); // event line idles high
+        }
+
+        void RN52Device::pinChanged(uint8_t pin, bool level) {
+            if (pin != this->_enablePin || level == this->_powered) return;
+            this->_powered = level;
+            this->_line.clear();
+            if (this->_powered)
+                this->_link.deviceSend("CMD\r\n", (uint64_t) this->bootMs * 1000);
+        }
+
+        void RN52Device::receive(uint8_t c) {
+            if (!this->_powered) return;
+            if (c == '\r' || c == '\n') {
+                if (!this->_line.empty()) this->execute();
+                this->_line.clear();
+            } else {
+                this->_line += (char) c;
+            }
+        }
+
+        void RN52Device::tick(uint64_t nowUs) {
+            if (this->_releaseInterruptUs != 0 && nowUs >= this->_releaseInterruptUs) {
+                this->_releaseInterruptUs = 0;
+                drivePin(this->_interruptPin, true);
+            }
+        }
+
+        void RN52Device::raiseEvent(uint16_t status) {
+            this->_status = status;
+            if (!this->_powered) return;
+            this->_releaseInterruptUs = nowMicros() + 100000;
+            drivePin(this->_interruptPin, false);
+        }
+
+        bool RN52Device::powered() const {
+            return this->_powered;
+        }
+
+        void RN52Device::execute() {
+            this->commandsHandled++;
+            const char cmd = this->_line[0];
+            if (this->_line == "D") {
+                this->_link.deviceSend("*** Settings ***\r\n"
+                                       "BTA=0006664B2D1C\r\n"
+                                       "BTName=StegoPhone-2D1C\r\n"
+                                       "Authen=1\r\n"
+                                       "COD=240704\r\n"
+                                       "DiscoveryMask=FF\r\n"
+                                       "ConnectionMask=FF\r\n"
+                                       "Extended Features=0004\r\n"
+                                       "Audio Route=00\r\n"
+                                       "MAX_Volume=0F\r\n"
+                                       "ToneVolume=0F\r\n"
+                                       "END\r\n");
+            } else if (this->_line == "Q") {
+                char reply[8];
+                snprintf(reply, sizeof(reply), "%04X\r\n", this->_status);
+                this->_link.deviceSend(reply);
+                this->_status &= 0x0FFF; // event bits clear once read
+            } else if (this->_line == "V") {
+                this->_link.deviceSend("RN52 v1.16 02/11/2014 (c) Microchip Technology\r\n");
+            } else if (cmd == 'S' || cmd == 'A' || cmd == 'B' || cmd == 'C' || cmd == 'E' || cmd == 'K' ||
+                       cmd == 'R' || cmd == '@' || cmd == '#') {
+                this->_link.deviceSend("AOK\r\n");
+            } else {
+                this->_link.deviceSend("?\r\n");
+            }
+        }
+
+        // ESP8266
+        //================================================================================================
+        ESP8266Device::ESP8266Device(SerialLink &link) : _link(link) {
+            this->commandsHandled = 0;
+            this->_echo = true; // the default after boot
+            this->_multiplexed = false;
+            this->_sendRemaining = 0;
+            this->_sendLength = 0;
+        }
+
+        void ESP8266Device::receive(uint8_t c) {
+            if (this->_sendRemaining > 0) {
+                this->sendPayloads += (char) c;
+                if (--this->_sendRemaining == 0) {
+                    char reply[48];
+                    snprintf(reply, sizeof(reply), "\r\nRecv %u bytes\r\n\r\nSEND OK\r\n",
+                             (unsigned) this->_sendLength);
+                    this->_link.deviceSend(reply);
+                }
+                return;
+            }
+            if (c == '\n') {
+                if (!this->_line.empty() && this->_line[this->_line.size() - 1] == '\r')
+                    this->_line.erase(this->_line.size() - 1);
+                if (!this->_line.empty()) this->execute();
+                this->_line.clear();
+            } else {
+                this->_line += (char) c;
+            }
+        }
+
+        void ESP8266Device::script(const char *command, const char *reply, uint64_t delayUs) {
+            Script entry;
+            entry.command = command;
+            entry.reply = reply;
+            entry.delayUs = delayUs;
+            this->_scripts.push_back(entry);
+        }
+
+        void ESP8266Device::clearScripts() {
+            this->_scripts.clear();
+        }
+
+        void ESP8266Device::sendUnsolicited(const char *data, uint64_t delayUs) {
+            this->_link.deviceSend(data, delayUs);
+        }
+
+        void ESP8266Device::sendIPD(uint8_t link, const uint8_t *data, size_t length, uint64_t delayUs) {
+            char header[32];
+            if (this->_multiplexed) snprintf(header, sizeof(header), "\r\n+IPD,%u,%u:", link, (unsigned) length);
+            else snprintf(header, sizeof(header), "\r\n+IPD,%u:", (unsigned) length);
+            this->_link.deviceSend(header, delayUs);
+            this->_link.deviceSend(data, length);
+        }
+
+        void ESP8266Device::execute() {
+            this->commandsHandled++;
+            if (this->_echo) {
+                this->_link.deviceSend(this->_line.c_str());
+                this->_link.deviceSend("\r\n");
+            }
+            for (size_t i = 0; i < this->_scripts.size(); i++) {
+                if (this->_scripts[i].command != this->_line) continue;
+                this->_link.deviceSend(this->_scripts[i].reply.c_str(), this->_scripts[i].delayUs);
+                return;
+            }
+            const std::string &line = this->_line;
+            // CONNECT / CLOSED carry the link id with AT+CIPMUX=1
+            const std::string prefix = this->_multiplexed ? line.substr(line.find('=') + 1, 1) + "," : "";
+            if (line == "AT+GMR") {
+                this->_link.deviceSend("AT version:1.2.0.0(Jul  1 2016 20:04:45)\r\n"
+                                       "SDK version:1.5.4.1(39cb9a32)\r\n"
+                                       "compiled Jul  1 2016 20:25:26\r\n"
+                                       "\r\nOK\r\n", 2000);
+            } else if (line == "AT") {
+                this->_link.deviceSend("\r\nOK\r\n");
+            } else if (line == "ATE0" || line == "ATE1") {
+                this->_echo = (line == "ATE1");
+                this->_link.deviceSend("\r\nOK\r\n");
+            } else if (line == "AT+CIPMUX=0" || line == "AT+CIPMUX=1") {
+                this->_multiplexed = (line == "AT+CIPMUX=1");
+                this->_link.deviceSend("\r\nOK\r\n");
+            } else if (line.compare(0, 12, "AT+CIPSTART=") == 0) {
+                this->_link.deviceSend((prefix + "CONNECT\r\n\r\nOK\r\n").c_str(), 20000);
+            } else if (line.compare(0, 12, "AT+CIPCLOSE=") == 0) {
+                this->_link.deviceSend((prefix + "CLOSED\r\n\r\nOK\r\n").c_str());
+            } else if (line.compare(0, 11, "AT+CIPSEND=") == 0) {
+                const size_t comma = line.find(',');
+                const char *length = line.c_str() + (this->_multiplexed ? comma + 1 : 11);
+                this->_sendLength = (size_t) atoi(length);
+                this->_sendRemaining = this->_sendLength;
+                this->_link.deviceSend("\r\nOK\r\n> ");
+            } else {
+                this->_link.deviceSend("\r\nERROR\r\n");
+            }
+        }
+    }
+}
@@ -0,0 +1,141 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include <string.h>
+#include "sim.h"
+#include "rtos.h"
+
+namespace StegoPhone {
+    namespace Sim {
+        // Glyphs are not the real U8g2 fonts: each character is a solid cell of the font's size whose
+        // columns encode the character code. Cell metrics match the fonts used on the device.
+        struct FontMetrics {
+            int16_t width;
+            int16_t ascent;
+            int16_t descent;
+        };
+
+        static FontMetrics metrics(HAL::Font font) {
+            FontMetrics m;
+            if (font == HAL::Font::Large) {
+                m.width = 12;
+                m.ascent = 17;
+                m.descent = 5;
+            } else {
+                m.width = 8;
+                m.ascent = 7;
+                m.descent = 1;
+            }
+            return m;
+        }
+
+        FrameBufferDisplay::FrameBufferDisplay() {
+            this->_font = HAL::Font::Small;
+            this->framesSent = 0;
+            memset(this->_buffer, 0, sizeof(this->_buffer));
+        }
+
+        void FrameBufferDisplay::begin() {
+            HAL::delay(initDelays().displayMs);
+            this->clear();
+        }
+
+        void FrameBufferDisplay::setFont(HAL::Font font) {
+            this->_font = font;
+        }
+
+        void FrameBufferDisplay::clear() {
+            this->clearBuffer();
+            this->sendBuffer();
+        }
+
+        void FrameBufferDisplay::clearBuffer() {
+            memset(this->_buffer, 0, sizeof(this->_buffer));
+        }
+
+        void FrameBufferDisplay::drawStr(int16_t x, int16_t y, const char *str) {
+            const FontMetrics m = metrics(this->_font);
+            const int16_t top = y - m.ascent;
+            const int16_t height = m.ascent + m.descent;
+            for (; *str; str++, x += m.width) {
+                const uint8_t c = (uint8_t) *str;
+                for (int16_t col = 0; col < m.width; col++) {
+                    // spaces stay blank so they can be used to erase, like with the real fonts
+                    const bool inked = (c != ' ') && (col > 0) && (col < m.width - 1) && ((c >> (col & 7)) & 1);
+                    for (int16_t row = 0; row < height; row++)
+                        this->setPixel(x + col, top + row, inked && (row > 0) && (row < height - 1));
+                }
+            }
+        }
+
+        void FrameBufferDisplay::sendBuffer() {
+            for (uint8_t row = 0; row < TileHeight; row++)
+                panel().sendTiles(this->_buffer, 0, row, TileWidth);
+            this->framesSent++;
+        }
+
+        uint8_t *FrameBufferDisplay::getBufferPtr() {
+            return this->_buffer;
+        }
+
+        bool FrameBufferDisplay::pixel(int16_t x, int16_t y) const {
+            if (x < 0 || y < 0 || x >= Width || y >= Height) return false;
+            return (this->_buffer[(y >> 3) * Width + x] >> (y & 7)) & 1;
+        }
+
+        void FrameBufferDisplay::setPixel(int16_t x, int16_t y, bool on) {
+            if (x < 0 || y < 0 || x >= Width || y >= Height) return;
+            uint8_t &b = this->_buffer[(y >> 3) * Width + x];
+            const uint8_t mask = (uint8_t) (1 << (y & 7));
+            if (on) b |= mask;
+            else b &= (uint8_t) ~mask;
+        }
+
+        PanelTransport::PanelTransport() {
+            this->wireBitsPerSecond = 0;
+            this->spansSent = 0;
+            this->bytesSent = 0;
+            this->_owedMicros = 0;
+            memset(this->_panel, 0, sizeof(this->_panel));
+        }
+
+        void PanelTransport::sendTiles(const uint8_t *buffer, uint8_t tileX, uint8_t tileY, uint8_t tileWidth) {
+            if (tileX >= HAL::Display::TileWidth || tileY >= HAL::Display::TileHeight || tileWidth == 0) return;
+            if (tileX + tileWidth > HAL::Display::TileWidth) tileWidth = HAL::Display::TileWidth - tileX;
+            const size_t offset = (size_t) tileY * HAL::Display::Width + (size_t) tileX * 8;
+            memcpy(this->_panel + offset, buffer + offset, (size_t) tileWidth * 8);
+            const size_t bytes = CommandBytes + (size_t) tileWidth * HAL::Display::PanelBytesPerTile;
+            this->spansSent++;
+            this->bytesSent += bytes;
+            if (!this->wireBitsPerSecond) return;
+            this->_owedMicros += (uint64_t) bytes * 8 * 1000000 / this->wireBitsPerSecond;
+            if (!RTOS::schedulerStarted() || !RTOS::currentTask()) {
+                warp(this->_owedMicros);
+                this->_owedMicros = 0;
+            } else if (this->_owedMicros >= 1000) {
+                // the scheduler works in milliseconds; the remainder carries into the next send
+                RTOS::delay((uint32_t) (this->_owedMicros / 1000));
+                this->_owedMicros %= 1000;
+            }
+        }
+
+        bool PanelTransport::panelPixel(int16_t x, int16_t y) const {
+            if (x < 0 || y < 0 || x >= HAL::Display::Width || y >= HAL::Display::Height) return false;
+            return (this->_panel[(y >> 3) * HAL::Display::Width + x] >> (y & 7)) & 1;
+        }
+
+        PanelTransport &panel() {
+            static PanelTransport transport;
+            return transport;
+        }
+
+        FrameBufferDisplay &frameBuffer() {
+            static FrameBufferDisplay display;
+            return display;
+        }
+    }
+}
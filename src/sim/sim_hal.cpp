@@ -0,0 +1,386 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+// HAL implementation for the native env
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#include "sim.h"
+#include "stegophone.h"
+#include "rtos.h"
+
+namespace StegoPhone {
+    namespace Sim {
+        // CLOCK
+        //================================================================================================
+        static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+        static uint64_t warpedUs = 0;
+
+        uint64_t hostMicros() {
+            return (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - epoch).count();
+        }
+
+        uint64_t nowMicros() {
+            return hostMicros() + warpedUs;
+        }
+
+        void warp(uint64_t us) {
+            warpedUs += us;
+            poll();
+        }
+
+        // DEVICES
+        //================================================================================================
+        static std::vector<Device *> &devices() {
+            static std::vector<Device *> list;
+            return list;
+        }
+
+        void addDevice(Device *device) {
+            devices().push_back(device);
+        }
+
+        void poll() {
+            static bool polling = false;
+            if (polling) return; // a device tick may fire an ISR that looks at the clock
+            polling = true;
+            const uint64_t now = nowMicros();
+            for (size_t i = 0; i < devices().size(); i++)
+                devices()[i]->tick(now);
+            polling = false;
+        }
+
+        // UART
+        //================================================================================================
+        SerialLink::SerialLink(const char *name) {
+            this->_name = name;
+            this->_device = 0;
+            this->_baud = 115200;
+            this->_lineFreeUs = 0;
+            this->bytesToDevice = 0;
+            this->bytesFromDevice = 0;
+        }
+
+        void SerialLink::attach(Device *device) {
+            this->_device = device;
+        }
+
+        void SerialLink::begin(uint32_t baud) {
+            this->_baud = baud;
+        }
+
+        int SerialLink::available() {
+            poll();
+            const uint64_t now = nowMicros();
+            int count = 0;
+            for (size_t i = 0; i < this->_rx.size() && this->_rx[i].dueUs <= now; i++)
+                count++;
+            return count;
+        }
+
+        int SerialLink::read() {
+            poll();
+            if (this->_rx.empty() || this->_rx.front().dueUs > nowMicros()) return -1;
+            const uint8_t c = this->_rx.front().c;
+            this->_rx.pop_front();
+            return c;
+        }
+
+        size_t SerialLink::write(uint8_t c) {
+            this->bytesToDevice++;
+            if (this->_device != 0) this->_device->receive(c);
+            return 1;
+        }
+
+        void SerialLink::deviceSend(const char *data, uint64_t delayUs) {
+            this->deviceSend((const uint8_t *) data, strlen(data), delayUs);
+        }
+
+        void SerialLink::deviceSend(const uint8_t *data, size_t length, uint64_t delayUs) {
+            uint64_t due = nowMicros() + delayUs;
+            if (due < this->_lineFreeUs) due = this->_lineFreeUs;
+            const uint64_t byteTime = this->byteTimeUs();
+            for (size_t i = 0; i < length; i++) {
+                due += byteTime;
+                Pending pending;
+                pending.dueUs = due;
+                pending.c = data[i];
+                this->_rx.push_back(pending);
+            }
+            this->_lineFreeUs = due;
+            this->bytesFromDevice += length;
+        }
+
+        uint64_t SerialLink::byteTimeUs() const {
+            return (10ULL * 1000000ULL + this->_baud - 1) / this->_baud;
+        }
+
+        const char *SerialLink::name() const {
+            return this->_name;
+        }
+
+        ConsoleLink::ConsoleLink() {
+            this->echo = false;
+            this->bytesWritten = 0;
+        }
+
+        void ConsoleLink::begin(uint32_t baud) {
+        }
+
+        int ConsoleLink::available() {
+            return (int) this->_input.size();
+        }
+
+        int ConsoleLink::read() {
+            if (this->_input.empty()) return -1;
+            const uint8_t c = this->_input.front();
+            this->_input.pop_front();
+            return c;
+        }
+
+        size_t ConsoleLink::write(uint8_t c) {
+            this->bytesWritten++;
+            if (this->echo) fputc(c, stdout);
+            return 1;
+        }
+
+        void ConsoleLink::inject(const char *input) {
+            while (*input)
+                this->_input.push_back((uint8_t) *input++);
+        }
+
+        SerialLink &rn52Link() {
+            static SerialLink link("RN52");
+            return link;
+        }
+
+        SerialLink &esp8266Link() {
+            static SerialLink link("ESP8266");
+            return link;
+        }
+
+        ConsoleLink &console() {
+            static ConsoleLink link;
+            return link;
+        }
+
+        RN52Device &rn52Device() {
+            static RN52Device *device = 0;
+            if (device == 0) {
+                device = new RN52Device(rn52Link(), StegoPhone::rn52ENPin, StegoPhone::rn52InterruptPin);
+                rn52Link().attach(device);
+                addDevice(device);
+            }
+            return *device;
+        }
+
+        ESP8266Device &esp8266Device() {
+            static ESP8266Device *device = 0;
+            if (device == 0) {
+                device = new ESP8266Device(esp8266Link());
+                esp8266Link().attach(device);
+                addDevice(device);
+            }
+            return *device;
+        }
+
+        // GPIO
+        //================================================================================================
+        static const uint8_t PinCount = 64;
+
+        struct Pin {
+            HAL::PinMode mode;
+            bool level;
+            HAL::InterruptHandler handler;
+            HAL::Edge edge;
+        };
+
+        static Pin pins[PinCount];
+
+        void drivePin(uint8_t pin, bool level) {
+            if (pin >= PinCount) return;
+            const bool previous = pins[pin].level;
+            pins[pin].level = level;
+            if ((previous == level) || (pins[pin].handler == 0)) return;
+            const bool fire = (pins[pin].edge == HAL::Edge::Change) ||
+                              ((pins[pin].edge == HAL::Edge::Rising) && level) ||
+                              ((pins[pin].edge == HAL::Edge::Falling) && !level);
+            if (fire) pins[pin].handler();
+        }
+
+        bool pinLevel(uint8_t pin) {
+            return (pin < PinCount) && pins[pin].level;
+        }
+
+        // USB
+        //================================================================================================
+        // reports wait for the next HAL::usbTask(), where USBHost_t36 would call back
+        struct KeyReport {
+            bool extras;
+            int unicode;
+            uint32_t top;
+            uint16_t key;
+        };
+
+        static HAL::KeyboardHandlers keyboardHandlers;
+        static std::deque<KeyReport> keyReports;
+        static std::deque<HAL::MouseReport> mouseReports;
+
+        void pressKey(int unicode) {
+            KeyReport report = {false, unicode, 0, 0};
+            keyReports.push_back(report);
+        }
+
+        void pressExtrasKey(uint32_t top, uint16_t key) {
+            KeyReport report = {true, 0, top, key};
+            keyReports.push_back(report);
+        }
+
+        void moveMouse(const HAL::MouseReport &report) {
+            mouseReports.push_back(report);
+        }
+
+        // BOARD
+        //================================================================================================
+        InitDelays &initDelays() {
+            static InitDelays delays = {20, 100, 25};
+            return delays;
+        }
+    }
+
+    namespace HAL {
+        // TIME
+        //================================================================================================
+        uint32_t millis() {
+            Sim::poll();
+            return (uint32_t) (Sim::nowMicros() / 1000);
+        }
+
+        uint32_t micros() {
+            Sim::poll();
+            return (uint32_t) Sim::nowMicros();
+        }
+
+        // warps the clock, or once tasks run, blocks this one and lets the others have the CPU
+        void delay(uint32_t ms) {
+            RTOS::delay(ms);
+        }
+
+        // RANDOM
+        //================================================================================================
+        // xorshift64: repeatable from run to run, different on every call
+        void randomBytes(uint8_t *out, size_t length) {
+            static uint64_t state = 0x537465676F50686FULL;
+            for (size_t i = 0; i < length; i++) {
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+                out[i] = (uint8_t) (state >> 32);
+            }
+        }
+
+        // GPIO
+        //================================================================================================
+        void pinMode(uint8_t pin, PinMode mode) {
+            if (pin >= Sim::PinCount) return;
+            Sim::pins[pin].mode = mode;
+            if (mode == PinMode::InputPullup) Sim::pins[pin].level = true;
+        }
+
+        void digitalWrite(uint8_t pin, bool value) {
+            if (pin >= Sim::PinCount) return;
+            Sim::pins[pin].level = value;
+            for (size_t i = 0; i < Sim::devices().size(); i++)
+                Sim::devices()[i]->pinChanged(pin, value);
+        }
+
+        bool digitalRead(uint8_t pin) {
+            Sim::poll();
+            return Sim::pinLevel(pin);
+        }
+
+        void attachInterrupt(uint8_t pin, InterruptHandler handler, Edge edge) {
+            if (pin >= Sim::PinCount) return;
+            Sim::pins[pin].handler = handler;
+            Sim::pins[pin].edge = edge;
+        }
+
+        void detachInterrupt(uint8_t pin) {
+            if (pin >= Sim::PinCount) return;
+            Sim::pins[pin].handler = 0;
+        }
+
+        // SERIAL
+        //================================================================================================
+        SerialPort &consoleSerial() {
+            return Sim::console();
+        }
+
+        SerialPort &esp8266Serial() {
+            Sim::esp8266Device();
+            return Sim::esp8266Link();
+        }
+
+        SerialPort &rn52Serial() {
+            Sim::rn52Device();
+            return Sim::rn52Link();
+        }
+
+        // DISPLAY
+        //================================================================================================
+        Display &display() {
+            return Sim::frameBuffer();
+        }
+
+        DisplayTransport &displayTransport() {
+            return Sim::panel();
+        }
+
+        // STORAGE
+        //================================================================================================
+        bool storageBegin() {
+            HAL::delay(Sim::initDelays().cardMs);
+            return true;
+        }
+
+        // I2C
+        //================================================================================================
+        void i2cBegin() {
+        }
+
+        // USB HOST
+        //================================================================================================
+        void usbBegin() {
+            HAL::delay(Sim::initDelays().usbMs);
+        }
+
+        void usbTask() {
+            while (!Sim::keyReports.empty()) {
+                const Sim::KeyReport report = Sim::keyReports.front();
+                Sim::keyReports.pop_front();
+                if (report.extras && Sim::keyboardHandlers.extrasPress)
+                    Sim::keyboardHandlers.extrasPress(report.top, report.key);
+                else if (!report.extras && Sim::keyboardHandlers.press)
+                    Sim::keyboardHandlers.press(report.unicode);
+            }
+        }
+
+        void attachKeyboard(const KeyboardHandlers &handlers) {
+            Sim::keyboardHandlers = handlers;
+        }
+
+        bool readMouse(MouseReport &report) {
+            if (Sim::mouseReports.empty()) return false;
+            report = Sim::mouseReports.front();
+            Sim::mouseReports.pop_front();
+            return true;
+        }
+    }
+}
@@ -0,0 +1,236 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+// RTOS shim for the native env: a single-CPU scheduler over host threads. Exactly one task holds
+// the CPU; it hands it over only when it blocks, yields or returns. Scheduler state is only touched
+// by the task holding the CPU (ISRs run on it too), the mutex just orders the handovers.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "rtos.h"
+#include "sim.h"
+
+namespace StegoPhone {
+    namespace RTOS {
+        struct Task {
+            const char *name;
+            TaskFunction function;
+            void *arg;
+            uint8_t priority;
+            bool ready;
+            bool deleted;
+            bool waitingNotify;
+            uint32_t notifyCount;
+            uint64_t wakeUs;
+            std::condition_variable cv;
+        };
+
+        static const uint64_t Never = ~0ULL;
+
+        // a wait with nothing able to end it; give up rather than spin forever
+        static const uint64_t DeadlockUs = 60ULL * 1000000ULL;
+
+        // never destroyed: task threads outlive main()
+        static std::mutex &cpu = *new std::mutex();
+        static std::vector<Task *> &tasks = *new std::vector<Task *>();
+        static Task *running = 0;
+        static thread_local Task *self = 0;
+        static bool started = false;
+
+        static bool runnable(const Task *task, uint64_t now) {
+            if (task->deleted) return false;
+            return task->ready || (task->waitingNotify && task->notifyCount > 0) || (task->wakeUs <= now);
+        }
+
+        // highest priority runnable task, round robin among equals starting after the current one;
+        // when nothing can run, skip the clock to the next timeout
+        static Task *pick() {
+            const uint64_t idleStart = Sim::nowMicros();
+            while (true) {
+                const uint64_t now = Sim::nowMicros();
+                size_t start = 0;
+                for (size_t i = 0; i < tasks.size(); i++)
+                    if (tasks[i] == running) start = i + 1;
+                Task *best = 0;
+                uint64_t nextWake = Never;
+                for (size_t n = 0; n < tasks.size(); n++) {
+                    Task *task = tasks[(start + n) % tasks.size()];
+                    if (runnable(task, now)) {
+                        if (!best || task->priority > best->priority) best = task;
+                    } else if (!task->deleted && task->wakeUs < nextWake) {
+                        nextWake = task->wakeUs;
+                    }
+                }
+                if (best) return best;
+                if (now - idleStart > DeadlockUs) {
+                    fprintf(stderr, "sim rtos: every task blocked with nothing to wake them\n");
+                    exit(3);
+                }
+                // idle: devices may still raise interrupts, so never skip more than a millisecond blind
+                Sim::warp(nextWake == Never ? 1000 : nextWake - now);
+            }
+        }
+
+        // hand the CPU to the next task and wait until it comes back to the caller
+        static void reschedule() {
+            Task *next = pick();
+            next->ready = false;
+            next->wakeUs = Never;
+            std::unique_lock<std::mutex> lock(cpu);
+            Task *previous = running;
+            running = next;
+            if (next == previous) return;
+            next->cv.notify_one();
+            if (previous && !previous->deleted) previous->cv.wait(lock, [previous] { return running == previous; });
+        }
+
+        static void taskMain(Task *task) {
+            self = task;
+            {
+                std::unique_lock<std::mutex> lock(cpu);
+                task->cv.wait(lock, [task] { return running == task; });
+            }
+            task->function(task->arg);
+            task->deleted = true;
+            reschedule();
+        }
+
+        static void spawn(Task *task) {
+            std::thread(taskMain, task).detach();
+        }
+
+        // TASKS
+        //================================================================================================
+        bool createTask(TaskFunction function, const char *name, uint16_t stackWords, void *arg, uint8_t priority,
+                        TaskHandle *handle) {
+            Task *task = new Task();
+            task->name = name;
+            task->function = function;
+            task->arg = arg;
+            task->priority = priority;
+            task->ready = true;
+            task->deleted = false;
+            task->waitingNotify = false;
+            task->notifyCount = 0;
+            task->wakeUs = Never;
+            tasks.push_back(task);
+            if (handle) *handle = task;
+            if (started) spawn(task);
+            return true;
+        }
+
+        void deleteTask(TaskHandle handle) {
+            Task *task = handle ? (Task *) handle : self;
+            task->deleted = true;
+            if (task == self) reschedule(); // does not come back
+        }
+
+        void startScheduler() {
+            if (started) return;
+            Task *main = new Task();
+            main->name = "main";
+            main->function = 0;
+            main->arg = 0;
+            main->priority = 1;
+            main->ready = false;
+            main->deleted = false;
+            main->waitingNotify = false;
+            main->notifyCount = 0;
+            main->wakeUs = Never;
+            self = main;
+            running = main;
+            started = true;
+            for (size_t i = 0; i < tasks.size(); i++)
+                spawn(tasks[i]);
+            tasks.push_back(main);
+        }
+
+        bool schedulerStarted() {
+            return started;
+        }
+
+        TaskHandle currentTask() {
+            return self;
+        }
+
+        void delay(uint32_t ms) {
+            if (!started || !self) {
+                Sim::warp((uint64_t) ms * 1000);
+                return;
+            }
+            self->wakeUs = Sim::nowMicros() + (uint64_t) ms * 1000;
+            reschedule();
+        }
+
+        uint32_t tickCount() {
+            return (uint32_t) (Sim::nowMicros() / 1000);
+        }
+
+        bool delayUntil(uint32_t &lastWake, uint32_t periodMs) {
+            const uint32_t now = tickCount();
+            const bool late = now - lastWake >= periodMs;
+            lastWake += periodMs;
+            if (late) return false;
+            const uint64_t wakeUs = ((uint64_t) (Sim::nowMicros() / 1000) + (lastWake - now)) * 1000;
+            if (!started || !self) {
+                Sim::warp(wakeUs - Sim::nowMicros());
+                return true;
+            }
+            self->wakeUs = wakeUs;
+            reschedule();
+            return true;
+        }
+
+        void yield() {
+            if (!started || !self) return;
+            self->ready = true;
+            reschedule();
+        }
+
+        uint32_t stackUnusedWords(TaskHandle task) {
+            return StackUnknown;
+        }
+
+        // one task holds the CPU at a time and ISRs run on it, so nothing can come between
+        void enterCritical() {
+        }
+
+        void exitCritical() {
+        }
+
+        // NOTIFICATIONS
+        //================================================================================================
+        void notify(TaskHandle task) {
+            ((Task *) task)->notifyCount++;
+        }
+
+        void notifyFromISR(TaskHandle task) {
+            notify(task);
+        }
+
+        uint32_t waitNotify(uint32_t timeoutMs) {
+            if (!started || !self) {
+                if (timeoutMs != WaitForever) Sim::warp((uint64_t) timeoutMs * 1000);
+                return 0;
+            }
+            if (self->notifyCount == 0) {
+                self->waitingNotify = true;
+                self->wakeUs = (timeoutMs == WaitForever) ? Never : Sim::nowMicros() + (uint64_t) timeoutMs * 1000;
+                reschedule();
+                self->waitingNotify = false;
+            }
+            const uint32_t count = self->notifyCount;
+            self->notifyCount = 0;
+            return count;
+        }
+    }
+}
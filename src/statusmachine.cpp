@@ -0,0 +1,188 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include <stdio.h>
+#include <string.h>
+#include "statusmachine.h"
+
+namespace StegoPhone {
+    namespace {
+        const char *const StatusNames[StatusCount] = {
+                "Offline", "InitializationStart", "InitializationFailure", "DisplayInitialized", "InputInitialized",
+                "PhoneBTInitialized", "HeadsetBTInitialized", "Ready", "CallIncoming", "IncomingRinging",
+                "CallConnected", "QuietModemAnnouncing", "QuietModemHandshaking", "QuietModemConnected",
+                "CallPINSending", "CallPINSynchronized", "ModemInitializing", "ModemHandshaking",
+                "EncryptionHandshaking", "EncryptedDataEstablished", "EncryptedVoice"};
+
+        const char *const EventNames[EventCount] = {
+                "Boot", "DisplayUp", "PhoneBTUp", "InputUp", "BootDone", "BootFailed", "CallRinging", "CallActive",
+                "CallEnded", "ModemAnnouncing", "ModemPeerHeard", "ModemConnected", "ModemStopped",
+                "KeyAgreementStarted", "KeyAgreed", "KeyAgreementFailed", "KeyAgreementStopped", "Timeout"};
+
+        struct PhaseSpan {
+            StegoStatus from;
+            StegoStatus to;
+            const char *name;
+        };
+
+        const PhaseSpan Phases[(uint8_t) StatusMachine::SetupPhase::Count] = {
+                {StegoStatus::IncomingRinging, StegoStatus::CallConnected, "answer"},
+                {StegoStatus::CallConnected, StegoStatus::QuietModemConnected, "modem"},
+                {StegoStatus::QuietModemConnected, StegoStatus::EncryptedDataEstablished, "keys"},
+                {StegoStatus::CallConnected, StegoStatus::EncryptedDataEstablished, "total"}};
+
+        static_assert(StatusCount <= 32, "one bit per status in _callEntered");
+    }
+
+    const char *statusName(StegoStatus status) {
+        return (uint8_t) status < StatusCount ? StatusNames[(uint8_t) status] : "?";
+    }
+
+    const char *eventName(StegoEvent event) {
+        return (uint8_t) event < EventCount ? EventNames[(uint8_t) event] : "?";
+    }
+
+    StatusMachine::StatusMachine(const StatusTransition *rows, const StatusDispatch &dispatch, void *context,
+                                 StegoStatus initial) : _dispatch(dispatch) {
+        this->_rows = rows;
+        this->_context = context;
+        this->_status = initial;
+        this->_enteredMicros = 0;
+        this->_timing = false;
+        this->_deadlineMicros = 0;
+        this->_callEntered = 0;
+        memset(this->_callMicros, 0, sizeof(this->_callMicros));
+        this->resetStats();
+    }
+
+    StegoStatus StatusMachine::status() const {
+        return this->_status;
+    }
+
+    bool StatusMachine::dispatch(StegoEvent event, uint32_t nowMicros) {
+        const uint8_t index = this->_dispatch.row[(uint8_t) this->_status][(uint8_t) event];
+        if (index == StatusDispatch::NoTransition) {
+            this->_ignored++;
+            return false;
+        }
+        const StatusTransition &row = this->_rows[index];
+        if (row.action) row.action(this->_context);
+        this->enter(row, nowMicros);
+        return true;
+    }
+
+    bool StatusMachine::poll(uint32_t nowMicros) {
+        if (!this->_timing || (int32_t) (nowMicros - this->_deadlineMicros) < 0) return false;
+        this->_timing = false;
+        this->_timeouts++;
+        this->dispatch(StegoEvent::Timeout, nowMicros);
+        return true;
+    }
+
+    uint32_t StatusMachine::stateMicros(uint32_t nowMicros) const {
+        return nowMicros - this->_enteredMicros;
+    }
+
+    void StatusMachine::enter(const StatusTransition &row, uint32_t nowMicros) {
+        TraceEntry &entry = this->_trace[this->_transitions % TraceDepth];
+        entry.micros = nowMicros;
+        entry.from = this->_status;
+        entry.event = row.event;
+        entry.to = row.to;
+        this->_transitions++;
+
+        this->_status = row.to;
+        this->_enteredMicros = nowMicros;
+        this->_timing = row.timeoutMs != 0;
+        this->_deadlineMicros = nowMicros + row.timeoutMs * 1000;
+
+        // a call starts from Ready; each state keeps its first entry in it
+        if (row.to == StegoStatus::Ready) {
+            this->_callEntered = 0;
+            return;
+        }
+        const uint32_t bit = (uint32_t) 1 << (uint8_t) row.to;
+        if (this->_callEntered & bit) return;
+        this->_callEntered |= bit;
+        this->_callMicros[(uint8_t) row.to] = nowMicros;
+        for (uint8_t p = 0; p < (uint8_t) SetupPhase::Count; p++) {
+            if (Phases[p].to != row.to || !(this->_callEntered & ((uint32_t) 1 << (uint8_t) Phases[p].from)))
+                continue;
+            PhaseStats &stats = this->_phases[p];
+            stats.lastMicros = nowMicros - this->_callMicros[(uint8_t) Phases[p].from];
+            if (stats.lastMicros > stats.maxMicros) stats.maxMicros = stats.lastMicros;
+            stats.count++;
+        }
+    }
+
+    // STATS
+    //================================================================================================
+    uint32_t StatusMachine::transitions() const {
+        return this->_transitions;
+    }
+
+    uint32_t StatusMachine::ignored() const {
+        return this->_ignored;
+    }
+
+    uint32_t StatusMachine::timeouts() const {
+        return this->_timeouts;
+    }
+
+    bool StatusMachine::recent(uint8_t back, TraceEntry &entry) const {
+        if (back >= TraceDepth || back >= this->_transitions) return false;
+        entry = this->_trace[(this->_transitions - 1 - back) % TraceDepth];
+        return true;
+    }
+
+    const StatusMachine::PhaseStats &StatusMachine::phase(SetupPhase phase) const {
+        return this->_phases[(uint8_t) phase];
+    }
+
+    const char *StatusMachine::phaseName(SetupPhase phase) {
+        return (uint8_t) phase < (uint8_t) SetupPhase::Count ? Phases[(uint8_t) phase].name : "?";
+    }
+
+    void StatusMachine::resetStats() {
+        this->_transitions = 0;
+        this->_ignored = 0;
+        this->_timeouts = 0;
+        memset(this->_trace, 0, sizeof(this->_trace));
+        memset(this->_phases, 0, sizeof(this->_phases));
+    }
+
+    void StatusMachine::consoleCommand(void *context, HAL::SerialPort &out, const char *args) {
+        StatusMachine *machine = (StatusMachine *) context;
+        if (strcmp(args, "reset") == 0) {
+            machine->resetStats();
+            out.println("state: stats reset");
+            return;
+        }
+        const uint32_t now = HAL::micros();
+        char line[128];
+        snprintf(line, sizeof(line), "state: %s for %lu ms%s, %lu transitions, %lu ignored, %lu timeouts",
+                 statusName(machine->_status), (unsigned long) (machine->stateMicros(now) / 1000),
+                 machine->_timing ? " (timeout armed)" : "", (unsigned long) machine->_transitions,
+                 (unsigned long) machine->_ignored, (unsigned long) machine->_timeouts);
+        out.println(line);
+        for (uint8_t p = 0; p < (uint8_t) SetupPhase::Count; p++) {
+            const PhaseStats &stats = machine->_phases[p];
+            snprintf(line, sizeof(line), "  %-6s %s -> %s: %lu calls, last %lu ms, worst %lu ms", Phases[p].name,
+                     statusName(Phases[p].from), statusName(Phases[p].to), (unsigned long) stats.count,
+                     (unsigned long) (stats.lastMicros / 1000), (unsigned long) (stats.maxMicros / 1000));
+            out.println(line);
+        }
+        // oldest first, timed back from now
+        TraceEntry entry;
+        for (int8_t back = TraceDepth - 1; back >= 0; back--) {
+            if (!machine->recent((uint8_t) back, entry)) continue;
+            snprintf(line, sizeof(line), "  -%lu ms %s --%s--> %s", (unsigned long) ((now - entry.micros) / 1000),
+                     statusName(entry.from), eventName(entry.event), statusName(entry.to));
+            out.println(line);
+        }
+    }
+}
@@ -7,43 +7,196 @@
 
 #include <cmath>
 #include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
 #include "stegophone.h"
+#include "console.h"
+#include "trace.h"
+#include "log.h"
+#include "keynames.h"
+#include "profile.h"
+#include "fskphy.h"
 
 namespace StegoPhone {
-    StegoPhone *StegoPhone::_instance = 0;
+    // STATUS TABLE
+    //================================================================================================
+    namespace {
+        void startModem(void *context) {
+            ((StegoPhone *) context)->modem()->start();
+        }
 
-    KeyboardController StegoPhone::keyboard(StegoPhone::usb);
-    MouseController StegoPhone::mouse(StegoPhone::usb);
+        // the call goes on as a plain one
+        void stopModem(void *context) {
+            StegoPhone *stego = (StegoPhone *) context;
+            stego->keyExchange()->abort();
+            stego->modem()->stop();
+        }
 
-    U8G2_SSD1322_NHD_256X64_F_4W_SW_SPI StegoPhone::display(U8G2_R0, OLED_CLK_Pin, OLED_SDA_Pin, OLED_CS_Pin,
-                                                            OLED_DC_Pin, OLED_RESET_Pin);
+        void startKeys(void *context) {
+            ((StegoPhone *) context)->startKeyAgreement();
+        }
 
-    usb_serial_class StegoPhone::ConsoleSerial = Serial;
-    HardwareSerial StegoPhone::ESP8266Serial = Serial1;
-    HardwareSerial StegoPhone::RN52Serial = Serial7;
-    SdExFat StegoPhone::sd = SdExFat();
+        void abortKeys(void *context) {
+            ((StegoPhone *) context)->keyExchange()->abort();
+        }
 
-    StegoPhone::StegoPhone() {
-        this->_status = StegoStatus::Offline;
-        this->userLEDStatus = true;
+        typedef StegoStatus S;
+        typedef StegoEvent E;
+
+        // CallIncoming, CallPINSending/Synchronized, ModemInitializing/Handshaking, HeadsetBTInitialized and
+        // EncryptedVoice have nothing leading to them yet
+        constexpr StatusTransition Transitions[] = {
+                // boot, step by step from setup()
+                {S::Offline, E::Boot, S::InitializationStart, 0, 0},
+                {S::InitializationStart, E::DisplayUp, S::DisplayInitialized, 0, 0},
+                {S::DisplayInitialized, E::PhoneBTUp, S::PhoneBTInitialized, 0, 0},
+                {S::PhoneBTInitialized, E::InputUp, S::InputInitialized, 0, 0},
+                {S::InputInitialized, E::BootDone, S::Ready, 0, 0},
+                {S::InitializationStart, E::BootFailed, S::InitializationFailure, 0, 0},
+                {S::DisplayInitialized, E::BootFailed, S::InitializationFailure, 0, 0},
+                {S::PhoneBTInitialized, E::BootFailed, S::InitializationFailure, 0, 0},
+                {S::InputInitialized, E::BootFailed, S::InitializationFailure, 0, 0},
+
+                // a call, incoming or placed on the phone
+                {S::Ready, E::CallRinging, S::IncomingRinging, StegoPhone::RingTimeoutMs, 0},
+                {S::IncomingRinging, E::CallEnded, S::Ready, 0, 0},
+                {S::IncomingRinging, E::Timeout, S::Ready, 0, 0},
+                {S::IncomingRinging, E::CallActive, S::CallConnected, 0, startModem},
+                {S::Ready, E::CallActive, S::CallConnected, 0, startModem},
+
+                // the quiet modem looks for a StegoPhone at the far end
+                {S::CallConnected, E::ModemAnnouncing, S::QuietModemAnnouncing, StegoPhone::PeerTimeoutMs, 0},
+                {S::QuietModemAnnouncing, E::Timeout, S::CallConnected, 0, stopModem},
+                {S::QuietModemAnnouncing, E::ModemPeerHeard, S::QuietModemHandshaking, 0, 0},
+                {S::QuietModemHandshaking, E::ModemAnnouncing, S::QuietModemAnnouncing, StegoPhone::PeerTimeoutMs, 0},
+                {S::QuietModemHandshaking, E::ModemConnected, S::QuietModemConnected, 0, startKeys},
+
+                // then agrees a key over it
+                {S::QuietModemConnected, E::KeyAgreementStarted, S::EncryptionHandshaking,
+                 StegoPhone::KeyAgreementTimeoutMs, 0},
+                {S::EncryptionHandshaking, E::KeyAgreed, S::EncryptedDataEstablished, 0, 0},
+                {S::EncryptionHandshaking, E::KeyAgreementFailed, S::CallConnected, 0, stopModem},
+                {S::EncryptionHandshaking, E::Timeout, S::CallConnected, 0, stopModem},
+                {S::EncryptionHandshaking, E::KeyAgreementStopped, S::QuietModemConnected, 0, 0},
+
+                // the modem stopped from elsewhere (the console, a test)
+                {S::QuietModemAnnouncing, E::ModemStopped, S::CallConnected, 0, 0},
+                {S::QuietModemHandshaking, E::ModemStopped, S::CallConnected, 0, 0},
+                {S::QuietModemConnected, E::ModemStopped, S::CallConnected, 0, abortKeys},
+                {S::EncryptionHandshaking, E::ModemStopped, S::CallConnected, 0, abortKeys},
+                {S::EncryptedDataEstablished, E::ModemStopped, S::CallConnected, 0, abortKeys},
+
+                // hang up from anywhere in a call
+                {S::CallConnected, E::CallEnded, S::Ready, 0, stopModem},
+                {S::QuietModemAnnouncing, E::CallEnded, S::Ready, 0, stopModem},
+                {S::QuietModemHandshaking, E::CallEnded, S::Ready, 0, stopModem},
+                {S::QuietModemConnected, E::CallEnded, S::Ready, 0, stopModem},
+                {S::EncryptionHandshaking, E::CallEnded, S::Ready, 0, stopModem},
+                {S::EncryptedDataEstablished, E::CallEnded, S::Ready, 0, stopModem},
+        };
 
-        // Serial ports
-        ConsoleSerial.begin(ConsoleSerialRate); // console/debug
-        RN52Serial.begin(RN52SerialRate); // Connected to RN52
-        ESP8266Serial.begin(ESP8266SerialRate); // ESP-12E
+        static_assert(transitionsUnique(Transitions), "a (status, event) pair appears twice in the status table");
+
+        constexpr StatusDispatch TransitionIndex = buildDispatch(Transitions);
+
+        // BOOT TABLE
+        //================================================================================================
+        const uint8_t BootPorts = 0;
+        const uint8_t BootDisplay = 1;
+        const uint8_t BootRN52 = 2;
+        const uint8_t BootESP8266 = 3;
+        const uint8_t BootStorage = 4;
+        const uint8_t BootUSB = 5;
+        const uint8_t BootLogo = 6;
+
+        // the display, SD card, USB host and RN52 power up all start on the first pass. The RN52 boots its
+        // own firmware and is polled; the display, card and USB inits block, so each runs on a BootJob
+        // task while the wheel keeps polling the rest
+        constexpr BootStep BootSteps[] = {
+                {"ports", 0, StegoPhone::bootPorts},
+                {"display", 0, StegoPhone::bootDisplay},
+                {"rn52", bootAfter(BootPorts), StegoPhone::bootRN52},
+                {"esp8266", bootAfter(BootPorts), StegoPhone::bootESP8266},
+                {"sd", 0, StegoPhone::bootStorage},
+                {"usb", 0, StegoPhone::bootUSB},
+                {"logo", bootAfter(BootDisplay) | bootAfter(BootStorage), StegoPhone::bootLogo},
+        };
 
-        // Display
-        display.begin();
+        static_assert(bootStepsOrdered(BootSteps), "a boot step depends on one below it");
 
-        pinMode(rn52InterruptPin, INPUT);
-        // Note, this means we do not want INPUT_PULLUP.
-        pinMode(userLEDPin, OUTPUT);
+        const uint8_t BootStepCount = sizeof(BootSteps) / sizeof(BootSteps[0]);
 
-        digitalWrite(userLEDPin, StegoPhone::userLEDStatus);
+        // the status events of the boot, in the order the status table takes them, each once its step is done
+        struct BootMilestone {
+            StegoStatus from;
+            uint8_t step;
+            StegoEvent event;
+        };
 
-        Wire.begin(); //Join I2C bus
+        const BootMilestone BootMilestones[] = {
+                {S::InitializationStart, BootDisplay, E::DisplayUp},
+                {S::DisplayInitialized, BootRN52, E::PhoneBTUp},
+                {S::PhoneBTInitialized, BootUSB, E::InputUp},
+        };
 
-        usb.begin();
+        // RN52 "Q" status word, bits 0-3: the connection state
+        const uint16_t RN52ConnectionMask = 0x000f;
+        const uint8_t RN52OutgoingCall = 4;     // dialled, not answered yet
+        const uint8_t RN52IncomingCall = 5;
+        const uint8_t RN52ActiveCall = 6;
+        const uint8_t RN52ThreeWayWaiting = 8;  // 8-11: three way calls, incoming on hold
+        const uint8_t RN52ActiveCallAlt = 12;
+    }
+
+    StegoPhone *StegoPhone::_instance = 0;
+
+    HAL::Display &StegoPhone::display = HAL::display();
+
+    HAL::SerialPort &StegoPhone::ConsoleSerial = HAL::consoleSerial();
+    HAL::SerialPort &StegoPhone::ESP8266Serial = HAL::esp8266Serial();
+    HAL::SerialPort &StegoPhone::RN52Serial = HAL::rn52Serial();
+
+    StegoPhone::StegoPhone() {
+        this->_status = new StatusMachine(Transitions, TransitionIndex, this);
+        this->_callEvent = StegoEvent::CallEnded;
+        this->_linkEvent = StegoEvent::ModemStopped;
+        this->_keyEvent = StegoEvent::KeyAgreementStopped;
+        this->_keyShareDue = false;
+        this->_keyShareMillis = 0;
+        this->userLEDStatus = true;
+        this->_rn52StatusUpdates = 0;
+
+        // console/debug; every other peripheral is started by the boot sequence
+        ConsoleSerial.begin(ConsoleSerialRate);
+
+        // Display
+        this->_compositor = new Compositor(display, HAL::displayTransport());
+
+        // USB input, queued by the callbacks for the UI
+        this->_input = new InputQueue();
+        this->_uiTask = 0;
+        this->_usbTask = 0;
+
+        // call audio modem, with its frame pools, idle until a call starts it
+        this->_modemPhy = new FskPhy();
+        this->_modem = new ModemStage(*this->_modemPhy);
+        this->_cipher = new FrameCipher();
+        this->_keyExchange = new KeyExchange(*this->_cipher);
+        this->_jitter = new JitterBuffer();
+        this->_fec = new FrameFec();
+
+        // timers, serviced on their own task or from loop()
+        this->_timers = new TimerWheel(HAL::micros());
+        this->_boot = new BootSequence(BootSteps, BootStepCount, this);
+        this->_bootTimer.setCallback(StegoPhone::bootStep, this);
+        this->_blinkTimer.setCallback(StegoPhone::blinkStep, this);
+
+#if !STEGOS_DISPLAY_DMA
+        HAL::pinMode(userLEDPin, HAL::PinMode::Output);
+
+        HAL::digitalWrite(userLEDPin, StegoPhone::userLEDStatus);
+#endif
     }
 
     StegoPhone *StegoPhone::getInstance() {
@@ -53,109 +206,342 @@ namespace StegoPhone {
     }
 
     void StegoPhone::setup() {
-        this->_status = StegoStatus::InitializationStart;
-        display.setFont(u8g2_font_amstrad_cpc_extended_8f);
-        drawDisplay(0, 10, "StegoPhone / StegOS", true, true);
+        this->_status->dispatch(StegoEvent::Boot, HAL::micros());
+        Console::getInstance()->addCommand("trace", "dump the serial trace [clear|stats]", Trace::consoleCommand);
+        Console::getInstance()->addCommand("log", "log queue and drop counters", Log::consoleCommand);
+        Console::getInstance()->addCommand("rn52", "RN52 status and interrupt latency", RN52::consoleCommand);
+        Console::getInstance()->addCommand("esp8266", "ESP8266 link state, URC and +IPD counters",
+                                           ESP8266::consoleCommand);
+        Console::getInstance()->addCommand("prof", "hot path timing histograms [reset]", Profile::consoleCommand);
+        Console::getInstance()->addCommand("tasks", "stack, CPU share and step time per task [reset]",
+                                           TaskManager::consoleCommand);
+        Console::getInstance()->addCommand("display", "frame and byte counts", Compositor::consoleCommand,
+                                           this->_compositor);
+        Console::getInstance()->addCommand("input", "USB input queue, drops and latency", InputQueue::consoleCommand,
+                                           this->_input);
+        Console::getInstance()->addCommand("modem", "call modem link, block timing and frames [reset]",
+                                           ModemStage::consoleCommand, this->_modem);
+        Console::getInstance()->addCommand("aead", "data frame sealing, tag failures and replays [reset]",
+                                           FrameCipher::consoleCommand, this->_cipher);
+        Console::getInstance()->addCommand("keyx", "X25519 key agreement state and slice timing [reset]",
+                                           KeyExchange::consoleCommand, this->_keyExchange);
+        Console::getInstance()->addCommand("jitter", "voice playout delay, loss and late frames [reset]",
+                                           JitterBuffer::consoleCommand, this->_jitter);
+        Console::getInstance()->addCommand("fec", "Reed-Solomon frame coding, corrections and failures [reset]",
+                                           FrameFec::consoleCommand, this->_fec);
+        Console::getInstance()->addCommand("state", "status, recent transitions and call set up times [reset]",
+                                           StatusMachine::consoleCommand, this->_status);
+        Console::getInstance()->addCommand("timers", "timer wheel, armed timers and lateness [reset]",
+                                           TimerWheel::consoleCommand, this->_timers);
+
+        Console::getInstance()->addCommand("boot", "boot steps and their timeline", BootSequence::consoleCommand,
+                                           this->_boot);
+
+        // every step runs from the wheel, polled until the last one is done
+        this->_timers->arm(&this->_bootTimer, 0, BootPollMs, HAL::micros());
+    }
 
-        this->_status = StegoStatus::DisplayInitialized;
+    bool StegoPhone::booting() {
+        const StegoStatus status = this->_status->status();
+        return status != StegoStatus::Offline && status != StegoStatus::InitializationFailure &&
+               (uint8_t) status < (uint8_t) StegoStatus::Ready;
+    }
 
-        // boot RN-52
-        drawDisplay(0, 20, "RN52 Initializing in 5..", true, false);
-        int countdown = 5;
-        while(countdown-- > 0) {
-            drawDisplay(0, 30, "   ", true, false);
-            drawDisplay(0, 30, (uint64_t) countdown, true, false);
-            delay(1000);
-        }
-        RN52 *rn52 = RN52::getInstance();
-        // try to initialize
-        if (!rn52->setup() || !rn52->Enable()) {
-            drawDisplay(0, 10, "StegoPhone / StegOS", true, true);
-            drawDisplay(0, 20, "RN52 Error", true, false);
-            this->_status = StegoStatus::InitializationFailure;
-            this->blinkForever();
-        } else {
-            this->_status = StegoStatus::Ready;
+    BootSequence *StegoPhone::bootSequence() {
+        return this->_boot;
+    }
+
+    void StegoPhone::bootStep(void *context) {
+        StegoPhone *stego = (StegoPhone *) context;
+        if (stego->_boot->poll()) stego->_timers->cancel(&stego->_bootTimer);
+        stego->observeBoot();
+    }
+
+    void StegoPhone::observeBoot() {
+        // in status order, so one pass goes as far as the steps done allow
+        for (size_t i = 0; i < sizeof(BootMilestones) / sizeof(BootMilestones[0]); i++) {
+            const BootMilestone &milestone = BootMilestones[i];
+            if (this->_status->status() == milestone.from && this->_boot->done(milestone.step))
+                this->_status->dispatch(milestone.event, HAL::micros());
         }
+        if (!this->_boot->finished() || !this->booting()) return;
 
+        if (!this->_boot->failed()) {
+            this->_status->dispatch(StegoEvent::BootDone, HAL::micros());
+            return;
+        }
+        const uint8_t failure = this->_boot->firstFailure();
         drawDisplay(0, 10, "StegoPhone / StegOS", true, true);
-        drawDisplay(0, 20, "Initializing SD Card", true, false);
+        if (failure == BootRN52) drawDisplay(0, 20, "RN52 Error", true, false);
+        else if (failure == BootStorage) drawDisplay(0, 20, "SD Failed init", true, false);
+        else drawDisplay(0, 20, this->_boot->name(failure), true, false);
+        STEGOS_LOG_ERROR("boot failed at %s", this->_boot->name(failure)); // names are static
+        this->_status->dispatch(StegoEvent::BootFailed, HAL::micros());
+        this->blinkForever();
+    }
 
-        if (!sd.begin(SD_CONFIG)) {
-            drawDisplay(0, 10, "StegoPhone / StegOS", true, true);
-            drawDisplay(0, 20, "SD Failed init", true, false);
-            ConsoleSerial.println("SD initialization failed");
-            this->blinkForever();
-        }
+    // BOOT STEPS
+    //================================================================================================
+    BootStepResult StegoPhone::bootPorts(void *context, bool first) {
+        RN52Serial.begin(RN52SerialRate); // Connected to RN52
+        ESP8266Serial.begin(ESP8266SerialRate); // ESP-12E
+        HAL::pinMode(rn52InterruptPin, HAL::PinMode::Input);
+        // Note, this means we do not want INPUT_PULLUP.
+        HAL::i2cBegin(); //Join I2C bus
+        return BootStepResult::Done;
+    }
+
+    BootStepResult StegoPhone::bootDisplay(void *context, bool first) {
+        StegoPhone *stego = (StegoPhone *) context;
+        if (first) stego->_displayJob.start("bootdisp", BootJobPriority, StegoPhone::initDisplay, stego);
+        return stego->_displayJob.result();
+    }
+
+    bool StegoPhone::initDisplay(void *context) {
+        StegoPhone *stego = (StegoPhone *) context;
+        display.begin();
+        display.setFont(HAL::Font::Small);
+        stego->drawDisplay(0, 10, "StegoPhone / StegOS", true, true);
+        stego->drawDisplay(0, 20, "Initializing", true, false);
+        stego->commitDisplay(true);
+        return true;
+    }
+
+    BootStepResult StegoPhone::bootRN52(void *context, bool first) {
+        // the RN52 belongs to its event task, which powers it up; polled, this step services it instead
+        RN52 *rn52 = RN52::getInstance();
+        if (first) rn52->requestPowerUp();
+        if (!rn52->eventTaskRunning()) rn52->loop();
+        const RN52Status status = rn52->status();
+        if (status == RN52Status::Offline) return BootStepResult::Pending;
+        return status == RN52Status::Present ? BootStepResult::Done : BootStepResult::Failed;
+    }
+
+    BootStepResult StegoPhone::bootESP8266(void *context, bool first) {
+        // the bring up is queued by the ESP8266's own task and runs in the background from there;
+        // "esp8266" on the console shows how it went
+        ESP8266 *esp8266 = ESP8266::getInstance();
+        if (first) esp8266->requestSetup();
+        if (!esp8266->taskRunning()) esp8266->loop();
+        return esp8266->setupRequested() ? BootStepResult::Pending : BootStepResult::Done;
+    }
+
+    BootStepResult StegoPhone::bootStorage(void *context, bool first) {
+        StegoPhone *stego = (StegoPhone *) context;
+        if (first) stego->_storageJob.start("bootsd", BootJobPriority, StegoPhone::initStorage, stego);
+        const BootStepResult result = stego->_storageJob.result();
+        if (result == BootStepResult::Failed) ConsoleSerial.println("SD initialization failed");
+        return result;
+    }
+
+    bool StegoPhone::initStorage(void *context) {
+        return HAL::storageBegin();
+    }
 
-        drawDisplay(0, 30, "Initializing USB", true, false);
+    BootStepResult StegoPhone::bootUSB(void *context, bool first) {
+        StegoPhone *stego = (StegoPhone *) context;
+        if (first) stego->_usbJob.start("bootusb", BootJobPriority, StegoPhone::initUSB, stego);
+        return stego->_usbJob.result();
+    }
 
-        keyboard.attachPress(StegoPhone::OnUSBKeyboardPress);
-        keyboard.attachExtrasPress(StegoPhone::OnUSBKeyboardHIDExtrasPress);
-        keyboard.attachRawPress(StegoPhone::OnUSBKeyboardRawPress);
-	    keyboard.attachRawRelease(StegoPhone::OnUSBKeyboardRawRelease);
+    bool StegoPhone::initUSB(void *context) {
+        HAL::usbBegin();
+        HAL::KeyboardHandlers keyboardHandlers;
+        keyboardHandlers.press = StegoPhone::OnUSBKeyboardPress;
+        keyboardHandlers.extrasPress = StegoPhone::OnUSBKeyboardHIDExtrasPress;
+        keyboardHandlers.rawPress = StegoPhone::OnUSBKeyboardRawPress;
+        keyboardHandlers.rawRelease = StegoPhone::OnUSBKeyboardRawRelease;
+        HAL::attachKeyboard(keyboardHandlers);
+        return true;
+    }
 
-        if (!this->displayLogo()) {
+    BootStepResult StegoPhone::bootLogo(void *context, bool first) {
+        StegoPhone *stego = (StegoPhone *) context;
+        if (!stego->displayLogo()) {
         }
 
-        display.setFont(u8g2_font_profont22_tf);
-        drawDisplay(70, 32, "StegoPhone", true, true);
-        display.setFont(u8g2_font_amstrad_cpc_extended_8f);
+        display.setFont(HAL::Font::Large);
+        stego->drawDisplay(70, 32, "StegoPhone", true, true);
+        display.setFont(HAL::Font::Small);
+        stego->commitDisplay(true);
+        return BootStepResult::Done;
     }
 
     void StegoPhone::loop() {
+        STEGOS_PROFILE_SCOPE(Loop);
+
+        // timers, unless their task runs them; while booting they own the display, so nothing else runs
+        if (!this->_timers->taskRunning()) this->_timers->advance(HAL::micros());
+        if (this->booting()) return;
 
-        // give the RN52 a chance to handle its inputs
+        // give the RN52 a chance to handle its inputs, unless its event task does
         RN52 *rn52 = RN52::getInstance();
-        rn52->loop();
-
-        // handle USB
-        usb.Task();
-
-        if (mouse.available()) {
-            Serial.print("Mouse: buttons = ");
-            Serial.print(mouse.getButtons());
-            Serial.print(",  mouseX = ");
-            Serial.print(mouse.getMouseX());
-            Serial.print(",  mouseY = ");
-            Serial.print(mouse.getMouseY());
-            Serial.print(",  wheel = ");
-            Serial.print(mouse.getWheel());
-            Serial.print(",  wheelH = ");
-            Serial.print(mouse.getWheelH());
-            Serial.println();
-            mouse.mouseDataClear();
+        if (!rn52->eventTaskRunning()) rn52->loop();
+
+        // same for the ESP8266
+        ESP8266 *esp8266 = ESP8266::getInstance();
+        if (!esp8266->taskRunning()) esp8266->loop();
+
+        // and the modem, whose link drives the QuietModem* states while it runs
+        if (!this->_modem->taskRunning()) this->_modem->process();
+        this->observeLink();
+
+        // then the key agreement on top of a connected link
+        if (!this->_keyExchange->taskRunning()) this->_keyExchange->slice();
+        this->shareKeys();
+        this->observeKeys();
+
+        // handle USB, unless its task does; then whatever it queued
+        if (!this->_usbTask) this->pollUSB();
+        this->handleInput();
+
+        // the status is read on the RN52 side; drawing stays on this task
+        if (rn52->statusUpdates() != this->_rn52StatusUpdates) {
+            this->_rn52StatusUpdates = rn52->statusUpdates();
+            char hexStatus[5];
+            snprintf(hexStatus, sizeof(hexStatus), "%04X", rn52->statusWord());
+            drawDisplay(0, 50, "RN52:", true, false);
+            drawDisplay(80, 50, "          ", true, false);
+            drawDisplay(80, 50, hexStatus, true, false);
+            this->observeCall(rn52->statusWord());
         }
+        this->_status->poll(HAL::micros());
+
+        Console::getInstance()->loop();
+
+        // everything drawn this tick goes out as one frame
+        this->commitDisplay();
+    }
+
+    // STATUS
+    //================================================================================================
+    void StegoPhone::observe(StegoEvent &last, StegoEvent now) {
+        if (now == last) return;
+        last = now;
+        this->_status->dispatch(now, HAL::micros());
+    }
+
+    void StegoPhone::observeCall(uint16_t statusWord) {
+        const uint8_t connection = (uint8_t) (statusWord & RN52ConnectionMask);
+        if (connection == RN52OutgoingCall) return;
+        if (connection == RN52IncomingCall)
+            this->observe(this->_callEvent, StegoEvent::CallRinging);
+        else if (connection == RN52ActiveCall || connection == RN52ActiveCallAlt ||
+                 (connection >= RN52ThreeWayWaiting && connection < RN52ActiveCallAlt))
+            this->observe(this->_callEvent, StegoEvent::CallActive);
+        else
+            this->observe(this->_callEvent, StegoEvent::CallEnded);
+    }
 
-        switch (this->_status) {
-            case StegoStatus::Ready:
-                // intentional fallthrough
+    void StegoPhone::observeLink() {
+        switch (this->_modem->linkState()) {
+            case ModemLinkState::Announcing:
+                this->observe(this->_linkEvent, StegoEvent::ModemAnnouncing);
+                break;
+            case ModemLinkState::Handshaking:
+                this->observe(this->_linkEvent, StegoEvent::ModemPeerHeard);
+                break;
+            case ModemLinkState::Connected:
+                this->observe(this->_linkEvent, StegoEvent::ModemConnected);
+                break;
             default:
+                this->observe(this->_linkEvent, StegoEvent::ModemStopped);
                 break;
         }
     }
 
-    void StegoPhone::drawDisplay(u8g2_int_t x, u8g2_int_t y, uint64_t data, bool send, bool clear) {
+    void StegoPhone::observeKeys() {
+        switch (this->_keyExchange->state()) {
+            case KeyExchangeState::ComputingPublic:
+            case KeyExchangeState::WaitingPeer:
+            case KeyExchangeState::ComputingShared:
+                this->observe(this->_keyEvent, StegoEvent::KeyAgreementStarted);
+                break;
+            case KeyExchangeState::Established:
+                this->observe(this->_keyEvent, StegoEvent::KeyAgreed);
+                break;
+            case KeyExchangeState::Failed:
+                this->observe(this->_keyEvent, StegoEvent::KeyAgreementFailed);
+                break;
+            default:
+                this->observe(this->_keyEvent, StegoEvent::KeyAgreementStopped);
+                break;
+        }
+    }
+
+    // KEY AGREEMENT
+    //================================================================================================
+    void StegoPhone::startKeyAgreement() {
+        uint8_t secret[Crypto::X25519::Bytes];
+        HAL::randomBytes(secret, sizeof(secret));
+        // roles from the two public keys: both ends start here, on their own link coming up
+        this->_keyExchange->begin(secret);
+        Crypto::wipe(secret, sizeof(secret));
+        this->_keyShareDue = true;
+    }
+
+    void StegoPhone::shareKeys() {
+        const KeyExchangeState state = this->_keyExchange->state();
+        ModemFrame *frame;
+        while ((frame = this->_modem->receive()) != 0) {
+            // nothing takes data frames before the session is keyed
+            if (frame->type == ModemFrameType::KeyShare && frame->length == Crypto::X25519::Bytes) {
+                if (state == KeyExchangeState::ComputingPublic || state == KeyExchangeState::WaitingPeer)
+                    this->_keyExchange->peerKey(frame->data);
+                else if (state == KeyExchangeState::ComputingShared || state == KeyExchangeState::Established)
+                    this->_keyShareDue = true; // the peer is still waiting: ours was lost
+            }
+            this->_modem->release(frame);
+        }
+
+        // ours once it is computed, then every KeyShareIntervalMs until the peer's arrives
+        uint8_t ours[Crypto::X25519::Bytes];
+        if (!this->_keyExchange->publicKey(ours)) return;
+        const uint32_t now = HAL::millis();
+        if (!this->_keyShareDue && (state != KeyExchangeState::WaitingPeer ||
+                                    now - this->_keyShareMillis < KeyShareIntervalMs))
+            return;
+        frame = this->_modem->acquire();
+        if (!frame) return;
+        frame->type = ModemFrameType::KeyShare;
+        frame->length = sizeof(ours);
+        memcpy(frame->data, ours, sizeof(ours));
+        this->_modem->send(frame);
+        this->_keyShareDue = false;
+        this->_keyShareMillis = now;
+    }
+
+    void StegoPhone::drawDisplay(int16_t x, int16_t y, uint64_t data, bool send, bool clear) {
         char buf[50];
         snprintf(buf, sizeof(buf),  "%" PRIu64, data);
         drawDisplay(x , y, buf, send, clear);
     }
 
 
-    void StegoPhone::drawDisplay(u8g2_int_t x, u8g2_int_t y, char data, bool send, bool clear) {
-        if (clear) display.clear();
+    void StegoPhone::drawDisplay(int16_t x, int16_t y, char data, bool send, bool clear) {
         const char tmp[2] = { data, '\0'};
-        display.drawStr(x, y, tmp);
-        if (send) display.sendBuffer();
+        drawDisplay(x, y, tmp, send, clear);
     }
 
-    void StegoPhone::drawDisplay(u8g2_int_t x, u8g2_int_t y, const char* data, bool send, bool clear) {
-        if (clear) display.clear();
+    // send requests a frame; it goes out with the tick's commitDisplay()
+    void StegoPhone::drawDisplay(int16_t x, int16_t y, const char* data, bool send, bool clear) {
+        STEGOS_PROFILE_SCOPE(Draw);
+        if (clear) display.clearBuffer();
         display.drawStr(x, y, data);
-        if (send) display.sendBuffer();
+        if (send || clear) this->_compositor->request();
     }
 
-    void StegoPhone::drawDisplay(u8g2_int_t x, u8g2_int_t y, std::vector<char*> data, bool send, bool clear) {
+    bool StegoPhone::commitDisplay(bool force) {
+        STEGOS_PROFILE_SCOPE(Commit);
+        if (force) return this->_compositor->flush();
+        return this->_compositor->commit();
+    }
+
+    Compositor *StegoPhone::compositor() {
+        return this->_compositor;
+    }
+
+    void StegoPhone::drawDisplay(int16_t x, int16_t y, std::vector<char*> data, bool send, bool clear) {
         for (size_t i=0; i<data.size(); i++) {
             drawDisplay(x,y,data[i], (i == 0) && send, (i == (data.size() - 1)) && clear);
         }
@@ -167,13 +553,127 @@ namespace StegoPhone {
         return haveLogo;
     }
 
+    // TASKS
+    //================================================================================================
+    bool StegoPhone::startTasks(uint8_t uiPriority, uint8_t usbPriority) {
+        TaskManager *tasks = TaskManager::getInstance();
+        if (!this->_uiTask) {
+            const TaskSpec ui = {"ui", uiPriority, UITaskStackWords, TaskTrigger::Event, UIIdleMs, StegoPhone::uiStep,
+                                 this};
+            this->_uiTask = tasks->start(ui);
+            this->_compositor->setCommitter(this->_uiTask);
+        }
+        if (!this->_usbTask) {
+            const TaskSpec usb = {"usb", usbPriority, USBTaskStackWords, TaskTrigger::Periodic, USBPollMs,
+                                  StegoPhone::usbStep, this};
+            this->_usbTask = tasks->start(usb);
+        }
+        return this->_uiTask && this->_usbTask;
+    }
+
+    void StegoPhone::stopTasks() {
+        ManagedTask *ui = this->_uiTask;
+        ManagedTask *usb = this->_usbTask;
+        this->_uiTask = 0;
+        this->_usbTask = 0;
+        this->_compositor->setCommitter(0);
+        TaskManager::getInstance()->stop(usb);
+        TaskManager::getInstance()->stop(ui);
+    }
+
+    void StegoPhone::uiStep(void *context, uint32_t notifications) {
+        StegoPhone *stego = (StegoPhone *) context;
+        stego->loop();
+        // a frame held back by the interval goes out when the interval ends, not with the next input
+        ManagedTask *task = stego->_uiTask;
+        if (!task) return;
+        const uint32_t dueMs = stego->_compositor->msUntilDue();
+        task->setPeriod(dueMs < UIIdleMs ? dueMs : UIIdleMs);
+    }
+
+    void StegoPhone::usbStep(void *context, uint32_t notifications) {
+        ((StegoPhone *) context)->pollUSB();
+    }
+
+    void StegoPhone::pollUSB() {
+        STEGOS_PROFILE_SCOPE(UsbPoll);
+        // the host controller is started by the boot sequence
+        if (!this->_boot->done(BootUSB)) return;
+
+        // keyboard callbacks fire in here and only queue
+        HAL::usbTask();
+
+        HAL::MouseReport mouseReport;
+        while (HAL::readMouse(mouseReport))
+            this->_input->pushMouse(mouseReport);
+        this->_input->flushMouse();
+
+        if (this->_uiTask && this->_input->depth()) this->_uiTask->notify();
+    }
+
+    uint32_t StegoPhone::handleInput() {
+        uint32_t count = 0;
+        InputEvent event;
+        while (this->_input->pop(event)) {
+            STEGOS_PROFILE_SCOPE(InputEvent);
+            switch (event.type) {
+                case InputEventType::Key:
+                    this->handleKey(event.code);
+                    break;
+                case InputEventType::Consumer:
+                    this->handleConsumer((uint32_t) event.page << 16, event.code);
+                    break;
+                case InputEventType::Mouse:
+                    this->handleMouse(event);
+                    break;
+            }
+            this->_input->handled(event);
+            count++;
+        }
+        return count;
+    }
+
+    InputQueue *StegoPhone::input() {
+        return this->_input;
+    }
+
+    ModemStage *StegoPhone::modem() {
+        return this->_modem;
+    }
+
+    FrameCipher *StegoPhone::cipher() {
+        return this->_cipher;
+    }
+
+    KeyExchange *StegoPhone::keyExchange() {
+        return this->_keyExchange;
+    }
+
+    JitterBuffer *StegoPhone::jitterBuffer() {
+        return this->_jitter;
+    }
+
+    FrameFec *StegoPhone::fec() {
+        return this->_fec;
+    }
+
     StegoStatus StegoPhone::status() {
+        return this->_status->status();
+    }
+
+    StatusMachine *StegoPhone::statusMachine() {
         return this->_status;
     }
 
+    TimerWheel *StegoPhone::timers() {
+        return this->_timers;
+    }
+
     void StegoPhone::setUserLED(bool newValue) {
         this->userLEDStatus = newValue;
-        digitalWrite(userLEDPin, this->userLEDStatus);
+#if !STEGOS_DISPLAY_DMA
+        HAL::digitalWrite(userLEDPin, this->userLEDStatus);
+#endif
     }
 
     void StegoPhone::toggleUserLED() {
@@ -181,338 +681,50 @@ namespace StegoPhone {
     }
 
     void StegoPhone::blinkForever(int interval) {
-        while (1) {
-            this->toggleUserLED();
-            delay(interval);
-        }
+        this->commitDisplay(true);
+        this->_timers->arm(&this->_blinkTimer, interval, interval, HAL::micros());
+    }
+
+    void StegoPhone::blinkStep(void *context) {
+        ((StegoPhone *) context)->toggleUserLED();
     }
 
     void StegoPhone::OnUSBKeyboardPress(int unicode) {
-        StegoPhone *stego = StegoPhone::StegoPhone::getInstance();
-        stego->toggleUserLED();
-
-        std::map<int, std::string>::iterator specialKey;
-        std::map<int, std::string> specialKeys = {
-            {KEYD_UP       , "UP"},
-            {KEYD_DOWN     , "DN"},
-            {KEYD_LEFT     , "LEFT"},
-            {KEYD_RIGHT    , "RIGHT"},
-            {KEYD_INSERT   , "Ins"},
-            {KEYD_DELETE   , "Del"},
-            {KEYD_PAGE_UP  , "PUP"},
-            {KEYD_PAGE_DOWN, "PDN"},
-            {KEYD_HOME     , "HOME"},
-            {KEYD_END      , "END"},
-            {KEYD_F1       , "F1"},
-            {KEYD_F2       , "F2"},
-            {KEYD_F3       , "F3"},
-            {KEYD_F4       , "F4"},
-            {KEYD_F5       , "F5"},
-            {KEYD_F6       , "F6"},
-            {KEYD_F7       , "F7"},
-            {KEYD_F8       , "F8"},
-            {KEYD_F9       , "F9"},
-            {KEYD_F10      , "F10"},
-            {KEYD_F11      , "F11"},
-            {KEYD_F12      , "F12"}
-        };
-        std::map<int, std::string>::iterator controlKey;
-        std::map<int, std::string> controlKeys = {
-            {  0, "NULL"},
-            {  1, "SOH"},
-            {  2, "STX"},
-            {  3, "ETX"},
-            {  4, "EOT"},
-            {  5, "ENQ"},
-            {  6, "ACK"},
-            {  7, "BEL"},
-            {  8, "BS"},
-            {  9, "HT"},
-            { 10, "LF"},
-            { 11, "VT"},
-            { 12, "FF"},
-            { 13, "CR"},
-            { 14, "SO"},
-            { 15, "SI"},
-            { 16, "DLE"},
-            { 17, "DC1"},
-            { 18, "DC2"},
-            { 19, "DC3"},
-            { 20, "DC4"},
-            { 21, "NAK"},
-            { 22, "SYN"},
-            { 23, "ETB"},
-            { 24, "CAN"},
-            { 25, "EM"},
-            { 26, "SUB"},
-            { 27, "ESC"},
-            { 28, "FS"},
-            { 29, "GS"},
-            { 30, "RS"},
-            { 31, "US"},
-            { 32, "Space"}
-        };
+        STEGOS_PROFILE_SCOPE(UsbCallback);
+        StegoPhone::getInstance()->_input->pushKey(unicode);
+    }
 
-        bool found = false;
-        specialKey = specialKeys.find(unicode);
-        if (specialKey != specialKeys.end()) {
-            Serial.println(specialKey->second.c_str());
-            stego->drawDisplay(0, 10, "Key: ", true, false);
-            stego->drawDisplay(60, 10, "      ", true, false);
-            stego->drawDisplay(60, 10, specialKey->second.c_str(), true, false);
-            found = true;
-        } else if (unicode <= 32) {
-            controlKey = controlKeys.find(unicode);
-            if (controlKey != controlKeys.end()) {
-                Serial.println(controlKey->second.c_str());
-                stego->drawDisplay(0, 10, "Key: ", true, false);
-                stego->drawDisplay(60, 10, "      ", true, false);
-                stego->drawDisplay(60, 10, controlKey->second.c_str(), true, false);
-                found = true;
-            }
-        }
+    void StegoPhone::OnUSBKeyboardHIDExtrasPress(uint32_t top, uint16_t key) {
+        STEGOS_PROFILE_SCOPE(UsbCallback);
+        StegoPhone::getInstance()->_input->pushConsumer(top, key);
+    }
+
+    void StegoPhone::handleKey(int unicode) {
+        this->toggleUserLED();
 
-        if (!found) {
-            Serial.print((char) unicode);
-            stego->drawDisplay(0, 10, "Key: ", true, false);
-            stego->drawDisplay(60, 10, "      ", true, false);
-            stego->drawDisplay(60, 10, (char) unicode, true, false);
+        const char *name = KeyNames::keyboard(unicode);
+        if (name) {
+            STEGOS_LOG_INFO("%s", name); // names are static
+            this->drawDisplay(0, 10, "Key: ", true, false);
+            this->drawDisplay(60, 10, "      ", true, false);
+            this->drawDisplay(60, 10, name, true, false);
+        } else {
+            STEGOS_LOG_INFO("%c", unicode);
+            this->drawDisplay(0, 10, "Key: ", true, false);
+            this->drawDisplay(60, 10, "      ", true, false);
+            this->drawDisplay(60, 10, (char) unicode, true, false);
         }
     }
 
-    void StegoPhone::OnUSBKeyboardHIDExtrasPress(uint32_t top, uint16_t key) {
-        Serial.print("HID (");
-        Serial.print(top, HEX);
-        Serial.print(") key press:");
-        Serial.print(key, HEX);
-        if (top == 0xc0000) {
-            switch (key) {
-            case  0x20 : Serial.print(" - +10"); break;
-            case  0x21 : Serial.print(" - +100"); break;
-            case  0x22 : Serial.print(" - AM/PM"); break;
-            case  0x30 : Serial.print(" - Power"); break;
-            case  0x31 : Serial.print(" - Reset"); break;
-            case  0x32 : Serial.print(" - Sleep"); break;
-            case  0x33 : Serial.print(" - Sleep After"); break;
-            case  0x34 : Serial.print(" - Sleep Mode"); break;
-            case  0x35 : Serial.print(" - Illumination"); break;
-            case  0x36 : Serial.print(" - Function Buttons"); break;
-            case  0x40 : Serial.print(" - Menu"); break;
-            case  0x41 : Serial.print(" - Menu  Pick"); break;
-            case  0x42 : Serial.print(" - Menu Up"); break;
-            case  0x43 : Serial.print(" - Menu Down"); break;
-            case  0x44 : Serial.print(" - Menu Left"); break;
-            case  0x45 : Serial.print(" - Menu Right"); break;
-            case  0x46 : Serial.print(" - Menu Escape"); break;
-            case  0x47 : Serial.print(" - Menu Value Increase"); break;
-            case  0x48 : Serial.print(" - Menu Value Decrease"); break;
-            case  0x60 : Serial.print(" - Data On Screen"); break;
-            case  0x61 : Serial.print(" - Closed Caption"); break;
-            case  0x62 : Serial.print(" - Closed Caption Select"); break;
-            case  0x63 : Serial.print(" - VCR/TV"); break;
-            case  0x64 : Serial.print(" - Broadcast Mode"); break;
-            case  0x65 : Serial.print(" - Snapshot"); break;
-            case  0x66 : Serial.print(" - Still"); break;
-            case  0x80 : Serial.print(" - Selection"); break;
-            case  0x81 : Serial.print(" - Assign Selection"); break;
-            case  0x82 : Serial.print(" - Mode Step"); break;
-            case  0x83 : Serial.print(" - Recall Last"); break;
-            case  0x84 : Serial.print(" - Enter Channel"); break;
-            case  0x85 : Serial.print(" - Order Movie"); break;
-            case  0x86 : Serial.print(" - Channel"); break;
-            case  0x87 : Serial.print(" - Media Selection"); break;
-            case  0x88 : Serial.print(" - Media Select Computer"); break;
-            case  0x89 : Serial.print(" - Media Select TV"); break;
-            case  0x8A : Serial.print(" - Media Select WWW"); break;
-            case  0x8B : Serial.print(" - Media Select DVD"); break;
-            case  0x8C : Serial.print(" - Media Select Telephone"); break;
-            case  0x8D : Serial.print(" - Media Select Program Guide"); break;
-            case  0x8E : Serial.print(" - Media Select Video Phone"); break;
-            case  0x8F : Serial.print(" - Media Select Games"); break;
-            case  0x90 : Serial.print(" - Media Select Messages"); break;
-            case  0x91 : Serial.print(" - Media Select CD"); break;
-            case  0x92 : Serial.print(" - Media Select VCR"); break;
-            case  0x93 : Serial.print(" - Media Select Tuner"); break;
-            case  0x94 : Serial.print(" - Quit"); break;
-            case  0x95 : Serial.print(" - Help"); break;
-            case  0x96 : Serial.print(" - Media Select Tape"); break;
-            case  0x97 : Serial.print(" - Media Select Cable"); break;
-            case  0x98 : Serial.print(" - Media Select Satellite"); break;
-            case  0x99 : Serial.print(" - Media Select Security"); break;
-            case  0x9A : Serial.print(" - Media Select Home"); break;
-            case  0x9B : Serial.print(" - Media Select Call"); break;
-            case  0x9C : Serial.print(" - Channel Increment"); break;
-            case  0x9D : Serial.print(" - Channel Decrement"); break;
-            case  0x9E : Serial.print(" - Media Select SAP"); break;
-            case  0xA0 : Serial.print(" - VCR Plus"); break;
-            case  0xA1 : Serial.print(" - Once"); break;
-            case  0xA2 : Serial.print(" - Daily"); break;
-            case  0xA3 : Serial.print(" - Weekly"); break;
-            case  0xA4 : Serial.print(" - Monthly"); break;
-            case  0xB0 : Serial.print(" - Play"); break;
-            case  0xB1 : Serial.print(" - Pause"); break;
-            case  0xB2 : Serial.print(" - Record"); break;
-            case  0xB3 : Serial.print(" - Fast Forward"); break;
-            case  0xB4 : Serial.print(" - Rewind"); break;
-            case  0xB5 : Serial.print(" - Scan Next Track"); break;
-            case  0xB6 : Serial.print(" - Scan Previous Track"); break;
-            case  0xB7 : Serial.print(" - Stop"); break;
-            case  0xB8 : Serial.print(" - Eject"); break;
-            case  0xB9 : Serial.print(" - Random Play"); break;
-            case  0xBA : Serial.print(" - Select DisC"); break;
-            case  0xBB : Serial.print(" - Enter Disc"); break;
-            case  0xBC : Serial.print(" - Repeat"); break;
-            case  0xBD : Serial.print(" - Tracking"); break;
-            case  0xBE : Serial.print(" - Track Normal"); break;
-            case  0xBF : Serial.print(" - Slow Tracking"); break;
-            case  0xC0 : Serial.print(" - Frame Forward"); break;
-            case  0xC1 : Serial.print(" - Frame Back"); break;
-            case  0xC2 : Serial.print(" - Mark"); break;
-            case  0xC3 : Serial.print(" - Clear Mark"); break;
-            case  0xC4 : Serial.print(" - Repeat From Mark"); break;
-            case  0xC5 : Serial.print(" - Return To Mark"); break;
-            case  0xC6 : Serial.print(" - Search Mark Forward"); break;
-            case  0xC7 : Serial.print(" - Search Mark Backwards"); break;
-            case  0xC8 : Serial.print(" - Counter Reset"); break;
-            case  0xC9 : Serial.print(" - Show Counter"); break;
-            case  0xCA : Serial.print(" - Tracking Increment"); break;
-            case  0xCB : Serial.print(" - Tracking Decrement"); break;
-            case  0xCD : Serial.print(" - Pause/Continue"); break;
-            case  0xE0 : Serial.print(" - Volume"); break;
-            case  0xE1 : Serial.print(" - Balance"); break;
-            case  0xE2 : Serial.print(" - Mute"); break;
-            case  0xE3 : Serial.print(" - Bass"); break;
-            case  0xE4 : Serial.print(" - Treble"); break;
-            case  0xE5 : Serial.print(" - Bass Boost"); break;
-            case  0xE6 : Serial.print(" - Surround Mode"); break;
-            case  0xE7 : Serial.print(" - Loudness"); break;
-            case  0xE8 : Serial.print(" - MPX"); break;
-            case  0xE9 : Serial.print(" - Volume Up"); break;
-            case  0xEA : Serial.print(" - Volume Down"); break;
-            case  0xF0 : Serial.print(" - Speed Select"); break;
-            case  0xF1 : Serial.print(" - Playback Speed"); break;
-            case  0xF2 : Serial.print(" - Standard Play"); break;
-            case  0xF3 : Serial.print(" - Long Play"); break;
-            case  0xF4 : Serial.print(" - Extended Play"); break;
-            case  0xF5 : Serial.print(" - Slow"); break;
-            case  0x100: Serial.print(" - Fan Enable"); break;
-            case  0x101: Serial.print(" - Fan Speed"); break;
-            case  0x102: Serial.print(" - Light"); break;
-            case  0x103: Serial.print(" - Light Illumination Level"); break;
-            case  0x104: Serial.print(" - Climate Control Enable"); break;
-            case  0x105: Serial.print(" - Room Temperature"); break;
-            case  0x106: Serial.print(" - Security Enable"); break;
-            case  0x107: Serial.print(" - Fire Alarm"); break;
-            case  0x108: Serial.print(" - Police Alarm"); break;
-            case  0x150: Serial.print(" - Balance Right"); break;
-            case  0x151: Serial.print(" - Balance Left"); break;
-            case  0x152: Serial.print(" - Bass Increment"); break;
-            case  0x153: Serial.print(" - Bass Decrement"); break;
-            case  0x154: Serial.print(" - Treble Increment"); break;
-            case  0x155: Serial.print(" - Treble Decrement"); break;
-            case  0x160: Serial.print(" - Speaker System"); break;
-            case  0x161: Serial.print(" - Channel Left"); break;
-            case  0x162: Serial.print(" - Channel Right"); break;
-            case  0x163: Serial.print(" - Channel Center"); break;
-            case  0x164: Serial.print(" - Channel Front"); break;
-            case  0x165: Serial.print(" - Channel Center Front"); break;
-            case  0x166: Serial.print(" - Channel Side"); break;
-            case  0x167: Serial.print(" - Channel Surround"); break;
-            case  0x168: Serial.print(" - Channel Low Frequency Enhancement"); break;
-            case  0x169: Serial.print(" - Channel Top"); break;
-            case  0x16A: Serial.print(" - Channel Unknown"); break;
-            case  0x170: Serial.print(" - Sub-channel"); break;
-            case  0x171: Serial.print(" - Sub-channel Increment"); break;
-            case  0x172: Serial.print(" - Sub-channel Decrement"); break;
-            case  0x173: Serial.print(" - Alternate Audio Increment"); break;
-            case  0x174: Serial.print(" - Alternate Audio Decrement"); break;
-            case  0x180: Serial.print(" - Application Launch Buttons"); break;
-            case  0x181: Serial.print(" - AL Launch Button Configuration Tool"); break;
-            case  0x182: Serial.print(" - AL Programmable Button Configuration"); break;
-            case  0x183: Serial.print(" - AL Consumer Control Configuration"); break;
-            case  0x184: Serial.print(" - AL Word Processor"); break;
-            case  0x185: Serial.print(" - AL Text Editor"); break;
-            case  0x186: Serial.print(" - AL Spreadsheet"); break;
-            case  0x187: Serial.print(" - AL Graphics Editor"); break;
-            case  0x188: Serial.print(" - AL Presentation App"); break;
-            case  0x189: Serial.print(" - AL Database App"); break;
-            case  0x18A: Serial.print(" - AL Email Reader"); break;
-            case  0x18B: Serial.print(" - AL Newsreader"); break;
-            case  0x18C: Serial.print(" - AL Voicemail"); break;
-            case  0x18D: Serial.print(" - AL Contacts/Address Book"); break;
-            case  0x18E: Serial.print(" - AL Calendar/Schedule"); break;
-            case  0x18F: Serial.print(" - AL Task/Project Manager"); break;
-            case  0x190: Serial.print(" - AL Log/Journal/Timecard"); break;
-            case  0x191: Serial.print(" - AL Checkbook/Finance"); break;
-            case  0x192: Serial.print(" - AL Calculator"); break;
-            case  0x193: Serial.print(" - AL A/V Capture/Playback"); break;
-            case  0x194: Serial.print(" - AL Local Machine Browser"); break;
-            case  0x195: Serial.print(" - AL LAN/WAN Browser"); break;
-            case  0x196: Serial.print(" - AL Internet Browser"); break;
-            case  0x197: Serial.print(" - AL Remote Networking/ISP Connect"); break;
-            case  0x198: Serial.print(" - AL Network Conference"); break;
-            case  0x199: Serial.print(" - AL Network Chat"); break;
-            case  0x19A: Serial.print(" - AL Telephony/Dialer"); break;
-            case  0x19B: Serial.print(" - AL Logon"); break;
-            case  0x19C: Serial.print(" - AL Logoff"); break;
-            case  0x19D: Serial.print(" - AL Logon/Logoff"); break;
-            case  0x19E: Serial.print(" - AL Terminal Lock/Screensaver"); break;
-            case  0x19F: Serial.print(" - AL Control Panel"); break;
-            case  0x1A0: Serial.print(" - AL Command Line Processor/Run"); break;
-            case  0x1A1: Serial.print(" - AL Process/Task Manager"); break;
-            case  0x1A2: Serial.print(" - AL Select Tast/Application"); break;
-            case  0x1A3: Serial.print(" - AL Next Task/Application"); break;
-            case  0x1A4: Serial.print(" - AL Previous Task/Application"); break;
-            case  0x1A5: Serial.print(" - AL Preemptive Halt Task/Application"); break;
-            case  0x200: Serial.print(" - Generic GUI Application Controls"); break;
-            case  0x201: Serial.print(" - AC New"); break;
-            case  0x202: Serial.print(" - AC Open"); break;
-            case  0x203: Serial.print(" - AC Close"); break;
-            case  0x204: Serial.print(" - AC Exit"); break;
-            case  0x205: Serial.print(" - AC Maximize"); break;
-            case  0x206: Serial.print(" - AC Minimize"); break;
-            case  0x207: Serial.print(" - AC Save"); break;
-            case  0x208: Serial.print(" - AC Print"); break;
-            case  0x209: Serial.print(" - AC Properties"); break;
-            case  0x21A: Serial.print(" - AC Undo"); break;
-            case  0x21B: Serial.print(" - AC Copy"); break;
-            case  0x21C: Serial.print(" - AC Cut"); break;
-            case  0x21D: Serial.print(" - AC Paste"); break;
-            case  0x21E: Serial.print(" - AC Select All"); break;
-            case  0x21F: Serial.print(" - AC Find"); break;
-            case  0x220: Serial.print(" - AC Find and Replace"); break;
-            case  0x221: Serial.print(" - AC Search"); break;
-            case  0x222: Serial.print(" - AC Go To"); break;
-            case  0x223: Serial.print(" - AC Home"); break;
-            case  0x224: Serial.print(" - AC Back"); break;
-            case  0x225: Serial.print(" - AC Forward"); break;
-            case  0x226: Serial.print(" - AC Stop"); break;
-            case  0x227: Serial.print(" - AC Refresh"); break;
-            case  0x228: Serial.print(" - AC Previous Link"); break;
-            case  0x229: Serial.print(" - AC Next Link"); break;
-            case  0x22A: Serial.print(" - AC Bookmarks"); break;
-            case  0x22B: Serial.print(" - AC History"); break;
-            case  0x22C: Serial.print(" - AC Subscriptions"); break;
-            case  0x22D: Serial.print(" - AC Zoom In"); break;
-            case  0x22E: Serial.print(" - AC Zoom Out"); break;
-            case  0x22F: Serial.print(" - AC Zoom"); break;
-            case  0x230: Serial.print(" - AC Full Screen View"); break;
-            case  0x231: Serial.print(" - AC Normal View"); break;
-            case  0x232: Serial.print(" - AC View Toggle"); break;
-            case  0x233: Serial.print(" - AC Scroll Up"); break;
-            case  0x234: Serial.print(" - AC Scroll Down"); break;
-            case  0x235: Serial.print(" - AC Scroll"); break;
-            case  0x236: Serial.print(" - AC Pan Left"); break;
-            case  0x237: Serial.print(" - AC Pan Right"); break;
-            case  0x238: Serial.print(" - AC Pan"); break;
-            case  0x239: Serial.print(" - AC New Window"); break;
-            case  0x23A: Serial.print(" - AC Tile Horizontally"); break;
-            case  0x23B: Serial.print(" - AC Tile Vertically"); break;
-            case  0x23C: Serial.print(" - AC Format"); break;
+    void StegoPhone::handleConsumer(uint32_t top, uint16_t usage) {
+        const char *name = (top == KeyNames::ConsumerPage) ? KeyNames::consumer(usage) : 0;
+        if (!name) name = "";
+        STEGOS_LOG_INFO("HID (%X) key press:%X%s%s", top, usage, *name ? " - " : "", name);
+    }
 
-            }
-        }
-        Serial.println();
+    void StegoPhone::handleMouse(const InputEvent &event) {
+        STEGOS_LOG_DEBUG("Mouse: buttons = %u,  mouseX = %d,  mouseY = %d,  wheel = %d,  wheelH = %d",
+                         event.buttons, event.dx, event.dy, event.wheel, event.wheelH);
     }
 
     void StegoPhone::OnUSBKeyboardRawPress(uint8_t keycode) {
@@ -522,29 +734,4 @@ namespace StegoPhone {
     void StegoPhone::OnUSBKeyboardRawRelease(uint8_t keycode) {
         //StegoPhone::getInstance()->toggleUserLED();
     }
-
-    //Bool function to search Serial RX buffer for a string value
-    bool StegoPhone::recFind(HardwareSerial serialPort, String target, uint32_t timeout) {
-        char rdChar = '\0';
-        String rdBuff = "";
-        unsigned long startMillis = millis();
-        while (millis() - startMillis < timeout) {
-            while (serialPort.available() > 0) {
-                rdChar = serialPort.read();
-                rdBuff += rdChar;
-                ConsoleSerial.write(rdChar);
-                if (rdBuff.indexOf(target) != -1) {
-                    break;
-                }
-            }
-            if (rdBuff.indexOf(target) != -1) {
-                break;
-            }
-        }
-        if (rdBuff.indexOf(target) != -1) {
-            return true;
-        } else {
-            return false;
-        }
-    }
 }
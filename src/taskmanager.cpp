@@ -0,0 +1,184 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include <stdio.h>
+#include <string.h>
+#include "taskmanager.h"
+
+namespace StegoPhone {
+    // MANAGED TASK
+    //================================================================================================
+    const TaskSpec &ManagedTask::spec() const {
+        return this->_spec;
+    }
+
+    RTOS::TaskHandle ManagedTask::handle() const {
+        return this->_handle;
+    }
+
+    void ManagedTask::notify() {
+        RTOS::notify(this->_handle);
+    }
+
+    void ManagedTask::notifyFromISR() {
+        RTOS::notifyFromISR(this->_handle);
+    }
+
+    void ManagedTask::setPeriod(uint32_t periodMs) {
+        this->_periodMs = periodMs;
+    }
+
+    TaskStats ManagedTask::stats() const {
+        TaskStats stats;
+        stats.steps = this->_steps;
+        stats.lastStepMicros = this->_lastStepMicros;
+        stats.maxStepMicros = this->_maxStepMicros;
+        stats.overruns = this->_overruns;
+        stats.busyMicros = this->_busyMicros;
+        stats.stackUnusedWords = RTOS::stackUnusedWords(this->_handle);
+        return stats;
+    }
+
+    // TASK MANAGER
+    //================================================================================================
+    TaskManager *TaskManager::_instance = 0;
+
+    TaskManager *TaskManager::getInstance() {
+        if (0 == _instance)
+            _instance = new TaskManager();
+        return _instance;
+    }
+
+    TaskManager::TaskManager() {
+        memset(this->_tasks, 0, sizeof(this->_tasks));
+        this->_statsSince = HAL::micros();
+    }
+
+    ManagedTask *TaskManager::start(const TaskSpec &spec) {
+        ManagedTask *task = 0;
+        for (uint8_t i = 0; i < MaxTasks && !task; i++)
+            if (!this->_tasks[i]._used) task = &this->_tasks[i];
+        if (!task) return 0;
+        task->_spec = spec;
+        task->_periodMs = spec.periodMs;
+        task->_steps = 0;
+        task->_lastStepMicros = 0;
+        task->_maxStepMicros = 0;
+        task->_overruns = 0;
+        task->_busyMicros = 0;
+        task->_handle = 0;
+        task->_used = true;
+        if (!RTOS::createTask(TaskManager::run, spec.name, spec.stackWords, task, spec.priority, &task->_handle)) {
+            task->_used = false;
+            return 0;
+        }
+        return task;
+    }
+
+    void TaskManager::stop(ManagedTask *task) {
+        if (!task || !task->_used) return;
+        RTOS::TaskHandle handle = task->_handle;
+        task->_used = false;
+        task->_handle = 0;
+        RTOS::deleteTask(handle);
+    }
+
+    uint8_t TaskManager::count() const {
+        uint8_t count = 0;
+        for (uint8_t i = 0; i < MaxTasks; i++)
+            if (this->_tasks[i]._used) count++;
+        return count;
+    }
+
+    ManagedTask *TaskManager::find(const char *name) {
+        for (uint8_t i = 0; i < MaxTasks; i++)
+            if (this->_tasks[i]._used && strcmp(this->_tasks[i]._spec.name, name) == 0) return &this->_tasks[i];
+        return 0;
+    }
+
+    uint32_t TaskManager::cpuPermille(const ManagedTask *task) const {
+        const uint32_t elapsed = HAL::micros() - this->_statsSince;
+        if (!elapsed) return 0;
+        return (uint32_t) (task->_busyMicros * 1000 / elapsed);
+    }
+
+    void TaskManager::resetStats() {
+        for (uint8_t i = 0; i < MaxTasks; i++) {
+            ManagedTask &task = this->_tasks[i];
+            task._steps = 0;
+            task._lastStepMicros = 0;
+            task._maxStepMicros = 0;
+            task._overruns = 0;
+            task._busyMicros = 0;
+        }
+        this->_statsSince = HAL::micros();
+    }
+
+    void TaskManager::run(void *arg) {
+        ManagedTask *task = (ManagedTask *) arg;
+        uint32_t notifications = 0;
+        uint32_t lastWake = RTOS::tickCount();
+        while (true) {
+            const uint32_t start = HAL::micros();
+            task->_spec.step(task->_spec.context, notifications);
+            const uint32_t elapsed = HAL::micros() - start;
+            task->_steps++;
+            task->_lastStepMicros = elapsed;
+            if (elapsed > task->_maxStepMicros) task->_maxStepMicros = elapsed;
+            task->_busyMicros += elapsed;
+
+            const uint32_t periodMs = task->_periodMs;
+            if (task->_spec.trigger == TaskTrigger::Event) {
+                notifications = RTOS::waitNotify(periodMs);
+                continue;
+            }
+            // on the period from the last wake, so the time spent in steps does not add up
+            if (!RTOS::delayUntil(lastWake, periodMs)) {
+                // late: still sleep a tick, a yield would starve every lower priority task; the period
+                // starts again from there rather than running the missed ones back to back
+                task->_overruns++;
+                RTOS::delay(1);
+                lastWake = RTOS::tickCount();
+            }
+        }
+    }
+
+    void TaskManager::consoleCommand(void *context, HAL::SerialPort &out, const char *args) {
+        TaskManager *manager = TaskManager::getInstance();
+        if (strcmp(args, "reset") == 0) {
+            manager->resetStats();
+            out.println("tasks: stats reset");
+            return;
+        }
+        char line[128];
+        snprintf(line, sizeof(line), "tasks: %u running, stats over %lu ms", (unsigned) manager->count(),
+                 (unsigned long) ((HAL::micros() - manager->_statsSince) / 1000));
+        out.println(line);
+        out.println("  name       pri trigger  period  stack free/size  cpu%   steps  step last/max us  overruns");
+        for (uint8_t i = 0; i < MaxTasks; i++) {
+            ManagedTask &task = manager->_tasks[i];
+            if (!task._used) continue;
+            const TaskStats stats = task.stats();
+            const uint32_t permille = manager->cpuPermille(&task);
+            char period[16];
+            if (task._periodMs == RTOS::WaitForever) snprintf(period, sizeof(period), "-");
+            else snprintf(period, sizeof(period), "%lums", (unsigned long) task._periodMs);
+            char stack[24];
+            if (stats.stackUnusedWords == RTOS::StackUnknown)
+                snprintf(stack, sizeof(stack), "n/a/%u", (unsigned) task._spec.stackWords);
+            else
+                snprintf(stack, sizeof(stack), "%lu/%u", (unsigned long) stats.stackUnusedWords,
+                         (unsigned) task._spec.stackWords);
+            snprintf(line, sizeof(line), "  %-10s %3u %-8s %6s %16s %3lu.%lu %7lu %8lu/%-8lu %8lu", task._spec.name,
+                     (unsigned) task._spec.priority, task._spec.trigger == TaskTrigger::Event ? "event" : "periodic",
+                     period, stack, (unsigned long) (permille / 10), (unsigned long) (permille % 10),
+                     (unsigned long) stats.steps, (unsigned long) stats.lastStepMicros,
+                     (unsigned long) stats.maxStepMicros, (unsigned long) stats.overruns);
+            out.println(line);
+        }
+    }
+}
@@ -0,0 +1,287 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include <stdio.h>
+#include <string.h>
+#include "timerwheel.h"
+#include "rtos.h"
+
+namespace StegoPhone {
+    Timer::Timer(TimerCallback callback, void *context) {
+        this->_callback = callback;
+        this->_context = context;
+        this->_next = 0;
+        this->_link = 0;
+        this->_expiry = 0;
+        this->_periodMs = 0;
+    }
+
+    void Timer::setCallback(TimerCallback callback, void *context) {
+        this->_callback = callback;
+        this->_context = context;
+    }
+
+    bool Timer::armed() const {
+        return this->_link != 0;
+    }
+
+    TimerWheel::TimerWheel(uint32_t nowMicros) {
+        this->_task = 0;
+        memset(this->_slots, 0, sizeof(this->_slots));
+        this->_tick = 0;
+        this->_micros = 0;
+        this->_lastMicros = nowMicros;
+        this->_armed = 0;
+        this->resetStats();
+    }
+
+    void TimerWheel::place(Timer *timer) {
+        const uint64_t span = (uint64_t) 1 << (SlotBits * Levels);
+        uint64_t expiry = timer->_expiry;
+        if (expiry <= this->_tick) expiry = this->_tick + 1; // already due: the next tick
+        if (expiry - this->_tick >= span) expiry = this->_tick + span - 1;
+        const uint64_t delta = expiry - this->_tick;
+        uint8_t level = 0;
+        while (level < Levels - 1 && delta >= ((uint64_t) 1 << (SlotBits * (level + 1))))
+            level++;
+        this->link(timer, &this->_slots[level][(expiry >> (SlotBits * level)) & (Slots - 1)]);
+    }
+
+    void TimerWheel::link(Timer *timer, Timer **slot) {
+        timer->_next = *slot;
+        if (timer->_next) timer->_next->_link = &timer->_next;
+        timer->_link = slot;
+        *slot = timer;
+    }
+
+    void TimerWheel::unlink(Timer *timer) {
+        *timer->_link = timer->_next;
+        if (timer->_next) timer->_next->_link = timer->_link;
+        timer->_next = 0;
+        timer->_link = 0;
+    }
+
+    // an arm() on another task may have read a later micros() than the advance() it races with, so
+    // anything behind the clock is taken as no time at all
+    void TimerWheel::catchUp(uint32_t nowMicros) {
+        const int32_t elapsed = (int32_t) (nowMicros - this->_lastMicros);
+        if (elapsed <= 0) return;
+        this->_micros += (uint32_t) elapsed;
+        this->_lastMicros = nowMicros;
+    }
+
+    void TimerWheel::arm(Timer *timer, uint32_t delayMs, uint32_t periodMs, uint32_t nowMicros) {
+        RTOS::enterCritical();
+        this->catchUp(nowMicros);
+        if (timer->_link) this->unlink(timer);
+        else this->_armed++;
+        timer->_expiry = this->_micros / 1000 + delayMs;
+        timer->_periodMs = periodMs;
+        this->place(timer);
+        RTOS::exitCritical();
+
+        // the task may be asleep past the new expiry
+        ManagedTask *task = this->_task;
+        if (task && RTOS::currentTask() != task->handle()) task->notify();
+    }
+
+    bool TimerWheel::cancel(Timer *timer) {
+        RTOS::enterCritical();
+        const bool armed = timer->_link != 0;
+        if (armed) {
+            this->unlink(timer);
+            this->_armed--;
+        }
+        RTOS::exitCritical();
+        return armed;
+    }
+
+    // the slot of level the current tick has come round to, re-placed a level or more down
+    void TimerWheel::cascade(uint8_t level) {
+        Timer **slot = &this->_slots[level][(this->_tick >> (SlotBits * level)) & (Slots - 1)];
+        Timer *timer = *slot;
+        *slot = 0;
+        while (timer) {
+            Timer *next = timer->_next;
+            // due on the tick being advanced to: its finest slot is run right after the cascade
+            if (timer->_expiry <= this->_tick) this->link(timer, &this->_slots[0][this->_tick & (Slots - 1)]);
+            else this->place(timer);
+            this->_cascaded++;
+            timer = next;
+        }
+    }
+
+    uint32_t TimerWheel::advance(uint32_t nowMicros) {
+        RTOS::enterCritical();
+        this->catchUp(nowMicros);
+        const uint64_t now = this->_micros;
+        const uint64_t target = now / 1000;
+        RTOS::exitCritical();
+
+        uint32_t count = 0;
+        while (true) {
+            RTOS::enterCritical();
+            if (this->_tick >= target) {
+                RTOS::exitCritical();
+                break;
+            }
+            const uint64_t tick = ++this->_tick;
+            this->_ticks++;
+            // each level comes round as the one below wraps
+            for (uint8_t level = 1; level < Levels; level++) {
+                if ((tick >> (SlotBits * (level - 1))) & (Slots - 1)) break;
+                this->cascade(level);
+            }
+            Timer **slot = &this->_slots[0][tick & (Slots - 1)];
+            RTOS::exitCritical();
+
+            // everything in the slot is due now; one at a time, callbacks outside the critical section
+            while (true) {
+                RTOS::enterCritical();
+                Timer *timer = *slot;
+                if (!timer) {
+                    RTOS::exitCritical();
+                    break;
+                }
+                this->unlink(timer);
+                const uint64_t expiry = timer->_expiry;
+                const TimerCallback callback = timer->_callback;
+                void *context = timer->_context;
+                if (timer->_periodMs) {
+                    // same phase; periods missed in a long gap are skipped, not run back to back
+                    timer->_expiry += timer->_periodMs;
+                    if (timer->_expiry <= target)
+                        timer->_expiry += ((target - timer->_expiry) / timer->_periodMs + 1) * timer->_periodMs;
+                    this->place(timer);
+                } else {
+                    this->_armed--;
+                }
+                RTOS::exitCritical();
+
+                const uint64_t due = expiry * 1000;
+                const uint32_t late = now > due ? (uint32_t) (now - due) : 0;
+                this->_lastLateMicros = late;
+                this->_totalLateMicros += late;
+                if (late > this->_maxLateMicros) this->_maxLateMicros = late;
+                if (late >= LateMicros) this->_late++;
+                this->_fired++;
+                count++;
+                if (callback) callback(context);
+            }
+        }
+        return count;
+    }
+
+    uint32_t TimerWheel::msUntilNext() const {
+        if (!this->_armed) return RTOS::WaitForever;
+        // the finest wheel holds the next Slots ticks; anything further needs a cascade first, at the
+        // latest when it wraps
+        const uint64_t wrap = (this->_tick | (Slots - 1)) + 1;
+        for (uint64_t tick = this->_tick + 1; tick <= this->_tick + Slots; tick++) {
+            if (this->_slots[0][tick & (Slots - 1)]) return (uint32_t) (tick < wrap ? tick : wrap) - this->_tick;
+        }
+        return (uint32_t) (wrap - this->_tick);
+    }
+
+    uint32_t TimerWheel::armedCount() const {
+        return this->_armed;
+    }
+
+    // SERVICE TASK
+    //================================================================================================
+    bool TimerWheel::startTask(uint8_t priority) {
+        if (this->_task) return true;
+        const TaskSpec spec = {"timers", priority, TaskStackWords, TaskTrigger::Event, RTOS::WaitForever,
+                               TimerWheel::taskStep, this};
+        this->_task = TaskManager::getInstance()->start(spec);
+        return this->_task != 0;
+    }
+
+    void TimerWheel::stopTask() {
+        if (!this->_task) return;
+        ManagedTask *task = this->_task;
+        this->_task = 0;
+        TaskManager::getInstance()->stop(task);
+    }
+
+    bool TimerWheel::taskRunning() const {
+        return this->_task != 0;
+    }
+
+    void TimerWheel::taskStep(void *context, uint32_t notifications) {
+        TimerWheel *wheel = (TimerWheel *) context;
+        wheel->advance(HAL::micros());
+        ManagedTask *task = wheel->_task;
+        const uint32_t nextMs = wheel->msUntilNext();
+        if (task) task->setPeriod(nextMs < IdleWakeMs ? nextMs : IdleWakeMs);
+    }
+
+    // STATS
+    //================================================================================================
+    uint32_t TimerWheel::fired() const {
+        return this->_fired;
+    }
+
+    uint32_t TimerWheel::lastLateMicros() const {
+        return this->_lastLateMicros;
+    }
+
+    uint32_t TimerWheel::meanLateMicros() const {
+        return this->_fired ? (uint32_t) (this->_totalLateMicros / this->_fired) : 0;
+    }
+
+    uint32_t TimerWheel::maxLateMicros() const {
+        return this->_maxLateMicros;
+    }
+
+    uint32_t TimerWheel::late() const {
+        return this->_late;
+    }
+
+    uint32_t TimerWheel::ticks() const {
+        return this->_ticks;
+    }
+
+    uint32_t TimerWheel::cascaded() const {
+        return this->_cascaded;
+    }
+
+    void TimerWheel::resetStats() {
+        this->_fired = 0;
+        this->_lastLateMicros = 0;
+        this->_totalLateMicros = 0;
+        this->_maxLateMicros = 0;
+        this->_late = 0;
+        this->_ticks = 0;
+        this->_cascaded = 0;
+    }
+
+    void TimerWheel::consoleCommand(void *context, HAL::SerialPort &out, const char *args) {
+        TimerWheel *wheel = (TimerWheel *) context;
+        if (strcmp(args, "reset") == 0) {
+            wheel->resetStats();
+            out.println("timers: stats reset");
+            return;
+        }
+        char next[16];
+        const uint32_t nextMs = wheel->msUntilNext();
+        if (nextMs == RTOS::WaitForever) snprintf(next, sizeof(next), "-");
+        else snprintf(next, sizeof(next), "%lums", (unsigned long) nextMs);
+        char line[128];
+        snprintf(line, sizeof(line), "timers: %lu armed, %s, next tick with work in %s",
+                 (unsigned long) wheel->_armed, wheel->_task ? "on its task" : "polled", next);
+        out.println(line);
+        snprintf(line, sizeof(line), "  fired %lu, late %lu (>= %lu us), lateness last/mean/max %lu/%lu/%lu us",
+                 (unsigned long) wheel->_fired, (unsigned long) wheel->_late, (unsigned long) LateMicros,
+                 (unsigned long) wheel->_lastLateMicros, (unsigned long) wheel->meanLateMicros(),
+                 (unsigned long) wheel->_maxLateMicros);
+        out.println(line);
+        snprintf(line, sizeof(line), "  %lu ticks, %lu timers cascaded", (unsigned long) wheel->_ticks,
+                 (unsigned long) wheel->_cascaded);
+        out.println(line);
+    }
+}
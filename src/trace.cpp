@@ -0,0 +1,156 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include <stdio.h>
+#include <string.h>
+#include "trace.h"
+
+namespace StegoPhone {
+    static_assert((STEGOS_TRACE_CAPACITY & (STEGOS_TRACE_CAPACITY - 1)) == 0, "trace capacity must be a power of two");
+
+    // bytes per dumped line
+    static const uint8_t DumpWidth = 16;
+
+    bool Trace::enabled() {
+        return STEGOS_TRACE != 0;
+    }
+
+    const char *Trace::channelName(TraceChannel channel) {
+        switch (channel) {
+            case TraceChannel::RN52:
+                return "RN52";
+            case TraceChannel::ESP8266:
+                return "ESP8266";
+            default:
+                return "?";
+        }
+    }
+
+#if STEGOS_TRACE
+    Trace::Slot Trace::_slots[Trace::Capacity];
+    std::atomic<uint32_t> Trace::_head(0);
+    uint32_t Trace::_cursor = 0;
+    uint32_t Trace::_lost = 0;
+
+    void Trace::record(TraceChannel channel, TraceDirection direction, const uint8_t *data, size_t length) {
+        while (length--)
+            record(channel, direction, *data++);
+    }
+
+    bool Trace::next(TraceRecord &record) {
+        while (true) {
+            const uint32_t head = _head.load(std::memory_order_acquire);
+            if (head - _cursor > Capacity) {
+                _lost += head - _cursor - Capacity;
+                _cursor = head - Capacity;
+            }
+            if (_cursor == head) return false;
+
+            // seqlock read: the word must carry this index before and after copying the timestamp
+            const Slot &slot = _slots[_cursor & (Capacity - 1)];
+            const uint32_t word = slot.word.load(std::memory_order_acquire);
+            const uint32_t micros = slot.micros.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            const bool consistent = (word != Busy) && ((word >> 16) == (_cursor & 0xFFFF)) &&
+                                    (slot.word.load(std::memory_order_relaxed) == word);
+            if (consistent) {
+                record.micros = micros;
+                record.channel = (TraceChannel) ((word >> 9) & 0x7F);
+                record.direction = (TraceDirection) ((word >> 8) & 1);
+                record.value = (uint8_t) word;
+                _cursor++;
+                return true;
+            }
+            // either still being written (stop here) or already overwritten (skip it)
+            if (_head.load(std::memory_order_acquire) - _cursor <= Capacity) return false;
+            _lost++;
+            _cursor++;
+        }
+    }
+
+    void Trace::clear() {
+        _cursor = _head.load(std::memory_order_acquire);
+    }
+
+    uint32_t Trace::recorded() {
+        return _head.load(std::memory_order_relaxed);
+    }
+
+    uint32_t Trace::lost() {
+        return _lost;
+    }
+#else
+    bool Trace::next(TraceRecord &record) {
+        return false;
+    }
+
+    void Trace::clear() {
+    }
+
+    uint32_t Trace::recorded() {
+        return 0;
+    }
+
+    uint32_t Trace::lost() {
+        return 0;
+    }
+#endif
+
+    static void dumpLine(HAL::SerialPort &out, const TraceRecord &first, const uint8_t *data, uint8_t length) {
+        char line[32 + DumpWidth * 4];
+        int pos = snprintf(line, sizeof(line), "%10lu %-7s %s ", (unsigned long) first.micros,
+                           Trace::channelName(first.channel), first.direction == TraceDirection::Rx ? "RX" : "TX");
+        for (uint8_t i = 0; i < DumpWidth; i++) {
+            if (i < length) pos += snprintf(line + pos, sizeof(line) - pos, "%02x ", data[i]);
+            else pos += snprintf(line + pos, sizeof(line) - pos, "   ");
+        }
+        for (uint8_t i = 0; i < length; i++)
+            line[pos++] = (data[i] >= 0x20 && data[i] < 0x7F) ? (char) data[i] : '.';
+        line[pos] = '\0';
+        out.println(line);
+    }
+
+    uint32_t Trace::dump(HAL::SerialPort &out, uint32_t maxRecords) {
+        if (!enabled()) {
+            out.println("trace: not compiled in (build with -DSTEGOS_TRACE=1)");
+            return 0;
+        }
+        TraceRecord first;
+        TraceRecord record;
+        uint8_t data[DumpWidth];
+        uint8_t length = 0;
+        uint32_t printed = 0;
+        while (printed < maxRecords && next(record)) {
+            // a new line per channel/direction change, or when full
+            if (length > 0 && (length == DumpWidth || record.channel != first.channel ||
+                               record.direction != first.direction)) {
+                dumpLine(out, first, data, length);
+                length = 0;
+            }
+            if (length == 0) first = record;
+            data[length++] = record.value;
+            printed++;
+        }
+        if (length > 0) dumpLine(out, first, data, length);
+        return printed;
+    }
+
+    void Trace::consoleCommand(void *context, HAL::SerialPort &out, const char *args) {
+        if (strcmp(args, "clear") == 0) {
+            clear();
+        } else if (strcmp(args, "stats") == 0) {
+            out.print("trace: recorded ");
+            out.print((unsigned long) recorded());
+            out.print(", lost ");
+            out.print((unsigned long) lost());
+            out.print(", capacity ");
+            out.println((unsigned long) Capacity);
+        } else {
+            dump(out);
+        }
+    }
+}
@@ -0,0 +1,430 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include <string.h>
+#include "voicecodec.h"
+#include "dsp.h"
+#include "resampler.h"
+
+namespace StegoPhone {
+    namespace {
+        const VoiceModeInfo ModeInfo[] = {
+                {3200, 160, 8, 20},
+                {2400, 160, 6, 20},
+                {1200, 320, 6, 40},
+        };
+
+        const uint8_t Order = VoiceParams::Order;
+        const int16_t Emphasis = 30720; // 0.9375
+        const int32_t VoicedThreshold = 16384; // normalised pitch correlation, Q15
+        const int32_t SubMultipleThreshold = 27853; // 0.85 of the best correlation, Q15
+        const uint64_t PitchEnergyFloor = 64 * 64; // per sample, low passed; quieter is unvoiced
+
+        // bits per LAR, 3200 and the rest, and the Q14 range each is quantised over
+        const uint8_t FineLarBits[Order] = {6, 6, 5, 5, 5, 5, 4, 4, 4, 3};
+        const uint8_t CoarseLarBits[Order] = {5, 5, 4, 4, 4, 4, 3, 3, 2, 2};
+        const int32_t LarRange[Order] = {26624, 26624, 19661, 19661, 14746, 14746, 12288, 12288, 9830, 9830};
+
+        // Gaussian lag window (about 60 Hz of bandwidth expansion), Q15, so sharp formants stay stable
+        const int32_t LagWindow[Order + 1] = {32768, 32732, 32623, 32442, 32191, 31871, 31484, 31033, 30520,
+                                              29950, 29324};
+
+        template<uint16_t Length>
+        struct Window {
+            int16_t values[Length];
+        };
+
+        template<uint16_t Length>
+        constexpr Window<Length> designHamming() {
+            Window<Length> window = {};
+            for (uint16_t i = 0; i < Length; i++) {
+                const double phase = 2 * DSP::Design::Pi * i / (Length - 1);
+                window.values[i] = DSP::Design::toQ15(0.54 - 0.46 * DSP::Design::sine(phase + DSP::Design::Pi / 2));
+            }
+            return window;
+        }
+
+        // the LPC window: the frame and the WindowLead samples before it
+        const uint16_t ShortWindowLength = VoiceEncoder::WindowLead + 160;
+        const uint16_t LongWindowLength = VoiceEncoder::WindowLead + 320;
+        constexpr Window<ShortWindowLength> ShortWindow = designHamming<ShortWindowLength>();
+        constexpr Window<LongWindowLength> LongWindow = designHamming<LongWindowLength>();
+
+        // GSM 06.10's piecewise linear log area ratio, on and back from a Q15 reflection coefficient
+        int16_t toLar(int16_t k) {
+            const int32_t magnitude = k < 0 ? -(int32_t) k : k;
+            int32_t lar;
+            if (magnitude < 22118)
+                lar = magnitude >> 1;
+            else if (magnitude < 31130)
+                lar = magnitude - 11059;
+            else
+                lar = (magnitude - 26112) << 2;
+            return (int16_t) (k < 0 ? -lar : lar);
+        }
+
+        int16_t fromLar(int16_t lar) {
+            const int32_t magnitude = lar < 0 ? -(int32_t) lar : lar;
+            int32_t k;
+            if (magnitude < 11059)
+                k = magnitude << 1;
+            else if (magnitude < 20070)
+                k = magnitude + 11059;
+            else
+                k = (magnitude >> 2) + 26112;
+            if (k > 32767) k = 32767;
+            return (int16_t) (lar < 0 ? -k : k);
+        }
+
+        // uniform over [-range, range), decoded to the middle of each step
+        uint8_t quantise(int32_t value, int32_t range, uint8_t bits) {
+            const int32_t levels = 1 << bits;
+            int32_t index = (int32_t) (((int64_t) (value + range) * levels) / (2 * range));
+            if (index < 0) index = 0;
+            if (index >= levels) index = levels - 1;
+            return (uint8_t) index;
+        }
+
+        int16_t dequantise(uint8_t index, int32_t range, uint8_t bits) {
+            return (int16_t) (-range + (range * (2 * index + 1)) / (1 << bits));
+        }
+
+        // floor(log2(rms^2) + 1/2): 3dB steps, 0 kept for silence; decodes to 2^(code / 2)
+        uint8_t gainCode(uint32_t rms) {
+            if (!rms) return 0;
+            const uint64_t power = (uint64_t) rms * rms;
+            uint8_t code = 0;
+            while (((uint64_t) 1 << (code + 1)) <= power)
+                code++;
+            // past the half way point (2^(code + 1/2)) when power^2 >= 2^(2 code + 1)
+            if (power * power >= ((uint64_t) 1 << (2 * code + 1))) code++;
+            if (code < 1) code = 1;
+            if (code > 31) code = 31;
+            return code;
+        }
+
+        uint16_t gainValue(uint8_t code) {
+            if (!code) return 0;
+            const uint32_t whole = (uint32_t) 1 << (code >> 1);
+            return (uint16_t) ((code & 1) ? (whole * 46341) >> 15 : whole); // odd codes: times sqrt(2)
+        }
+
+        void putBits(uint8_t *bits, uint16_t &position, uint8_t count, uint32_t value) {
+            while (count--) {
+                const uint8_t bit = (uint8_t) ((value >> count) & 1);
+                if (bit)
+                    bits[position >> 3] |= (uint8_t) (0x80 >> (position & 7));
+                position++;
+            }
+        }
+
+        uint32_t getBits(const uint8_t *bits, uint16_t &position, uint8_t count) {
+            uint32_t value = 0;
+            while (count--) {
+                value = (value << 1) | ((bits[position >> 3] >> (7 - (position & 7))) & 1);
+                position++;
+            }
+            return value;
+        }
+
+        // pitch 7, gain 5 (two at 3200), then the LARs, MSB first
+        void pack(VoiceMode mode, const uint8_t *codes, uint8_t lagCode, const uint8_t *gains, uint8_t *bits) {
+            memset(bits, 0, voiceModeInfo(mode).frameBytes);
+            const uint8_t *larBits = mode == VoiceMode::Bits3200 ? FineLarBits : CoarseLarBits;
+            uint16_t position = 0;
+            putBits(bits, position, 7, lagCode);
+            putBits(bits, position, 5, gains[0]);
+            if (mode == VoiceMode::Bits3200) putBits(bits, position, 5, gains[1]);
+            for (uint8_t i = 0; i < Order; i++)
+                putBits(bits, position, larBits[i], codes[i]);
+        }
+
+        void unpack(VoiceMode mode, const uint8_t *bits, VoiceParams &params) {
+            const uint8_t *larBits = mode == VoiceMode::Bits3200 ? FineLarBits : CoarseLarBits;
+            uint16_t position = 0;
+            const uint8_t lagCode = (uint8_t) getBits(bits, position, 7);
+            params.lag = lagCode ? (uint8_t) (lagCode + VoiceEncoder::MinLag - 1) : 0;
+            params.rms[0] = gainValue((uint8_t) getBits(bits, position, 5));
+            params.rms[1] = mode == VoiceMode::Bits3200 ? gainValue((uint8_t) getBits(bits, position, 5))
+                                                        : params.rms[0];
+            for (uint8_t i = 0; i < Order; i++)
+                params.lar[i] = dequantise((uint8_t) getBits(bits, position, larBits[i]), LarRange[i], larBits[i]);
+        }
+    }
+
+    const VoiceModeInfo &voiceModeInfo(VoiceMode mode) {
+        return ModeInfo[(uint8_t) mode];
+    }
+
+    // ENCODER
+    //================================================================================================
+    VoiceEncoder::VoiceEncoder(VoiceMode mode) {
+        this->setMode(mode);
+    }
+
+    void VoiceEncoder::setMode(VoiceMode mode) {
+        this->_mode = mode;
+        this->reset();
+    }
+
+    VoiceMode VoiceEncoder::mode() const {
+        return this->_mode;
+    }
+
+    void VoiceEncoder::reset() {
+        memset(&this->_params, 0, sizeof(this->_params));
+        this->_voicing = 0;
+        this->_previousInput = 0;
+        this->_lowpass = 0;
+        memset(this->_speech, 0, sizeof(this->_speech));
+        memset(this->_pitch, 0, sizeof(this->_pitch));
+        memset(this->_windowed, 0, sizeof(this->_windowed));
+        memset(this->_reflection, 0, sizeof(this->_reflection));
+    }
+
+    const VoiceParams &VoiceEncoder::lastParams() const {
+        return this->_params;
+    }
+
+    int16_t VoiceEncoder::lastVoicing() const {
+        return this->_voicing;
+    }
+
+    void VoiceEncoder::analyse(uint16_t frameSamples) {
+        const uint16_t length = (uint16_t) (WindowLead + frameSamples);
+        const int16_t *window = frameSamples == 160 ? ShortWindow.values : LongWindow.values;
+        for (uint16_t i = 0; i < length; i++)
+            this->_windowed[i] = (int16_t) (((int32_t) this->_speech[i] * window[i] + (1 << 14)) >> 15);
+
+        int64_t r[Order + 1];
+        for (uint8_t i = 0; i <= Order; i++)
+            r[i] = (DSP::dotQ15(this->_windowed, this->_windowed + i, length - i) * LagWindow[i]) >> 15;
+        r[0] += r[0] >> 13; // -40dB noise floor
+        memset(this->_reflection, 0, sizeof(this->_reflection));
+        if (r[0] <= 0) return;
+
+        // normalised to r[0] = 2^24, then Levinson-Durbin in Q24 for A(z) = 1 + sum a[j] z^-j
+        const int32_t One = 1 << 24;
+        uint8_t shift = 0;
+        while ((r[0] >> shift) >= ((int64_t) 1 << 30))
+            shift++;
+        const int64_t r0 = r[0] >> shift;
+        int32_t normalised[Order + 1];
+        for (uint8_t i = 0; i <= Order; i++)
+            normalised[i] = (int32_t) (((r[i] >> shift) * One) / r0);
+
+        int32_t a[Order + 1] = {One};
+        int32_t previous[Order + 1];
+        int64_t error = One;
+        for (uint8_t i = 1; i <= Order; i++) {
+            int64_t sum = (int64_t) normalised[i] * One;
+            for (uint8_t j = 1; j < i; j++)
+                sum += (int64_t) a[j] * normalised[i - j];
+            const int64_t k = -sum / error;
+            if (k >= One - One / 1000 || k <= -One + One / 1000) break;
+            memcpy(previous, a, sizeof(a));
+            for (uint8_t j = 1; j < i; j++)
+                a[j] = (int32_t) (previous[j] + ((k * previous[i - j]) >> 24));
+            a[i] = (int32_t) k;
+            error = (error * (One - ((k * k) >> 24))) >> 24;
+            this->_reflection[i - 1] = DSP::saturate16((int32_t) (k >> 9));
+            if (error <= 0) break;
+        }
+    }
+
+    uint8_t VoiceEncoder::searchPitch(uint16_t frameSamples) {
+        // normalised correlation of the frame against itself lag samples back, for every lag
+        const int16_t *frame = this->_pitch + MaxLag;
+        const uint64_t energy = (uint64_t) DSP::energyQ15(frame, frameSamples);
+        this->_voicing = 0;
+        if (energy < PitchEnergyFloor * frameSamples) return 0;
+        const uint32_t frameRoot = DSP::isqrt64(energy);
+
+        int16_t correlation[MaxLag + 1];
+        uint64_t lagEnergy = DSP::energyQ15(frame - MinLag, frameSamples);
+        uint8_t best = MinLag;
+        for (uint8_t lag = MinLag; lag <= MaxLag; lag++) {
+            const int64_t c = DSP::dotQ15(frame, frame - lag, frameSamples);
+            const uint64_t denominator = (uint64_t) frameRoot * DSP::isqrt64(lagEnergy);
+            int32_t normalised = 0;
+            if (c > 0 && denominator) {
+                const int64_t q = (c << 15) / (int64_t) denominator;
+                normalised = q > 32767 ? 32767 : (int32_t) q;
+            }
+            correlation[lag] = (int16_t) normalised;
+            if (normalised > correlation[best]) best = lag;
+            // slide the lagged window one sample further back
+            if (lag < MaxLag) {
+                const int32_t entering = frame[-(int32_t) lag - 1];
+                const int32_t leaving = frame[frameSamples - lag - 1];
+                lagEnergy = lagEnergy + (uint64_t) (entering * entering) - (uint64_t) (leaving * leaving);
+            }
+        }
+
+        // a period that fits twice or three times is the pitch, not its multiple
+        const int32_t floor = (correlation[best] * SubMultipleThreshold) >> 15;
+        for (uint8_t divisor = 3; divisor >= 2; divisor--) {
+            const uint8_t centre = (uint8_t) ((best + divisor / 2) / divisor);
+            if (centre < MinLag + 1) continue;
+            uint8_t candidate = centre;
+            for (uint8_t lag = (uint8_t) (centre - 1); lag <= centre + 1 && lag <= MaxLag; lag++)
+                if (correlation[lag] > correlation[candidate]) candidate = lag;
+            if (correlation[candidate] > floor) {
+                best = candidate;
+                break;
+            }
+        }
+        this->_voicing = correlation[best];
+        return this->_voicing > VoicedThreshold ? best : 0;
+    }
+
+    void VoiceEncoder::encode(const int16_t *samples, uint8_t *bits) {
+        const uint16_t frameSamples = voiceModeInfo(this->_mode).frameSamples;
+        int16_t *speech = this->_speech + WindowLead;
+        int16_t *lowpassed = this->_pitch + MaxLag;
+        for (uint16_t i = 0; i < frameSamples; i++) {
+            const int16_t x = samples[i];
+            speech[i] = DSP::saturate16(x - (((int32_t) this->_previousInput * Emphasis) >> 15));
+            this->_previousInput = x;
+            this->_lowpass += (x - this->_lowpass) >> 2;
+            lowpassed[i] = (int16_t) this->_lowpass;
+        }
+
+        this->analyse(frameSamples);
+        const uint8_t lag = this->searchPitch(frameSamples);
+
+        uint8_t gains[2];
+        if (this->_mode == VoiceMode::Bits3200) {
+            gains[0] = gainCode(DSP::rmsQ15(speech, frameSamples / 2));
+            gains[1] = gainCode(DSP::rmsQ15(speech + frameSamples / 2, frameSamples / 2));
+        } else {
+            gains[0] = gains[1] = gainCode(DSP::rmsQ15(speech, frameSamples));
+        }
+        const uint8_t *larBits = this->_mode == VoiceMode::Bits3200 ? FineLarBits : CoarseLarBits;
+        uint8_t codes[Order];
+        for (uint8_t i = 0; i < Order; i++) {
+            codes[i] = quantise(toLar(this->_reflection[i]), LarRange[i], larBits[i]);
+            this->_params.lar[i] = dequantise(codes[i], LarRange[i], larBits[i]);
+        }
+        this->_params.lag = lag;
+        this->_params.rms[0] = gainValue(gains[0]);
+        this->_params.rms[1] = gainValue(gains[1]);
+        pack(this->_mode, codes, lag ? (uint8_t) (lag - MinLag + 1) : 0, gains, bits);
+
+        // the tail of this frame leads the next one's windows
+        memmove(this->_speech, this->_speech + frameSamples, WindowLead * sizeof(int16_t));
+        memmove(this->_pitch, this->_pitch + frameSamples, MaxLag * sizeof(int16_t));
+    }
+
+    // DECODER
+    //================================================================================================
+    VoiceDecoder::VoiceDecoder(VoiceMode mode) {
+        this->setMode(mode);
+    }
+
+    void VoiceDecoder::setMode(VoiceMode mode) {
+        this->_mode = mode;
+        this->reset();
+    }
+
+    VoiceMode VoiceDecoder::mode() const {
+        return this->_mode;
+    }
+
+    void VoiceDecoder::reset() {
+        memset(&this->_params, 0, sizeof(this->_params));
+        this->_lost = 0;
+        memset(this->_lattice, 0, sizeof(this->_lattice));
+        this->_pulseCountdown = 0;
+        this->_noise = 0x2545f491;
+        this->_deemphasis = 0;
+    }
+
+    const VoiceParams &VoiceDecoder::lastParams() const {
+        return this->_params;
+    }
+
+    void VoiceDecoder::decode(const uint8_t *bits, int16_t *samples) {
+        VoiceParams next;
+        unpack(this->_mode, bits, next);
+        this->_lost = 0;
+        this->synthesise(next, samples);
+    }
+
+    void VoiceDecoder::conceal(int16_t *samples) {
+        VoiceParams next = this->_params;
+        if (this->_lost < ConcealFrames) this->_lost++;
+        for (uint8_t half = 0; half < 2; half++)
+            next.rms[half] = this->_lost >= ConcealFrames ? 0 : (uint16_t) (next.rms[half] >> 1);
+        this->synthesise(next, samples);
+    }
+
+    int32_t VoiceDecoder::excitation(uint8_t lag, uint32_t gain) {
+        if (lag) {
+            // one pulse a period, sqrt(lag) times the level so the power per sample comes out at gain^2
+            if (this->_pulseCountdown > lag) this->_pulseCountdown = lag;
+            if (--this->_pulseCountdown) return 0;
+            this->_pulseCountdown = lag;
+            return (int32_t) ((gain * DSP::isqrt64((uint64_t) lag << 16)) >> 8);
+        }
+        // xorshift noise, uniform, so sqrt(3) times the level over full scale
+        uint32_t x = this->_noise;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        this->_noise = x;
+        return (int32_t) (((int64_t) (int16_t) (x >> 16) * gain * 56756) >> 30);
+    }
+
+    void VoiceDecoder::synthesise(const VoiceParams &next, int16_t *samples) {
+        const uint16_t frameSamples = voiceModeInfo(this->_mode).frameSamples;
+        const uint8_t subframes = (uint8_t) (frameSamples / SubframeSamples);
+        const uint8_t half = (uint8_t) (subframes / 2);
+        const VoiceParams &last = this->_params;
+        for (uint8_t s = 0; s < subframes; s++) {
+            // the spectrum and the pitch slide from the last frame to this one; the level reaches
+            // rms[0] half way and rms[1] at the end
+            const int32_t step = s + 1;
+            int16_t k[Order];
+            int32_t prediction = 32768; // product of (1 - k^2), Q15
+            for (uint8_t i = 0; i < Order; i++) {
+                const int32_t lar = last.lar[i] + ((next.lar[i] - last.lar[i]) * step) / subframes;
+                k[i] = fromLar((int16_t) lar);
+                prediction = (prediction * (32768 - (((int32_t) k[i] * k[i]) >> 15))) >> 15;
+            }
+            int32_t rms;
+            if (s < half)
+                rms = last.rms[1] + (((int32_t) next.rms[0] - last.rms[1]) * step) / half;
+            else
+                rms = next.rms[0] + (((int32_t) next.rms[1] - next.rms[0]) * (step - half)) / (subframes - half);
+            const uint32_t gain = (uint32_t) (((uint64_t) rms * DSP::isqrt64((uint64_t) prediction << 15)) >> 15);
+            uint8_t lag;
+            if (last.lag && next.lag)
+                lag = (uint8_t) (last.lag + ((next.lag - last.lag) * step) / subframes);
+            else
+                lag = s < half ? last.lag : next.lag;
+
+            int16_t *out = samples + s * SubframeSamples;
+            for (uint8_t n = 0; n < SubframeSamples; n++) {
+                // all pole lattice, the synthesis side of A(z): b[i] holds the backward error of stage i.
+                // Products truncate toward zero here and in the de-emphasis, so with no excitation the
+                // tail dies away instead of settling into a small limit cycle.
+                int32_t f = this->excitation(lag, gain);
+                for (uint8_t i = Order; i > 0; i--) {
+                    f = DSP::saturate32((int64_t) f - ((int64_t) k[i - 1] * this->_lattice[i - 1]) / 32768);
+                    if (i < Order)
+                        this->_lattice[i] = DSP::saturate32(
+                                (int64_t) this->_lattice[i - 1] + ((int64_t) k[i - 1] * f) / 32768);
+                }
+                this->_lattice[0] = f;
+                this->_deemphasis = DSP::saturate16(f + ((int32_t) this->_deemphasis * Emphasis) / 32768);
+                out[n] = this->_deemphasis;
+            }
+        }
+        this->_params = next;
+    }
+}
@@ -0,0 +1,227 @@
+//################################################################################################
+//## StegoPhone : Steganography over Telephone / StegOS
+//## (c) 2020 Jessica Mulein (jessica@mulein.com)
+//## All rights reserved.
+//## Made available under the GPLv3
+//################################################################################################
+
+#include <string.h>
+#include "x25519.h"
+#include "chacha20poly1305.h"
+
+// Field arithmetic mod p = 2^255 - 19 after TweetNaCl: an element is sum of v[i] * 2^(16 i). Products
+// land in 31 int64_t columns; 2^256 is 38 mod p, so the top 15 fold down times 38, and two carry passes
+// bring every limb back to 16 bits (the top carry wraps round times 38 as well). Sums and differences
+// are left unreduced: every multiply takes inputs at most one addition away from a carried element,
+// under 2^18 in magnitude, so no column passes 2^45.
+
+namespace StegoPhone {
+    namespace Crypto {
+        const uint8_t X25519::BasePoint[X25519::Bytes] = {9};
+
+        namespace {
+            typedef int32_t Field[16];
+
+            const Field A24 = {0xdb41, 1}; // (486662 - 2) / 4
+
+            void carry(int64_t *limbs) {
+                for (uint8_t i = 0; i < 16; i++) {
+                    limbs[i] += (int64_t) 1 << 16;
+                    const int64_t c = limbs[i] >> 16;
+                    if (i < 15)
+                        limbs[i + 1] += c - 1;
+                    else
+                        limbs[0] += 38 * (c - 1);
+                    limbs[i] -= c << 16;
+                }
+            }
+
+            void add(Field out, const Field a, const Field b) {
+                for (uint8_t i = 0; i < 16; i++)
+                    out[i] = a[i] + b[i];
+            }
+
+            void subtract(Field out, const Field a, const Field b) {
+                for (uint8_t i = 0; i < 16; i++)
+                    out[i] = a[i] - b[i];
+            }
+
+            void multiply(Field out, const Field a, const Field b) {
+                int64_t columns[31];
+                for (uint8_t i = 0; i < 31; i++)
+                    columns[i] = 0;
+                for (uint8_t i = 0; i < 16; i++) {
+                    const int64_t ai = a[i];
+                    for (uint8_t j = 0; j < 16; j++)
+                        columns[i + j] += ai * b[j];
+                }
+                for (uint8_t i = 0; i < 15; i++)
+                    columns[i] += 38 * columns[i + 16];
+                carry(columns);
+                carry(columns);
+                for (uint8_t i = 0; i < 16; i++)
+                    out[i] = (int32_t) columns[i];
+            }
+
+            void square(Field out, const Field a) {
+                multiply(out, a, a);
+            }
+
+            // p and q swapped when bit is 1, by mask
+            void swap(Field p, Field q, uint32_t bit) {
+                const int32_t mask = (int32_t) (0 - bit);
+                for (uint8_t i = 0; i < 16; i++) {
+                    const int32_t t = mask & (p[i] ^ q[i]);
+                    p[i] ^= t;
+                    q[i] ^= t;
+                }
+            }
+
+            void unpack(Field out, const uint8_t *bytes) {
+                for (uint8_t i = 0; i < 16; i++)
+                    out[i] = bytes[2 * i] | ((int32_t) bytes[2 * i + 1] << 8);
+                out[15] &= 0x7fff; // the top bit of u is ignored
+            }
+
+            // fully reduced, little endian
+            void pack(uint8_t *out, const Field value) {
+                int64_t t[16], m[16];
+                for (uint8_t i = 0; i < 16; i++)
+                    t[i] = value[i];
+                carry(t);
+                carry(t);
+                carry(t);
+                // subtract p twice, keeping the difference each time it does not go negative
+                for (uint8_t pass = 0; pass < 2; pass++) {
+                    m[0] = t[0] - 0xffed;
+                    for (uint8_t i = 1; i < 15; i++) {
+                        m[i] = t[i] - 0xffff - ((m[i - 1] >> 16) & 1);
+                        m[i - 1] &= 0xffff;
+                    }
+                    m[15] = t[15] - 0x7fff - ((m[14] >> 16) & 1);
+                    m[14] &= 0xffff;
+                    const int64_t borrow = (m[15] >> 16) & 1;
+                    const int64_t keep = borrow - 1; // all ones: take m
+                    for (uint8_t i = 0; i < 16; i++)
+                        t[i] ^= keep & (t[i] ^ m[i]);
+                }
+                for (uint8_t i = 0; i < 16; i++) {
+                    out[2 * i] = (uint8_t) t[i];
+                    out[2 * i + 1] = (uint8_t) (t[i] >> 8);
+                }
+                wipe(t, sizeof(t));
+                wipe(m, sizeof(m));
+            }
+        }
+
+        X25519::X25519() {
+            this->clear();
+        }
+
+        X25519::~X25519() {
+            this->clear();
+        }
+
+        void X25519::begin(const uint8_t *scalar, const uint8_t *point) {
+            memcpy(this->_scalar, scalar, Bytes);
+            this->_scalar[0] &= 248;
+            this->_scalar[31] = (uint8_t) ((this->_scalar[31] & 127) | 64);
+            unpack(this->_x1, point);
+            // (x2 : z2) = 1, the point at infinity; (x3 : z3) = (u : 1)
+            for (uint8_t i = 0; i < 16; i++) {
+                this->_x2[i] = 0;
+                this->_z2[i] = 0;
+                this->_x3[i] = this->_x1[i];
+                this->_z3[i] = 0;
+            }
+            this->_x2[0] = 1;
+            this->_z3[0] = 1;
+            memset(this->_out, 0, sizeof(this->_out));
+            this->_stepsDone = 0;
+        }
+
+        void X25519::ladderStep() {
+            const uint16_t bit = (uint16_t) (LadderSteps - 1 - this->_stepsDone);
+            const uint32_t set = (this->_scalar[bit >> 3] >> (bit & 7)) & 1;
+            Field e, f;
+            swap(this->_x2, this->_x3, set);
+            swap(this->_z2, this->_z3, set);
+            add(e, this->_x2, this->_z2);
+            subtract(this->_x2, this->_x2, this->_z2);
+            add(this->_z2, this->_x3, this->_z3);
+            subtract(this->_x3, this->_x3, this->_z3);
+            square(this->_z3, e);
+            square(f, this->_x2);
+            multiply(this->_x2, this->_z2, this->_x2);
+            multiply(this->_z2, this->_x3, e);
+            add(e, this->_x2, this->_z2);
+            subtract(this->_x2, this->_x2, this->_z2);
+            square(this->_x3, this->_x2);
+            subtract(this->_z2, this->_z3, f);
+            multiply(this->_x2, this->_z2, A24);
+            add(this->_x2, this->_x2, this->_z3);
+            multiply(this->_z2, this->_z2, this->_x2);
+            multiply(this->_x2, this->_z3, f);
+            multiply(this->_z3, this->_x3, this->_x1);
+            square(this->_x3, e);
+            swap(this->_x2, this->_x3, set);
+            swap(this->_z2, this->_z3, set);
+            wipe(e, sizeof(e));
+            wipe(f, sizeof(f));
+        }
+
+        bool X25519::step(uint16_t steps) {
+            for (; steps && this->_stepsDone < TotalSteps; steps--) {
+                if (this->_stepsDone < LadderSteps) {
+                    this->ladderStep();
+                    if (this->_stepsDone == LadderSteps - 1) memcpy(this->_inverse, this->_z2, sizeof(Field));
+                } else if (this->_stepsDone < LadderSteps + InvertSteps) {
+                    // z2^(p - 2): the exponent's bits 253..0 are all set but bits 4 and 2
+                    const uint16_t bit = (uint16_t) (InvertSteps - 1 - (this->_stepsDone - LadderSteps));
+                    square(this->_inverse, this->_inverse);
+                    if (bit != 2 && bit != 4) multiply(this->_inverse, this->_inverse, this->_z2);
+                } else {
+                    multiply(this->_x2, this->_x2, this->_inverse);
+                    pack(this->_out, this->_x2);
+                }
+                this->_stepsDone++;
+            }
+            return this->done();
+        }
+
+        bool X25519::done() const {
+            return this->_stepsDone >= TotalSteps;
+        }
+
+        uint16_t X25519::stepsLeft() const {
+            return (uint16_t) (TotalSteps - this->_stepsDone);
+        }
+
+        bool X25519::result(uint8_t *out) const {
+            memcpy(out, this->_out, Bytes);
+            uint8_t any = 0;
+            for (uint8_t i = 0; i < Bytes; i++)
+                any |= this->_out[i];
+            return this->done() && any != 0;
+        }
+
+        void X25519::clear() {
+            wipe(this->_scalar, sizeof(this->_scalar));
+            wipe(this->_x1, sizeof(this->_x1));
+            wipe(this->_x2, sizeof(this->_x2));
+            wipe(this->_z2, sizeof(this->_z2));
+            wipe(this->_x3, sizeof(this->_x3));
+            wipe(this->_z3, sizeof(this->_z3));
+            wipe(this->_inverse, sizeof(this->_inverse));
+            wipe(this->_out, sizeof(this->_out));
+            this->_stepsDone = 0;
+        }
+
+        bool X25519::compute(uint8_t *out, const uint8_t *scalar, const uint8_t *point) {
+            X25519 job;
+            job.begin(scalar, point);
+            job.step(TotalSteps);
+            return job.result(out);
+        }
+    }
+}